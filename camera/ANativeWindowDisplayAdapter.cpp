@@ -19,6 +19,7 @@
 #include <ui/GraphicBuffer.h>
 #include <ui/GraphicBufferMapper.h>
 #include <hal_public.h>
+#include <cutils/properties.h>
 
 namespace Ti {
 namespace Camera {
@@ -30,6 +31,12 @@ const int ANativeWindowDisplayAdapter::DISPLAY_TIMEOUT = 1000;  // seconds
 //Suspends buffers after given amount of failed dq's
 const int ANativeWindowDisplayAdapter::FAILED_DQS_TO_SUSPEND = 3;
 
+//Paced frames are queued this much ahead of their target time
+const nsecs_t ANativeWindowDisplayAdapter::PACING_MARGIN = 1000000;
+
+//Frames ahead of the cadence by more refreshes than this restart it
+const int ANativeWindowDisplayAdapter::MAX_PACING_REFRESHES = 2;
+
 
 OMX_COLOR_FORMATTYPE toOMXPixFormat(const char* parameters_format)
 {
@@ -73,6 +80,8 @@ OMX_COLOR_FORMATTYPE toOMXPixFormat(const char* parameters_format)
  * Display Adapter class STARTS here..
  */
 ANativeWindowDisplayAdapter::ANativeWindowDisplayAdapter():mDisplayThread(NULL),
+                                        mDisplayQ(Utils::MessageQueue::DEFAULT_CAPACITY,
+                                                  Utils::MessageQueue::SINGLE_CONSUMER),
                                         mDisplayState(ANativeWindowDisplayAdapter::DISPLAY_INIT),
                                         mDisplayEnabled(false),
                                         mBufferCount(0),
@@ -114,6 +123,20 @@ ANativeWindowDisplayAdapter::ANativeWindowDisplayAdapter():mDisplayThread(NULL),
 
     mFD = -1;
 
+    mPacing = false;
+    mRefreshPeriod = 0;
+    mDequeueDepth = 0;
+    mMinUndequeued = 0;
+    mLastTarget = 0;
+    mLastTimestamp = 0;
+    mLastQueued = 0;
+    mLastQueuedTarget = 0;
+    mFramesQueued = 0;
+    mFramesDisplayed = 0;
+    mFramesDropped = 0;
+    mCadenceBreaks = 0;
+    mMaxIntervalError = 0;
+
     LOG_FUNCTION_NAME_EXIT;
 }
 
@@ -310,6 +333,50 @@ int ANativeWindowDisplayAdapter::enableDisplay(int width, int height, struct tim
 
 #endif
 
+    {
+        char value[PROPERTY_VALUE_MAX];
+        int refreshRate;
+
+        android::AutoMutex lock(mLock);
+
+        property_get("camera.display.pacing", value, "0");
+        mPacing = ( 0 != atoi(value) );
+
+        property_get("camera.display.refresh", value, "60");
+        refreshRate = atoi(value);
+        if ( 0 >= refreshRate ) {
+            refreshRate = 60;
+        }
+        mRefreshPeriod = seconds(1) / refreshRate;
+
+        property_get("camera.display.dequeue.depth", value, "1");
+        mDequeueDepth = atoi(value);
+
+        // The camera has to keep at least two buffers to fill
+        if ( ( NULL == mANativeWindow ) || ( NO_ERROR != minUndequeueableBuffers(mMinUndequeued) ) ) {
+            mMinUndequeued = 0;
+        }
+        if ( mDequeueDepth > mBufferCount - mMinUndequeued - 2 ) {
+            mDequeueDepth = mBufferCount - mMinUndequeued - 2;
+        }
+        if ( 0 > mDequeueDepth ) {
+            mDequeueDepth = 0;
+        }
+
+        mPacedFrames.clear();
+        mLastTarget = 0;
+        mLastTimestamp = 0;
+        mLastQueued = 0;
+        mLastQueuedTarget = 0;
+        mFramesQueued = 0;
+        mFramesDropped = 0;
+        mCadenceBreaks = 0;
+        mMaxIntervalError = 0;
+
+        CAMHAL_LOGDB("Display pacing %d, refresh %d Hz, dequeue depth %d",
+                     mPacing, refreshRate, mDequeueDepth);
+    }
+
     //Send START_DISPLAY COMMAND to display thread. Display thread will start and then wait for a message
     sem.Create();
     msg.command = DisplayThread::DISPLAY_START;
@@ -383,6 +450,15 @@ int ANativeWindowDisplayAdapter::disableDisplay(bool cancel_buffer)
         ///Reset the display enabled flag
         mDisplayEnabled = false;
 
+        if ( mPacing ) {
+            CAMHAL_LOGDB("Display pacing: %u queued, %u dropped, %u cadence breaks, max interval error %u us",
+                         mFramesQueued, mFramesDropped, mCadenceBreaks,
+                         ( unsigned int ) ns2us(mMaxIntervalError));
+        }
+
+        // Paced frames still waiting are returned with the other buffers
+        mPacedFrames.clear();
+
         // Reset pause flag since display is being disabled
         mPaused = false;
 
@@ -424,6 +500,14 @@ status_t ANativeWindowDisplayAdapter::pauseDisplay(bool pause)
     {
         android::AutoMutex lock(mLock);
         mPaused = pause;
+
+        // Nothing of the preview before the pause may reach the window after it
+        if ( pause && !mPacedFrames.isEmpty() ) {
+            dropPacedFrames();
+
+            Utils::Message msg;
+            mDisplayQ.put(&msg);
+        }
     }
 
     LOG_FUNCTION_NAME_EXIT;
@@ -869,7 +953,7 @@ bool ANativeWindowDisplayAdapter::supportsExternalBuffering()
 void ANativeWindowDisplayAdapter::displayThread()
 {
     bool shouldLive = true;
-    int timeout = 0;
+    int timeout = ANativeWindowDisplayAdapter::DISPLAY_TIMEOUT;
     status_t ret;
 
     LOG_FUNCTION_NAME;
@@ -879,7 +963,7 @@ void ANativeWindowDisplayAdapter::displayThread()
         ret = Utils::MessageQueue::waitForMsg(&mDisplayThread->msgQ()
                                                                 ,  &mDisplayQ
                                                                 , NULL
-                                                                , ANativeWindowDisplayAdapter::DISPLAY_TIMEOUT);
+                                                                , timeout);
 
         if ( !mDisplayThread->msgQ().isEmpty() )
             {
@@ -910,7 +994,12 @@ void ANativeWindowDisplayAdapter::displayThread()
                 // We dequeue and return the frame back to Camera adapter
                 if(mDisplayState == ANativeWindowDisplayAdapter::DISPLAY_STARTED)
                 {
-                    handleFrameReturn();
+                    if ( mPacing ) {
+                        timeout = postPacedFrames();
+                        dequeueAhead();
+                    } else {
+                        handleFrameReturn();
+                    }
                 }
 
                 if (mDisplayState == ANativeWindowDisplayAdapter::DISPLAY_EXITED)
@@ -921,6 +1010,12 @@ void ANativeWindowDisplayAdapter::displayThread()
                 }
             }
         }
+        else if ( mPacing && ( mDisplayState == ANativeWindowDisplayAdapter::DISPLAY_STARTED ) )
+            {
+            ///Woken up for the next paced frame
+            timeout = postPacedFrames();
+            dequeueAhead();
+            }
     }
 
     LOG_FUNCTION_NAME_EXIT;
@@ -1006,12 +1101,9 @@ status_t ANativeWindowDisplayAdapter::PostFrame(ANativeWindowDisplayAdapter::Dis
     status_t ret = NO_ERROR;
     uint32_t actualFramesWithDisplay = 0;
     android_native_buffer_t *buffer = NULL;
-    android::GraphicBufferMapper &mapper = android::GraphicBufferMapper::get();
     int i;
 
     ///@todo Do cropping based on the stabilized frame coordinates
-    ///@todo Insert logic to drop frames here based on refresh rate of
-    ///display or rendering rate whichever is lower
     ///Queue the buffer to overlay
 
     if ( NULL == mANativeWindow ) {
@@ -1046,6 +1138,8 @@ status_t ANativeWindowDisplayAdapter::PostFrame(ANativeWindowDisplayAdapter::Dis
 
 #endif
 
+    FrameTrace::stamp(FrameTrace::STAGE_DISPLAY, dispFrame.mBuffer, dispFrame.mType);
+
     android::AutoMutex lock(mLock);
 
     mFramesType.add( (int)mBuffers[i].opaque, dispFrame.mType);
@@ -1054,69 +1148,232 @@ status_t ANativeWindowDisplayAdapter::PostFrame(ANativeWindowDisplayAdapter::Dis
                 (!mPaused ||  CameraFrame::CameraFrame::SNAPSHOT_FRAME == dispFrame.mType) &&
                 !mSuspend)
     {
-        uint32_t xOff, yOff;
+        if ( CameraFrame::SNAPSHOT_FRAME == dispFrame.mType ) {
+            // Older preview frames must not cover the snapshot
+            dropPacedFrames();
+            ret = queueBuffer(i, dispFrame.mOffset);
+        } else if ( mPacing ) {
+            // Queued by the display thread once its time comes
+            PacedFrame paced;
+            paced.index = i;
+            paced.offset = dispFrame.mOffset;
+            paced.target = schedulePacedFrame(dispFrame.mTimestamp, systemTime());
+            mPacedFrames.add(paced);
+        } else {
+            ret = queueBuffer(i, dispFrame.mOffset);
+        }
 
-        CameraHal::getXYFromOffset(&xOff, &yOff, dispFrame.mOffset, PAGE_SIZE, mPixelFormat);
+        // HWComposer has not minimum buffer requirement. We should be able to dequeue
+        // the buffer immediately
+        Utils::Message msg;
+        mDisplayQ.put(&msg);
 
-        // Set crop only if current x and y offsets do not match with frame offsets
-        if ((mXOff != xOff) || (mYOff != yOff)) {
-            CAMHAL_LOGDB("offset = %u left = %d top = %d right = %d bottom = %d",
-                          dispFrame.mOffset, xOff, yOff ,
-                          xOff + mPreviewWidth, yOff + mPreviewHeight);
+    }
+    else
+    {
+        // cancel buffer and dequeue another one
+        cancelBuffer(i);
 
-            // We'll ignore any errors here, if the surface is
-            // already invalid, we'll know soon enough.
-            mANativeWindow->set_crop(mANativeWindow, xOff, yOff,
-                                     xOff + mPreviewWidth, yOff + mPreviewHeight);
+        Utils::Message msg;
+        mDisplayQ.put(&msg);
+        ret = NO_ERROR;
+    }
 
-            // Update the current x and y offsets
-            mXOff = xOff;
-            mYOff = yOff;
-        }
+    return ret;
+}
 
-        {
-            buffer_handle_t *handle = (buffer_handle_t *) mBuffers[i].opaque;
-            if (!mUseExternalBufferLocking) {
-                // unlock buffer before sending to display
-                mapper.unlock(*handle);
-            }
-            ret = mANativeWindow->enqueue_buffer(mANativeWindow, handle);
+status_t ANativeWindowDisplayAdapter::queueBuffer(int index, uint32_t offset)
+{
+    status_t ret = NO_ERROR;
+    android::GraphicBufferMapper &mapper = android::GraphicBufferMapper::get();
+    buffer_handle_t *handle = (buffer_handle_t *) mBuffers[index].opaque;
+    uint32_t xOff, yOff;
+
+    CameraHal::getXYFromOffset(&xOff, &yOff, offset, PAGE_SIZE, mPixelFormat);
+
+    // Set crop only if current x and y offsets do not match with frame offsets
+    if ((mXOff != xOff) || (mYOff != yOff)) {
+        CAMHAL_LOGDB("offset = %u left = %d top = %d right = %d bottom = %d",
+                      offset, xOff, yOff ,
+                      xOff + mPreviewWidth, yOff + mPreviewHeight);
+
+        // We'll ignore any errors here, if the surface is
+        // already invalid, we'll know soon enough.
+        mANativeWindow->set_crop(mANativeWindow, xOff, yOff,
+                                 xOff + mPreviewWidth, yOff + mPreviewHeight);
+
+        // Update the current x and y offsets
+        mXOff = xOff;
+        mYOff = yOff;
+    }
+
+    if (!mUseExternalBufferLocking) {
+        // unlock buffer before sending to display
+        mapper.unlock(*handle);
+    }
+    ret = mANativeWindow->enqueue_buffer(mANativeWindow, handle);
+    if ( NO_ERROR != ret ) {
+        CAMHAL_LOGE("Surface::queueBuffer returned error %d", ret);
+    } else {
+        mFramesDisplayed++;
+    }
+
+    mFramesWithCameraAdapterMap.removeItem(handle);
+
+    return ret;
+}
+
+status_t ANativeWindowDisplayAdapter::cancelBuffer(int index)
+{
+    status_t ret = NO_ERROR;
+    android::GraphicBufferMapper &mapper = android::GraphicBufferMapper::get();
+    buffer_handle_t *handle = (buffer_handle_t *) mBuffers[index].opaque;
+
+    if (!mUseExternalBufferLocking) {
+        // unlock buffer before giving it up
+        mapper.unlock(*handle);
+    }
+
+    ret = mANativeWindow->cancel_buffer(mANativeWindow, handle);
+    if ( NO_ERROR != ret ) {
+        CAMHAL_LOGE("Surface::cancelBuffer returned error %d", ret);
+    }
+
+    mFramesWithCameraAdapterMap.removeItem(handle);
+
+    return ret;
+}
+
+nsecs_t ANativeWindowDisplayAdapter::schedulePacedFrame(nsecs_t timestamp, nsecs_t arrival)
+{
+    nsecs_t target = arrival;
+
+    // Frames follow the previous one by the number of refreshes closest
+    // to their timestamp difference, a 30 fps sensor on a 60 Hz panel
+    // gets two refreshes per frame no matter when frames arrive
+    if ( ( 0 != mLastTarget ) && ( timestamp > mLastTimestamp ) ) {
+        nsecs_t refreshes = ( timestamp - mLastTimestamp + mRefreshPeriod / 2 ) / mRefreshPeriod;
+        if ( 1 > refreshes ) {
+            refreshes = 1;
         }
-        if ( NO_ERROR != ret ) {
-            CAMHAL_LOGE("Surface::queueBuffer returned error %d", ret);
+
+        target = mLastTarget + refreshes * mRefreshPeriod;
+
+        // Frames more than half a refresh late, or too far ahead of the
+        // cadence to keep latency low, start it over
+        if ( ( target + mRefreshPeriod / 2 < arrival ) ||
+             ( target > arrival + MAX_PACING_REFRESHES * mRefreshPeriod ) ) {
+            mCadenceBreaks++;
+            target = arrival;
         }
+    }
 
-        mFramesWithCameraAdapterMap.removeItem((buffer_handle_t *) dispFrame.mBuffer->opaque);
+    mLastTarget = target;
+    mLastTimestamp = timestamp;
 
+    return ( target > arrival ) ? target : arrival;
+}
 
-        // HWComposer has not minimum buffer requirement. We should be able to dequeue
-        // the buffer immediately
-        Utils::Message msg;
-        mDisplayQ.put(&msg);
+/**
+   @brief Gives every paced frame still waiting back to the window unshown
 
+   The cadence starts over with the next frame. Must be called with mLock held
+ */
+void ANativeWindowDisplayAdapter::dropPacedFrames()
+{
+    for ( size_t i = 0; i < mPacedFrames.size(); i++ ) {
+        cancelBuffer(mPacedFrames[i].index);
+        mFramesDropped++;
     }
-    else
-    {
-        buffer_handle_t *handle = (buffer_handle_t *) mBuffers[i].opaque;
-        if (!mUseExternalBufferLocking) {
-            // unlock buffer before giving it up
-            mapper.unlock(*handle);
+
+    mPacedFrames.clear();
+    mLastTarget = 0;
+}
+
+int ANativeWindowDisplayAdapter::postPacedFrames()
+{
+    android::AutoMutex lock(mLock);
+    const nsecs_t now = systemTime();
+
+    if ( mPaused ) {
+        dropPacedFrames();
+        return ANativeWindowDisplayAdapter::DISPLAY_TIMEOUT;
+    }
+
+    while ( !mPacedFrames.isEmpty() ) {
+        const PacedFrame frame = mPacedFrames[0];
+
+        if ( frame.target > now + PACING_MARGIN ) {
+            // milliseconds, rounded down so the margin is kept
+            return ( int ) ( ( frame.target - now - PACING_MARGIN ) / 1000000 ) + 1;
         }
 
-        // cancel buffer and dequeue another one
-        ret = mANativeWindow->cancel_buffer(mANativeWindow, handle);
-        if ( NO_ERROR != ret ) {
-            CAMHAL_LOGE("Surface::cancelBuffer returned error %d", ret);
+        mPacedFrames.removeAt(0);
+
+        // A newer frame is due as well, showing this one would only delay it
+        if ( !mPacedFrames.isEmpty() && ( mPacedFrames[0].target <= now + PACING_MARGIN ) ) {
+            cancelBuffer(frame.index);
+            mFramesDropped++;
+            continue;
         }
 
-        mFramesWithCameraAdapterMap.removeItem((buffer_handle_t *) dispFrame.mBuffer->opaque);
+        if ( 0 != mLastQueued ) {
+            nsecs_t error = ( now - mLastQueued ) - ( frame.target - mLastQueuedTarget );
+            if ( 0 > error ) {
+                error = -error;
+            }
+            if ( error > mMaxIntervalError ) {
+                mMaxIntervalError = error;
+            }
+        }
 
-        Utils::Message msg;
-        mDisplayQ.put(&msg);
-        ret = NO_ERROR;
+        queueBuffer(frame.index, frame.offset);
+        mLastQueued = now;
+        mLastQueuedTarget = frame.target;
+        mFramesQueued++;
     }
 
-    return ret;
+    return ANativeWindowDisplayAdapter::DISPLAY_TIMEOUT;
+}
+
+void ANativeWindowDisplayAdapter::dequeueAhead()
+{
+    for ( ;; ) {
+        {
+            android::AutoMutex lock(mLock);
+            const int withWindow = mBufferCount - mFramesWithCameraAdapterMap.size();
+
+            if ( withWindow <= mMinUndequeued + mDequeueDepth ) {
+                return;
+            }
+        }
+
+        if ( !handleFrameReturn() ) {
+            return;
+        }
+    }
+}
+
+void ANativeWindowDisplayAdapter::dump(int fd) const
+{
+    android::AutoMutex lock(mLock);
+    char buffer[256];
+
+    int len = snprintf(buffer, sizeof(buffer),
+            "ANativeWindowDisplayAdapter:\n"
+            "    displayed %u\n"
+            "ANativeWindowDisplayAdapter pacing:\n"
+            "    enabled %d, refresh %u us, dequeue depth %d\n"
+            "    queued %u, dropped %u, cadence breaks %u\n"
+            "    max interval error %u us\n",
+            mFramesDisplayed,
+            mPacing, ( unsigned int ) ns2us(mRefreshPeriod), mDequeueDepth,
+            mFramesQueued, mFramesDropped, mCadenceBreaks,
+            ( unsigned int ) ns2us(mMaxIntervalError));
+
+    if ( len > 0 ) {
+        write(fd, buffer, len);
+    }
 }
 
 
@@ -1249,6 +1506,7 @@ void ANativeWindowDisplayAdapter::frameCallback(CameraFrame* caFrame)
     df.mLength = caFrame->mLength;
     df.mWidth = caFrame->mWidth;
     df.mHeight = caFrame->mHeight;
+    df.mTimestamp = caFrame->mTimestamp;
     PostFrame(df);
 }
 
@@ -70,7 +70,6 @@ TI_CAMERAHAL_COMMON_INCLUDES := \
     $(LOCAL_PATH)/../include \
     $(LOCAL_PATH)/../hwc \
     external/jpeg \
-    external/jhead \
     $(LOCAL_PATH)/../libtiutils \
     $(LOCAL_PATH)/inc
 
@@ -90,12 +89,17 @@ TI_CAMERAHAL_COMMON_SRC := \
     ANativeWindowDisplayAdapter.cpp \
     BufferSourceAdapter.cpp \
     CameraProperties.cpp \
+    CapabilityIndex.cpp \
     BaseCameraAdapter.cpp \
     MemoryManager.cpp \
     Encoder_libjpeg.cpp \
+    ExifTemplate.cpp \
     Decoder_libjpeg.cpp \
     SensorListener.cpp  \
     NV12_resize.cpp \
+    FormatConverter.cpp \
+    BracketMerge.cpp \
+    FrameTrace.cpp \
     CameraParameters.cpp \
     TICameraParameters.cpp \
     CameraHalCommon.cpp \
@@ -123,6 +127,18 @@ TI_CAMERAHAL_USB_SRC := \
     V4LCameraAdapter/V4LCameraAdapter.cpp \
     V4LCameraAdapter/V4LCapabilities.cpp
 
+TI_CAMERAHAL_SYNTHETIC_SRC := \
+    SyntheticCameraAdapter/SyntheticCameraAdapter.cpp \
+    SyntheticCameraAdapter/SyntheticCapabilities.cpp
+
+ifdef TI_CAMERAHAL_SYNTHETIC_CAMERA
+    # Add a camera generating its own frames, for boards without sensors
+    # and for timing the HAL with test/CameraHal/camera_bench
+    CAMERAHAL_CFLAGS += -DSYNTHETIC_CAMERA_ADAPTER
+    TI_CAMERAHAL_COMMON_SRC += $(TI_CAMERAHAL_SYNTHETIC_SRC)
+    TI_CAMERAHAL_COMMON_INCLUDES += $(LOCAL_PATH)/inc/SyntheticCameraAdapter
+endif
+
 TI_CAMERAHAL_COMMON_SHARED_LIBRARIES := \
     libui \
     libbinder \
@@ -134,24 +150,6 @@ TI_CAMERAHAL_COMMON_SHARED_LIBRARIES := \
     libgui \
     libjpeg
 
-ifeq ($(shell test $(PLATFORM_SDK_VERSION) -ge 19 || echo 1),)
-# check for 5.0 and greater
-ifeq ($(shell test $(PLATFORM_SDK_VERSION) -ge 21 || echo 1),)
-TI_CAMERAHAL_COMMON_SHARED_LIBRARIES += \
-    libjhead
-# currently 4.4.3 and 4.4.4
-else ifneq ($(filter 4.4.3 4.4.4,$(PLATFORM_VERSION)),)
-TI_CAMERAHAL_COMMON_SHARED_LIBRARIES += \
-    libjhead
-else
-TI_CAMERAHAL_COMMON_SHARED_LIBRARIES += \
-    libexif
-endif
-else
-TI_CAMERAHAL_COMMON_SHARED_LIBRARIES += \
-    libexif
-endif
-
 ifdef ANDROID_API_JB_MR1_OR_LATER
 TI_CAMERAHAL_COMMON_SHARED_LIBRARIES += \
     libion_ti
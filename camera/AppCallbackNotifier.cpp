@@ -22,12 +22,19 @@
 #include <ui/GraphicBufferMapper.h>
 #include "NV12_resize.h"
 #include "TICameraParameters.h"
+#include <cutils/atomic.h>
+#include <cutils/properties.h>
 
 namespace Ti {
 namespace Camera {
 
 const int AppCallbackNotifier::NOTIFIER_TIMEOUT = -1;
 android::KeyedVector<void*, android::sp<Encoder_libjpeg> > gEncoderQueue;
+android::Mutex gEncoderQueueLock;
+
+// How long a capture frame waits for room in the encoder pool before it
+// is queued anyway
+#define ENCODER_RESERVE_TIMEOUT 1000000000LL // 1 second
 
 void AppCallbackNotifierEncoderCallback(void* main_jpeg,
                                         void* thumb_jpeg,
@@ -84,34 +91,39 @@ void AppCallbackNotifier::EncoderDoneCb(void* main_jpeg, void* thumb_jpeg, Camer
     src = main_param->src;
 
     if(encoded_mem && encoded_mem->data && (jpeg_size > 0)) {
-        if (cookie2) {
-            ExifElementsTable* exif = (ExifElementsTable*) cookie2;
-            Section_t* exif_section = NULL;
-
-            exif->insertExifToJpeg((unsigned char*) encoded_mem->data, jpeg_size);
+        if (cookie2 && mExifTemplate &&
+            (NO_ERROR == mExifTemplate->update(*(ExifElementsTable*) cookie2))) {
+            const uint8_t* jpeg = (const uint8_t*) encoded_mem->data;
+            const uint8_t* thumb = NULL;
+            size_t thumb_size = 0;
 
             if(thumb_jpeg) {
                 thumb_param = (Encoder_libjpeg::params *) thumb_jpeg;
-                exif->insertExifThumbnailImage((const char*)thumb_param->dst,
-                                               (int)thumb_param->jpeg_size);
+                thumb = thumb_param->dst;
+                thumb_size = thumb_param->jpeg_size;
             }
 
-            exif_section = FindSection(M_EXIF);
+            // APP1 goes right after SOI, the jpeg data is copied once behind it
+            size_t data_offset = ExifTemplate::jpegDataOffset(jpeg, jpeg_size);
+            size_t header_size = mExifTemplate->size(thumb_size);
 
-            if (exif_section) {
-                picture = mRequestMemory(-1, jpeg_size + exif_section->Size, 1, NULL);
-                if (picture && picture->data) {
-                    exif->saveJpeg((unsigned char*) picture->data, jpeg_size + exif_section->Size);
-                }
+            picture = mRequestMemory(-1, header_size + jpeg_size - data_offset, 1, NULL);
+            if (picture && picture->data) {
+                uint8_t* dst = (uint8_t*) picture->data;
+                mExifTemplate->write(dst, thumb, thumb_size);
+                memcpy(dst + header_size, jpeg + data_offset, jpeg_size - data_offset);
             }
-            delete exif;
-            cookie2 = NULL;
         } else {
             picture = mRequestMemory(-1, jpeg_size, 1, NULL);
             if (picture && picture->data) {
                 memcpy(picture->data, encoded_mem->data, jpeg_size);
             }
         }
+
+        if (cookie2) {
+            delete (ExifElementsTable*) cookie2;
+            cookie2 = NULL;
+        }
     }
     } // scope for mutex lock
 
@@ -153,11 +165,14 @@ void AppCallbackNotifier::EncoderDoneCb(void* main_jpeg, void* thumb_jpeg, Camer
         if (cookie2) {
             delete (ExifElementsTable*) cookie2;
         }
-        encoder = gEncoderQueue.valueFor(src);
-        if (encoder.get()) {
-            gEncoderQueue.removeItem(src);
-            encoder.clear();
+        {
+            android::AutoMutex lock(gEncoderQueueLock);
+            encoder = gEncoderQueue.valueFor(src);
+            if (encoder.get()) {
+                gEncoderQueue.removeItem(src);
+            }
         }
+        encoder.clear();
         mFrameProvider->returnFrame(camera_buffer, type);
     }
 
@@ -174,9 +189,21 @@ status_t AppCallbackNotifier::initialize()
     LOG_FUNCTION_NAME;
 
     mPreviewMemory = 0;
+    mEncoderPool = NULL;
+    mExifTemplate = NULL;
 
     mMeasurementEnabled = false;
 
+    char value[PROPERTY_VALUE_MAX];
+    property_get("camera.preview.cb.adaptive", value, "0");
+    mPreviewCallbackAdaptive = ( 0 != atoi(value) );
+    mLastPreviewCallbackTimestamp = 0;
+    mFramesQueueDropped = 0;
+    mPreviewCallbackLatency = 0;
+    mPreviewCallbackLatencyMax = 0;
+    mPreviewCallbacksSent = 0;
+    mPreviewCallbacksDropped = 0;
+
     mNotifierState = NOTIFIER_STOPPED;
 
     ///Create the app notifier thread
@@ -196,9 +223,27 @@ status_t AppCallbackNotifier::initialize()
         return ret;
         }
 
+    ///Start the encoder workers, encoders get their own threads if this fails
+    mEncoderPool = new EncoderPool(ENCODER_THREADS, MAX_ENCODERS);
+    if ( ( NULL != mEncoderPool ) && ( NO_ERROR != mEncoderPool->initialize() ) )
+        {
+        CAMHAL_LOGEA("Couldn't start encoder pool");
+        delete mEncoderPool;
+        mEncoderPool = NULL;
+        }
+
+    mExifTemplate = new ExifTemplate();
+
     mUseMetaDataBufferMode = true;
     mRawAvailable = false;
 
+    mVideoSlots = NULL;
+    mVideoSlotCount = 0;
+    mVideoMetadataMemory = NULL;
+#ifdef CAMERAHAL_DEBUG
+    mVideoSlotsWithApp = NULL;
+#endif
+
     mRecording = false;
     mPreviewing = false;
     mExternalLocking = false;
@@ -463,265 +508,6 @@ void AppCallbackNotifier::notifyEvent()
 
 }
 
-static void alignYV12(int width,
-                      int height,
-                      size_t &yStride,
-                      size_t &uvStride,
-                      size_t &ySize,
-                      size_t &uvSize,
-                      size_t &size)
-{
-    yStride = ( width + 0xF ) & ~0xF;
-    uvStride = ( yStride / 2 + 0xF ) & ~0xF;
-    ySize = yStride * height;
-    uvSize = uvStride * height / 2;
-    size = ySize + uvSize * 2;
-}
-
-static void copy2Dto1D(void *dst,
-                       void *src,
-                       int width,
-                       int height,
-                       size_t stride,
-                       uint32_t offset,
-                       unsigned int bytesPerPixel,
-                       size_t length,
-                       const char *pixelFormat)
-{
-    unsigned int alignedRow, row;
-    unsigned char *bufferDst, *bufferSrc;
-    unsigned char *bufferDstEnd, *bufferSrcEnd;
-    uint16_t *bufferSrc_UV;
-
-    unsigned int *y_uv = (unsigned int *)src;
-
-    CAMHAL_LOGVB("copy2Dto1D() y= %p ; uv=%p.",y_uv[0], y_uv[1]);
-    CAMHAL_LOGVB("pixelFormat = %s; offset=%d",pixelFormat,offset);
-
-    if (pixelFormat!=NULL) {
-        if (strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV422I) == 0) {
-            bytesPerPixel = 2;
-            bufferSrc = ( unsigned char * ) y_uv[0] + offset;
-            uint32_t xOff = offset % stride;
-            uint32_t yOff = offset / stride;
-            uint8_t *bufferSrcUV = ((uint8_t*)y_uv[1] + (stride/2)*yOff + xOff);
-            uint8_t *bufferSrcUVEven = bufferSrcUV;
-
-            uint8_t *bufferDstY = ( uint8_t * ) dst;
-            uint8_t *bufferDstU = bufferDstY + 1;
-            uint8_t *bufferDstV = bufferDstY + 3;
-
-            // going to convert from NV12 here and return
-            for ( int i = 0 ; i < height; i ++ ) {
-                for ( int j = 0 ; j < width / 2 ; j++ ) {
-
-                    // Y
-                    *bufferDstY = *bufferSrc;
-                    bufferSrc++;
-                    bufferDstY += 2;
-
-                    *bufferDstY = *bufferSrc;
-                    bufferSrc++;
-                    bufferDstY += 2;
-
-                    // V
-                    *bufferDstV = *(bufferSrcUV + 1);
-                    bufferDstV += 4;
-
-                    // U
-                    *bufferDstU = *bufferSrcUV;
-                    bufferDstU += 4;
-
-                    bufferSrcUV += 2;
-                }
-                if ( i % 2 ) {
-                    bufferSrcUV += ( stride - width);
-                    bufferSrcUVEven = bufferSrcUV;
-                } else {
-                    bufferSrcUV = bufferSrcUVEven;
-                }
-                bufferSrc += ( stride - width);
-            }
-
-            return;
-        } else if (strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV420SP) == 0 ||
-                   strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV420P) == 0) {
-            bytesPerPixel = 1;
-            bufferDst = ( unsigned char * ) dst;
-            bufferDstEnd = ( unsigned char * ) dst + width*height*bytesPerPixel;
-            bufferSrc = ( unsigned char * ) y_uv[0] + offset;
-            bufferSrcEnd = ( unsigned char * ) ( ( size_t ) y_uv[0] + length + offset);
-            row = width*bytesPerPixel;
-            alignedRow = stride-width;
-            int stride_bytes = stride / 8;
-            uint32_t xOff = offset % stride;
-            uint32_t yOff = offset / stride;
-
-            // going to convert from NV12 here and return
-            // Step 1: Y plane: iterate through each row and copy
-            for ( int i = 0 ; i < height ; i++) {
-                memcpy(bufferDst, bufferSrc, row);
-                bufferSrc += stride;
-                bufferDst += row;
-                if ( ( bufferSrc > bufferSrcEnd ) || ( bufferDst > bufferDstEnd ) ) {
-                    break;
-                }
-            }
-
-            bufferSrc_UV = ( uint16_t * ) ((uint8_t*)y_uv[1] + (stride/2)*yOff + xOff);
-
-            if (strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV420SP) == 0) {
-                 uint16_t *bufferDst_UV;
-
-                // Step 2: UV plane: convert NV12 to NV21 by swapping U & V
-                bufferDst_UV = (uint16_t *) (((uint8_t*)dst)+row*height);
-
-#ifdef ARCH_ARM_HAVE_NEON
-                for (int i = 0 ; i < height/2 ; i++, bufferSrc_UV += alignedRow/2) {
-                    int n = width;
-                    asm volatile (
-                    "   pld [%[src], %[src_stride], lsl #2]                         \n\t"
-                    "   cmp %[n], #32                                               \n\t"
-                    "   blt 1f                                                      \n\t"
-                    "0: @ 32 byte swap                                              \n\t"
-                    "   sub %[n], %[n], #32                                         \n\t"
-                    "   vld2.8  {q0, q1} , [%[src]]!                                \n\t"
-                    "   vswp q0, q1                                                 \n\t"
-                    "   cmp %[n], #32                                               \n\t"
-                    "   vst2.8  {q0,q1},[%[dst]]!                                   \n\t"
-                    "   bge 0b                                                      \n\t"
-                    "1: @ Is there enough data?                                     \n\t"
-                    "   cmp %[n], #16                                               \n\t"
-                    "   blt 3f                                                      \n\t"
-                    "2: @ 16 byte swap                                              \n\t"
-                    "   sub %[n], %[n], #16                                         \n\t"
-                    "   vld2.8  {d0, d1} , [%[src]]!                                \n\t"
-                    "   vswp d0, d1                                                 \n\t"
-                    "   cmp %[n], #16                                               \n\t"
-                    "   vst2.8  {d0,d1},[%[dst]]!                                   \n\t"
-                    "   bge 2b                                                      \n\t"
-                    "3: @ Is there enough data?                                     \n\t"
-                    "   cmp %[n], #8                                                \n\t"
-                    "   blt 5f                                                      \n\t"
-                    "4: @ 8 byte swap                                               \n\t"
-                    "   sub %[n], %[n], #8                                          \n\t"
-                    "   vld2.8  {d0, d1} , [%[src]]!                                \n\t"
-                    "   vswp d0, d1                                                 \n\t"
-                    "   cmp %[n], #8                                                \n\t"
-                    "   vst2.8  {d0[0],d1[0]},[%[dst]]!                             \n\t"
-                    "   bge 4b                                                      \n\t"
-                    "5: @ end                                                       \n\t"
-#ifdef NEEDS_ARM_ERRATA_754319_754320
-                    "   vmov s0,s0  @ add noop for errata item                      \n\t"
-#endif
-                    : [dst] "+r" (bufferDst_UV), [src] "+r" (bufferSrc_UV), [n] "+r" (n)
-                    : [src_stride] "r" (stride_bytes)
-                    : "cc", "memory", "q0", "q1"
-                    );
-                }
-#else
-                for ( int i = 0; i < height/2; ++i ) {
-                    for ( int j = 0; j < width/2; ++j ) {
-                        bufferDst_UV[j] = (bufferSrc_UV[j] >> 8) | (bufferSrc_UV[j] << 8);
-                    }
-                    bufferSrc_UV += stride/bytesPerPixel/2;
-                    bufferDst_UV += width/2;
-                }
-#endif
-            } else if (strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV420P) == 0) {
-                // Step 2: UV plane: convert NV12 to YV12 by de-interleaving U & V
-                // TODO(XXX): This version of CameraHal assumes NV12 format it set at
-                //            camera adapter to support YV12. Need to address for
-                //            USBCamera
-
-                size_t yStride, uvStride, ySize, uvSize, size;
-                alignYV12(width, height, yStride, uvStride, ySize, uvSize, size);
-
-                uint16_t *bufferDst_V = (uint16_t *) (((uint8_t*)dst) + ySize);
-                uint16_t *bufferDst_U = (uint16_t *) (((uint8_t*)dst) + ySize + uvSize);
-
-#ifdef ARCH_ARM_HAVE_NEON
-                int inc = (uvStride - width/2)/2;
-
-                for (int i = 0 ; i < height/2 ; i++, bufferSrc_UV += alignedRow/2) {
-                    int n = width;
-                    asm volatile (
-                    "   pld [%[src], %[src_stride], lsl #2]                         \n\t"
-                    "   cmp %[n], #32                                               \n\t"
-                    "   blt 1f                                                      \n\t"
-                    "0: @ 32 byte swap                                              \n\t"
-                    "   sub %[n], %[n], #32                                         \n\t"
-                    "   vld2.8  {q0, q1} , [%[src]]!                                \n\t"
-                    "   cmp %[n], #32                                               \n\t"
-                    "   vst1.8  {q1},[%[dst_v]]!                                    \n\t"
-                    "   vst1.8  {q0},[%[dst_u]]!                                    \n\t"
-                    "   bge 0b                                                      \n\t"
-                    "1: @ Is there enough data?                                     \n\t"
-                    "   cmp %[n], #16                                               \n\t"
-                    "   blt 3f                                                      \n\t"
-                    "2: @ 16 byte swap                                              \n\t"
-                    "   sub %[n], %[n], #16                                         \n\t"
-                    "   vld2.8  {d0, d1} , [%[src]]!                                \n\t"
-                    "   cmp %[n], #16                                               \n\t"
-                    "   vst1.8  {d1},[%[dst_v]]!                                    \n\t"
-                    "   vst1.8  {d0},[%[dst_u]]!                                    \n\t"
-                    "   bge 2b                                                      \n\t"
-                    "3: @ Is there enough data?                                     \n\t"
-                    "   cmp %[n], #8                                                \n\t"
-                    "   blt 5f                                                      \n\t"
-                    "4: @ 8 byte swap                                               \n\t"
-                    "   sub %[n], %[n], #8                                          \n\t"
-                    "   vld2.8  {d0, d1} , [%[src]]!                                \n\t"
-                    "   cmp %[n], #8                                                \n\t"
-                    "   vst1.8  {d1[0]},[%[dst_v]]!                                 \n\t"
-                    "   vst1.8  {d0[0]},[%[dst_u]]!                                 \n\t"
-                    "   bge 4b                                                      \n\t"
-                    "5: @ end                                                       \n\t"
-#ifdef NEEDS_ARM_ERRATA_754319_754320
-                    "   vmov s0,s0  @ add noop for errata item                      \n\t"
-#endif
-                    : [dst_u] "+r" (bufferDst_U), [dst_v] "+r" (bufferDst_V),
-                      [src] "+r" (bufferSrc_UV), [n] "+r" (n)
-                    : [src_stride] "r" (stride_bytes)
-                    : "cc", "memory", "q0", "q1"
-                    );
-
-                    bufferDst_U += inc;
-                    bufferDst_V += inc;
-                }
-#else
-                uint8_t * udst = reinterpret_cast<uint8_t*>(bufferDst_V);
-                uint8_t * vdst = reinterpret_cast<uint8_t*>(bufferDst_U);
-
-                for ( int i = 0; i < height/2; ++i ) {
-                    for ( int j = 0; j < width/2; ++j ) {
-                        udst[j] = bufferSrc_UV[j] >> 8;
-                        vdst[j] = bufferSrc_UV[j] & 0x00ff;
-                    }
-                    bufferSrc_UV += stride/bytesPerPixel/2;
-                    udst += width/2;
-                    vdst += width/2;
-                }
-#endif
-            }
-            return ;
-
-        } else if(strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_RGB565) == 0) {
-            bytesPerPixel = 2;
-        }
-    }
-
-    bufferDst = ( unsigned char * ) dst;
-    bufferSrc = ( unsigned char * ) y_uv[0];
-    row = width*bytesPerPixel;
-    alignedRow = ( row + ( stride -1 ) ) & ( ~ ( stride -1 ) );
-
-    //iterate through each row
-    for ( int i = 0 ; i < height ; i++,  bufferSrc += alignedRow, bufferDst += row) {
-        memcpy(bufferDst, bufferSrc, row);
-    }
-}
-
 static void copyCroppedNV12(CameraFrame* frame, unsigned char *dst)
 {
     unsigned int stride, width, height;
@@ -841,6 +627,288 @@ void AppCallbackNotifier::setExternalLocking(bool extBuffLocking)
     mExternalLocking = extBuffLocking;
 }
 
+camera_memory_t *AppCallbackNotifier::getVideoHandleMemory(CameraBuffer *buffer)
+{
+    camera_memory_t *memory = NULL;
+    ssize_t index;
+
+    index = mVideoHandleMemoryMap.indexOfKey(buffer->opaque);
+    if ( 0 <= index ) {
+        return mVideoHandleMemoryMap.valueAt(index);
+    }
+
+    memory = mRequestMemory(-1, sizeof(buffer_handle_t), 1, NULL);
+    if ( ( NULL == memory ) || ( NULL == memory->data ) ) {
+        CAMHAL_LOGEA("Couldn't allocate video buffer handle memory");
+        if ( NULL != memory ) {
+            memory->release(memory);
+        }
+        return NULL;
+    }
+
+    mVideoHandleMemoryMap.add(buffer->opaque, memory);
+
+    return memory;
+}
+
+static inline video_metadata_t *videoMetadataAt(camera_memory_t *memory, int slot)
+{
+    return ( (video_metadata_t *) memory->data ) + slot;
+}
+
+int AppCallbackNotifier::getVideoSlot(const CameraBuffer *buffer) const
+{
+    if ( ( NULL == mVideoSlots ) || ( NULL == buffer ) ) {
+        return -1;
+    }
+
+    const CameraBuffer *first = mVideoSlots[0].buffer;
+    if ( ( buffer < first ) || ( buffer >= ( first + mVideoSlotCount ) ) ) {
+        CAMHAL_LOGEB("Buffer %p isn't a recording buffer", buffer);
+        return -1;
+    }
+
+    const int slot = buffer - first;
+
+#ifdef CAMERAHAL_DEBUG
+    if ( buffer->opaque != mVideoSlots[slot].opaque ) {
+        CAMHAL_LOGEB("Stale recording buffer in slot %d, handle %p registered as %p",
+                     slot, buffer->opaque, mVideoSlots[slot].opaque);
+        return -1;
+    }
+#endif
+
+    return slot;
+}
+
+int AppCallbackNotifier::getVideoMetadataSlot(const void *metadata) const
+{
+    if ( ( NULL == mVideoMetadataMemory ) || ( NULL == metadata ) ) {
+        return -1;
+    }
+
+    const uint8_t *base = (const uint8_t *) mVideoMetadataMemory->data;
+    const size_t offset = (const uint8_t *) metadata - base;
+
+    // a pointer below the base wraps around and fails the range check too
+    if ( ( offset >= ( mVideoSlotCount * sizeof(video_metadata_t) ) ) ||
+         ( 0 != ( offset % sizeof(video_metadata_t) ) ) ) {
+        CAMHAL_LOGEB("Video metadata %p wasn't sent by the camera", metadata);
+        return -1;
+    }
+
+    const int slot = offset / sizeof(video_metadata_t);
+
+#ifdef CAMERAHAL_DEBUG
+    if ( 0 >= android_atomic_dec(&mVideoSlotsWithApp[slot]) ) {
+        android_atomic_inc(&mVideoSlotsWithApp[slot]);
+        CAMHAL_LOGEB("Video metadata slot %d released but not held by the application", slot);
+        return -1;
+    }
+#endif
+
+    return slot;
+}
+
+void AppCallbackNotifier::sendVideoMetadata(CameraFrame *frame, int slot)
+{
+#ifdef CAMERAHAL_DEBUG
+    android_atomic_inc(&mVideoSlotsWithApp[slot]);
+#endif
+
+    FrameTrace::stamp(FrameTrace::STAGE_APP_CALLBACK, frame->mBuffer, frame->mFrameType);
+    mDataCbTimestamp(frame->mTimestamp, CAMERA_MSG_VIDEO_FRAME,
+                     mVideoMetadataMemory, slot, mCallbackCookie);
+}
+
+void AppCallbackNotifier::scaleAndSendVideoFrame(VideoScaleJob &job, int threads)
+{
+    CameraFrame *frame = &job.frame;
+    CameraBuffer *vBuf = job.videoBuffer;
+    video_metadata_t *videoMetadataBuffer = videoMetadataAt(mVideoMetadataMemory, job.slot);
+    android::GraphicBufferMapper &mapper = android::GraphicBufferMapper::get();
+    android::Rect bounds;
+    structResizeConfig config;
+    nsecs_t start, elapsed;
+
+    start = systemTime();
+
+    bounds.left = 0;
+    bounds.top = 0;
+    bounds.right = mVideoWidth;
+    bounds.bottom = mVideoHeight;
+    if (mExternalLocking) {
+        lockBufferAndUpdatePtrs(frame);
+    }
+    void *y_uv[2];
+    mapper.lock((buffer_handle_t)vBuf, CAMHAL_GRALLOC_USAGE, bounds, y_uv);
+    y_uv[1] = y_uv[0] + mVideoHeight*4096;
+
+    structConvImage input =  {frame->mWidth,
+                              frame->mHeight,
+                              4096,
+                              IC_FORMAT_YCbCr420_lp,
+                              (mmByte *)frame->mYuv[0],
+                              (mmByte *)frame->mYuv[1],
+                              frame->mOffset};
+
+    structConvImage output = {mVideoWidth,
+                              mVideoHeight,
+                              4096,
+                              IC_FORMAT_YCbCr420_lp,
+                              (mmByte *)y_uv[0],
+                              (mmByte *)y_uv[1],
+                              0};
+
+    VT_resizeFrame_getConfig(&config);
+    if ( threads > config.uNumThreads ) {
+        config.uNumThreads = threads;
+    }
+
+    VT_resizeFrame_Video_lp_ex(&input, &output, NULL, &config);
+    mapper.unlock((buffer_handle_t)vBuf->opaque);
+    if (mExternalLocking) {
+        unlockBufferAndUpdatePtrs(frame);
+    }
+    videoMetadataBuffer->metadataBufferType = (int) android::kMetadataBufferTypeCameraSource;
+    /* FIXME remove cast */
+    videoMetadataBuffer->handle = (void *)vBuf->opaque;
+    videoMetadataBuffer->offset = 0;
+
+    elapsed = systemTime() - start;
+    {
+        android::AutoMutex lock(mVideoScalerLock);
+        mVideoScaleTime = ( mVideoScaleTime * 7 + elapsed ) / 8;
+        if ( elapsed > mVideoScaleTimeMax ) {
+            mVideoScaleTimeMax = elapsed;
+        }
+        mVideoFramesScaled++;
+    }
+
+    CAMHAL_LOGVB("mDataCbTimestamp : frame->mBuffer=0x%x, videoMetadataBuffer=0x%x, slot=%d",
+                    frame->mBuffer->opaque, videoMetadataBuffer, job.slot);
+
+    sendVideoMetadata(frame, job.slot);
+}
+
+void AppCallbackNotifier::queueVideoScale(const VideoScaleJob &job)
+{
+    bool dropped = false;
+
+    {
+        android::AutoMutex lock(mVideoScalerLock);
+
+        if ( VIDEO_SCALER_DEPTH <= mVideoScaleJobCount ) {
+            // A whole frame behind already, waiting would stall every other
+            // callback so the frame is dropped and the resize gets more threads
+            mVideoFramesDropped++;
+            if ( IC_RESIZE_MAX_THREADS > mVideoScalerThreads ) {
+                mVideoScalerThreads++;
+                CAMHAL_LOGDB("Video scaler falling behind, resizing on %d threads", mVideoScalerThreads);
+            } else {
+                CAMHAL_LOGDB("Video scaler falling behind, %u frames dropped", mVideoFramesDropped);
+            }
+            dropped = true;
+        } else {
+            mVideoScaleJobs[( mVideoScaleJobHead + mVideoScaleJobCount ) % VIDEO_SCALER_DEPTH] = job;
+            mVideoScaleJobCount++;
+            mVideoScalerCondition.signal();
+        }
+    }
+
+    if ( dropped ) {
+        mFrameProvider->returnFrame(job.frame.mBuffer, CameraFrame::VIDEO_FRAME_SYNC);
+    }
+}
+
+bool AppCallbackNotifier::videoScalerThread()
+{
+    VideoScaleJob job;
+    int threads;
+
+    {
+        android::AutoMutex lock(mVideoScalerLock);
+
+        while ( !mVideoScalerExiting && ( 0 == mVideoScaleJobCount ) ) {
+            mVideoScalerCondition.wait(mVideoScalerLock);
+        }
+
+        if ( mVideoScalerExiting ) {
+            return false;
+        }
+
+        // The job keeps its slot until it has been sent, so only one
+        // more frame can queue up behind it
+        job = mVideoScaleJobs[mVideoScaleJobHead];
+        threads = mVideoScalerThreads;
+    }
+
+    scaleAndSendVideoFrame(job, threads);
+
+    {
+        android::AutoMutex lock(mVideoScalerLock);
+        mVideoScaleJobHead = ( mVideoScaleJobHead + 1 ) % VIDEO_SCALER_DEPTH;
+        mVideoScaleJobCount--;
+    }
+
+    return true;
+}
+
+void AppCallbackNotifier::startVideoScaler()
+{
+    structResizeConfig config;
+
+    if ( !mUseMetaDataBufferMode || !mUseVideoBuffers || ( NULL != mVideoScalerThread.get() ) ) {
+        return;
+    }
+
+    VT_resizeFrame_getConfig(&config);
+
+    {
+        android::AutoMutex lock(mVideoScalerLock);
+        mVideoScaleJobHead = 0;
+        mVideoScaleJobCount = 0;
+        mVideoScalerExiting = false;
+        mVideoScalerThreads = config.uNumThreads;
+        mVideoScaleTime = 0;
+        mVideoScaleTimeMax = 0;
+        mVideoFramesScaled = 0;
+        mVideoFramesDropped = 0;
+    }
+
+    // Frames are resized on the notification thread if this fails
+    mVideoScalerThread = new VideoScalerThread(this);
+    if ( NO_ERROR != mVideoScalerThread->run("VideoScalerThread", android::PRIORITY_URGENT_DISPLAY) ) {
+        CAMHAL_LOGEA("Couldn't run VideoScalerThread");
+        mVideoScalerThread.clear();
+    }
+}
+
+void AppCallbackNotifier::stopVideoScaler()
+{
+    if ( NULL == mVideoScalerThread.get() ) {
+        return;
+    }
+
+    {
+        android::AutoMutex lock(mVideoScalerLock);
+        mVideoScalerExiting = true;
+        mVideoScalerCondition.signal();
+    }
+
+    mVideoScalerThread->requestExitAndWait();
+    mVideoScalerThread.clear();
+
+    // Frames which didn't get their turn go back to the camera
+    android::AutoMutex lock(mVideoScalerLock);
+    while ( 0 < mVideoScaleJobCount ) {
+        mFrameProvider->returnFrame(mVideoScaleJobs[mVideoScaleJobHead].frame.mBuffer,
+                                    CameraFrame::VIDEO_FRAME_SYNC);
+        mVideoScaleJobHead = ( mVideoScaleJobHead + 1 ) % VIDEO_SCALER_DEPTH;
+        mVideoScaleJobCount--;
+    }
+}
+
 void AppCallbackNotifier::copyAndSendPreviewFrame(CameraFrame* frame, int32_t msgType)
 {
     camera_memory_t* picture = NULL;
@@ -859,11 +927,25 @@ void AppCallbackNotifier::copyAndSendPreviewFrame(CameraFrame* frame, int32_t ms
             goto exit;
         }
 
+        if ( ( CAMERA_MSG_PREVIEW_FRAME == msgType ) &&
+             ( CameraFrame::PREVIEW_FRAME_SYNC == frame->mFrameType ) ) {
+            // Frames captured within one callback latency of the last frame
+            // sent arrived while the framework was still taking the previous
+            // one. They are dropped before the copy, so callbacks follow the
+            // rate the framework copies and dispatches them at.
+            if ( mPreviewCallbackAdaptive && ( 0 < mPreviewCallbackLatency ) &&
+                 ( 0 < mLastPreviewCallbackTimestamp ) &&
+                 ( ( frame->mTimestamp - mLastPreviewCallbackTimestamp ) < mPreviewCallbackLatency ) ) {
+                mPreviewCallbacksDropped++;
+                goto exit;
+            }
+        }
+
         dest = &mPreviewBuffers[mPreviewBufCount];
         if (mExternalLocking) {
             lockBufferAndUpdatePtrs(frame);
         }
-        CAMHAL_LOGVB("%d:copy2Dto1D(%p, %p, %d, %d, %d, %d, %d,%s)",
+        CAMHAL_LOGVB("%d:convertFromNV12(%p, %p, %d, %d, %d, %d, %d,%s)",
                      __LINE__,
                       dest,
                       frame->mBuffer,
@@ -889,29 +971,49 @@ void AppCallbackNotifier::copyAndSendPreviewFrame(CameraFrame* frame, int32_t ms
                 goto exit;
               }
               else{
-                copy2Dto1D(dest->mapped,
-                           frame->mYuv,
-                           mPreviewWidth,
-                           mPreviewHeight,
-                           mPreviewStride,
-                           frame->mOffset,
-                           2,
-                           frame->mLength,
-                           mPreviewPixelFormat);
+                FormatConverter::convertFromNV12(mPreviewFormat,
+                                                 static_cast<uint8_t *>(dest->mapped),
+                                                 reinterpret_cast<uint8_t *>(frame->mYuv[0]),
+                                                 reinterpret_cast<uint8_t *>(frame->mYuv[1]),
+                                                 mPreviewWidth,
+                                                 mPreviewHeight,
+                                                 mPreviewStride,
+                                                 frame->mOffset,
+                                                 frame->mLength);
               }
             }
         }
     }
 
  exit:
+    // Copied frames are stamped once the copy is done, they go back
+    // before the callback runs
+    if ( NULL != dest ) {
+        FrameTrace::stamp(FrameTrace::STAGE_APP_CALLBACK, frame->mBuffer, frame->mFrameType);
+    }
+
     mFrameProvider->returnFrame(frame->mBuffer, (CameraFrame::FrameType) frame->mFrameType);
 
     if((mNotifierState == AppCallbackNotifier::NOTIFIER_STARTED) &&
        mCameraHal->msgTypeEnabled(msgType) &&
        (dest != NULL) && (dest->mapped != NULL)) {
         android::AutoMutex locker(mLock);
-        if ( mPreviewMemory )
+        nsecs_t start = systemTime();
+
+        if ( mPreviewMemory ) {
             mDataCb(msgType, mPreviewMemory, mPreviewBufCount, NULL, mCallbackCookie);
+        }
+
+        if ( CAMERA_MSG_PREVIEW_FRAME == msgType ) {
+            nsecs_t latency = systemTime() - start;
+
+            mPreviewCallbackLatency = ( mPreviewCallbackLatency * 7 + latency ) / 8;
+            if ( latency > mPreviewCallbackLatencyMax ) {
+                mPreviewCallbackLatencyMax = latency;
+            }
+            mPreviewCallbacksSent++;
+            mLastPreviewCallbackTimestamp = frame->mTimestamp;
+        }
     }
 
     if (mExternalLocking) {
@@ -1057,7 +1159,10 @@ void AppCallbackNotifier::notifyFrame()
 
                     // Video snapshot with LDCNSF on adds a few bytes start offset
                     // and a few bytes on every line. They must be skipped.
-                    int rightCrop = frame->mAlignment/2 - frame->mWidth;
+                    // NV12 strides are in pixels already, YUV422I ones in bytes.
+                    const bool nv12 = CameraFrame::FORMAT_YUV420SP_NV12 & frame->mQuirks;
+                    const int inWidth = nv12 ? frame->mAlignment : frame->mAlignment/2;
+                    int rightCrop = inWidth - frame->mWidth;
 
                     CAMHAL_LOGDB("Video snapshot right crop = %d", rightCrop);
                     CAMHAL_LOGDB("Video snapshot offset = %d", frame->mOffset);
@@ -1068,13 +1173,16 @@ void AppCallbackNotifier::notifyFrame()
                         main_jpeg->dst = (uint8_t*) buf;
                         main_jpeg->dst_size = frame->mLength;
                         main_jpeg->quality = encode_quality;
-                        main_jpeg->in_width = frame->mAlignment/2; // use stride here
+                        main_jpeg->in_width = inWidth; // use stride here
                         main_jpeg->in_height = frame->mHeight;
-                        main_jpeg->out_width = frame->mAlignment/2;
+                        main_jpeg->out_width = inWidth;
                         main_jpeg->out_height = frame->mHeight;
                         main_jpeg->right_crop = rightCrop;
                         main_jpeg->start_offset = frame->mOffset;
-                        if ( CameraFrame::FORMAT_YUV422I_UYVY & frame->mQuirks) {
+                        if ( nv12 ) {
+                            main_jpeg->format = TICameraParameters::PIXEL_FORMAT_YUV420SP_NV12;
+                        }
+                        else if ( CameraFrame::FORMAT_YUV422I_UYVY & frame->mQuirks) {
                             main_jpeg->format = TICameraParameters::PIXEL_FORMAT_YUV422I_UYVY;
                         }
                         else { //if ( CameraFrame::FORMAT_YUV422I_YUYV & frame->mQuirks)
@@ -1115,6 +1223,16 @@ void AppCallbackNotifier::notifyFrame()
                         tn_jpeg->format = android::CameraParameters::PIXEL_FORMAT_YUV420SP;;
                     }
 
+                    // Wait here for room in the encoder pool, which throttles
+                    // captures when encoding can't keep up. This only holds back
+                    // the notifier thread, and if the pool is still full the
+                    // encoder gets a thread of its own.
+                    const bool reserved = ( NULL != mEncoderPool ) &&
+                                          mEncoderPool->reserve(ENCODER_RESERVE_TIMEOUT);
+                    if ( ( NULL != mEncoderPool ) && !reserved ) {
+                        CAMHAL_LOGDA("Encoder pool still full, encoding on a separate thread");
+                    }
+
                     android::sp<Encoder_libjpeg> encoder = new Encoder_libjpeg(main_jpeg,
                                                       tn_jpeg,
                                                       AppCallbackNotifierEncoderCallback,
@@ -1122,8 +1240,13 @@ void AppCallbackNotifier::notifyFrame()
                                                       this,
                                                       raw_picture,
                                                       exif_data, frame->mBuffer);
-                    gEncoderQueue.add(frame->mBuffer->mapped, encoder);
-                    encoder->run();
+                    {
+                        android::AutoMutex lock(gEncoderQueueLock);
+                        gEncoderQueue.add(frame->mBuffer->mapped, encoder);
+                    }
+                    if ( !reserved || ( NO_ERROR != mEncoderPool->submit(encoder) ) ) {
+                        encoder->run();
+                    }
                     encoder.clear();
                     if (params != NULL)
                       {
@@ -1173,75 +1296,48 @@ void AppCallbackNotifier::notifyFrame()
                         {
                         if(mUseMetaDataBufferMode)
                             {
-                            camera_memory_t *videoMedatadaBufferMemory =
-                                             mVideoMetadataBufferMemoryMap.valueFor(frame->mBuffer->opaque);
-                            video_metadata_t *videoMetadataBuffer = (video_metadata_t *) videoMedatadaBufferMemory->data;
+                            const int slot = getVideoSlot(frame->mBuffer);
 
-                            if( (NULL == videoMedatadaBufferMemory) || (NULL == videoMetadataBuffer) || (NULL == frame->mBuffer) )
+                            if ( 0 > slot )
                                 {
-                                CAMHAL_LOGEA("Error! One of the video buffers is NULL");
+                                CAMHAL_LOGEA("Error! Video frame without a recording buffer slot");
                                 break;
                                 }
 
+                            video_metadata_t *videoMetadataBuffer = videoMetadataAt(mVideoMetadataMemory, slot);
+
                             if ( mUseVideoBuffers )
                               {
-                                CameraBuffer *vBuf = mVideoMap.valueFor(frame->mBuffer->opaque);
-                                android::GraphicBufferMapper &mapper = android::GraphicBufferMapper::get();
-                                android::Rect bounds;
-                                bounds.left = 0;
-                                bounds.top = 0;
-                                bounds.right = mVideoWidth;
-                                bounds.bottom = mVideoHeight;
-                                if (mExternalLocking) {
-                                    lockBufferAndUpdatePtrs(frame);
-                                }
-                                void *y_uv[2];
-                                mapper.lock((buffer_handle_t)vBuf, CAMHAL_GRALLOC_USAGE, bounds, y_uv);
-                                y_uv[1] = y_uv[0] + mVideoHeight*4096;
-
-                                structConvImage input =  {frame->mWidth,
-                                                          frame->mHeight,
-                                                          4096,
-                                                          IC_FORMAT_YCbCr420_lp,
-                                                          (mmByte *)frame->mYuv[0],
-                                                          (mmByte *)frame->mYuv[1],
-                                                          frame->mOffset};
-
-                                structConvImage output = {mVideoWidth,
-                                                          mVideoHeight,
-                                                          4096,
-                                                          IC_FORMAT_YCbCr420_lp,
-                                                          (mmByte *)y_uv[0],
-                                                          (mmByte *)y_uv[1],
-                                                          0};
-
-                                VT_resizeFrame_Video_opt2_lp(&input, &output, NULL, 0);
-                                mapper.unlock((buffer_handle_t)vBuf->opaque);
-                                if (mExternalLocking) {
-                                    unlockBufferAndUpdatePtrs(frame);
-                                }
-                                videoMetadataBuffer->metadataBufferType = (int) android::kMetadataBufferTypeCameraSource;
-                                /* FIXME remove cast */
-                                videoMetadataBuffer->handle = (void *)vBuf->opaque;
-                                videoMetadataBuffer->offset = 0;
+                                VideoScaleJob job;
+                                job.frame = *frame;
+                                job.videoBuffer = mVideoSlots[slot].videoBuffer;
+                                job.slot = slot;
+
+                                if ( NULL != mVideoScalerThread.get() )
+                                  {
+                                    queueVideoScale(job);
+                                  }
+                                else
+                                  {
+                                    scaleAndSendVideoFrame(job, 0);
+                                  }
                               }
                             else
                               {
                                 videoMetadataBuffer->metadataBufferType = (int) android::kMetadataBufferTypeCameraSource;
                                 videoMetadataBuffer->handle = camera_buffer_get_omx_ptr(frame->mBuffer);
                                 videoMetadataBuffer->offset = frame->mOffset;
-                              }
 
-                            CAMHAL_LOGVB("mDataCbTimestamp : frame->mBuffer=0x%x, videoMetadataBuffer=0x%x, videoMedatadaBufferMemory=0x%x",
-                                            frame->mBuffer->opaque, videoMetadataBuffer, videoMedatadaBufferMemory);
+                                CAMHAL_LOGVB("mDataCbTimestamp : frame->mBuffer=0x%x, videoMetadataBuffer=0x%x, slot=%d",
+                                                frame->mBuffer->opaque, videoMetadataBuffer, slot);
 
-                            mDataCbTimestamp(frame->mTimestamp, CAMERA_MSG_VIDEO_FRAME,
-                                                videoMedatadaBufferMemory, 0, mCallbackCookie);
+                                sendVideoMetadata(frame, slot);
+                              }
                             }
                         else
                             {
                             //TODO: Need to revisit this, should ideally be mapping the TILER buffer using mRequestMemory
-                            camera_memory_t* fakebuf = mRequestMemory(-1, sizeof(buffer_handle_t), 1, NULL);
+                            camera_memory_t* fakebuf = ( NULL != frame->mBuffer ) ? getVideoHandleMemory(frame->mBuffer) : NULL;
                             if( (NULL == fakebuf) || ( NULL == fakebuf->data) || ( NULL == frame->mBuffer))
                                 {
                                 CAMHAL_LOGEA("Error! One of the video buffers is NULL");
@@ -1251,8 +1347,8 @@ void AppCallbackNotifier::notifyFrame()
                                 lockBufferAndUpdatePtrs(frame);
                             }
                             *reinterpret_cast<buffer_handle_t*>(fakebuf->data) = reinterpret_cast<buffer_handle_t>(frame->mBuffer->mapped);
+                            FrameTrace::stamp(FrameTrace::STAGE_APP_CALLBACK, frame->mBuffer, frame->mFrameType);
                             mDataCbTimestamp(frame->mTimestamp, CAMERA_MSG_VIDEO_FRAME, fakebuf, 0, mCallbackCookie);
-                            fakebuf->release(fakebuf);
                             if (mExternalLocking) {
                                 unlockBufferAndUpdatePtrs(frame);
                             }
@@ -1334,9 +1430,26 @@ void AppCallbackNotifier::frameCallback(CameraFrame* caFrame)
         frame = new CameraFrame(*caFrame);
         if ( NULL != frame )
             {
+              const bool droppable = ( CameraFrame::PREVIEW_FRAME_SYNC == frame->mFrameType ) ||
+                                     ( CameraFrame::FRAME_DATA_SYNC == frame->mFrameType );
               msg.command = AppCallbackNotifier::NOTIFIER_CMD_PROCESS_FRAME;
               msg.arg1 = frame;
-              mFrameQ.put(&msg);
+
+              // Streaming frames are dropped rather than stalling the
+              // adapter thread behind a full queue
+              if ( !droppable )
+                {
+                mFrameQ.put(&msg);
+                }
+              else if ( NO_ERROR != mFrameQ.tryPut(&msg) )
+                {
+                const int32_t dropped = android_atomic_inc(&mFramesQueueDropped) + 1;
+                CAMHAL_LOGEB("Frame queue full, frame type 0x%x dropped (%d so far)",
+                             frame->mFrameType, dropped);
+                mFrameProvider->returnFrame(frame->mBuffer,
+                                            (CameraFrame::FrameType) frame->mFrameType);
+                delete frame;
+                }
             }
         else
             {
@@ -1462,6 +1575,18 @@ AppCallbackNotifier::~AppCallbackNotifier()
     ///Stop app callback notifier if not already stopped
     stop();
 
+    ///Waits for the encoders still running
+    if ( NULL != mEncoderPool )
+        {
+        delete mEncoderPool;
+        mEncoderPool = NULL;
+        }
+
+    delete mExifTemplate;
+    mExifTemplate = NULL;
+
+    stopVideoScaler();
+
     ///Unregister with the frame provider
     if ( NULL != mFrameProvider )
         {
@@ -1515,26 +1640,28 @@ void AppCallbackNotifier::releaseSharedVideoBuffers()
 {
     LOG_FUNCTION_NAME;
 
-    if(mUseMetaDataBufferMode)
-    {
-        camera_memory_t* videoMedatadaBufferMemory;
-        for (unsigned int i = 0; i < mVideoMetadataBufferMemoryMap.size();  i++)
-            {
-            videoMedatadaBufferMemory = mVideoMetadataBufferMemoryMap.valueAt(i);
-            if(NULL != videoMedatadaBufferMemory)
-                {
-                videoMedatadaBufferMemory->release(videoMedatadaBufferMemory);
-                CAMHAL_LOGDB("Released  videoMedatadaBufferMemory=%p", videoMedatadaBufferMemory);
-                }
-            }
+    if ( NULL != mVideoMetadataMemory )
+        {
+        mVideoMetadataMemory->release(mVideoMetadataMemory);
+        CAMHAL_LOGDB("Released video metadata memory %p", mVideoMetadataMemory);
+        mVideoMetadataMemory = NULL;
+        }
 
-        mVideoMetadataBufferMemoryMap.clear();
-        mVideoMetadataBufferReverseMap.clear();
-        if (mUseVideoBuffers)
-            {
-            mVideoMap.clear();
-            }
-    }
+    delete [] mVideoSlots;
+    mVideoSlots = NULL;
+    mVideoSlotCount = 0;
+
+#ifdef CAMERAHAL_DEBUG
+    delete [] mVideoSlotsWithApp;
+    mVideoSlotsWithApp = NULL;
+#endif
+
+    for (unsigned int i = 0; i < mVideoHandleMemoryMap.size(); i++)
+        {
+        camera_memory_t *videoHandleMemory = mVideoHandleMemoryMap.valueAt(i);
+        videoHandleMemory->release(videoHandleMemory);
+        }
+    mVideoHandleMemoryMap.clear();
 
     LOG_FUNCTION_NAME_EXIT;
 }
@@ -1611,6 +1738,7 @@ status_t AppCallbackNotifier::startPreviewCallbacks(android::CameraParameters &p
     mPreviewHeight = h;
     mPreviewStride = 4096;
     mPreviewPixelFormat = CameraHal::getPixelFormatConstant(params.getPreviewFormat());
+    mPreviewFormat = FormatConverter::fromPixelFormat(mPreviewPixelFormat);
     size = CameraHal::calculateBufferSize(mPreviewPixelFormat, w, h);
 
     mPreviewMemory = mRequestMemory(-1, size, AppCallbackNotifier::MAX_BUFFERS, NULL);
@@ -1634,6 +1762,12 @@ status_t AppCallbackNotifier::startPreviewCallbacks(android::CameraParameters &p
 
     mPreviewBufCount = 0;
 
+    mLastPreviewCallbackTimestamp = 0;
+    mPreviewCallbackLatency = 0;
+    mPreviewCallbackLatencyMax = 0;
+    mPreviewCallbacksSent = 0;
+    mPreviewCallbacksDropped = 0;
+
     mPreviewing = true;
 
     LOG_FUNCTION_NAME_EXIT;
@@ -1708,6 +1842,42 @@ status_t AppCallbackNotifier::stopPreviewCallbacks()
 
 }
 
+void AppCallbackNotifier::dump(int fd) const
+{
+    android::AutoMutex lock(mLock);
+    char buffer[256];
+
+    int len = snprintf(buffer, sizeof(buffer),
+            "AppCallbackNotifier preview callbacks:\n"
+            "    adaptive %d\n"
+            "    sent %u, dropped %u, dropped on full queue %d\n"
+            "    latency avg %u us, max %u us\n",
+            mPreviewCallbackAdaptive,
+            mPreviewCallbacksSent, mPreviewCallbacksDropped,
+            android_atomic_acquire_load(&mFramesQueueDropped),
+            ( unsigned int ) ns2us(mPreviewCallbackLatency),
+            ( unsigned int ) ns2us(mPreviewCallbackLatencyMax));
+
+    if ( len > 0 ) {
+        write(fd, buffer, len);
+    }
+
+    android::AutoMutex scalerLock(mVideoScalerLock);
+    len = snprintf(buffer, sizeof(buffer),
+            "AppCallbackNotifier video scaler:\n"
+            "    running %d, threads %d\n"
+            "    scaled %u, dropped %u\n"
+            "    time avg %u us, max %u us\n",
+            ( NULL != mVideoScalerThread.get() ), mVideoScalerThreads,
+            mVideoFramesScaled, mVideoFramesDropped,
+            ( unsigned int ) ns2us(mVideoScaleTime),
+            ( unsigned int ) ns2us(mVideoScaleTimeMax));
+
+    if ( len > 0 ) {
+        write(fd, buffer, len);
+    }
+}
+
 status_t AppCallbackNotifier::useMetaDataBufferMode(bool enable)
 {
     mUseMetaDataBufferMode = enable;
@@ -1742,6 +1912,8 @@ status_t AppCallbackNotifier::startRecording()
 
     mRecording = true;
 
+    startVideoScaler();
+
     LOG_FUNCTION_NAME_EXIT;
 
     return ret;
@@ -1755,36 +1927,53 @@ status_t AppCallbackNotifier::initSharedVideoBuffers(CameraBuffer *buffers, uint
 
     if(mUseMetaDataBufferMode)
         {
-        camera_memory_t* videoMedatadaBufferMemory = NULL;
-
-        if(NULL == buffers)
+        if( (NULL == buffers) || (0 == count) )
             {
             CAMHAL_LOGEA("Error! Video buffers are NULL");
             return BAD_VALUE;
             }
 
+        if ( NULL != mVideoSlots )
+            {
+            CAMHAL_LOGDA("Recording buffers still registered, releasing them");
+            releaseSharedVideoBuffers();
+            }
+
+        // one metadata buffer per slot, sent with the slot as the index
+        mVideoMetadataMemory = mRequestMemory(-1, sizeof(video_metadata_t), count, NULL);
+        mVideoSlots = new VideoSlot[count];
+#ifdef CAMERAHAL_DEBUG
+        mVideoSlotsWithApp = new int32_t[count];
+#endif
+        if( (NULL == mVideoMetadataMemory) || (NULL == mVideoMetadataMemory->data) || (NULL == mVideoSlots) )
+            {
+            CAMHAL_LOGEA("Error! Could not allocate memory for Video Metadata Buffers");
+            releaseSharedVideoBuffers();
+            return NO_MEMORY;
+            }
+
+        mVideoSlotCount = count;
+
         for (uint32_t i = 0; i < count; i++)
             {
-            videoMedatadaBufferMemory = mRequestMemory(-1, sizeof(video_metadata_t), 1, NULL);
-            if((NULL == videoMedatadaBufferMemory) || (NULL == videoMedatadaBufferMemory->data))
+            mVideoSlots[i].buffer = &buffers[i];
+            mVideoSlots[i].videoBuffer = ( NULL != vidBufs ) ? &vidBufs[i] : NULL;
+            mVideoSlots[i].opaque = buffers[i].opaque;
+#ifdef CAMERAHAL_DEBUG
+            mVideoSlotsWithApp[i] = 0;
+#endif
+            CAMHAL_LOGDB("buffers[%d]=%p, videoMetadata=%p",
+                    i, &buffers[i], videoMetadataAt(mVideoMetadataMemory, i));
+            }
+        }
+    else if (NULL != buffers)
+        {
+        for (uint32_t i = 0; i < count; i++)
+            {
+            if (NULL == getVideoHandleMemory(&buffers[i]))
                 {
-                CAMHAL_LOGEA("Error! Could not allocate memory for Video Metadata Buffers");
                 return NO_MEMORY;
                 }
-
-            // FIXME remove cast
-            mVideoMetadataBufferMemoryMap.add((void *)buffers[i].opaque, videoMedatadaBufferMemory);
-            mVideoMetadataBufferReverseMap.add(videoMedatadaBufferMemory->data, &buffers[i]);
-            CAMHAL_LOGDB("buffers[%d]=%p, videoMedatadaBufferMemory=%p, videoMedatadaBufferMemory->data=%p",
-                    i, &buffers[i], videoMedatadaBufferMemory, videoMedatadaBufferMemory->data);
-
-            if (vidBufs != NULL)
-              {
-                //ASSERT(buffers[i].type == CAMERA_BUFFER_GRALLOC);
-                // FIXME remove cast
-                mVideoMap.add((void *)buffers[i].opaque, &vidBufs[i]);
-                CAMHAL_LOGVB("buffers[%d]=%p, vBuffArr[%d]=%p", i, &buffers[i], i, &vidBufs[i]);
-              }
             }
         }
 
@@ -1818,6 +2007,8 @@ status_t AppCallbackNotifier::stopRecording()
          mFrameProvider->disableFrameNotification(CameraFrame::VIDEO_FRAME_SYNC);
         }
 
+    stopVideoScaler();
+
     ///Release the shared video buffers
     releaseSharedVideoBuffers();
 
@@ -1854,8 +2045,13 @@ status_t AppCallbackNotifier::releaseRecordingFrame(const void* mem)
     if(mUseMetaDataBufferMode)
         {
         video_metadata_t *videoMetadataBuffer = (video_metadata_t *) mem ;
-        /* FIXME remove cast */
-        frame = mVideoMetadataBufferReverseMap.valueFor(videoMetadataBuffer);
+        const int slot = getVideoMetadataSlot(mem);
+        if ( 0 > slot )
+            {
+            return BAD_VALUE;
+            }
+
+        frame = mVideoSlots[slot].buffer;
         CAMHAL_LOGVB("Releasing frame with videoMetadataBuffer=0x%x, videoMetadataBuffer->handle=0x%x & frame handle=0x%x\n",
                        videoMetadataBuffer, videoMetadataBuffer->handle, frame);
         }
@@ -1943,7 +2139,10 @@ status_t AppCallbackNotifier::start()
     mNotifierState = AppCallbackNotifier::NOTIFIER_STARTED;
     CAMHAL_LOGDA(" --> AppCallbackNotifier NOTIFIER_STARTED \n");
 
-    gEncoderQueue.clear();
+    {
+        android::AutoMutex lock(gEncoderQueueLock);
+        gEncoderQueue.clear();
+    }
 
     LOG_FUNCTION_NAME_EXIT;
 
@@ -1968,11 +2167,29 @@ status_t AppCallbackNotifier::stop()
     CAMHAL_LOGDA(" --> AppCallbackNotifier NOTIFIER_STOPPED \n");
     }
 
-    while(!gEncoderQueue.isEmpty()) {
-        android::sp<Encoder_libjpeg> encoder = gEncoderQueue.valueAt(0);
+    // Cancel every encoder before waiting for any of them, otherwise an
+    // encoder queued in the pool waits for the others to finish encoding
+    {
+        android::AutoMutex lock(gEncoderQueueLock);
+        for (size_t i = 0; i < gEncoderQueue.size(); i++) {
+            gEncoderQueue.valueAt(i)->requestCancel();
+        }
+    }
+
+    for (;;) {
+        android::sp<Encoder_libjpeg> encoder;
         camera_memory_t* encoded_mem = NULL;
         ExifElementsTable* exif = NULL;
 
+        {
+            android::AutoMutex lock(gEncoderQueueLock);
+            if (gEncoderQueue.isEmpty()) {
+                break;
+            }
+            encoder = gEncoderQueue.valueAt(0);
+            gEncoderQueue.removeItemsAt(0);
+        }
+
         if(encoder.get()) {
             encoder->cancel();
 
@@ -1986,7 +2203,6 @@ status_t AppCallbackNotifier::stop()
 
             encoder.clear();
         }
-        gEncoderQueue.removeItemsAt(0);
     }
 
     LOG_FUNCTION_NAME_EXIT;
@@ -51,6 +51,7 @@ const LUT cameraCommandsUserToHAL[] = {
 #ifdef OMAP_ENHANCEMENT_CPCAM
     { "CAMERA_USE_BUFFERS_REPROCESS",           CameraAdapter::CAMERA_USE_BUFFERS_REPROCESS },
     { "CAMERA_START_REPROCESS",                 CameraAdapter::CAMERA_START_REPROCESS },
+    { "CAMERA_RELEASE_BUFFERS_REPROCESS",       CameraAdapter::CAMERA_RELEASE_BUFFERS_REPROCESS },
 #endif
 };
 
@@ -59,6 +60,34 @@ const LUTtypeHAL CamCommandsLUT = {
     cameraCommandsUserToHAL
 };
 
+//Frame types which are reference counted per buffer
+static const unsigned int REFCOUNTED_FRAMES = CameraFrame::IMAGE_FRAME |
+                                              CameraFrame::RAW_FRAME |
+                                              CameraFrame::SNAPSHOT_FRAME |
+                                              CameraFrame::PREVIEW_FRAME_SYNC |
+                                              CameraFrame::FRAME_DATA_SYNC |
+                                              CameraFrame::VIDEO_FRAME_SYNC |
+                                              CameraFrame::REPROCESS_INPUT_FRAME;
+
+static inline volatile int32_t * frameRefCount(CameraBuffer * frameBuf, CameraFrame::FrameType frameType)
+{
+    unsigned int type = frameType;
+
+    if ( ( NULL == frameBuf ) || !( type & REFCOUNTED_FRAMES ) || ( type & ( type - 1 ) ) )
+        {
+        return NULL;
+        }
+
+    // image and raw frames are delivered in the same capture buffers
+    // and share one count
+    if ( CameraFrame::RAW_FRAME == type )
+        {
+        type = CameraFrame::IMAGE_FRAME;
+        }
+
+    return &frameBuf->refCount[__builtin_ctz(type)];
+}
+
 /*--------------------Camera Adapter Class STARTS here-----------------------------*/
 
 BaseCameraAdapter::BaseCameraAdapter()
@@ -334,8 +363,8 @@ void BaseCameraAdapter::removeFramePointers()
 void BaseCameraAdapter::returnFrame(CameraBuffer * frameBuf, CameraFrame::FrameType frameType)
 {
     status_t res = NO_ERROR;
-    size_t subscriberCount = 0;
-    int refCount = -1;
+    volatile int32_t *count = NULL;
+    int32_t refCount = -1;
 
     if ( NULL == frameBuf )
         {
@@ -345,35 +374,36 @@ void BaseCameraAdapter::returnFrame(CameraBuffer * frameBuf, CameraFrame::FrameT
 
     if ( NO_ERROR == res)
         {
-        android::AutoMutex lock(mReturnFrameLock);
-
-        refCount = getFrameRefCountByType(frameBuf, frameType);
-
         if(frameType == CameraFrame::PREVIEW_FRAME_SYNC)
             {
-            mFramesWithDisplay--;
+            android_atomic_dec(&mFramesWithDisplay);
             }
         else if(frameType == CameraFrame::VIDEO_FRAME_SYNC)
             {
-            mFramesWithEncoder--;
+            android_atomic_dec(&mFramesWithEncoder);
             }
 
-        if ( 0 < refCount )
-            {
+        count = frameRefCount(frameBuf, frameType);
 
-            refCount--;
-            setFrameRefCountByType(frameBuf, frameType, refCount);
+        // drop our reference without letting the count go below zero
+        do
+            {
+            refCount = ( NULL != count ) ? android_atomic_acquire_load(count) : 0;
+            if ( 0 >= refCount )
+                {
+                CAMHAL_LOGDA("Frame returned when ref count is already zero!!");
+                return;
+                }
+            } while ( android_atomic_release_cas(refCount, refCount - 1, count) );
 
-            if (mRecording) {
-                refCount += getFrameRefCount(frameBuf);
-            }
+        refCount--;
 
-            }
-        else
-            {
-            CAMHAL_LOGDA("Frame returned when ref count is already zero!!");
-            return;
-            }
+        // only the thread dropping the last reference sees zero here,
+        // so the buffer can't be queued twice
+        int32_t total = android_atomic_dec(&frameBuf->refCountTotal) - 1;
+        if (mRecording) {
+            refCount = total;
+        }
         }
 
     CAMHAL_LOGVB("REFCOUNT 0x%x %d", frameBuf, refCount);
@@ -396,6 +426,7 @@ void BaseCameraAdapter::returnFrame(CameraBuffer * frameBuf, CameraFrame::FrameT
             mBuffersWithDucati.add((int)camera_buffer_get_omx_ptr(frameBuf),1);
             }
 #endif
+            FrameTrace::stamp(FrameTrace::STAGE_RETURN, frameBuf, frameType);
             res = fillThisBuffer(frameBuf, frameType);
             }
         }
@@ -435,13 +466,15 @@ status_t BaseCameraAdapter::sendCommand(CameraCommands operation, int value1, in
                     mSnapshotBuffersAvailable.clear();
                     for ( uint32_t i = 0 ; i < desc->mMaxQueueable ; i++ )
                         {
-                        mPreviewBuffersAvailable.add(&mPreviewBuffers[i], 0);
+                        addFrameBuffer(mPreviewBuffersAvailable, &mPreviewBuffers[i],
+                                       CameraFrame::PREVIEW_FRAME_SYNC, 0);
                         }
                     // initial ref count for undeqeueued buffers is 1 since buffer provider
                     // is still holding on to it
                     for ( uint32_t i = desc->mMaxQueueable ; i < desc->mCount ; i++ )
                         {
-                        mPreviewBuffersAvailable.add(&mPreviewBuffers[i], 1);
+                        addFrameBuffer(mPreviewBuffersAvailable, &mPreviewBuffers[i],
+                                       CameraFrame::PREVIEW_FRAME_SYNC, 1);
                         }
                     }
 
@@ -488,13 +521,15 @@ status_t BaseCameraAdapter::sendCommand(CameraCommands operation, int value1, in
                         mPreviewDataBuffersAvailable.clear();
                         for ( uint32_t i = 0 ; i < desc->mMaxQueueable ; i++ )
                             {
-                            mPreviewDataBuffersAvailable.add(&mPreviewDataBuffers[i], 0);
+                            addFrameBuffer(mPreviewDataBuffersAvailable, &mPreviewDataBuffers[i],
+                                           CameraFrame::FRAME_DATA_SYNC, 0);
                             }
                         // initial ref count for undeqeueued buffers is 1 since buffer provider
                         // is still holding on to it
                         for ( uint32_t i = desc->mMaxQueueable ; i < desc->mCount ; i++ )
                             {
-                            mPreviewDataBuffersAvailable.add(&mPreviewDataBuffers[i], 1);
+                            addFrameBuffer(mPreviewDataBuffersAvailable, &mPreviewDataBuffers[i],
+                                           CameraFrame::FRAME_DATA_SYNC, 1);
                             }
                         }
 
@@ -579,12 +614,14 @@ status_t BaseCameraAdapter::sendCommand(CameraCommands operation, int value1, in
                 mVideoInBuffers = desc->mBuffers;
                 mVideoInBuffersAvailable.clear();
                 for (uint32_t i = 0 ; i < desc->mMaxQueueable ; i++) {
-                    mVideoInBuffersAvailable.add(&mVideoInBuffers[i], 0);
+                    addFrameBuffer(mVideoInBuffersAvailable, &mVideoInBuffers[i],
+                                   CameraFrame::REPROCESS_INPUT_FRAME, 0);
                 }
                 // initial ref count for undeqeueued buffers is 1 since buffer provider
                 // is still holding on to it
                 for ( uint32_t i = desc->mMaxQueueable ; i < desc->mCount ; i++ ) {
-                    mVideoInBuffersAvailable.add(&mVideoInBuffers[i], 1);
+                    addFrameBuffer(mVideoInBuffersAvailable, &mVideoInBuffers[i],
+                                   CameraFrame::REPROCESS_INPUT_FRAME, 1);
                 }
                 ret = useBuffers(CameraAdapter::CAMERA_REPROCESS,
                                  desc->mBuffers,
@@ -1074,12 +1111,14 @@ status_t BaseCameraAdapter::sendCommand(CameraCommands operation, int value1, in
                  mVideoBuffersLength = desc->mLength;
                  mVideoBuffersAvailable.clear();
                  for ( uint32_t i = 0 ; i < desc->mMaxQueueable ; i++ ) {
-                     mVideoBuffersAvailable.add(&mVideoBuffers[i], 1);
+                     addFrameBuffer(mVideoBuffersAvailable, &mVideoBuffers[i],
+                                    CameraFrame::VIDEO_FRAME_SYNC, 1);
                  }
                  // initial ref count for undeqeueued buffers is 1 since buffer provider
                  // is still holding on to it
                  for ( uint32_t i = desc->mMaxQueueable ; i < desc->mCount ; i++ ) {
-                     mVideoBuffersAvailable.add(&mVideoBuffers[i], 1);
+                     addFrameBuffer(mVideoBuffersAvailable, &mVideoBuffers[i],
+                                    CameraFrame::VIDEO_FRAME_SYNC, 1);
                  }
              }
 
@@ -1117,6 +1156,12 @@ status_t BaseCameraAdapter::sendCommand(CameraCommands operation, int value1, in
             ret = cameraPreviewInitialization();
             break;
 
+#ifdef OMAP_ENHANCEMENT_CPCAM
+        case CameraAdapter::CAMERA_RELEASE_BUFFERS_REPROCESS:
+            ret = releaseReprocessBuffers();
+            break;
+#endif
+
         default:
             CAMHAL_LOGEB("Command 0x%x unsupported!", operation);
             break;
@@ -1290,6 +1335,8 @@ status_t BaseCameraAdapter::sendFrameToSubscribers(CameraFrame *frame)
         return -EINVAL;
         }
 
+    FrameTrace::stamp(FrameTrace::STAGE_SUBSCRIBERS, frame->mBuffer, frame->mFrameMask);
+
     for( mask = 1; mask < CameraFrame::ALL_FRAMES; mask <<= 1){
       if( mask & frame->mFrameMask ){
         switch( mask ){
@@ -1473,136 +1520,57 @@ int BaseCameraAdapter::setInitFrameRefCount(CameraBuffer * buf, unsigned int mas
 
 int BaseCameraAdapter::getFrameRefCount(CameraBuffer * frameBuf)
 {
-    int res = 0, refCnt = 0;
-
-    for (unsigned int frameType = 1; frameType < CameraFrame::ALL_FRAMES; frameType <<= 1) {
-        refCnt = getFrameRefCountByType(frameBuf, static_cast<CameraFrame::FrameType>(frameType));
-        if (refCnt > 0) res += refCnt;
-    }
-    return res;
+    return android_atomic_acquire_load(&frameBuf->refCountTotal);
 }
 
 int BaseCameraAdapter::getFrameRefCountByType(CameraBuffer * frameBuf, CameraFrame::FrameType frameType)
 {
-    int res = -1;
-    ssize_t index = NAME_NOT_FOUND;
-
-    LOG_FUNCTION_NAME;
+    volatile int32_t *count = frameRefCount(frameBuf, frameType);
 
-    switch (frameType) {
-        case CameraFrame::IMAGE_FRAME:
-        case CameraFrame::RAW_FRAME:
-        {
-            android::AutoMutex lock(mCaptureBufferLock);
-            index = mCaptureBuffersAvailable.indexOfKey(frameBuf);
-            if (index != NAME_NOT_FOUND) {
-                res = mCaptureBuffersAvailable[index];
-            }
-            break;
-        }
-        case CameraFrame::SNAPSHOT_FRAME:
-        {
-            android::AutoMutex lock(mSnapshotBufferLock);
-            index = mSnapshotBuffersAvailable.indexOfKey(frameBuf);
-            if (index != NAME_NOT_FOUND) {
-                res = mSnapshotBuffersAvailable[index];
-            }
-            break;
-        }
-        case CameraFrame::PREVIEW_FRAME_SYNC:
-        {
-            android::AutoMutex lock(mPreviewBufferLock);
-            index = mPreviewBuffersAvailable.indexOfKey(frameBuf);
-            if (index != NAME_NOT_FOUND) {
-                res = mPreviewBuffersAvailable[index];
-            }
-            break;
-        }
-        case CameraFrame::FRAME_DATA_SYNC:
-        {
-            android::AutoMutex lock(mPreviewDataBufferLock);
-            index = mPreviewDataBuffersAvailable.indexOfKey(frameBuf);
-            if (index != NAME_NOT_FOUND) {
-                res = mPreviewDataBuffersAvailable[index];
-            }
-            break;
-        }
-        case CameraFrame::VIDEO_FRAME_SYNC:
+    if ( NULL == count )
         {
-            android::AutoMutex lock(mVideoBufferLock);
-            index = mVideoBuffersAvailable.indexOfKey(frameBuf);
-            if (index != NAME_NOT_FOUND) {
-                res = mVideoBuffersAvailable[index];
-            }
-            break;
+        return -1;
         }
-        case CameraFrame::REPROCESS_INPUT_FRAME:
+
+    return android_atomic_acquire_load(count);
+}
+
+void BaseCameraAdapter::setFrameRefCountByType(CameraBuffer * frameBuf, CameraFrame::FrameType frameType, int refCount)
+{
+    volatile int32_t *count = frameRefCount(frameBuf, frameType);
+    int32_t oldCount;
+
+    if ( NULL == count )
         {
-            android::AutoMutex lock(mVideoInBufferLock);
-            index = mVideoInBuffersAvailable.indexOfKey(frameBuf);
-            if (index != NAME_NOT_FOUND) {
-                res = mVideoInBuffersAvailable[index];
-            }
-            break;
+        return;
         }
-        default:
-            break;
-    }
 
-    LOG_FUNCTION_NAME_EXIT;
+    do
+        {
+        oldCount = *count;
+        } while ( android_atomic_release_cas(oldCount, refCount, count) );
 
-    return res;
+    android_atomic_add(refCount - oldCount, &frameBuf->refCountTotal);
 }
 
-void BaseCameraAdapter::setFrameRefCountByType(CameraBuffer * frameBuf, CameraFrame::FrameType frameType, int refCount)
+void BaseCameraAdapter::addFrameBuffer(android::Vector<CameraBuffer *> &buffers,
+                                       CameraBuffer * frameBuf,
+                                       CameraFrame::FrameType frameType,
+                                       int refCount)
 {
+    buffers.add(frameBuf);
+    setFrameRefCountByType(frameBuf, frameType, refCount);
+}
 
-    LOG_FUNCTION_NAME;
-
-    switch ( frameType )
+void BaseCameraAdapter::clearFrameBuffers(android::Vector<CameraBuffer *> &buffers,
+                                          CameraFrame::FrameType frameType)
+{
+    for ( unsigned int i = 0 ; i < buffers.size() ; i++ )
         {
-        case CameraFrame::IMAGE_FRAME:
-        case CameraFrame::RAW_FRAME:
-                {
-                android::AutoMutex lock(mCaptureBufferLock);
-                mCaptureBuffersAvailable.replaceValueFor(frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::SNAPSHOT_FRAME:
-                {
-                android::AutoMutex lock(mSnapshotBufferLock);
-                mSnapshotBuffersAvailable.replaceValueFor(frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::PREVIEW_FRAME_SYNC:
-                {
-                android::AutoMutex lock(mPreviewBufferLock);
-                mPreviewBuffersAvailable.replaceValueFor(frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::FRAME_DATA_SYNC:
-                {
-                android::AutoMutex lock(mPreviewDataBufferLock);
-                mPreviewDataBuffersAvailable.replaceValueFor(frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::VIDEO_FRAME_SYNC:
-                {
-                android::AutoMutex lock(mVideoBufferLock);
-                mVideoBuffersAvailable.replaceValueFor(frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::REPROCESS_INPUT_FRAME: {
-            android::AutoMutex lock(mVideoInBufferLock);
-            mVideoInBuffersAvailable.replaceValueFor(frameBuf, refCount);
+        setFrameRefCountByType(buffers[i], frameType, 0);
         }
-            break;
-        default:
-            break;
-        };
-
-    LOG_FUNCTION_NAME_EXIT;
 
+    buffers.clear();
 }
 
 status_t BaseCameraAdapter::startVideoCapture()
@@ -1627,7 +1595,8 @@ status_t BaseCameraAdapter::startVideoCapture()
 
         for ( unsigned int i = 0 ; i < mPreviewBuffersAvailable.size() ; i++ )
             {
-            mVideoBuffersAvailable.add(mPreviewBuffersAvailable.keyAt(i), 0);
+            addFrameBuffer(mVideoBuffersAvailable, mPreviewBuffersAvailable[i],
+                           CameraFrame::VIDEO_FRAME_SYNC, 0);
             }
 
         mRecording = true;
@@ -1653,7 +1622,7 @@ status_t BaseCameraAdapter::stopVideoCapture()
         {
         for ( unsigned int i = 0 ; i < mVideoBuffersAvailable.size() ; i++ )
             {
-            CameraBuffer *frameBuf = mVideoBuffersAvailable.keyAt(i);
+            CameraBuffer *frameBuf = mVideoBuffersAvailable[i];
             if( getFrameRefCountByType(frameBuf,  CameraFrame::VIDEO_FRAME_SYNC) > 0)
                 {
                 returnFrame(frameBuf, CameraFrame::VIDEO_FRAME_SYNC);
@@ -1897,6 +1866,13 @@ status_t BaseCameraAdapter::cameraPreviewInitialization() {
   return ret;
 }
 
+status_t BaseCameraAdapter::releaseReprocessBuffers() {
+  status_t ret = NO_ERROR;
+  LOG_FUNCTION_NAME;
+  LOG_FUNCTION_NAME_EXIT;
+  return ret;
+}
+
 status_t BaseCameraAdapter::setState(CameraCommands operation)
 {
     status_t ret = NO_ERROR;
@@ -2697,6 +2673,9 @@ extern "C" status_t OMXCameraAdapter_Capabilities(
 extern "C" status_t V4LCameraAdapter_Capabilities(
         CameraProperties::Properties * const properties_array,
         const int starting_camera, const int max_camera, int & supportedCameras);
+extern "C" status_t SyntheticCameraAdapter_Capabilities(
+        CameraProperties::Properties * const properties_array,
+        const int starting_camera, const int max_camera, int & supportedCameras);
 
 extern "C" status_t CameraAdapter_Capabilities(
         CameraProperties::Properties * const properties_array,
@@ -2728,6 +2707,18 @@ extern "C" status_t CameraAdapter_Capabilities(
         ret = UNKNOWN_ERROR;
     }
 #endif
+#ifdef SYNTHETIC_CAMERA_ADAPTER
+    //Synthetic camera goes after the real ones
+    int num_synthetic_cameras = 0;
+    err = SyntheticCameraAdapter_Capabilities( properties_array,
+                                               supportedCameras + num_cameras_supported,
+                                               max_camera, num_synthetic_cameras);
+    if(err != NO_ERROR) {
+        CAMHAL_LOGEA("error while getting SyntheticCameraAdapter capabilities");
+        ret = UNKNOWN_ERROR;
+    }
+    num_cameras_supported += num_synthetic_cameras;
+#endif
 
     supportedCameras += num_cameras_supported;
     CAMHAL_LOGEB("supportedCameras= %d\n", supportedCameras);
@@ -0,0 +1,464 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file BracketMerge.cpp
+*
+* Exposure fusion of bracketed NV12 frames with a per CPU dispatch table
+* for the row kernels.
+*
+*/
+
+#include "BracketMerge.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#if defined(ARCH_ARM_HAVE_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Ti {
+namespace Camera {
+
+/*--------------------Scalar kernels---------------------------------*/
+
+// (128 - |y - 128|)^2 / 128 + 1, a peak at mid grey which never reaches 0
+static void weighScalar(uint8_t *weights, const uint8_t *srcY, int width)
+{
+    for ( int i = 0; i < width; i++ ) {
+        const int d = srcY[i] - 128;
+        const int h = 128 - ( d < 0 ? -d : d );
+        weights[i] = ( ( h * h ) >> 7 ) + 1;
+    }
+}
+
+static void chromaWeightsScalar(uint8_t *dst, const uint8_t *lumaWeights, int width)
+{
+    for ( int i = 0; i + 1 < width; i += 2 ) {
+        dst[i] = lumaWeights[i];
+        dst[i + 1] = lumaWeights[i];
+    }
+}
+
+static void accumulateScalar(uint32_t *sum, uint16_t *weightSum,
+                             const uint8_t *src, const uint8_t *weights, int width)
+{
+    for ( int i = 0; i < width; i++ ) {
+        sum[i] += src[i] * weights[i];
+        weightSum[i] += weights[i];
+    }
+}
+
+// floor(sum / weightSum + 1/2) without leaving integers
+static void normalizeScalar(uint8_t *dst, const uint32_t *sum, const uint16_t *weightSum, int width)
+{
+    for ( int i = 0; i < width; i++ ) {
+        dst[i] = ( 2 * sum[i] + weightSum[i] ) / ( 2 * weightSum[i] );
+    }
+}
+
+static const BracketMerge::Kernels gScalarKernels = {
+    BracketMerge::KERNELS_SCALAR,
+    "scalar",
+    weighScalar,
+    chromaWeightsScalar,
+    accumulateScalar,
+    normalizeScalar,
+};
+
+/*--------------------NEON kernels---------------------------------*/
+
+#if defined(ARCH_ARM_HAVE_NEON)
+
+static void weighNeon(uint8_t *weights, const uint8_t *srcY, int width)
+{
+    const uint8x16_t mid = vdupq_n_u8(128);
+    const uint8x16_t one = vdupq_n_u8(1);
+    int i = 0;
+
+    for ( ; i + 16 <= width; i += 16 ) {
+        const uint8x16_t h = vsubq_u8(mid, vabdq_u8(vld1q_u8(srcY + i), mid));
+        const uint16x8_t lo = vmull_u8(vget_low_u8(h), vget_low_u8(h));
+        const uint16x8_t hi = vmull_u8(vget_high_u8(h), vget_high_u8(h));
+        const uint8x16_t w = vcombine_u8(vshrn_n_u16(lo, 7), vshrn_n_u16(hi, 7));
+        vst1q_u8(weights + i, vaddq_u8(w, one));
+    }
+
+    weighScalar(weights + i, srcY + i, width - i);
+}
+
+static void chromaWeightsNeon(uint8_t *dst, const uint8_t *lumaWeights, int width)
+{
+    int i = 0;
+
+    for ( ; i + 32 <= width; i += 32 ) {
+        const uint8x16x2_t w = vld2q_u8(lumaWeights + i);
+        uint8x16x2_t uv;
+        uv.val[0] = w.val[0];
+        uv.val[1] = w.val[0];
+        vst2q_u8(dst + i, uv);
+    }
+
+    chromaWeightsScalar(dst + i, lumaWeights + i, width - i);
+}
+
+static void accumulateNeon(uint32_t *sum, uint16_t *weightSum,
+                           const uint8_t *src, const uint8_t *weights, int width)
+{
+    int i = 0;
+
+    for ( ; i + 8 <= width; i += 8 ) {
+        const uint8x8_t w = vld1_u8(weights + i);
+        const uint16x8_t p = vmull_u8(vld1_u8(src + i), w);
+        vst1q_u32(sum + i, vaddw_u16(vld1q_u32(sum + i), vget_low_u16(p)));
+        vst1q_u32(sum + i + 4, vaddw_u16(vld1q_u32(sum + i + 4), vget_high_u16(p)));
+        vst1q_u16(weightSum + i, vaddw_u8(vld1q_u16(weightSum + i), w));
+    }
+
+    accumulateScalar(sum + i, weightSum + i, src + i, weights + i, width - i);
+}
+
+// Reciprocal estimate refined twice, which is exact to well below
+// half a code value for the weight sums produced here
+static inline uint16x4_t divideNeon(uint32x4_t sum, uint16x4_t weightSum)
+{
+    const float32x4_t w = vcvtq_f32_u32(vmovl_u16(weightSum));
+    float32x4_t r = vrecpeq_f32(w);
+    r = vmulq_f32(vrecpsq_f32(w, r), r);
+    r = vmulq_f32(vrecpsq_f32(w, r), r);
+    const float32x4_t q = vmlaq_f32(vdupq_n_f32(0.5f), vcvtq_f32_u32(sum), r);
+    return vmovn_u32(vcvtq_u32_f32(q));
+}
+
+static void normalizeNeon(uint8_t *dst, const uint32_t *sum, const uint16_t *weightSum, int width)
+{
+    int i = 0;
+
+    for ( ; i + 8 <= width; i += 8 ) {
+        const uint16x8_t ws = vld1q_u16(weightSum + i);
+        const uint16x4_t lo = divideNeon(vld1q_u32(sum + i), vget_low_u16(ws));
+        const uint16x4_t hi = divideNeon(vld1q_u32(sum + i + 4), vget_high_u16(ws));
+        vst1_u8(dst + i, vqmovn_u16(vcombine_u16(lo, hi)));
+    }
+
+    normalizeScalar(dst + i, sum + i, weightSum + i, width - i);
+}
+
+static const BracketMerge::Kernels gNeonKernels = {
+    BracketMerge::KERNELS_NEON,
+    "neon",
+    weighNeon,
+    chromaWeightsNeon,
+    accumulateNeon,
+    normalizeNeon,
+};
+
+#endif
+
+/*--------------------SSE2 kernels---------------------------------*/
+
+#if defined(__SSE2__)
+
+static void weighSse2(uint8_t *weights, const uint8_t *srcY, int width)
+{
+    const __m128i mid = _mm_set1_epi8((char) 128);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+
+    for ( ; i + 16 <= width; i += 16 ) {
+        const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(srcY + i));
+        const __m128i d = _mm_or_si128(_mm_subs_epu8(y, mid), _mm_subs_epu8(mid, y));
+        const __m128i h = _mm_sub_epi8(mid, d);
+        const __m128i lo = _mm_unpacklo_epi8(h, zero);
+        const __m128i hi = _mm_unpackhi_epi8(h, zero);
+        const __m128i w = _mm_packus_epi16(_mm_srli_epi16(_mm_mullo_epi16(lo, lo), 7),
+                                           _mm_srli_epi16(_mm_mullo_epi16(hi, hi), 7));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(weights + i), _mm_add_epi8(w, one));
+    }
+
+    weighScalar(weights + i, srcY + i, width - i);
+}
+
+static void chromaWeightsSse2(uint8_t *dst, const uint8_t *lumaWeights, int width)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+    int i = 0;
+
+    for ( ; i + 16 <= width; i += 16 ) {
+        const __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lumaWeights + i));
+        const __m128i even = _mm_and_si128(w, lowBytes);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_or_si128(even, _mm_slli_epi16(even, 8)));
+    }
+
+    chromaWeightsScalar(dst + i, lumaWeights + i, width - i);
+}
+
+static void accumulateSse2(uint32_t *sum, uint16_t *weightSum,
+                           const uint8_t *src, const uint8_t *weights, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+
+    for ( ; i + 8 <= width; i += 8 ) {
+        const __m128i s = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)), zero);
+        const __m128i w = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(weights + i)), zero);
+        const __m128i p = _mm_mullo_epi16(s, w);
+        __m128i *acc = reinterpret_cast<__m128i *>(sum + i);
+        __m128i *ws = reinterpret_cast<__m128i *>(weightSum + i);
+        _mm_storeu_si128(acc, _mm_add_epi32(_mm_loadu_si128(acc), _mm_unpacklo_epi16(p, zero)));
+        _mm_storeu_si128(acc + 1, _mm_add_epi32(_mm_loadu_si128(acc + 1), _mm_unpackhi_epi16(p, zero)));
+        _mm_storeu_si128(ws, _mm_add_epi16(_mm_loadu_si128(ws), w));
+    }
+
+    accumulateScalar(sum + i, weightSum + i, src + i, weights + i, width - i);
+}
+
+static void normalizeSse2(uint8_t *dst, const uint32_t *sum, const uint16_t *weightSum, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 half = _mm_set1_ps(0.5f);
+    int i = 0;
+
+    for ( ; i + 8 <= width; i += 8 ) {
+        // sums stay below 2^31, so the signed conversions are exact
+        const __m128i ws = _mm_loadu_si128(reinterpret_cast<const __m128i *>(weightSum + i));
+        const __m128 s0 = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(sum + i)));
+        const __m128 s1 = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(sum + i + 4)));
+        const __m128 w0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(ws, zero));
+        const __m128 w1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(ws, zero));
+        const __m128i q0 = _mm_cvttps_epi32(_mm_add_ps(_mm_div_ps(s0, w0), half));
+        const __m128i q1 = _mm_cvttps_epi32(_mm_add_ps(_mm_div_ps(s1, w1), half));
+        const __m128i q = _mm_packus_epi16(_mm_packs_epi32(q0, q1), zero);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), q);
+    }
+
+    normalizeScalar(dst + i, sum + i, weightSum + i, width - i);
+}
+
+static const BracketMerge::Kernels gSse2Kernels = {
+    BracketMerge::KERNELS_SSE2,
+    "sse2",
+    weighSse2,
+    chromaWeightsSse2,
+    accumulateSse2,
+    normalizeSse2,
+};
+
+#endif
+
+/*--------------------Dispatch---------------------------------*/
+
+static pthread_once_t gKernelsOnce = PTHREAD_ONCE_INIT;
+static const BracketMerge::Kernels *gKernels = &gScalarKernels;
+
+static void selectKernels()
+{
+#if defined(ARCH_ARM_HAVE_NEON)
+    gKernels = &gNeonKernels;
+#elif defined(__SSE2__)
+    if ( __builtin_cpu_supports("sse2") ) {
+        gKernels = &gSse2Kernels;
+    }
+#endif
+
+    CAMHAL_LOGDB("Using %s bracket merge kernels", gKernels->name);
+}
+
+const BracketMerge::Kernels & BracketMerge::kernels()
+{
+    pthread_once(&gKernelsOnce, selectKernels);
+    return *gKernels;
+}
+
+const BracketMerge::Kernels * BracketMerge::kernels(KernelSet type)
+{
+    switch ( type ) {
+        case KERNELS_AUTO:
+            return &kernels();
+        case KERNELS_SCALAR:
+            return &gScalarKernels;
+#if defined(ARCH_ARM_HAVE_NEON)
+        case KERNELS_NEON:
+            return &gNeonKernels;
+#endif
+#if defined(__SSE2__)
+        case KERNELS_SSE2:
+            return &gSse2Kernels;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+/*--------------------BracketMerge---------------------------------*/
+
+BracketMerge::BracketMerge() :
+    mSum(NULL),
+    mWeightSum(NULL),
+    mWeights(NULL),
+    mRowCapacity(0),
+    mToneStrength(-1)
+{
+    setToneStrength(DEFAULT_TONE_STRENGTH);
+}
+
+BracketMerge::~BracketMerge()
+{
+    delete [] mSum;
+    delete [] mWeightSum;
+    delete [] mWeights;
+}
+
+void BracketMerge::setToneStrength(int strength)
+{
+    if ( strength < 0 ) {
+        strength = 0;
+    } else if ( strength > MAX_TONE_STRENGTH ) {
+        strength = MAX_TONE_STRENGTH;
+    }
+
+    if ( strength == mToneStrength ) {
+        return;
+    }
+
+    // x * (1 + k) / (1 + k * x): identity for k = 0, otherwise the
+    // shadows are lifted while black and white stay in place
+    const float k = strength / 100.0f;
+    for ( int i = 0; i < 256; i++ ) {
+        const float x = i / 255.0f;
+        mToneCurve[i] = ( uint8_t ) ( 255.0f * x * ( 1.0f + k ) / ( 1.0f + k * x ) + 0.5f );
+    }
+
+    mToneStrength = strength;
+}
+
+status_t BracketMerge::allocRows(int width)
+{
+    if ( width <= mRowCapacity ) {
+        return NO_ERROR;
+    }
+
+    delete [] mSum;
+    delete [] mWeightSum;
+    delete [] mWeights;
+
+    mSum = new uint32_t[3 * width];
+    mWeightSum = new uint16_t[3 * width];
+    mWeights = new uint8_t[2 * width];
+
+    if ( ( NULL == mSum ) || ( NULL == mWeightSum ) || ( NULL == mWeights ) ) {
+        CAMHAL_LOGEB("Unable to allocate bracket merge rows for width %d", width);
+        delete [] mSum;
+        delete [] mWeightSum;
+        delete [] mWeights;
+        mSum = NULL;
+        mWeightSum = NULL;
+        mWeights = NULL;
+        mRowCapacity = 0;
+        return NO_MEMORY;
+    }
+
+    mRowCapacity = width;
+
+    return NO_ERROR;
+}
+
+void BracketMerge::applyToneCurve(uint8_t *row, int width)
+{
+    for ( int i = 0; i < width; i++ ) {
+        row[i] = mToneCurve[row[i]];
+    }
+}
+
+status_t BracketMerge::merge(const Frame *src,
+                             size_t count,
+                             const Frame &dst,
+                             int width,
+                             int height,
+                             const Kernels & k)
+{
+    status_t ret = NO_ERROR;
+
+    if ( ( NULL == src ) || ( 0 == count ) || ( count > MAX_FRAMES ) ||
+         ( width < 2 ) || ( height < 2 ) || ( width & 1 ) || ( height & 1 ) ) {
+        CAMHAL_LOGEB("Invalid bracket merge of %u frames %dx%d", ( unsigned int ) count, width, height);
+        return BAD_VALUE;
+    }
+
+    for ( size_t i = 0; i < count; i++ ) {
+        if ( !src[i].y || !src[i].uv || ( src[i].stride < ( size_t ) width ) ) {
+            return BAD_VALUE;
+        }
+    }
+
+    if ( !dst.y || !dst.uv || ( dst.stride < ( size_t ) width ) ) {
+        return BAD_VALUE;
+    }
+
+    ret = allocRows(width);
+    if ( NO_ERROR != ret ) {
+        return ret;
+    }
+
+    uint32_t * const sum[3] = { mSum, mSum + width, mSum + 2 * width };
+    uint16_t * const weightSum[3] = { mWeightSum, mWeightSum + width, mWeightSum + 2 * width };
+    uint8_t * const lumaWeights = mWeights;
+    uint8_t * const chromaWeights = mWeights + width;
+
+    for ( int row = 0; row < height; row += 2 ) {
+        memset(mSum, 0, 3 * width * sizeof(*mSum));
+        memset(mWeightSum, 0, 3 * width * sizeof(*mWeightSum));
+
+        for ( size_t i = 0; i < count; i++ ) {
+            const uint8_t *y0 = src[i].y + row * src[i].stride;
+            const uint8_t *y1 = y0 + src[i].stride;
+            const uint8_t *uv = src[i].uv + ( row / 2 ) * src[i].stride;
+
+            k.weigh(lumaWeights, y0, width);
+            k.accumulate(sum[0], weightSum[0], y0, lumaWeights, width);
+            k.chromaWeights(chromaWeights, lumaWeights, width);
+            k.accumulate(sum[2], weightSum[2], uv, chromaWeights, width);
+
+            k.weigh(lumaWeights, y1, width);
+            k.accumulate(sum[1], weightSum[1], y1, lumaWeights, width);
+        }
+
+        uint8_t *y0 = dst.y + row * dst.stride;
+        uint8_t *y1 = y0 + dst.stride;
+        uint8_t *uv = dst.uv + ( row / 2 ) * dst.stride;
+
+        k.normalize(y0, sum[0], weightSum[0], width);
+        k.normalize(y1, sum[1], weightSum[1], width);
+        k.normalize(uv, sum[2], weightSum[2], width);
+
+        if ( 0 < mToneStrength ) {
+            applyToneCurve(y0, width);
+            applyToneCurve(y1, width);
+        }
+    }
+
+    return ret;
+}
+
+} // namespace Camera
+} // namespace Ti
@@ -124,7 +124,7 @@ const int BufferSourceAdapter::NO_BUFFERS_IMAGE_CAPTURE_SYSTEM_HEAP = 15;
 /**
  * Display Adapter class STARTS here..
  */
-BufferSourceAdapter::BufferSourceAdapter() : mBufferCount(0)
+BufferSourceAdapter::BufferSourceAdapter() : mBufferCount(0), mBufferGeneration(0)
 {
     LOG_FUNCTION_NAME;
 
@@ -138,6 +138,16 @@ BufferSourceAdapter::BufferSourceAdapter() : mBufferCount(0)
     mPreviewWidth = 0;
     mPreviewHeight = 0;
 
+    mQueueBatches = 0;
+    mFramesQueued = 0;
+    mMaxQueueDepth = 0;
+    mQueueWaitTotal = 0;
+    mQueueWaitMax = 0;
+    mReturnBatches = 0;
+    mFramesReturned = 0;
+    mDequeueWaitTotal = 0;
+    mDequeueWaitMax = 0;
+
     LOG_FUNCTION_NAME_EXIT;
 }
 
@@ -230,6 +240,10 @@ int BufferSourceAdapter::setPreviewWindow(preview_stream_ops_t *source)
 
     // Move to new source obj
     mBufferSource = source;
+    {
+        android::AutoMutex lock(mLock);
+        mBufferGeneration++;
+    }
 
     LOG_FUNCTION_NAME_EXIT;
 
@@ -249,6 +263,11 @@ bool BufferSourceAdapter::match(const char * str) {
     return strcmp(id1, str) == 0;
 }
 
+uint32_t BufferSourceAdapter::getBufferGeneration() const {
+    android::AutoMutex lock(mLock);
+    return mBufferGeneration;
+}
+
 int BufferSourceAdapter::setFrameProvider(FrameNotifier *frameProvider)
 {
     LOG_FUNCTION_NAME;
@@ -483,6 +502,8 @@ CameraBuffer* BufferSourceAdapter::allocateBufferList(int width, int dummyHeight
     mFrameHeight = height;
     mBufferSourceDirection = BUFFER_SOURCE_TAP_OUT;
 
+    updateBufferIndices();
+
     return mBuffers;
 
  fail:
@@ -597,10 +618,13 @@ CameraBuffer *BufferSourceAdapter::getBuffers(bool reset) {
             newBuffers[index].type = mBuffers[j].type;
             newBuffers[index].format = mBuffers[j].format;
             newBuffers[index].mapped = mBuffers[j].mapped;
+            index++;
         }
 
         delete [] mBuffers;
         mBuffers = newBuffers;
+
+        updateBufferIndices();
     }
 
     return mBuffers;
@@ -625,16 +649,29 @@ int BufferSourceAdapter::getBufferCount() {
 CameraBuffer* BufferSourceAdapter::getBufferList(int *num) {
     LOG_FUNCTION_NAME;
     status_t err;
-    const int lnumBufs = 1;
     int formatSource;
     android::GraphicBufferMapper &mapper = android::GraphicBufferMapper::get();
     buffer_handle_t *handle;
+    CameraBuffer *buffer = NULL;
+    int stride = 0;
+    void *privateData = NULL;
+    ssize_t index;
 
     // TODO(XXX): Only supporting one input buffer at a time right now
     *num = 1;
-    mBufferCount = *num;
-    mBuffers = new CameraBuffer [lnumBufs];
-    memset (mBuffers, 0, sizeof(CameraBuffer) * lnumBufs);
+
+    android::AutoMutex lock(mLock);
+
+    // Every buffer of the source keeps its CameraBuffer for as long as the
+    // source hands it out, a request for a known buffer allocates nothing
+    // and the camera gets the same CameraBuffer back
+    if ( NULL == mBuffers ) {
+        mBuffers = new CameraBuffer [NO_BUFFERS_IMAGE_CAPTURE_SYSTEM_HEAP];
+        memset (mBuffers, 0, sizeof(CameraBuffer) * NO_BUFFERS_IMAGE_CAPTURE_SYSTEM_HEAP);
+        mBufferCount = 0;
+        mBufferIndices.clear();
+        mBufferGeneration++;
+    }
 
     if ( NULL == mBufferSource ) {
         return NULL;
@@ -642,8 +679,8 @@ CameraBuffer* BufferSourceAdapter::getBufferList(int *num) {
 
     err = extendedOps()->update_and_get_buffer(mBufferSource,
                                                &handle,
-                                               &mBuffers[0].stride,
-                                               &mBuffers[0].privateData);
+                                               &stride,
+                                               &privateData);
     if (err != 0) {
         CAMHAL_LOGEB("update and get buffer failed: %s (%d)", strerror(-err), -err);
         if ( ENODEV == err ) {
@@ -654,11 +691,33 @@ CameraBuffer* BufferSourceAdapter::getBufferList(int *num) {
     }
 
     CAMHAL_LOGD("got handle %p", handle);
-    mBuffers[0].opaque = (void *)handle;
-    mBuffers[0].type = CAMERA_BUFFER_ANW;
-    mFramesWithCameraAdapterMap.add(handle, 0);
 
-    err = extendedOps()->get_buffer_dimension(mBufferSource, &mBuffers[0].width, &mBuffers[0].height);
+    index = mBufferIndices.indexOfKey(handle);
+    if ( 0 > index ) {
+        if ( NO_BUFFERS_IMAGE_CAPTURE_SYSTEM_HEAP <= mBufferCount ) {
+            // the source went through more buffers than the table holds,
+            // none of them is with the camera between two requests
+            CAMHAL_LOGDA("Input buffer table full, starting over");
+            mBufferCount = 0;
+            mBufferIndices.clear();
+            mFramesWithCameraAdapterMap.clear();
+            mBufferGeneration++;
+        }
+        index = mBufferCount++;
+        mBufferIndices.add(handle, index);
+    } else {
+        index = mBufferIndices.valueAt(index);
+    }
+
+    buffer = &mBuffers[index];
+    memset (buffer, 0, sizeof(CameraBuffer));
+    buffer->opaque = (void *)handle;
+    buffer->type = CAMERA_BUFFER_ANW;
+    buffer->stride = stride;
+    buffer->privateData = privateData;
+    mFramesWithCameraAdapterMap.add(handle, index);
+
+    err = extendedOps()->get_buffer_dimension(mBufferSource, &buffer->width, &buffer->height);
     err = extendedOps()->get_buffer_format(mBufferSource, &formatSource);
 
     int t, l, r, b, w, h;
@@ -668,26 +727,24 @@ CameraBuffer* BufferSourceAdapter::getBufferList(int *num) {
     // lock buffer
     {
         void *y_uv[2];
-        android::Rect bounds(mBuffers[0].width, mBuffers[0].height);
+        android::Rect bounds(buffer->width, buffer->height);
         mapper.lock(*handle, CAMHAL_GRALLOC_USAGE, bounds, y_uv);
-        mBuffers[0].mapped = y_uv[0];
+        buffer->mapped = y_uv[0];
     }
 
-    mFrameWidth = mBuffers[0].width;
-    mFrameHeight = mBuffers[0].height;
+    mFrameWidth = buffer->width;
+    mFrameHeight = buffer->height;
     mPixelFormat = getFormatFromANW(formatSource);
 
-    mBuffers[0].format = mPixelFormat;
-    mBuffers[0].actual_size = CameraHal::calculateBufferSize(mPixelFormat, w, h);
-    mBuffers[0].offset = t * w + l * CameraHal::getBPP(mPixelFormat);
+    buffer->format = mPixelFormat;
+    buffer->actual_size = CameraHal::calculateBufferSize(mPixelFormat, w, h);
+    buffer->offset = t * w + l * CameraHal::getBPP(mPixelFormat);
+    buffer->index = index;
     mBufferSourceDirection = BUFFER_SOURCE_TAP_IN;
 
-    return mBuffers;
+    return buffer;
 
  fail:
-    // need to cancel buffers if any were dequeued
-    freeBufferList(mBuffers);
-
     if (NULL != mErrorNotifier.get()) {
         mErrorNotifier->errorNotify(-ENOMEM);
     }
@@ -843,7 +900,51 @@ void BufferSourceAdapter::addFrame(CameraFrame* frame)
     }
 }
 
-void BufferSourceAdapter::handleFrameCallback(CameraFrame* frame)
+void BufferSourceAdapter::handleFrameCallbacks(android::Vector<CameraFrame *> &frames, nsecs_t wait)
+{
+    int enqueued = 0;
+    bool ok = true;
+
+    {
+        android::AutoMutex lock(mLock);
+
+        mQueueBatches++;
+        mFramesQueued += frames.size();
+        if ( frames.size() > mMaxQueueDepth ) {
+            mMaxQueueDepth = frames.size();
+        }
+        mQueueWaitTotal += wait;
+        if ( wait > mQueueWaitMax ) {
+            mQueueWaitMax = wait;
+        }
+
+        for ( size_t i = 0; i < frames.size(); i++ ) {
+            CameraFrame *frame = frames.itemAt(i);
+
+            // once the source failed the rest of the batch is dropped,
+            // like the frames still queued behind it
+            if ( ok ) {
+                bool queued = false;
+                ok = handleFrameCallback(frame, queued);
+                if ( queued ) {
+                    enqueued++;
+                }
+            }
+
+            frame->mMetaData.clear();
+            delete frame;
+        }
+    }
+
+    frames.clear();
+
+    if ( ok && ( 0 < enqueued ) ) {
+        // signal return frame thread that it can dequeue the buffers now
+        mReturnFrame->signal(enqueued);
+    }
+}
+
+bool BufferSourceAdapter::handleFrameCallback(CameraFrame* frame, bool &queued)
 {
     status_t ret = NO_ERROR;
     buffer_handle_t *handle = NULL;
@@ -851,28 +952,22 @@ void BufferSourceAdapter::handleFrameCallback(CameraFrame* frame)
     uint32_t x, y;
     android::GraphicBufferMapper &mapper = android::GraphicBufferMapper::get();
 
-    android::AutoMutex lock(mLock);
-
     if (!mBuffers || !frame->mBuffer) {
         CAMHAL_LOGEA("Adapter sent BufferSourceAdapter a NULL frame?");
-        return;
-    }
-
-    for ( i = 0; i < mBufferCount; i++ ) {
-        if (frame->mBuffer == &mBuffers[i]) {
-            break;
-        }
+        return true;
     }
 
-    if (i >= mBufferCount) {
+    // frames carry a pointer into mBuffers, its offset is the index
+    if ( ( frame->mBuffer < mBuffers ) || ( frame->mBuffer >= ( mBuffers + mBufferCount ) ) ) {
         CAMHAL_LOGD("Can't find frame in buffer list");
         if (frame->mFrameType != CameraFrame::REPROCESS_INPUT_FRAME) {
             mFrameProvider->returnFrame(frame->mBuffer,
                     static_cast<CameraFrame::FrameType>(frame->mFrameType));
         }
-        return;
+        return true;
     }
 
+    i = frame->mBuffer - mBuffers;
     handle = (buffer_handle_t *) mBuffers[i].opaque;
 
     // Handle input buffers
@@ -882,7 +977,8 @@ void BufferSourceAdapter::handleFrameCallback(CameraFrame* frame)
         CAMHAL_LOGD("Unlock %p (buffer #%d)", handle, i);
         mapper.unlock(*handle);
         extendedOps()->release_buffer(mBufferSource, mBuffers[i].privateData);
-        return;
+        mFramesWithCameraAdapterMap.removeItem(handle);
+        return true;
     }
 
     CameraHal::getXYFromOffset(&x, &y, frame->mOffset, frame->mAlignment, mPixelFormat);
@@ -917,75 +1013,123 @@ void BufferSourceAdapter::handleFrameCallback(CameraFrame* frame)
     }
 
     mFramesWithCameraAdapterMap.removeItem((buffer_handle_t *) frame->mBuffer->opaque);
+    queued = true;
 
-    return;
+    return true;
 
 fail:
     mFramesWithCameraAdapterMap.clear();
     mBufferSource = NULL;
     mReturnFrame->requestExit();
     mQueueFrame->requestExit();
+    return false;
 }
 
 
-bool BufferSourceAdapter::handleFrameReturn()
+int BufferSourceAdapter::handleFrameReturn(int count)
 {
     status_t err;
     buffer_handle_t *buf;
-    int i = 0;
+    ssize_t i = 0;
+    int returned = 0;
     int stride;  // dummy variable to get stride
-    CameraFrame::FrameType type;
     android::GraphicBufferMapper &mapper = android::GraphicBufferMapper::get();
     void *y_uv[2];
     android::Rect bounds(mFrameWidth, mFrameHeight);
+    nsecs_t start, wait;
 
     android::AutoMutex lock(mLock);
 
-    if ( (NULL == mBufferSource) || (NULL == mBuffers) ) {
-        return false;
-    }
+    mReturnBatches++;
 
-    err = mBufferSource->dequeue_buffer(mBufferSource, &buf, &stride);
-    if (err != 0) {
-        CAMHAL_LOGEB("dequeueBuffer failed: %s (%d)", strerror(-err), -err);
+    for ( int n = 0; n < count; n++ ) {
+        if ( (NULL == mBufferSource) || (NULL == mBuffers) ) {
+            break;
+        }
 
-        if ( ENODEV == err ) {
-            CAMHAL_LOGEA("Preview surface abandoned!");
-            mBufferSource = NULL;
+        start = systemTime();
+        err = mBufferSource->dequeue_buffer(mBufferSource, &buf, &stride);
+        wait = systemTime() - start;
+
+        mDequeueWaitTotal += wait;
+        if ( wait > mDequeueWaitMax ) {
+            mDequeueWaitMax = wait;
         }
 
-        return false;
-    }
+        if (err != 0) {
+            CAMHAL_LOGEB("dequeueBuffer failed: %s (%d)", strerror(-err), -err);
 
-    err = mBufferSource->lock_buffer(mBufferSource, buf);
-    if (err != 0) {
-        CAMHAL_LOGEB("lockbuffer failed: %s (%d)", strerror(-err), -err);
+            if ( ENODEV == err ) {
+                CAMHAL_LOGEA("Preview surface abandoned!");
+                mBufferSource = NULL;
+            }
 
-        if ( ENODEV == err ) {
-            CAMHAL_LOGEA("Preview surface abandoned!");
-            mBufferSource = NULL;
+            break;
         }
 
-        return false;
-    }
+        err = mBufferSource->lock_buffer(mBufferSource, buf);
+        if (err != 0) {
+            CAMHAL_LOGEB("lockbuffer failed: %s (%d)", strerror(-err), -err);
 
-    mapper.lock(*buf, CAMHAL_GRALLOC_USAGE, bounds, y_uv);
+            if ( ENODEV == err ) {
+                CAMHAL_LOGEA("Preview surface abandoned!");
+                mBufferSource = NULL;
+            }
 
-    for(i = 0; i < mBufferCount; i++) {
-        if (mBuffers[i].opaque == buf)
             break;
-    }
+        }
+
+        i = mBufferIndices.indexOfKey(buf);
+        if ( 0 > i ) {
+            CAMHAL_LOGEB("Failed to find handle %p", buf);
+            mBufferSource->cancel_buffer(mBufferSource, buf);
+            continue;
+        }
+        i = mBufferIndices.valueAt(i);
 
-    if (i >= mBufferCount) {
-        CAMHAL_LOGEB("Failed to find handle %p", buf);
+        mapper.lock(*buf, CAMHAL_GRALLOC_USAGE, bounds, y_uv);
+
+        mFramesWithCameraAdapterMap.add((buffer_handle_t *) mBuffers[i].opaque, i);
+
+        CAMHAL_LOGVB("handleFrameReturn: found graphic buffer %d of %d", (int) i, mBufferCount - 1);
+
+        mFrameProvider->returnFrame(&mBuffers[i], formatToOutputFrameType(mPixelFormat));
+        mFramesReturned++;
+        returned++;
     }
 
-    mFramesWithCameraAdapterMap.add((buffer_handle_t *) mBuffers[i].opaque, i);
+    return returned;
+}
 
-    CAMHAL_LOGVB("handleFrameReturn: found graphic buffer %d of %d", i, mBufferCount - 1);
+void BufferSourceAdapter::updateBufferIndices()
+{
+    mBufferIndices.clear();
+    for ( int i = 0; i < mBufferCount; i++ ) {
+        mBufferIndices.add((buffer_handle_t *) mBuffers[i].opaque, i);
+    }
+}
 
-    mFrameProvider->returnFrame(&mBuffers[i], formatToOutputFrameType(mPixelFormat));
-    return true;
+void BufferSourceAdapter::dump(int fd) const
+{
+    android::AutoMutex lock(mLock);
+    char buffer[384];
+
+    int len = snprintf(buffer, sizeof(buffer),
+            "BufferSourceAdapter %s:\n"
+            "    frames %u in %u batches, max queue depth %u\n"
+            "    queue wait avg %u us, max %u us\n"
+            "    returned %u in %u batches, dequeue wait avg %u us, max %u us\n",
+            ( BUFFER_SOURCE_TAP_IN == mBufferSourceDirection ) ? "tap-in" : "tap-out",
+            mFramesQueued, mQueueBatches, mMaxQueueDepth,
+            ( unsigned int ) ns2us(mQueueBatches ? mQueueWaitTotal / mQueueBatches : 0),
+            ( unsigned int ) ns2us(mQueueWaitMax),
+            mFramesReturned, mReturnBatches,
+            ( unsigned int ) ns2us(mReturnBatches ? mDequeueWaitTotal / mReturnBatches : 0),
+            ( unsigned int ) ns2us(mDequeueWaitMax));
+
+    if ( len > 0 ) {
+        write(fd, buffer, len);
+    }
 }
 
 void BufferSourceAdapter::frameCallback(CameraFrame* caFrame)
@@ -27,6 +27,7 @@
 #include "TICameraParameters.h"
 #include "CameraProperties.h"
 #include <cutils/properties.h>
+#include <cutils/atomic.h>
 
 #include <poll.h>
 #include <math.h>
@@ -36,6 +37,7 @@ namespace Camera {
 
 extern "C" CameraAdapter* OMXCameraAdapter_Factory(size_t);
 extern "C" CameraAdapter* V4LCameraAdapter_Factory(size_t, CameraHal*);
+extern "C" CameraAdapter* SyntheticCameraAdapter_Factory(size_t);
 
 /*****************************************************************************/
 
@@ -55,6 +57,10 @@ const uint32_t MessageNotifier::FRAME_BIT_FIELD_POSITION = 0;
 // until faux-NPA mode is implemented
 const int CameraHal::NO_BUFFERS_IMAGE_CAPTURE_SYSTEM_HEAP = 15;
 
+// Single shots in capture pipeline mode alternate between these buffers, so the
+// next shot can be filled while the previous one is still being encoded or delivered
+const int CameraHal::NO_BUFFERS_IMAGE_CAPTURE_PIPELINE = 2;
+
 #ifdef CAMERAHAL_USE_RAW_IMAGE_SAVING
 // HACK: Default path to directory where RAW images coming from video port will be saved to.
 //       If directory not exists the saving is skipped and video port frame is ignored.
@@ -367,18 +373,24 @@ int CameraHal::setParameters(const char* parameters)
 
     LOG_FUNCTION_NAME_EXIT;
 
-    return setParameters(params);
+    return setParameters(params, &str_params);
+}
+
+int CameraHal::setParameters(const android::CameraParameters& params)
+{
+    return setParameters(params, NULL);
 }
 
 /**
    @brief Set the camera parameters.
 
    @param[in] params Camera parameters to configure the camera
+   @param[in] source Flat string params was parsed from, NULL if none
    @return NO_ERROR
    @todo Define error codes
 
  */
-int CameraHal::setParameters(const android::CameraParameters& params)
+int CameraHal::setParameters(const android::CameraParameters& params, const android::String8 *source)
 {
 
     LOG_FUNCTION_NAME;
@@ -392,6 +404,7 @@ int CameraHal::setParameters(const android::CameraParameters& params)
     bool restartPreviewRequired = false;
     bool updateRequired = false;
     android::CameraParameters oldParams = mParameters;
+    OperatingMode validationMode = MODE_MAX;
 #ifdef MOTOROLA_CAMERA
     char value[PROPERTY_VALUE_MAX];
 #endif
@@ -405,11 +418,23 @@ int CameraHal::setParameters(const android::CameraParameters& params)
     {
         android::AutoMutex lock(mLock);
 
+        mParametersDiff.compute(mParameters, params, source);
+
+        // Values accepted so far were checked against the capabilities of
+        // the mode the adapter was in, check all of them again when the
+        // adapter has switched modes since
+        validationMode = mCameraProperties->getMode();
+        if ( validationMode != mValidatedMode ) {
+            mParametersDiff.invalidate();
+        }
+        mValidatedMode = MODE_MAX;
+
         ///Ensure that preview is not enabled when the below parameters are changed.
         if(!previewEnabled())
             {
             if ((valstr = params.getPreviewFormat()) != NULL) {
-                if ( isParameterValid(valstr, mCameraProperties->get(CameraProperties::SUPPORTED_PREVIEW_FORMATS))) {
+                if ( !isParameterChanged(android::CameraParameters::KEY_PREVIEW_FORMAT) ||
+                     isParameterValid(valstr, CameraProperties::SUPPORTED_PREVIEW_FORMATS)) {
                     mParameters.setPreviewFormat(valstr);
                     CAMHAL_LOGDB("PreviewFormat set %s", valstr);
                 } else {
@@ -493,7 +518,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
         }
 
         if ((valstr = params.get(TICameraParameters::KEY_IPP)) != NULL) {
-            if (isParameterValid(valstr,mCameraProperties->get(CameraProperties::SUPPORTED_IPP_MODES))) {
+            if (!isParameterChanged(TICameraParameters::KEY_IPP) ||
+                isParameterValid(valstr, CameraProperties::SUPPORTED_IPP_MODES)) {
                 if ((mParameters.get(TICameraParameters::KEY_IPP) == NULL) ||
                         (strcmp(valstr, mParameters.get(TICameraParameters::KEY_IPP)))) {
                     CAMHAL_LOGDB("IPP mode set %s", params.get(TICameraParameters::KEY_IPP));
@@ -577,10 +603,11 @@ int CameraHal::setParameters(const android::CameraParameters& params)
             restartPreviewRequired |= resetVideoModeParameters();
             }
 
-        if ( (!isResolutionValid(w, h, mCameraProperties->get(CameraProperties::SUPPORTED_PREVIEW_SIZES)))
-                && (!isResolutionValid(w, h, mCameraProperties->get(CameraProperties::SUPPORTED_PREVIEW_SUBSAMPLED_SIZES)))
-                && (!isResolutionValid(w, h, mCameraProperties->get(CameraProperties::SUPPORTED_PREVIEW_SIDEBYSIDE_SIZES)))
-                && (!isResolutionValid(w, h, mCameraProperties->get(CameraProperties::SUPPORTED_PREVIEW_TOPBOTTOM_SIZES))) ) {
+        if ( isParameterChanged(android::CameraParameters::KEY_PREVIEW_SIZE)
+                && (!isResolutionValid(w, h, CameraProperties::SUPPORTED_PREVIEW_SIZES))
+                && (!isResolutionValid(w, h, CameraProperties::SUPPORTED_PREVIEW_SUBSAMPLED_SIZES))
+                && (!isResolutionValid(w, h, CameraProperties::SUPPORTED_PREVIEW_SIDEBYSIDE_SIZES))
+                && (!isResolutionValid(w, h, CameraProperties::SUPPORTED_PREVIEW_TOPBOTTOM_SIZES)) ) {
             CAMHAL_LOGEB("Invalid preview resolution %d x %d", w, h);
             return BAD_VALUE;
         }
@@ -596,7 +623,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
         CAMHAL_LOGDB("Preview Resolution: %d x %d", w, h);
 
         if ((valstr = params.get(android::CameraParameters::KEY_FOCUS_MODE)) != NULL) {
-            if (isParameterValid(valstr, mCameraProperties->get(CameraProperties::SUPPORTED_FOCUS_MODES))) {
+            if (!isParameterChanged(android::CameraParameters::KEY_FOCUS_MODE) ||
+                isParameterValid(valstr, CameraProperties::SUPPORTED_FOCUS_MODES)) {
                 CAMHAL_LOGDB("Focus mode set %s", valstr);
 
                 // we need to take a decision on the capture mode based on whether CAF picture or
@@ -631,10 +659,11 @@ int CameraHal::setParameters(const android::CameraParameters& params)
             }
 
         params.getPictureSize(&w, &h);
-        if ( (isResolutionValid(w, h, mCameraProperties->get(CameraProperties::SUPPORTED_PICTURE_SIZES)))
-                || (isResolutionValid(w, h, mCameraProperties->get(CameraProperties::SUPPORTED_PICTURE_SUBSAMPLED_SIZES)))
-                || (isResolutionValid(w, h, mCameraProperties->get(CameraProperties::SUPPORTED_PICTURE_TOPBOTTOM_SIZES)))
-                || (isResolutionValid(w, h, mCameraProperties->get(CameraProperties::SUPPORTED_PICTURE_SIDEBYSIDE_SIZES))) ) {
+        if ( (!isParameterChanged(android::CameraParameters::KEY_PICTURE_SIZE))
+                || (isResolutionValid(w, h, CameraProperties::SUPPORTED_PICTURE_SIZES))
+                || (isResolutionValid(w, h, CameraProperties::SUPPORTED_PICTURE_SUBSAMPLED_SIZES))
+                || (isResolutionValid(w, h, CameraProperties::SUPPORTED_PICTURE_TOPBOTTOM_SIZES))
+                || (isResolutionValid(w, h, CameraProperties::SUPPORTED_PICTURE_SIDEBYSIDE_SIZES)) ) {
             mParameters.setPictureSize(w, h);
         } else {
             CAMHAL_LOGEB("ERROR: Invalid picture resolution %d x %d", w, h);
@@ -644,7 +673,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
         CAMHAL_LOGDB("Picture Size by App %d x %d", w, h);
 
         if ( (valstr = params.getPictureFormat()) != NULL ) {
-            if (isParameterValid(valstr,mCameraProperties->get(CameraProperties::SUPPORTED_PICTURE_FORMATS))) {
+            if (!isParameterChanged(android::CameraParameters::KEY_PICTURE_FORMAT) ||
+                isParameterValid(valstr, CameraProperties::SUPPORTED_PICTURE_FORMATS)) {
                 if ((strcmp(valstr, android::CameraParameters::PIXEL_FORMAT_BAYER_RGGB) == 0) &&
                     mCameraProperties->get(CameraProperties::MAX_PICTURE_WIDTH) &&
                     mCameraProperties->get(CameraProperties::MAX_PICTURE_HEIGHT)) {
@@ -673,6 +703,17 @@ int CameraHal::setParameters(const android::CameraParameters& params)
         }
 #endif
 
+        if ((valstr = params.get(TICameraParameters::KEY_CAPTURE_PIPELINE)) != NULL) {
+            if (!strcmp(valstr, android::CameraParameters::TRUE) ||
+                !strcmp(valstr, android::CameraParameters::FALSE)) {
+                CAMHAL_LOGDB("Capture pipeline %s", valstr);
+                mParameters.set(TICameraParameters::KEY_CAPTURE_PIPELINE, valstr);
+            } else {
+                CAMHAL_LOGEB("ERROR: Invalid capture pipeline value: %s", valstr);
+                return BAD_VALUE;
+            }
+        }
+
         // Variable framerate ranges have higher priority over
         // deprecated constant FPS.
         // There is possible 3 situations :
@@ -697,8 +738,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
                 ((curMaxFPS != maxFPS) || (curMinFPS != minFPS))) {
             CAMHAL_LOGDB("## current minFPS = %d; maxFPS=%d", curMinFPS, curMaxFPS);
             CAMHAL_LOGDB("## requested minFPS = %d; maxFPS=%d", minFPS, maxFPS);
-            if (!isFpsRangeValid(minFPS, maxFPS, params.get(android::CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE)) &&
-                !isFpsRangeValid(minFPS, maxFPS, params.get(TICameraParameters::KEY_FRAMERATE_RANGES_EXT_SUPPORTED))) {
+            if (!isFpsRangeValid(minFPS, maxFPS, CameraProperties::FRAMERATE_RANGE_SUPPORTED) &&
+                !isFpsRangeValid(minFPS, maxFPS, CameraProperties::FRAMERATE_RANGE_EXT_SUPPORTED)) {
                 CAMHAL_LOGEA("Trying to set invalid FPS Range (%d,%d)", minFPS, maxFPS);
                 return BAD_VALUE;
             }
@@ -714,8 +755,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
         valstr = params.get(android::CameraParameters::KEY_PREVIEW_FRAME_RATE);
         if (valstr != NULL && strlen(valstr) && (framerate != curFramerate)) {
             CAMHAL_LOGD("current framerate = %d reqested framerate = %d", curFramerate, framerate);
-            if (!isParameterValid(framerate, params.get(android::CameraParameters::KEY_SUPPORTED_PREVIEW_FRAME_RATES)) &&
-                !isParameterValid(framerate, params.get(TICameraParameters::KEY_FRAMERATES_EXT_SUPPORTED))) {
+            if (!isParameterValid(framerate, CameraProperties::SUPPORTED_PREVIEW_FRAME_RATES) &&
+                !isParameterValid(framerate, CameraProperties::SUPPORTED_PREVIEW_FRAME_RATES_EXT)) {
                 CAMHAL_LOGEA("Trying to set invalid frame rate %d", framerate);
                 return BAD_VALUE;
             }
@@ -794,7 +835,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
         }
 
         if ((valstr = params.get(TICameraParameters::KEY_EXPOSURE_MODE)) != NULL) {
-            if (isParameterValid(valstr, mCameraProperties->get(CameraProperties::SUPPORTED_EXPOSURE_MODES))) {
+            if (!isParameterChanged(TICameraParameters::KEY_EXPOSURE_MODE) ||
+                isParameterValid(valstr, CameraProperties::SUPPORTED_EXPOSURE_MODES)) {
                 CAMHAL_LOGDB("Exposure mode set = %s", valstr);
                 mParameters.set(TICameraParameters::KEY_EXPOSURE_MODE, valstr);
                 if (!strcmp(valstr, TICameraParameters::EXPOSURE_MODE_MANUAL)) {
@@ -852,7 +894,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
 #endif
 
         if ((valstr = params.get(android::CameraParameters::KEY_WHITE_BALANCE)) != NULL) {
-           if ( isParameterValid(valstr, mCameraProperties->get(CameraProperties::SUPPORTED_WHITE_BALANCE))) {
+           if (!isParameterChanged(android::CameraParameters::KEY_WHITE_BALANCE) ||
+               isParameterValid(valstr, CameraProperties::SUPPORTED_WHITE_BALANCE)) {
                CAMHAL_LOGDB("White balance set %s", valstr);
                mParameters.set(android::CameraParameters::KEY_WHITE_BALANCE, valstr);
             } else {
@@ -904,7 +947,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
 #endif
 
         if ((valstr = params.get(android::CameraParameters::KEY_ANTIBANDING)) != NULL) {
-            if (isParameterValid(valstr, mCameraProperties->get(CameraProperties::SUPPORTED_ANTIBANDING))) {
+            if (!isParameterChanged(android::CameraParameters::KEY_ANTIBANDING) ||
+                isParameterValid(valstr, CameraProperties::SUPPORTED_ANTIBANDING)) {
                 CAMHAL_LOGDB("Antibanding set %s", valstr);
                 mParameters.set(android::CameraParameters::KEY_ANTIBANDING, valstr);
              } else {
@@ -915,7 +959,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
 
 #ifdef OMAP_ENHANCEMENT
         if ((valstr = params.get(TICameraParameters::KEY_ISO)) != NULL) {
-            if (isParameterValid(valstr, mCameraProperties->get(CameraProperties::SUPPORTED_ISO_VALUES))) {
+            if (!isParameterChanged(TICameraParameters::KEY_ISO) ||
+                isParameterValid(valstr, CameraProperties::SUPPORTED_ISO_VALUES)) {
                 CAMHAL_LOGDB("ISO set %s", valstr);
                 mParameters.set(TICameraParameters::KEY_ISO, valstr);
             } else {
@@ -960,7 +1005,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
             }
 
         if ((valstr = params.get(android::CameraParameters::KEY_SCENE_MODE)) != NULL) {
-            if (isParameterValid(valstr, mCameraProperties->get(CameraProperties::SUPPORTED_SCENE_MODES))) {
+            if (!isParameterChanged(android::CameraParameters::KEY_SCENE_MODE) ||
+                isParameterValid(valstr, CameraProperties::SUPPORTED_SCENE_MODES)) {
                 CAMHAL_LOGDB("Scene mode set %s", valstr);
                 doesSetParameterNeedUpdate(valstr,
                                            mParameters.get(android::CameraParameters::KEY_SCENE_MODE),
@@ -973,7 +1019,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
         }
 
         if ((valstr = params.get(android::CameraParameters::KEY_FLASH_MODE)) != NULL) {
-            if (isParameterValid(valstr, mCameraProperties->get(CameraProperties::SUPPORTED_FLASH_MODES))) {
+            if (!isParameterChanged(android::CameraParameters::KEY_FLASH_MODE) ||
+                isParameterValid(valstr, CameraProperties::SUPPORTED_FLASH_MODES)) {
                 CAMHAL_LOGDB("Flash mode set %s", valstr);
                 mParameters.set(android::CameraParameters::KEY_FLASH_MODE, valstr);
             } else {
@@ -983,7 +1030,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
         }
 
         if ((valstr = params.get(android::CameraParameters::KEY_EFFECT)) != NULL) {
-            if (isParameterValid(valstr, mCameraProperties->get(CameraProperties::SUPPORTED_EFFECTS))) {
+            if (!isParameterChanged(android::CameraParameters::KEY_EFFECT) ||
+                isParameterValid(valstr, CameraProperties::SUPPORTED_EFFECTS)) {
                 CAMHAL_LOGDB("Effect set %s", valstr);
                 mParameters.set(android::CameraParameters::KEY_EFFECT, valstr);
              } else {
@@ -1149,6 +1197,13 @@ int CameraHal::setParameters(const android::CameraParameters& params)
             mParameters.remove(TICameraParameters::KEY_EXP_BRACKETING_RANGE);
             }
 
+        if( (valstr = params.get(TICameraParameters::KEY_EXP_BRACKETING_MERGE)) != NULL ) {
+            CAMHAL_LOGDB("Exposure bracketing merge %s", valstr);
+            mParameters.set(TICameraParameters::KEY_EXP_BRACKETING_MERGE, valstr);
+        } else {
+            mParameters.remove(TICameraParameters::KEY_EXP_BRACKETING_MERGE);
+        }
+
         if( (valstr = params.get(TICameraParameters::KEY_ZOOM_BRACKETING_RANGE)) != NULL ) {
             CAMHAL_LOGDB("Zoom Bracketing range %s", valstr);
             mParameters.set(TICameraParameters::KEY_ZOOM_BRACKETING_RANGE, valstr);
@@ -1320,7 +1375,7 @@ int CameraHal::setParameters(const android::CameraParameters& params)
         if ( (NULL != mCameraAdapter) &&
              (mPreviewEnabled || updateRequired) &&
              (!(mPreviewEnabled && restartPreviewRequired)) ) {
-            ret |= mCameraAdapter->setParameters(adapterParams);
+            ret |= setAdapterParameters(adapterParams, true);
         }
 
 #ifdef OMAP_ENHANCEMENT
@@ -1348,6 +1403,8 @@ int CameraHal::setParameters(const android::CameraParameters& params)
     //On fail restore old parameters
     if ( NO_ERROR != ret ) {
         mParameters = oldParams;
+    } else {
+        mValidatedMode = validationMode;
     }
 
     // Restart Preview if needed by KEY_RECODING_HINT only if preview is already running.
@@ -1536,6 +1593,8 @@ status_t CameraHal::allocImageBufs(unsigned int width, unsigned int height, size
         return NO_ERROR;
     }
 
+    freeHeldImageBufs(false);
+
     if ( NO_ERROR == ret ) {
         bytes = ((bytes+4095)/4096)*4096;
         mImageBuffers = mMemoryManager->allocateBufferList(0, 0, previewFormat, bytes, bufferCount);
@@ -1565,6 +1624,79 @@ status_t CameraHal::allocImageBufs(unsigned int width, unsigned int height, size
     return ret;
 }
 
+bool CameraHal::capturePipelineEnabled() const
+{
+    const char *valstr = mParameters.get(TICameraParameters::KEY_CAPTURE_PIPELINE);
+
+    return valstr && !strcmp(valstr, android::CameraParameters::TRUE);
+}
+
+status_t CameraHal::prepareImageCapture()
+{
+    status_t ret = NO_ERROR;
+    CameraFrame frame;
+    const char *valstr = NULL;
+    unsigned int bufferCount = NO_BUFFERS_IMAGE_CAPTURE_PIPELINE;
+
+#if PPM_INSTRUMENTATION || PPM_INSTRUMENTATION_ABS
+
+    struct timeval prepareStart;
+    gettimeofday(&prepareStart, NULL);
+
+#endif
+
+    LOG_FUNCTION_NAME;
+
+    // burst, bracketing, raw, cpcam and tap-out shots size their buffers at
+    // takePicture time, only plain single shots are prepared ahead
+    valstr = mParameters.get(TICameraParameters::KEY_CAP_MODE);
+    if ( !capturePipelineEnabled() ||
+         (mCameraAdapter->getState() != CameraAdapter::PREVIEW_STATE) ||
+         mBufferSourceAdapter_Out.get() ||
+         (mParameters.getInt(TICameraParameters::KEY_BURST) > 0) ||
+         mBracketingEnabled || mRawCapture ||
+         (valstr && !strcmp(valstr, TICameraParameters::CP_CAM_MODE)) ) {
+        LOG_FUNCTION_NAME_EXIT;
+        return NO_ERROR;
+    }
+
+    // settings changes are applied here, so any stale buffers get
+    // released before we decide whether they can be reused
+    ret = mCameraAdapter->sendCommand(CameraAdapter::CAMERA_QUERY_BUFFER_SIZE_IMAGE_CAPTURE,
+                                      ( int ) &frame,
+                                      bufferCount);
+    if ( NO_ERROR != ret ) {
+        CAMHAL_LOGEB("CAMERA_QUERY_BUFFER_SIZE_IMAGE_CAPTURE returned error 0x%x", ret);
+        LOG_FUNCTION_NAME_EXIT;
+        return ret;
+    }
+
+    if ( (NULL != mImageBuffers) && (mImageCount != bufferCount) ) {
+        CAMHAL_LOGDB("%u capture buffers already allocated, not preparing", mImageCount);
+        LOG_FUNCTION_NAME_EXIT;
+        return NO_ERROR;
+    }
+
+    ret = allocImageBufs(frame.mAlignment / getBPP(mParameters.getPictureFormat()),
+                         frame.mHeight,
+                         frame.mLength,
+                         mParameters.getPictureFormat(),
+                         bufferCount);
+    if ( NO_ERROR != ret ) {
+        CAMHAL_LOGEB("allocImageBufs returned error 0x%x", ret);
+    }
+
+#if PPM_INSTRUMENTATION || PPM_INSTRUMENTATION_ABS
+
+    CameraHal::PPM("Capture buffers prepared: ", &prepareStart);
+
+#endif
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return ret;
+}
+
 status_t CameraHal::allocVideoBufs(uint32_t width, uint32_t height, uint32_t bufferCount)
 {
   status_t ret = NO_ERROR;
@@ -1715,6 +1847,8 @@ status_t CameraHal::freeImageBufs()
 
     LOG_FUNCTION_NAME;
 
+    freeHeldImageBufs(false);
+
     if (NULL == mImageBuffers) {
         return -EINVAL;
     }
@@ -1722,7 +1856,22 @@ status_t CameraHal::freeImageBufs()
     if (mBufferSourceAdapter_Out.get()) {
         mBufferSourceAdapter_Out = 0;
     } else {
-        ret = mMemoryManager->freeBufferList(mImageBuffers);
+        // In capture pipeline mode the shot ends before its buffer comes back,
+        // the JPEG encoder may still read it when the image port is released.
+        bool held = false;
+        for (unsigned int i = 0; i < mImageCount; i++) {
+            if (0 < android_atomic_acquire_load(&mImageBuffers[i].refCountTotal)) {
+                held = true;
+                break;
+            }
+        }
+
+        if (held) {
+            CAMHAL_LOGDA("Image buffers still held downstream, freeing them later");
+            mHeldImageBuffers.add(mImageBuffers, mImageCount);
+        } else {
+            ret = mMemoryManager->freeBufferList(mImageBuffers);
+        }
     }
 
     mImageBuffers = NULL;
@@ -1732,6 +1881,30 @@ status_t CameraHal::freeImageBufs()
     return ret;
 }
 
+void CameraHal::freeHeldImageBufs(bool force)
+{
+    LOG_FUNCTION_NAME;
+
+    for (size_t i = mHeldImageBuffers.size(); i > 0; i--) {
+        CameraBuffer *buffers = mHeldImageBuffers.keyAt(i - 1);
+        unsigned int count = mHeldImageBuffers.valueAt(i - 1);
+        bool held = false;
+
+        for (unsigned int j = 0; !force && (j < count); j++) {
+            if (0 < android_atomic_acquire_load(&buffers[j].refCountTotal)) {
+                held = true;
+            }
+        }
+
+        if (!held) {
+            mMemoryManager->freeBufferList(buffers);
+            mHeldImageBuffers.removeItemsAt(i - 1);
+        }
+    }
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
 status_t CameraHal::freeVideoBufs(CameraBuffer *bufs)
 {
   status_t ret = NO_ERROR;
@@ -1819,6 +1992,10 @@ status_t CameraHal::startPreview() {
     // calls startPreview twice or more.
     mPreviewInitializationDone = false;
 
+    char value[PROPERTY_VALUE_MAX];
+    property_get("camera.trace", value, "0");
+    FrameTrace::setEnabled(0 != atoi(value));
+
     ///Enable the display adapter if present, actual overlay enable happens when we post the buffer
     if(mDisplayAdapter.get() != NULL) {
         CAMHAL_LOGDA("Enabling display");
@@ -1861,6 +2038,10 @@ status_t CameraHal::startPreview() {
 
     mPreviewEnabled = true;
     mPreviewStartInProgress = false;
+
+    // a failure here isn't fatal, takePicture allocates whatever is missing
+    prepareImageCapture();
+
     return ret;
 
     error:
@@ -1918,7 +2099,7 @@ status_t CameraHal::cameraPreviewInitialization()
     }
 
     if ( NULL != mCameraAdapter ) {
-      ret = mCameraAdapter->setParameters(mParameters);
+      ret = setAdapterParameters(mParameters);
     }
 
     if ((mPreviewStartInProgress == false) && (mDisplayPaused == false)){
@@ -1967,6 +2148,7 @@ status_t CameraHal::cameraPreviewInitialization()
         }
 
         signalEndImageCapture();
+        prepareImageCapture();
         return ret;
         }
 
@@ -2462,6 +2644,10 @@ status_t CameraHal::releaseTapinLocked(struct preview_stream_ops *tapin)
         android::sp<DisplayAdapter> in;
         in = mInAdapters.itemAt(i);
         if (in->match(id)) {
+            // its buffers may still be registered with the camera
+            if (mReprocessSource == in) {
+                releaseReprocessSourceLocked();
+            }
             CAMHAL_LOGD("REMOVE tap in %p \"%s\" at position %d", tapin, id, i);
             mInAdapters.removeAt(i);
             break;
@@ -2474,6 +2660,27 @@ status_t CameraHal::releaseTapinLocked(struct preview_stream_ops *tapin)
 }
 
 
+/**
+   @brief Ends the reprocess session of the current reprocess tap in.
+
+   The camera adapter keeps the tap in buffers registered between reprocess
+   requests. They have to be let go of before the tap in frees them.
+
+ */
+void CameraHal::releaseReprocessSourceLocked()
+{
+    LOG_FUNCTION_NAME;
+
+    if (mReprocessSource.get()) {
+        if (NULL != mCameraAdapter) {
+            mCameraAdapter->sendCommand(CameraAdapter::CAMERA_RELEASE_BUFFERS_REPROCESS);
+        }
+        mReprocessSource.clear();
+    }
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
 /**
    @brief Sets ANativeWindow object.
 
@@ -2882,7 +3089,7 @@ status_t CameraHal::restartPreview()
         } else {
             mParameters.set(TICameraParameters::KEY_CAP_MODE, "");
         }
-        mCameraAdapter->setParameters(mParameters);
+        setAdapterParameters(mParameters);
     }
 
     ret = startPreview();
@@ -3069,7 +3276,7 @@ status_t CameraHal::cancelAutoFocus()
     if( NULL != mCameraAdapter )
     {
         adapterParams.set(TICameraParameters::KEY_AUTO_FOCUS_LOCK, android::CameraParameters::FALSE);
-        mCameraAdapter->setParameters(adapterParams);
+        setAdapterParameters(adapterParams);
         mCameraAdapter->sendCommand(CameraAdapter::CAMERA_CANCEL_AUTOFOCUS);
         mAppCallbackNotifier->flushEventQueue();
     }
@@ -3283,6 +3490,7 @@ status_t CameraHal::__takePicture(const char *params, struct timeval *captureSta
     bool isCPCamMode = false;
     android::sp<DisplayAdapter> outAdapter = 0;
     bool reuseTapout = false;
+    bool buffersPrepared = false;
 #ifdef MOTOROLA_CAMERA
     unsigned int intensity = DEFAULT_INTENSITY;
 #endif
@@ -3393,7 +3601,7 @@ status_t CameraHal::__takePicture(const char *params, struct timeval *captureSta
             }
         }
 
-        mCameraAdapter->setParameters(mParameters);
+        setAdapterParameters(mParameters);
     } else
 #endif
     {
@@ -3458,6 +3666,9 @@ status_t CameraHal::__takePicture(const char *params, struct timeval *captureSta
                  mAppCallbackNotifier->setBurst(false);
              }
          } else {
+             if ( capturePipelineEnabled() && !isCPCamMode && !mRawCapture && !outAdapter.get() ) {
+                 bufferCount = NO_BUFFERS_IMAGE_CAPTURE_PIPELINE;
+             }
              if ( NULL != mAppCallbackNotifier.get() ) {
                  mAppCallbackNotifier->setBurst(false);
              }
@@ -3545,6 +3756,7 @@ status_t CameraHal::__takePicture(const char *params, struct timeval *captureSta
             }
         } else {
             mBufferSourceAdapter_Out.clear();
+            buffersPrepared = (NULL != mImageBuffers);
             // allocImageBufs will only allocate new buffers if mImageBuffers is NULL
             if ( NO_ERROR == ret ) {
                 max_queueable = bufferCount;
@@ -3561,7 +3773,11 @@ status_t CameraHal::__takePicture(const char *params, struct timeval *captureSta
 
 #if PPM_INSTRUMENTATION || PPM_INSTRUMENTATION_ABS
 
-    CameraHal::PPM("Takepicture buffers allocated: ", &mStartCapture);
+    if ( buffersPrepared ) {
+        CameraHal::PPM("Takepicture prepared buffers reused: ", &mStartCapture);
+    } else {
+        CameraHal::PPM("Takepicture buffers allocated: ", &mStartCapture);
+    }
     memcpy(&mImageBuffers->ppmStamp, &mStartCapture, sizeof(struct timeval));
 
 #endif
@@ -3740,6 +3956,7 @@ status_t CameraHal::reprocess(const char *params)
     android::ShotParameters shotParams;
     const char *valStr = NULL;
     struct timeval startReprocess;
+    uint32_t generation = 0;
 
     android::AutoMutex lock(mLock);
 
@@ -3787,6 +4004,13 @@ status_t CameraHal::reprocess(const char *params)
         goto exit;
     }
 
+    // The adapter only matches buffers by address, so the session it keeps
+    // must not outlive the tap in or the buffers it was registered with
+    generation = mBufferSourceAdapter_In->getBufferGeneration();
+    if ((mReprocessSource != mBufferSourceAdapter_In) || (mReprocessGeneration != generation)) {
+        releaseReprocessSourceLocked();
+    }
+
 
 #if PPM_INSTRUMENTATION || PPM_INSTRUMENTATION_ABS
 
@@ -3819,6 +4043,9 @@ status_t CameraHal::reprocess(const char *params)
         goto exit;
     }
 
+    mReprocessSource = mBufferSourceAdapter_In;
+    mReprocessGeneration = generation;
+
 #if PPM_INSTRUMENTATION || PPM_INSTRUMENTATION_ABS
 
     CameraHal::PPM("Reprocess buffers registered: ", &startReprocess);
@@ -3901,6 +4128,9 @@ status_t CameraHal::sendCommand(int32_t cmd, int32_t arg1, int32_t arg2)
         return BAD_VALUE;
     }
 
+    // Commands can move the adapter away from the parameters it was given
+    mParametersDiff.invalidate();
+
     if ( NO_ERROR == ret )
         {
         switch(cmd)
@@ -4008,6 +4238,31 @@ status_t  CameraHal::dump(int fd) const
 {
     LOG_FUNCTION_NAME;
     ///Implement this method when the h/w dump function is supported on Ducati side
+
+    if ( NULL != mMemoryManager.get() ) {
+        mMemoryManager->dump(fd);
+    }
+
+    if ( NULL != mAppCallbackNotifier.get() ) {
+        mAppCallbackNotifier->dump(fd);
+    }
+
+    if ( NULL != mDisplayAdapter.get() ) {
+        mDisplayAdapter->dump(fd);
+    }
+
+#ifdef OMAP_ENHANCEMENT_CPCAM
+    for ( size_t i = 0; i < mOutAdapters.size(); i++ ) {
+        mOutAdapters.itemAt(i)->dump(fd);
+    }
+
+    for ( size_t i = 0; i < mInAdapters.size(); i++ ) {
+        mInAdapters.itemAt(i)->dump(fd);
+    }
+#endif
+
+    FrameTrace::dump(fd);
+
     return NO_ERROR;
 }
 
@@ -4055,6 +4310,7 @@ CameraHal::CameraHal(int cameraId)
     mMeasurementEnabled = false;
     mPreviewDataBuffers = NULL;
     mCameraProperties = NULL;
+    mValidatedMode = MODE_MAX;
     mCurrentTime = 0;
     mFalsePreview = 0;
     mImageOffsets = NULL;
@@ -4087,6 +4343,7 @@ CameraHal::CameraHal(int cameraId)
 
 #ifdef OMAP_ENHANCEMENT_CPCAM
     mExtendedPreviewStreamOps = 0;
+    mReprocessGeneration = 0;
 #endif
 
     //These values depends on the sensor characteristics
@@ -4143,6 +4400,8 @@ CameraHal::~CameraHal()
     }
 
     freeImageBufs();
+    // nothing is left downstream once the notifier and adapter are gone
+    freeHeldImageBufs(true);
     freeRawBufs();
 
     /// Free the memory manager
@@ -4186,6 +4445,8 @@ status_t CameraHal::initialize(CameraProperties::Properties* properties)
     // will only print if DEBUG macro is defined
     mCameraProperties->dump();
 
+    mCapabilityIndex.build(mCameraProperties);
+
     if (strcmp(CameraProperties::DEFAULT_VALUE, mCameraProperties->get(CameraProperties::CAMERA_SENSOR_INDEX)) != 0 )
         {
         sensor_index = atoi(mCameraProperties->get(CameraProperties::CAMERA_SENSOR_INDEX));
@@ -4199,6 +4460,11 @@ status_t CameraHal::initialize(CameraProperties::Properties* properties)
     if (strcmp(sensor_name, V4L_CAMERA_NAME_USB) == 0) {
 #ifdef V4L_CAMERA_ADAPTER
         mCameraAdapter = V4LCameraAdapter_Factory(sensor_index, this);
+#endif
+    }
+    else if (strcmp(sensor_name, SYNTHETIC_CAMERA_NAME) == 0) {
+#ifdef SYNTHETIC_CAMERA_ADAPTER
+        mCameraAdapter = SyntheticCameraAdapter_Factory(sensor_index);
 #endif
     }
     else {
@@ -4302,132 +4568,53 @@ status_t CameraHal::initialize(CameraProperties::Properties* properties)
 
 }
 
-bool CameraHal::isResolutionValid(unsigned int width, unsigned int height, const char *supportedResolutions)
+bool CameraHal::isResolutionValid(unsigned int width, unsigned int height, const char *capability)
 {
-    bool ret = false;
-    status_t status = NO_ERROR;
-    char tmpBuffer[MAX_PROP_VALUE_LENGTH];
-    char *pos = NULL;
-
-    LOG_FUNCTION_NAME;
-
-    if (NULL == supportedResolutions) {
-        CAMHAL_LOGEA("Invalid supported resolutions string");
-        goto exit;
-    }
-
-    status = snprintf(tmpBuffer, MAX_PROP_VALUE_LENGTH - 1, "%dx%d", width, height);
-    if (0 > status) {
-        CAMHAL_LOGEA("Error encountered while generating validation string");
-        goto exit;
-    }
-
-    ret = isParameterValid(tmpBuffer, supportedResolutions);
-
-exit:
-    LOG_FUNCTION_NAME_EXIT;
-
-    return ret;
+    return mCapabilityIndex.isResolutionSupported(capability, width, height);
 }
 
-bool CameraHal::isFpsRangeValid(int fpsMin, int fpsMax, const char *supportedFpsRanges)
+bool CameraHal::isFpsRangeValid(int fpsMin, int fpsMax, const char *capability)
 {
-    bool ret = false;
-    char supported[MAX_PROP_VALUE_LENGTH];
-    char *pos;
-    int suppFpsRangeArray[2];
-    int i = 0;
-
-    LOG_FUNCTION_NAME;
-
-    if ( NULL == supportedFpsRanges ) {
-        CAMHAL_LOGEA("Invalid supported FPS ranges string");
-        return false;
-    }
-
-    if (fpsMin <= 0 || fpsMax <= 0 || fpsMin > fpsMax) {
-        return false;
-    }
-
-    strncpy(supported, supportedFpsRanges, MAX_PROP_VALUE_LENGTH);
-    pos = strtok(supported, " (,)");
-    while (pos != NULL) {
-        suppFpsRangeArray[i] = atoi(pos);
-        if (i++) {
-            if (fpsMin >= suppFpsRangeArray[0] && fpsMax <= suppFpsRangeArray[1]) {
-                ret = true;
-                break;
-            }
-            i = 0;
-        }
-        pos = strtok(NULL, " (,)");
-    }
-
-    LOG_FUNCTION_NAME_EXIT;
-
-    return ret;
+    return mCapabilityIndex.isFpsRangeSupported(capability, fpsMin, fpsMax);
 }
 
-bool CameraHal::isParameterValid(const char *param, const char *supportedParams)
+bool CameraHal::isParameterValid(const char *param, const char *capability)
 {
-    bool ret = false;
-    char *pos;
-    char supported[MAX_PROP_VALUE_LENGTH];
-
-    LOG_FUNCTION_NAME;
-
-    if (NULL == supportedParams) {
-        CAMHAL_LOGEA("Invalid supported parameters string");
-        goto exit;
-    }
-
     if (NULL == param) {
         CAMHAL_LOGEA("Invalid parameter string");
-        goto exit;
-    }
-
-    strncpy(supported, supportedParams, MAX_PROP_VALUE_LENGTH - 1);
-
-    pos = strtok(supported, ",");
-    while (pos != NULL) {
-        if (!strcmp(pos, param)) {
-            ret = true;
-            break;
-        }
-        pos = strtok(NULL, ",");
+        return false;
     }
 
-exit:
-    LOG_FUNCTION_NAME_EXIT;
-
-    return ret;
+    return mCapabilityIndex.isValueSupported(capability, param);
 }
 
-bool CameraHal::isParameterValid(int param, const char *supportedParams)
+bool CameraHal::isParameterValid(int param, const char *capability)
 {
-    bool ret = false;
-    status_t status;
-    char tmpBuffer[MAX_PROP_VALUE_LENGTH];
+    return mCapabilityIndex.isValueSupported(capability, param);
+}
 
-    LOG_FUNCTION_NAME;
+bool CameraHal::isParameterChanged(const char *key) const
+{
+    return mParametersDiff.changed(key);
+}
 
-    if (NULL == supportedParams) {
-        CAMHAL_LOGEA("Invalid supported parameters string");
-        goto exit;
+status_t CameraHal::setAdapterParameters(const android::CameraParameters &params, bool skipUnchanged)
+{
+    // Only setParameters() skips sets it applied already, other callers
+    // just make sure the next one goes through
+    if ( !skipUnchanged ) {
+        mParametersDiff.invalidate();
+        return mCameraAdapter->setParameters(params);
     }
 
-    status = snprintf(tmpBuffer, MAX_PROP_VALUE_LENGTH - 1, "%d", param);
-    if (0 > status) {
-        CAMHAL_LOGEA("Error encountered while generating validation string");
-        goto exit;
+    if ( !mParametersDiff.anyChanged() ) {
+        CAMHAL_LOGDA("Adapter parameters unchanged");
+        return NO_ERROR;
     }
 
-    ret = isParameterValid(tmpBuffer, supportedParams);
+    mParametersDiff.applied();
 
-exit:
-    LOG_FUNCTION_NAME_EXIT;
-
-    return ret;
+    return mCameraAdapter->setParameters(params);
 }
 
 status_t CameraHal::doesSetParameterNeedUpdate(const char* new_param, const char* old_param, bool& update) {
@@ -4660,6 +4847,7 @@ void CameraHal::initDefaultParameters()
     p.set(android::CameraParameters::KEY_MAX_NUM_DETECTED_FACES_HW, mCameraProperties->get(CameraProperties::MAX_FD_HW_FACES));
     p.set(android::CameraParameters::KEY_MAX_NUM_DETECTED_FACES_SW, mCameraProperties->get(CameraProperties::MAX_FD_SW_FACES));
     p.set(TICameraParameters::KEY_MECHANICAL_MISALIGNMENT_CORRECTION, mCameraProperties->get(CameraProperties::MECHANICAL_MISALIGNMENT_CORRECTION));
+    p.set(TICameraParameters::KEY_CAPTURE_PIPELINE, android::CameraParameters::FALSE);
     // Only one area a.k.a Touch AF for now.
     // TODO: Add support for multiple focus areas.
     p.set(android::CameraParameters::KEY_MAX_NUM_FOCUS_AREAS, mCameraProperties->get(CameraProperties::MAX_FOCUS_AREAS));
@@ -4765,6 +4953,9 @@ void CameraHal::deinitialize()
 
     mBufferSourceAdapter_Out.clear();
     mBufferSourceAdapter_In.clear();
+#ifdef OMAP_ENHANCEMENT_CPCAM
+    mReprocessSource.clear();
+#endif
     mOutAdapters.clear();
     mInAdapters.clear();
 
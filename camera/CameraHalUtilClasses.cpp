@@ -120,7 +120,7 @@ status_t CameraArea::transfrom(size_t width,
                                size_t &top,
                                size_t &left,
                                size_t &areaWidth,
-                               size_t &areaHeight)
+                               size_t &areaHeight) const
 {
     status_t ret = NO_ERROR;
     size_t hRange, vRange;
@@ -196,44 +196,39 @@ status_t CameraArea::checkArea(ssize_t top,
 }
 
 status_t CameraArea::parseAreas(const char *area,
-                                size_t areaLength,
-                                android::Vector<android::sp<CameraArea> > &areas)
+                                CameraArea *areas,
+                                size_t maxAreas,
+                                size_t &count)
 {
     status_t ret = NO_ERROR;
-    char *ctx;
-    char *pArea = NULL;
-    char *pStart = NULL;
+    const char *pArea = NULL;
     char *pEnd = NULL;
-    const char *startToken = "(";
+    const char startToken = '(';
     const char endToken = ')';
     const char sep = ',';
     ssize_t top, left, bottom, right, weight;
-    char *tmpBuffer = NULL;
-    android::sp<CameraArea> currentArea;
 
     LOG_FUNCTION_NAME
 
-    if ( ( NULL == area ) ||
-         ( 0 >= areaLength ) )
+    count = 0;
+
+    if ( ( NULL == area ) || ( NULL == areas ) )
         {
         return -EINVAL;
         }
 
-    tmpBuffer = ( char * ) malloc(areaLength);
-    if ( NULL == tmpBuffer )
+    // Areas are the runs of characters between start tokens,
+    // anything following an end token is ignored
+    pArea = area;
+    while ( startToken == *pArea )
         {
-        return -ENOMEM;
+        pArea++;
         }
 
-    memcpy(tmpBuffer, area, areaLength);
-
-    pArea = strtok_r(tmpBuffer, startToken, &ctx);
-
     do
         {
 
-        pStart = pArea;
-        if ( NULL == pStart )
+        if ( '\0' == *pArea )
             {
             CAMHAL_LOGEA("Parsing of the left area coordinate failed!");
             ret = -EINVAL;
@@ -241,7 +236,7 @@ status_t CameraArea::parseAreas(const char *area,
             }
         else
             {
-            left = static_cast<ssize_t>(strtol(pStart, &pEnd, 10));
+            left = static_cast<ssize_t>(strtol(pArea, &pEnd, 10));
             }
 
         if ( sep != *pEnd )
@@ -300,62 +295,142 @@ status_t CameraArea::parseAreas(const char *area,
             break;
         }
 
-        currentArea = new CameraArea(top, left, bottom, right, weight);
+        if ( maxAreas <= count )
+            {
+            CAMHAL_LOGEB("More than %d areas", ( int ) maxAreas);
+            ret = -EINVAL;
+            break;
+            }
+
+        areas[count++] = CameraArea(top, left, bottom, right, weight);
         CAMHAL_LOGDB("Area parsed [%dx%d, %dx%d] %d",
                      ( int ) top,
                      ( int ) left,
                      ( int ) bottom,
                      ( int ) right,
                      ( int ) weight);
-        if ( NULL != currentArea.get() )
-            {
-            areas.add(currentArea);
-            }
-        else
+
+        pArea = strchr(pEnd, startToken);
+        if ( NULL != pArea )
             {
-            ret = -ENOMEM;
-            break;
+            while ( startToken == *pArea )
+                {
+                pArea++;
+                }
             }
 
-        pArea = strtok_r(NULL, startToken, &ctx);
-
-        }
-    while ( NULL != pArea );
-
-    if ( NULL != tmpBuffer )
-        {
-        free(tmpBuffer);
         }
+    while ( ( NULL != pArea ) && ( '\0' != *pArea ) );
 
     LOG_FUNCTION_NAME_EXIT
 
     return ret;
 }
 
-bool CameraArea::areAreasDifferent(android::Vector< android::sp<CameraArea> > &area1,
-                                    android::Vector< android::sp<CameraArea> > &area2) {
-    if (area1.size() != area2.size()) {
-        return true;
+bool CameraArea::compare(const CameraArea &area) const {
+    return ((mTop == area.mTop) && (mLeft == area.mLeft) &&
+            (mBottom == area.mBottom) && (mRight == area.mRight) &&
+            (mWeight == area.mWeight));
+}
+
+uint64_t CameraAreas::hash(const char *area, size_t &length)
+{
+    // 64-bit FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    const char *pos = area;
+
+    while ( '\0' != *pos ) {
+        hash ^= static_cast<uint8_t>(*pos++);
+        hash *= 1099511628211ULL;
+    }
+
+    length = pos - area;
+
+    return hash;
+}
+
+status_t CameraAreas::parse(const char *area, bool &changed)
+{
+    status_t ret = NO_ERROR;
+    CameraArea areas[MAX_AREAS];
+    size_t count = 0;
+    uint64_t areaHash;
+    size_t length;
+
+    changed = false;
+
+    if ( NULL == area ) {
+        return -EINVAL;
+    }
+
+    areaHash = hash(area, length);
+    if ( mHashValid && ( areaHash == mHash ) && ( length == mLength ) ) {
+        return NO_ERROR;
+    }
+
+    ret = CameraArea::parseAreas(area, areas, MAX_AREAS, count);
+    if ( NO_ERROR != ret ) {
+        return ret;
     }
 
-    // not going to care about sorting order for now
-    for (int i = 0; i < area1.size(); i++) {
-        if (!area1.itemAt(i)->compare(area2.itemAt(i))) {
-            return true;
+    if ( count != mCount ) {
+        changed = true;
+    } else {
+        // not going to care about sorting order for now
+        for ( size_t i = 0; i < count; i++ ) {
+            if ( !areas[i].compare(mAreas[i]) ) {
+                changed = true;
+                break;
+            }
         }
     }
 
-    return false;
+    if ( changed ) {
+        for ( size_t i = 0; i < count; i++ ) {
+            mAreas[i] = areas[i];
+        }
+        mCount = count;
+    }
+
+    mHash = areaHash;
+    mLength = length;
+    mHashValid = true;
+
+    return ret;
 }
 
-bool CameraArea::compare(const android::sp<CameraArea> &area) {
-    return ((mTop == area->mTop) && (mLeft == area->mLeft) &&
-            (mBottom == area->mBottom) && (mRight == area->mRight) &&
-            (mWeight == area->mWeight));
+void CameraAreas::clear()
+{
+    mCount = 0;
+    mHashValid = false;
 }
 
 
 /*--------------------CameraArea Class ENDS here-----------------------------*/
 
+/*--------------------CameraMetadataResultPool Class STARTS here-----------------------------*/
+
+android::sp<CameraMetadataResult> CameraMetadataResultPool::acquire()
+{
+    for ( size_t i = 0; i < POOL_SIZE; i++ ) {
+        if ( NULL == mResults[i].get() ) {
+            mResults[i] = new (std::nothrow) CameraMetadataResult;
+            return mResults[i];
+        }
+
+        // Only referenced by the pool
+        if ( 1 == mResults[i]->getStrongCount() ) {
+            mResults[i]->reset();
+            return mResults[i];
+        }
+    }
+
+    CAMHAL_LOGVA("Metadata result pool exhausted");
+
+    return new (std::nothrow) CameraMetadataResult;
+}
+
+/*--------------------CameraMetadataResultPool Class ENDS here-----------------------------*/
+
 } // namespace Camera
 } // namespace Ti
@@ -22,10 +22,27 @@
 */
 
 #include "CameraProperties.h"
+#ifdef CAMERAHAL_USE_RAW_IMAGE_SAVING
+#include "CameraHal.h"
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/Vector.h>
 
 #define CAMERA_ROOT         "CameraRoot"
 #define CAMERA_INSTANCE     "CameraInstance"
 
+#define CAPS_CACHE_FILE     "/data/misc/camera/capabilities.bin"
+#define CAPS_CACHE_MAGIC    0x50434954 // "TICP"
+// bump whenever the layout of the cache changes
+#define CAPS_CACHE_VERSION  3
+#define DUCATI_FIRMWARE_FILE "/vendor/firmware/ducati-m3.bin"
+// DCC file ID, versions and sizes, the use cases follow
+#define DCC_HEADER_SIZE     80
+
 namespace Ti {
 namespace Camera {
 
@@ -39,6 +56,366 @@ static const char* g_camera_adapters[] = {
 #endif
 };
 
+/*********************************************************
+ Capability cache
+**********************************************************/
+
+// Capabilities only change with the camera firmware, the DCC tuning files
+// or the software build, so that is what the cache is keyed on. Checking
+// the key only takes a few stat() calls and DCC header reads, the OMX camera
+// is probed when the key changes.
+struct CapsCacheKey {
+    int64_t firmwareSize;
+    int64_t firmwareTime;
+    int64_t dccSize;
+    uint32_t dccHeaders;
+    uint32_t dccFiles;
+    char fingerprint[PROPERTY_VALUE_MAX];
+};
+
+struct CapsCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;      // of the whole file
+    uint32_t checksum;  // of everything after the header
+    uint32_t cameras;
+    uint32_t modes;
+    CapsCacheKey key;
+};
+
+// Followed by, for each camera: the current mode, then for each mode the
+// number of properties and the properties as key and value lengths, then
+// key and value null terminated.
+
+static bool cacheEnabled()
+{
+#ifdef V4L_CAMERA_ADAPTER
+    // USB cameras come and go, always probe them
+    return false;
+#else
+    char value[PROPERTY_VALUE_MAX];
+    property_get("camera.caps.cache", value, "1");
+    return atoi(value) != 0;
+#endif
+}
+
+static uint32_t cacheChecksum(const uint8_t *data, size_t size)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for ( size_t i = 0; i < size; i++ ) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Adds up the files of every DCC URI directory, the same files
+// DCCHandler hands to the camera. DccDataWriter saves tuning results into
+// the use cases of these files in place after every session, so their
+// times and contents can't be used. Only the sizes and the headers, which
+// identify the sensor module and the DCC version, are.
+static void getDccKey(CapsCacheKey &key)
+{
+    DIR *root = opendir(DCC_FILES_PATH);
+    if ( NULL == root ) {
+        return;
+    }
+
+    struct dirent *entry;
+    while ( (entry = readdir(root)) != NULL ) {
+        if ( entry->d_name[0] == '.' ) {
+            continue;
+        }
+
+        android::String8 dirPath(DCC_FILES_PATH);
+        dirPath.append(entry->d_name);
+#ifdef CAMERAHAL_USE_RAW_IMAGE_SAVING
+        // image dumps share the directory on some targets
+        if ( (dirPath == kRawImagesOutputDirPath) || (dirPath == kYuvImagesOutputDirPath) ) {
+            continue;
+        }
+#endif
+
+        DIR *dir = opendir(dirPath.string());
+        if ( NULL == dir ) {
+            continue;
+        }
+
+        struct dirent *file;
+        while ( (file = readdir(dir)) != NULL ) {
+            struct stat st;
+            android::String8 filePath(dirPath);
+            filePath.append("/");
+            filePath.append(file->d_name);
+            if ( (file->d_name[0] == '.') || (stat(filePath.string(), &st) != 0) ||
+                 !S_ISREG(st.st_mode) ) {
+                continue;
+            }
+
+            key.dccFiles++;
+            key.dccSize += st.st_size;
+
+            FILE *dcc = fopen(filePath.string(), "rb");
+            if ( NULL != dcc ) {
+                uint8_t header[DCC_HEADER_SIZE];
+                size_t length = fread(header, 1, sizeof(header), dcc);
+                // summed, the directory order doesn't matter
+                key.dccHeaders += cacheChecksum(header, length);
+                fclose(dcc);
+            }
+        }
+        closedir(dir);
+    }
+    closedir(root);
+}
+
+static void getCacheKey(CapsCacheKey &key)
+{
+    char firmware[PROPERTY_VALUE_MAX];
+    struct stat st;
+
+    memset(&key, 0, sizeof(key));
+
+    property_get("camera.caps.firmware", firmware, DUCATI_FIRMWARE_FILE);
+    if ( 0 == stat(firmware, &st) ) {
+        key.firmwareSize = st.st_size;
+        key.firmwareTime = st.st_mtime;
+    }
+
+    getDccKey(key);
+
+    property_get("ro.build.fingerprint", key.fingerprint, "");
+}
+
+static bool readCacheWord(const uint8_t *&pos, const uint8_t *end, uint32_t &value)
+{
+    if ( (size_t)(end - pos) < sizeof(value) ) {
+        return false;
+    }
+    memcpy(&value, pos, sizeof(value));
+    pos += sizeof(value);
+    return true;
+}
+
+static void appendCacheWord(android::Vector<uint8_t> &data, uint32_t value)
+{
+    data.appendArray(reinterpret_cast<const uint8_t *>(&value), sizeof(value));
+}
+
+static void appendCacheString(android::Vector<uint8_t> &data, const char *str, size_t len)
+{
+    data.appendArray(reinterpret_cast<const uint8_t *>(str), len + 1);
+}
+
+// Writes the cache off the camera service startup path. The file is
+// replaced atomically, so a reader never sees half of it.
+class CameraProperties::CacheWriter : public android::Thread
+{
+public:
+    CacheWriter(const android::Vector<uint8_t> &data) : android::Thread(false), mData(data) {}
+
+    virtual bool threadLoop()
+    {
+        const char *tmpFile = CAPS_CACHE_FILE ".tmp";
+        const uint8_t *pos = mData.array();
+        size_t remaining = mData.size();
+
+        int fd = open(tmpFile, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+        if ( fd < 0 ) {
+            CAMHAL_LOGE("Couldn't create %s: %s", tmpFile, strerror(errno));
+            return false;
+        }
+
+        while ( remaining > 0 ) {
+            ssize_t written = write(fd, pos, remaining);
+            if ( written < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                break;
+            }
+            pos += written;
+            remaining -= written;
+        }
+
+        if ( (remaining > 0) || (fsync(fd) != 0) ) {
+            CAMHAL_LOGE("Couldn't write %s: %s", tmpFile, strerror(errno));
+            close(fd);
+            unlink(tmpFile);
+            return false;
+        }
+        close(fd);
+
+        if ( rename(tmpFile, CAPS_CACHE_FILE) != 0 ) {
+            CAMHAL_LOGE("Couldn't rename %s: %s", tmpFile, strerror(errno));
+            unlink(tmpFile);
+            return false;
+        }
+
+        CAMHAL_LOGD("Saved %d bytes of capabilities to %s", (int)mData.size(), CAPS_CACHE_FILE);
+        return false;
+    }
+
+private:
+    android::Vector<uint8_t> mData;
+};
+
+status_t CameraProperties::loadCache()
+{
+    LOG_FUNCTION_NAME;
+
+    struct stat st;
+    int fd = open(CAPS_CACHE_FILE, O_RDONLY);
+    if ( fd < 0 ) {
+        CAMHAL_LOGD("No capability cache");
+        return NAME_NOT_FOUND;
+    }
+
+    if ( (fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(CapsCacheHeader)) ) {
+        close(fd);
+        return BAD_VALUE;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( MAP_FAILED == data ) {
+        CAMHAL_LOGE("Couldn't map %s: %s", CAPS_CACHE_FILE, strerror(errno));
+        return UNKNOWN_ERROR;
+    }
+
+    status_t ret = parseCache(static_cast<const uint8_t *>(data), st.st_size);
+    munmap(data, st.st_size);
+
+    if ( NO_ERROR != ret ) {
+        // leave nothing half loaded behind for the probe
+        mCamerasSupported = 0;
+        for ( int i = 0; i < MAX_CAMERAS_SUPPORTED; i++ ) {
+            mCameraProps[i] = Properties();
+        }
+    }
+
+    LOG_FUNCTION_NAME_EXIT;
+    return ret;
+}
+
+status_t CameraProperties::parseCache(const uint8_t *data, size_t size)
+{
+    CapsCacheHeader header;
+    CapsCacheKey key;
+
+    memcpy(&header, data, sizeof(header));
+    getCacheKey(key);
+
+    if ( (header.magic != CAPS_CACHE_MAGIC) || (header.version != CAPS_CACHE_VERSION) ||
+         (header.size != size) || (header.modes != MODE_MAX) ||
+         (header.cameras == 0) || (header.cameras > MAX_CAMERAS_SUPPORTED) ) {
+        CAMHAL_LOGD("Capability cache has an old format");
+        return BAD_VALUE;
+    }
+
+    if ( memcmp(&header.key, &key, sizeof(key)) != 0 ) {
+        CAMHAL_LOGD("Camera firmware, DCC files or build changed, capability cache is stale");
+        return BAD_VALUE;
+    }
+
+    if ( cacheChecksum(data + sizeof(header), size - sizeof(header)) != header.checksum ) {
+        CAMHAL_LOGE("Capability cache is corrupted");
+        return BAD_VALUE;
+    }
+
+    const uint8_t *pos = data + sizeof(header);
+    const uint8_t *end = data + size;
+
+    for ( uint32_t camera = 0; camera < header.cameras; camera++ ) {
+        Properties &props = mCameraProps[camera];
+        uint32_t currentMode;
+
+        if ( !readCacheWord(pos, end, currentMode) || (currentMode >= MODE_MAX) ) {
+            return BAD_VALUE;
+        }
+
+        for ( int mode = 0; mode < MODE_MAX; mode++ ) {
+            uint32_t count;
+            if ( !readCacheWord(pos, end, count) ) {
+                return BAD_VALUE;
+            }
+
+            props.mProperties[mode].clear();
+            for ( uint32_t i = 0; i < count; i++ ) {
+                uint32_t keyLen, valueLen;
+                if ( !readCacheWord(pos, end, keyLen) || !readCacheWord(pos, end, valueLen) ||
+                     ((size_t)(end - pos) < (size_t)keyLen + valueLen + 2) ||
+                     (pos[keyLen] != 0) || (pos[keyLen + 1 + valueLen] != 0) ) {
+                    return BAD_VALUE;
+                }
+
+                const char *name = reinterpret_cast<const char *>(pos);
+                const char *value = name + keyLen + 1;
+                props.mProperties[mode].add(android::String8(name, keyLen),
+                                            android::String8(value, valueLen));
+                pos += keyLen + valueLen + 2;
+            }
+        }
+
+        props.setMode(static_cast<OperatingMode>(currentMode));
+    }
+
+    if ( pos != end ) {
+        return BAD_VALUE;
+    }
+
+    mCamerasSupported = header.cameras;
+    return NO_ERROR;
+}
+
+void CameraProperties::saveCache()
+{
+    LOG_FUNCTION_NAME;
+
+    android::Vector<uint8_t> data;
+    CapsCacheHeader header;
+
+    memset(&header, 0, sizeof(header));
+    data.appendArray(reinterpret_cast<const uint8_t *>(&header), sizeof(header));
+
+    for ( int camera = 0; camera < mCamerasSupported; camera++ ) {
+        const Properties &props = mCameraProps[camera];
+
+        appendCacheWord(data, props.getMode());
+        for ( int mode = 0; mode < MODE_MAX; mode++ ) {
+            const android::DefaultKeyedVector<android::String8, android::String8> &values = props.mProperties[mode];
+
+            appendCacheWord(data, values.size());
+            for ( size_t i = 0; i < values.size(); i++ ) {
+                const android::String8 &name = values.keyAt(i);
+                const android::String8 &value = values.valueAt(i);
+                appendCacheWord(data, name.length());
+                appendCacheWord(data, value.length());
+                appendCacheString(data, name.string(), name.length());
+                appendCacheString(data, value.string(), value.length());
+            }
+        }
+    }
+
+    header.magic = CAPS_CACHE_MAGIC;
+    header.version = CAPS_CACHE_VERSION;
+    header.size = data.size();
+    header.checksum = cacheChecksum(data.array() + sizeof(header), data.size() - sizeof(header));
+    header.cameras = mCamerasSupported;
+    header.modes = MODE_MAX;
+    getCacheKey(header.key);
+    memcpy(data.editArray(), &header, sizeof(header));
+
+    mCacheWriter = new CacheWriter(data);
+    if ( NO_ERROR != mCacheWriter->run("CameraCapsCache") ) {
+        CAMHAL_LOGE("Couldn't start capability cache writer");
+        mCacheWriter.clear();
+    }
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
 /*********************************************************
  CameraProperties - public function implemetation
 **********************************************************/
@@ -97,6 +474,12 @@ status_t CameraProperties::loadProperties()
     //Must be re-initialized here, since loadProperties() could potentially be called more than once.
     mCamerasSupported = 0;
 
+    if ( cacheEnabled() && (NO_ERROR == loadCache()) ) {
+        CAMHAL_LOGI("num_cameras = %d, loaded from %s", mCamerasSupported, CAPS_CACHE_FILE);
+        LOG_FUNCTION_NAME_EXIT;
+        return NO_ERROR;
+    }
+
     // adapter updates capabilities and we update camera count
     const status_t err = CameraAdapter_Capabilities(mCameraProps, mCamerasSupported,
             MAX_CAMERAS_SUPPORTED, mCamerasSupported);
@@ -117,6 +500,10 @@ status_t CameraProperties::loadProperties()
             mCameraProps[i].setSensorIndex(i);
             mCameraProps[i].dump();
         }
+
+        if ( cacheEnabled() ) {
+            saveCache();
+        }
     }
 
     CAMHAL_LOGV("mCamerasSupported = %d", mCamerasSupported);
@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file CapabilityIndex.cpp
+*
+* Capability lookups and parameter diff used by CameraHal::setParameters.
+*
+*/
+
+#include "CapabilityIndex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace Ti {
+namespace Camera {
+
+const CapabilityIndex::Capability CapabilityIndex::kCapabilities[] = {
+    { CameraProperties::SUPPORTED_PREVIEW_FORMATS, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_PICTURE_FORMATS, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_IPP_MODES, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_FOCUS_MODES, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_EXPOSURE_MODES, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_WHITE_BALANCE, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_ANTIBANDING, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_ISO_VALUES, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_SCENE_MODES, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_FLASH_MODES, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_EFFECTS, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_PREVIEW_FRAME_RATES, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_PREVIEW_FRAME_RATES_EXT, ENTRY_VALUES },
+    { CameraProperties::SUPPORTED_PREVIEW_SIZES, ENTRY_RESOLUTIONS },
+    { CameraProperties::SUPPORTED_PREVIEW_SUBSAMPLED_SIZES, ENTRY_RESOLUTIONS },
+    { CameraProperties::SUPPORTED_PREVIEW_SIDEBYSIDE_SIZES, ENTRY_RESOLUTIONS },
+    { CameraProperties::SUPPORTED_PREVIEW_TOPBOTTOM_SIZES, ENTRY_RESOLUTIONS },
+    { CameraProperties::SUPPORTED_PICTURE_SIZES, ENTRY_RESOLUTIONS },
+    { CameraProperties::SUPPORTED_PICTURE_SUBSAMPLED_SIZES, ENTRY_RESOLUTIONS },
+    { CameraProperties::SUPPORTED_PICTURE_SIDEBYSIDE_SIZES, ENTRY_RESOLUTIONS },
+    { CameraProperties::SUPPORTED_PICTURE_TOPBOTTOM_SIZES, ENTRY_RESOLUTIONS },
+    { CameraProperties::FRAMERATE_RANGE_SUPPORTED, ENTRY_FPS_RANGES },
+    { CameraProperties::FRAMERATE_RANGE_EXT_SUPPORTED, ENTRY_FPS_RANGES },
+};
+
+const int CapabilityIndex::kCapabilityCount = sizeof(kCapabilities) / sizeof(kCapabilities[0]);
+
+CapabilityIndex::CapabilityIndex() : mProperties(NULL)
+{
+}
+
+void CapabilityIndex::build(CameraProperties::Properties *properties)
+{
+    LOG_FUNCTION_NAME;
+
+    CAMHAL_ASSERT(kCapabilityCount <= MAX_CAPABILITIES);
+
+    mProperties = properties;
+
+    const OperatingMode currentMode = properties->getMode();
+    for ( int mode = 0; mode < MODE_MAX; mode++ ) {
+        properties->setMode(static_cast<OperatingMode>(mode));
+
+        for ( int i = 0; i < kCapabilityCount; i++ ) {
+            Entry &entry = mEntries[mode][i];
+            const char *list = properties->get(kCapabilities[i].key);
+
+            entry.hashes.clear();
+            entry.values.clear();
+            entry.resolutions.clear();
+            entry.ranges.clear();
+
+            if ( NULL == list ) {
+                continue;
+            }
+
+            switch ( kCapabilities[i].type ) {
+                case ENTRY_VALUES:
+                    parseValues(list, entry);
+                    break;
+                case ENTRY_RESOLUTIONS:
+                    parseResolutions(list, entry);
+                    break;
+                case ENTRY_FPS_RANGES:
+                    parseFpsRanges(list, entry);
+                    break;
+            }
+        }
+    }
+    properties->setMode(currentMode);
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+uint32_t CapabilityIndex::hash(const char *value, size_t length)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for ( size_t i = 0; i < length; i++ ) {
+        h ^= (uint8_t)value[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void CapabilityIndex::parseValues(const char *list, Entry &entry)
+{
+    const char *pos = list;
+
+    while ( *pos ) {
+        const char *end = strchr(pos, ',');
+        const size_t length = end ? (size_t)(end - pos) : strlen(pos);
+
+        if ( length > 0 ) {
+            const uint32_t h = hash(pos, length);
+            size_t index = 0;
+            while ( (index < entry.hashes.size()) && (entry.hashes[index] <= h) ) {
+                index++;
+            }
+            entry.hashes.insertAt(h, index);
+            entry.values.insertAt(android::String8(pos, length), index);
+        }
+
+        if ( !end ) {
+            break;
+        }
+        pos = end + 1;
+    }
+}
+
+void CapabilityIndex::parseResolutions(const char *list, Entry &entry)
+{
+    const char *pos = list;
+
+    while ( *pos ) {
+        char *end = NULL;
+        const long width = strtol(pos, &end, 10);
+        if ( (end != pos) && (*end == 'x') ) {
+            const char *heightPos = end + 1;
+            const long height = strtol(heightPos, &end, 10);
+            if ( (end != heightPos) && ((*end == ',') || (*end == '\0')) &&
+                 (width > 0) && (width <= 0xFFFF) && (height > 0) && (height <= 0xFFFF) ) {
+                const uint32_t resolution = (uint32_t)width << 16 | (uint32_t)height;
+                size_t index = 0;
+                while ( (index < entry.resolutions.size()) && (entry.resolutions[index] < resolution) ) {
+                    index++;
+                }
+                entry.resolutions.insertAt(resolution, index);
+            }
+        }
+
+        const char *next = strchr(pos, ',');
+        if ( !next ) {
+            break;
+        }
+        pos = next + 1;
+    }
+}
+
+void CapabilityIndex::parseFpsRanges(const char *list, Entry &entry)
+{
+    // (min,max),(min,max)...
+    const char *pos = list;
+
+    while ( (pos = strchr(pos, '(')) != NULL ) {
+        FpsRange range;
+        if ( sscanf(pos, "(%d,%d)", &range.min, &range.max) == 2 ) {
+            entry.ranges.push_back(range);
+        }
+        pos++;
+    }
+}
+
+const CapabilityIndex::Entry *CapabilityIndex::find(const char *capability, EntryType type) const
+{
+    if ( (NULL == mProperties) || (NULL == capability) ) {
+        return NULL;
+    }
+
+    // callers normally pass the CameraProperties keys themselves
+    int index = -1;
+    for ( int i = 0; (i < kCapabilityCount) && (index < 0); i++ ) {
+        if ( kCapabilities[i].key == capability ) {
+            index = i;
+        }
+    }
+    for ( int i = 0; (i < kCapabilityCount) && (index < 0); i++ ) {
+        if ( strcmp(kCapabilities[i].key, capability) == 0 ) {
+            index = i;
+        }
+    }
+
+    if ( index < 0 ) {
+        CAMHAL_LOGEB("%s is not indexed", capability);
+        return NULL;
+    }
+
+    if ( kCapabilities[index].type != type ) {
+        CAMHAL_LOGEB("%s is not indexed as this type of list", capability);
+        return NULL;
+    }
+
+    return &mEntries[mProperties->getMode()][index];
+}
+
+bool CapabilityIndex::isValueSupported(const char *capability, const char *value) const
+{
+    const Entry *entry = find(capability, ENTRY_VALUES);
+
+    if ( (NULL == entry) || (NULL == value) ) {
+        return false;
+    }
+
+    const uint32_t h = hash(value, strlen(value));
+
+    // first hash not below h
+    size_t low = 0, high = entry->hashes.size();
+    while ( low < high ) {
+        const size_t mid = (low + high) / 2;
+        if ( entry->hashes[mid] < h ) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    for ( size_t i = low; (i < entry->hashes.size()) && (entry->hashes[i] == h); i++ ) {
+        if ( strcmp(entry->values[i].string(), value) == 0 ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CapabilityIndex::isValueSupported(const char *capability, int value) const
+{
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%d", value);
+    return isValueSupported(capability, buffer);
+}
+
+bool CapabilityIndex::isResolutionSupported(const char *capability, unsigned int width, unsigned int height) const
+{
+    const Entry *entry = find(capability, ENTRY_RESOLUTIONS);
+
+    if ( (NULL == entry) || (width > 0xFFFF) || (height > 0xFFFF) ) {
+        return false;
+    }
+
+    const uint32_t resolution = width << 16 | height;
+    size_t low = 0, high = entry->resolutions.size();
+    while ( low < high ) {
+        const size_t mid = (low + high) / 2;
+        if ( entry->resolutions[mid] < resolution ) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return (low < entry->resolutions.size()) && (entry->resolutions[low] == resolution);
+}
+
+bool CapabilityIndex::isFpsRangeSupported(const char *capability, int fpsMin, int fpsMax) const
+{
+    const Entry *entry = find(capability, ENTRY_FPS_RANGES);
+
+    if ( (NULL == entry) || (fpsMin <= 0) || (fpsMax <= 0) || (fpsMin > fpsMax) ) {
+        return false;
+    }
+
+    for ( size_t i = 0; i < entry->ranges.size(); i++ ) {
+        if ( (fpsMin >= entry->ranges[i].min) && (fpsMax <= entry->ranges[i].max) ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ParametersDiff::compute(const android::CameraParameters &oldParams,
+                             const android::CameraParameters &newParams,
+                             const android::String8 *source)
+{
+    mOld = oldParams;
+    mNew = newParams;
+    mSource = ( NULL != source ) ? *source : android::String8();
+    mAllChanged = false;
+}
+
+void ParametersDiff::invalidate()
+{
+    mAllChanged = true;
+    mAppliedSource = android::String8();
+}
+
+bool ParametersDiff::anyChanged() const
+{
+    return mAllChanged || mSource.isEmpty() || (mSource != mAppliedSource);
+}
+
+void ParametersDiff::applied()
+{
+    mAppliedSource = mSource;
+}
+
+bool ParametersDiff::changed(const char *key) const
+{
+    if ( mAllChanged ) {
+        return true;
+    }
+
+    const char *oldValue = mOld.get(key);
+    const char *newValue = mNew.get(key);
+
+    if ( (NULL == oldValue) || (NULL == newValue) ) {
+        return oldValue != newValue;
+    }
+
+    return strcmp(oldValue, newValue) != 0;
+}
+
+} // namespace Camera
+} // namespace Ti
@@ -22,6 +22,10 @@ extern "C" {
 }
 
 #define NUM_COMPONENTS_IN_YUV 3
+// lines of a component in one iMCU row: up to 4 (sampling) x 16 (scaled DCT)
+#define MAX_IMCU_ROWS 64
+// use the faster, less accurate DCT from 720p up
+#define FAST_DCT_MIN_AREA (1280 * 720)
 
 namespace Ti {
 namespace Camera {
@@ -128,17 +132,31 @@ libjpeg_source_mgr::~libjpeg_source_mgr() {}
 
 Decoder_libjpeg::Decoder_libjpeg()
 {
+    mInfo = NULL;
+    mError = NULL;
+    mTablesChecked = false;
+    mOutWidth = 0;
+    mOutHeight = 0;
     mWidth = 0;
     mHeight = 0;
     Y_Plane = NULL;
     U_Plane = NULL;
     V_Plane = NULL;
     UV_Plane = NULL;
+    mPadRow = NULL;
 }
 
 Decoder_libjpeg::~Decoder_libjpeg()
 {
     release();
+
+    if (mInfo) {
+        jpeg_destroy_decompress(mInfo);
+        delete mInfo;
+        mInfo = NULL;
+    }
+    delete mError;
+    mError = NULL;
 }
 
 void Decoder_libjpeg::release()
@@ -159,6 +177,9 @@ void Decoder_libjpeg::release()
         free(UV_Plane);
         UV_Plane = NULL;
     }
+    mPadRow = NULL;
+    mWidth = 0;
+    mHeight = 0;
 }
 
 int Decoder_libjpeg::readDHTSize()
@@ -200,98 +221,204 @@ int Decoder_libjpeg::appendDHT(unsigned char *jpeg_src, int filled_len, unsigned
 }
 
 
+void Decoder_libjpeg::startStream(unsigned int out_width, unsigned int out_height)
+{
+    if (NULL == mInfo) {
+        mInfo = new jpeg_decompress_struct;
+        mError = new jpeg_error_mgr;
+        mInfo->err = jpeg_std_error(mError);
+    } else {
+        // forget the tables of the previous stream
+        jpeg_destroy_decompress(mInfo);
+    }
+    jpeg_create_decompress(mInfo);
+
+    mOutWidth = out_width;
+    mOutHeight = out_height;
+    mTablesChecked = false;
+}
+
+bool Decoder_libjpeg::loadDefaultTables()
+{
+    /* Feed the tables as an abbreviated datastream, libjpeg keeps them for the following images */
+    unsigned char tables[sizeof(jpeg_odml_dht) + 2];
+    memcpy(tables, jpeg_odml_dht, sizeof(jpeg_odml_dht));
+    tables[sizeof(jpeg_odml_dht)] = 0xff; /* End of Image */
+    tables[sizeof(jpeg_odml_dht) + 1] = 0xd9;
+
+    struct libjpeg_source_mgr s_mgr(tables, sizeof(tables));
+    mInfo->src = &s_mgr;
+
+    int status = jpeg_read_header(mInfo, false);
+    mInfo->src = NULL;
+    if (status != JPEG_HEADER_TABLES_ONLY) {
+        CAMHAL_LOGEB("Couldn't load default huffman tables %d", status);
+        jpeg_abort_decompress(mInfo);
+        return false;
+    }
+
+    CAMHAL_LOGDA("No DHT in MJPEG stream, using default huffman tables");
+    return true;
+}
+
+bool Decoder_libjpeg::allocatePlanes(unsigned int width, unsigned int height)
+{
+    if ((width <= mWidth) && (height <= mHeight)) {
+        return true;
+    }
+
+    CAMHAL_LOGDB("Reallocating decode planes. Old WxH = %dx%d. New WxH = %dx%d",
+                 mWidth, mHeight, width, height);
+    release();
+
+    Y_Plane = (unsigned char **)malloc(MAX_IMCU_ROWS * sizeof(unsigned char *));
+    U_Plane = (unsigned char **)malloc(MAX_IMCU_ROWS * sizeof(unsigned char *));
+    V_Plane = (unsigned char **)malloc(MAX_IMCU_ROWS * sizeof(unsigned char *));
+    // U rows, V rows and a row for the padding lines of the last iMCU row
+    UV_Plane = (unsigned char *)malloc(width * (height * 2 + 1));
+    if (!Y_Plane || !U_Plane || !V_Plane || !UV_Plane) {
+        CAMHAL_LOGEA("Couldn't allocate decode planes");
+        release();
+        return false;
+    }
+
+    mPadRow = UV_Plane + width * height * 2;
+    mWidth = width;
+    mHeight = height;
+
+    return true;
+}
+
 bool Decoder_libjpeg::decode(unsigned char *jpeg_src, int filled_len, unsigned char *nv12_buffer, int stride)
 {
-    struct jpeg_decompress_struct cinfo;
-    struct jpeg_error_mgr jerr;
     struct libjpeg_source_mgr s_mgr(jpeg_src, filled_len);
 
     if (filled_len == 0)
         return false;
 
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_decompress(&cinfo);
+    if (NULL == mInfo) {
+        startStream(0, 0);
+    }
 
-    cinfo.src = &s_mgr;
-    int status = jpeg_read_header(&cinfo, true);
-    if (status != JPEG_HEADER_OK) {
+    if (!mTablesChecked) {
+        mTablesChecked = true;
+        if (!isDhtExist(jpeg_src, filled_len) && !loadDefaultTables()) {
+            return false;
+        }
+    }
+
+    mInfo->src = &s_mgr;
+    int status = jpeg_read_header(mInfo, true);
+    if ((status != JPEG_HEADER_OK) || (mInfo->num_components != NUM_COMPONENTS_IN_YUV)) {
         CAMHAL_LOGEA("jpeg header corrupted");
+        jpeg_abort_decompress(mInfo);
         return false;
     }
 
-    cinfo.out_color_space = JCS_YCbCr;
-    cinfo.raw_data_out = true;
-    status = jpeg_start_decompress(&cinfo);
+    mInfo->out_color_space = JCS_YCbCr;
+    mInfo->raw_data_out = true;
+    mInfo->scale_num = 1;
+    mInfo->scale_denom = 1;
+    for (unsigned int denom = 4; (denom > 1) && (mOutWidth > 0); denom /= 2) {
+        if ((mInfo->image_width == mOutWidth * denom) && (mInfo->image_height == mOutHeight * denom)) {
+            mInfo->scale_denom = denom;
+            break;
+        }
+    }
+    mInfo->dct_method = (mOutWidth * mOutHeight >= FAST_DCT_MIN_AREA) ? JDCT_IFAST : JDCT_ISLOW;
+
+    status = jpeg_start_decompress(mInfo);
     if (!status){
         CAMHAL_LOGEA("jpeg_start_decompress failed");
+        jpeg_abort_decompress(mInfo);
         return false;
     }
 
-    if (mWidth == 0){
-        mWidth = cinfo.output_width;
-        mHeight = cinfo.output_height;
-        CAMHAL_LOGEA("w x h = %d x %d. stride=%d", cinfo.output_width, cinfo.output_height, stride);
+    const unsigned int width = mInfo->output_width;
+    const unsigned int height = mInfo->output_height;
+    const int imcuRows = mInfo->max_v_samp_factor * mInfo->min_DCT_scaled_size;
+    const int imcuCols = mInfo->max_h_samp_factor * mInfo->min_DCT_scaled_size;
+    jpeg_component_info *comp = mInfo->comp_info;
+
+    // scaled decodes may bring chroma up to the luma resolution
+    if ((comp[1].h_samp_factor * comp[1].DCT_scaled_size != comp[2].h_samp_factor * comp[2].DCT_scaled_size) ||
+        (comp[1].v_samp_factor * comp[1].DCT_scaled_size != comp[2].v_samp_factor * comp[2].DCT_scaled_size)) {
+        CAMHAL_LOGEA("Unsupported chroma sampling");
+        jpeg_abort_decompress(mInfo);
+        return false;
     }
-    else if ((cinfo.output_width > mWidth) || (cinfo.output_height > mHeight)) {
-        CAMHAL_LOGEA(" Free the existing buffers so that they are reallocated for new w x h. Old WxH = %dx%d. New WxH = %dx%d",
-        mWidth, mHeight, cinfo.output_width, cinfo.output_height);
-        release();
-        mWidth = cinfo.output_width;
-        mHeight = cinfo.output_height;
+    const int chromaStep = 2 * comp[1].h_samp_factor * comp[1].DCT_scaled_size / imcuCols;
+
+    // raw data comes in whole DCT blocks, rows may be wider than the image
+    unsigned int rowSize = 0;
+    for (int c = 0; c < NUM_COMPONENTS_IN_YUV; c++) {
+        unsigned int size = comp[c].width_in_blocks * comp[c].DCT_scaled_size;
+        if (size > rowSize) {
+            rowSize = size;
+        }
+        if (comp[c].v_samp_factor * comp[c].DCT_scaled_size > MAX_IMCU_ROWS) {
+            CAMHAL_LOGEB("Unsupported sampling factor %d", comp[c].v_samp_factor);
+            jpeg_abort_decompress(mInfo);
+            return false;
+        }
     }
 
-    unsigned int decoded_uv_buffer_size = cinfo.output_width * cinfo.output_height / 2;
-    if (Y_Plane == NULL)Y_Plane = (unsigned char **)malloc(cinfo.output_height * sizeof(unsigned char *));
-    if (U_Plane == NULL)U_Plane = (unsigned char **)malloc(cinfo.output_height * sizeof(unsigned char *));
-    if (V_Plane == NULL)V_Plane = (unsigned char **)malloc(cinfo.output_height * sizeof(unsigned char *));
-    if (UV_Plane == NULL) UV_Plane = (unsigned char *)malloc(decoded_uv_buffer_size);
+    if (!allocatePlanes(rowSize, (height + 1) / 2)) {
+        jpeg_abort_decompress(mInfo);
+        return false;
+    }
 
     unsigned char **YUV_Planes[NUM_COMPONENTS_IN_YUV];
     YUV_Planes[0] = Y_Plane;
     YUV_Planes[1] = U_Plane;
     YUV_Planes[2] = V_Plane;
 
-    unsigned char *row = &nv12_buffer[0];
-
-    // Y Component
-    for (unsigned int j = 0; j < cinfo.output_height; j++, row += stride)
-        YUV_Planes[0][j] = row;
-
-    row = &UV_Plane[0];
-
-    // U Component
-    for (unsigned int j = 0; j < cinfo.output_height; j+=2, row += cinfo.output_width / 2){
-        YUV_Planes[1][j+0] = row;
-        YUV_Planes[1][j+1] = row;
-    }
+    unsigned char *chroma[NUM_COMPONENTS_IN_YUV];
+    chroma[0] = NULL;
+    chroma[1] = UV_Plane;
+    chroma[2] = UV_Plane + mWidth * mHeight;
+
+    // Luma goes straight into the output, chroma rows into the U and V planes.
+    // Only the chroma rows of even lines are kept.
+    while (mInfo->output_scanline < height) {
+        const unsigned int top = mInfo->output_scanline;
+
+        for (int c = 0; c < NUM_COMPONENTS_IN_YUV; c++) {
+            const int rows = comp[c].v_samp_factor * comp[c].DCT_scaled_size;
+            const int lines = imcuRows / rows;
+            for (int r = 0; r < rows; r++) {
+                const unsigned int line = top + r * lines;
+                if ((line >= height) || ((c > 0) && (line & 1))) {
+                    YUV_Planes[c][r] = mPadRow;
+                } else if (c == 0) {
+                    YUV_Planes[c][r] = nv12_buffer + line * stride;
+                } else {
+                    YUV_Planes[c][r] = chroma[c] + (line / 2) * mWidth;
+                }
+            }
+        }
 
-    // V Component
-    for (unsigned int j = 0; j < cinfo.output_height; j+=2, row += cinfo.output_width / 2){
-        YUV_Planes[2][j+0] = row;
-        YUV_Planes[2][j+1] = row;
+        if (0 == jpeg_read_raw_data(mInfo, YUV_Planes, imcuRows)) {
+            CAMHAL_LOGEA("jpeg_read_raw_data failed");
+            jpeg_abort_decompress(mInfo);
+            return false;
+        }
     }
 
     // Interleaving U and V
-    for (unsigned int i = 0; i < cinfo.output_height; i += 8) {
-        jpeg_read_raw_data(&cinfo, YUV_Planes, 8);
-        YUV_Planes[0] += 8;
-        YUV_Planes[1] += 8;
-        YUV_Planes[2] += 8;
-    }
-
-    unsigned char *uv_ptr = nv12_buffer + (stride * cinfo.output_height);
-    unsigned char *u_ptr = UV_Plane;
-    unsigned char *v_ptr = UV_Plane + (decoded_uv_buffer_size / 2);
-    for(unsigned int i = 0; i < cinfo.output_height / 2; i++){
-        for(unsigned int j = 0; j < cinfo.output_width; j+=2){
-            *(uv_ptr + j) = *u_ptr; u_ptr++;
-            *(uv_ptr + j + 1) = *v_ptr; v_ptr++;
+    unsigned char *uv_ptr = nv12_buffer + (stride * height);
+    for (unsigned int i = 0; i < height / 2; i++) {
+        const unsigned char *u_ptr = chroma[1] + i * mWidth;
+        const unsigned char *v_ptr = chroma[2] + i * mWidth;
+        for (unsigned int j = 0; j < width / 2; j++) {
+            uv_ptr[2 * j] = u_ptr[j * chromaStep];
+            uv_ptr[2 * j + 1] = v_ptr[j * chromaStep];
         }
         uv_ptr = uv_ptr + stride;
     }
 
-    jpeg_finish_decompress(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
+    jpeg_finish_decompress(mInfo);
+    mInfo->src = NULL;
 
     return true;
 }
@@ -35,6 +35,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <math.h>
+#include <cutils/atomic.h>
 
 extern "C" {
     #include "jpeglib.h"
@@ -43,6 +44,13 @@ extern "C" {
 
 #define ARRAY_SIZE(array) (sizeof((array)) / sizeof((array)[0]))
 #define MIN(x,y) ((x < y) ? x : y)
+#define MAX(x,y) ((x > y) ? x : y)
+#define ALIGN_UP(x,a) (((x) + (a) - 1) / (a) * (a))
+
+// luma rows handed to libjpeg per write call, one 4:2:0 MCU row
+#define ENCODER_MCU_ROWS 16
+// luma rows produced per band, the resize engine splits a band between its workers
+#define ENCODER_BAND_ROWS (4 * ENCODER_MCU_ROWS)
 
 namespace Ti {
 namespace Camera {
@@ -100,24 +108,6 @@ libjpeg_destination_mgr::libjpeg_destination_mgr(uint8_t* input, int size) {
 }
 
 /* private static functions */
-static void nv21_to_yuv(uint8_t* dst, uint8_t* y, uint8_t* uv, int width) {
-    if (!dst || !y || !uv) {
-        return;
-    }
-
-    while ((width--) > 0) {
-        uint8_t y0 = y[0];
-        uint8_t v0 = uv[0];
-        uint8_t u0 = *(uv+1);
-        dst[0] = y0;
-        dst[1] = u0;
-        dst[2] = v0;
-        dst += 3;
-        y++;
-        if(!(width % 2)) uv+=2;
-    }
-}
-
 static void uyvy_to_yuv(uint8_t* dst, uint32_t* src, int width) {
     if (!dst || !src) {
         return;
@@ -234,32 +224,25 @@ static void yuyv_to_yuv(uint8_t* dst, uint32_t* src, int width) {
     }
 }
 
-static void resize_nv12(Encoder_libjpeg::params* params, uint8_t* dst_buffer) {
-    structConvImage o_img_ptr, i_img_ptr;
-
-    if (!params || !dst_buffer) {
-        return;
+static Encoder_libjpeg::format_t resolve_format(const char* format) {
+    if (strcmp(format, android::CameraParameters::PIXEL_FORMAT_YUV420SP) == 0) {
+        return Encoder_libjpeg::FORMAT_NV21;
+    } else if (strcmp(format, TICameraParameters::PIXEL_FORMAT_YUV420SP_NV12) == 0) {
+        return Encoder_libjpeg::FORMAT_NV12;
+    } else if (strcmp(format, android::CameraParameters::PIXEL_FORMAT_YUV422I) == 0) {
+        return Encoder_libjpeg::FORMAT_YUYV;
+    } else if (strcmp(format, TICameraParameters::PIXEL_FORMAT_YUV422I_UYVY) == 0) {
+        return Encoder_libjpeg::FORMAT_UYVY;
     }
 
-    //input
-    i_img_ptr.uWidth =  params->in_width;
-    i_img_ptr.uStride =  i_img_ptr.uWidth;
-    i_img_ptr.uHeight =  params->in_height;
-    i_img_ptr.eFormat = IC_FORMAT_YCbCr420_lp;
-    i_img_ptr.imgPtr = (uint8_t*) params->src;
-    i_img_ptr.clrPtr = i_img_ptr.imgPtr + (i_img_ptr.uWidth * i_img_ptr.uHeight);
-    i_img_ptr.uOffset = 0;
-
-    //ouput
-    o_img_ptr.uWidth = params->out_width;
-    o_img_ptr.uStride = o_img_ptr.uWidth;
-    o_img_ptr.uHeight = params->out_height;
-    o_img_ptr.eFormat = IC_FORMAT_YCbCr420_lp;
-    o_img_ptr.imgPtr = dst_buffer;
-    o_img_ptr.clrPtr = o_img_ptr.imgPtr + (o_img_ptr.uWidth * o_img_ptr.uHeight);
-    o_img_ptr.uOffset = 0;
-
-    VT_resizeFrame_Video_opt2_lp(&i_img_ptr, &o_img_ptr, NULL, 0);
+    return Encoder_libjpeg::FORMAT_UNSUPPORTED;
+}
+
+// replicates the last sample of a row up to the width libjpeg reads
+static inline void pad_row(uint8_t* row, int width, int padded_width) {
+    if (padded_width > width) {
+        memset(row + width, row[width - 1], padded_width - width);
+    }
 }
 
 /* public static functions */
@@ -324,57 +307,10 @@ bool ExifElementsTable::isAsciiTag(const char* tag) {
     return (strcmp(tag, TAG_GPS_PROCESSING_METHOD) == 0);
 }
 
-void ExifElementsTable::insertExifToJpeg(unsigned char* jpeg, size_t jpeg_size) {
-    ReadMode_t read_mode = (ReadMode_t)(READ_METADATA | READ_IMAGE);
-
-    ResetJpgfile();
-    if (ReadJpegSectionsFromBuffer(jpeg, jpeg_size, read_mode)) {
-        jpeg_opened = true;
-#ifdef ANDROID_API_JB_OR_LATER
-        create_EXIF(table, exif_tag_count, gps_tag_count, has_datetime_tag);
-#else
-        create_EXIF(table, exif_tag_count, gps_tag_count);
-#endif
-    }
-}
-
-status_t ExifElementsTable::insertExifThumbnailImage(const char* thumb, int len) {
-    status_t ret = NO_ERROR;
-
-    if ((len > 0) && jpeg_opened) {
-        ret = ReplaceThumbnailFromBuffer(thumb, len) ? NO_ERROR : UNKNOWN_ERROR;
-        CAMHAL_LOGDB("insertExifThumbnailImage. ReplaceThumbnail(). ret=%d", ret);
-    }
-
-    return ret;
-}
-
-void ExifElementsTable::saveJpeg(unsigned char* jpeg, size_t jpeg_size) {
-    if (jpeg_opened) {
-       WriteJpegToBuffer(jpeg, jpeg_size);
-       DiscardData();
-       jpeg_opened = false;
-    }
-}
-
 /* public functions */
-ExifElementsTable::~ExifElementsTable() {
-    int num_elements = gps_tag_count + exif_tag_count;
-
-    for (int i = 0; i < num_elements; i++) {
-        if (table[i].Value) {
-            free(table[i].Value);
-        }
-    }
-
-    if (jpeg_opened) {
-        DiscardData();
-    }
-}
-
 status_t ExifElementsTable::insertElement(const char* tag, const char* value) {
     unsigned int value_length = 0;
-    status_t ret = NO_ERROR;
+    const ExifTagInfo* info = NULL;
 
     if (!value || !tag) {
         return -EINVAL;
@@ -385,58 +321,211 @@ status_t ExifElementsTable::insertElement(const char* tag, const char* value) {
         return NO_MEMORY;
     }
 
+    info = ExifTemplate::findTag(tag);
+    if (!info) {
+        CAMHAL_LOGEB("Unsupported EXIF tag %s", tag);
+        return BAD_VALUE;
+    }
+
     if (isAsciiTag(tag)) {
         value_length = sizeof(ExifAsciiPrefix) + strlen(value + sizeof(ExifAsciiPrefix));
     } else {
         value_length = strlen(value);
     }
 
-    if (IsGpsTag(tag)) {
-        table[position].GpsTag = TRUE;
-        table[position].Tag = GpsTagNameToValue(tag);
-        gps_tag_count++;
-    } else {
-        table[position].GpsTag = FALSE;
-        table[position].Tag = TagNameToValue(tag);
-        exif_tag_count++;
-
-        if (strcmp(tag, TAG_DATETIME) == 0) {
-#ifdef ANDROID_API_JB_OR_LATER
-            has_datetime_tag = true;
-#else
-            // jhead isn't taking datetime tag...this is a WA
-            ImageInfo.numDateTimeTags = 1;
-            memcpy(ImageInfo.DateTime, value,
-                   MIN(ARRAY_SIZE(ImageInfo.DateTime), value_length + 1));
-#endif
+    if (values_size + value_length + 1 > sizeof(values)) {
+        CAMHAL_LOGEB("No room left for EXIF tag %s", tag);
+        return NO_MEMORY;
+    }
+
+    memcpy(values + values_size, value, value_length);
+    values[values_size + value_length] = '\0';
+
+    table[position].info = info;
+    table[position].offset = values_size;
+    table[position].length = value_length;
+    values_size += value_length + 1;
+
+    position++;
+    return NO_ERROR;
+}
+
+/* private member functions */
+bool Encoder_libjpeg::encodeRaw420(jpeg_compress_struct* cinfo, params* input, format_t format, Context& context) {
+    const int width = cinfo->image_width;
+    const int height = cinfo->image_height;
+    const int pitch = input->out_width;
+    const bool resize = (input->in_width != input->out_width) ||
+                        (input->in_height != input->out_height);
+    // libjpeg reads every component up to the next block boundary
+    const int luma_width = ALIGN_UP(width, DCTSIZE);
+    const int chroma_pairs = (width + 1) / 2;
+    const int chroma_width = ALIGN_UP(chroma_pairs, DCTSIZE);
+    const int chroma_height = (height + 1) / 2;
+    // luma is fed straight from the source buffer whenever possible
+    const bool copy_luma = resize || (luma_width != width);
+    const int luma_pitch = ALIGN_UP(MAX(luma_width, pitch), 16);
+    const FormatConverter::Kernels& kernels = FormatConverter::kernels();
+
+    JSAMPROW y_rows[ENCODER_BAND_ROWS];
+    JSAMPROW cb_rows[ENCODER_BAND_ROWS / 2];
+    JSAMPROW cr_rows[ENCODER_BAND_ROWS / 2];
+    uint8_t *y_band = NULL, *uv_band = NULL, *cb_band, *cr_band;
+    structResizeSession* session = NULL;
+    uint8_t* scratch = NULL;
+    bool ret = false;
+
+    size_t scratch_size = 2 * (ENCODER_BAND_ROWS / 2) * chroma_width;
+    if (copy_luma) scratch_size += ENCODER_BAND_ROWS * luma_pitch;
+    if (resize) scratch_size += (ENCODER_BAND_ROWS / 2) * luma_pitch;
+
+    scratch = context.scratch(scratch_size);
+    if (!scratch) {
+        CAMHAL_LOGEB("Encoder: unable to allocate %d bytes of band buffers", (int) scratch_size);
+        return false;
+    }
+
+    cb_band = scratch;
+    cr_band = cb_band + (ENCODER_BAND_ROWS / 2) * chroma_width;
+    if (copy_luma) y_band = cr_band + (ENCODER_BAND_ROWS / 2) * chroma_width;
+    if (resize) uv_band = y_band + ENCODER_BAND_ROWS * luma_pitch;
+
+    if (resize) {
+        // start_offset is top * stride + left within the luma plane, the
+        // co-sited chroma pair starts at top / 2 and the even column below left
+        const int top = input->start_offset / input->in_width;
+        const int left = input->start_offset % input->in_width;
+        structConvImage in;
+        in.uWidth = input->in_width;
+        in.uStride = input->in_width;
+        in.uHeight = input->in_height;
+        in.eFormat = IC_FORMAT_YCbCr420_lp;
+        in.imgPtr = input->src + input->start_offset;
+        in.clrPtr = input->src + (in.uWidth * in.uHeight) + (top / 2) * in.uStride + (left & ~1);
+        in.uOffset = 0;
+
+        session = VT_resizeFrame_Video_open(&in, input->out_width, input->out_height, NULL);
+        if (!session) {
+            goto exit;
         }
     }
 
-    table[position].DataLength = 0;
-    table[position].Value = (char*) malloc(sizeof(char) * (value_length + 1));
+    for (int band = 0; (band < height) && !mCancelEncoding; band += ENCODER_BAND_ROWS) {
+        const int rows = MIN(ENCODER_BAND_ROWS, height - band);
+        const int chroma_first = band / 2;
+        const int chroma_rows = MIN(ENCODER_BAND_ROWS / 2, chroma_height - chroma_first);
+        const uint8_t* uv_src;
+        int uv_pitch, uv_rows;
+
+        // luma
+        if (resize) {
+            VT_resizeFrame_Video_rows(session, y_band, uv_band, luma_pitch, band, rows);
+            uv_src = uv_band;
+            uv_pitch = luma_pitch;
+            // the resize engine produces out_height / 2 chroma rows
+            uv_rows = MIN(chroma_rows, input->out_height / 2 - chroma_first);
+        } else {
+            const uint8_t* y_src = input->src + input->start_offset + band * pitch;
+            if (copy_luma) {
+                for (int i = 0; i < rows; i++) {
+                    memcpy(y_band + i * luma_pitch, y_src + i * pitch, width);
+                }
+            } else {
+                for (int i = 0; i < rows; i++) {
+                    y_rows[i] = (JSAMPROW) (y_src + i * pitch);
+                }
+            }
+            uv_src = input->src + input->out_width * input->out_height + chroma_first * pitch;
+            uv_pitch = pitch;
+            uv_rows = chroma_rows;
+        }
 
-    if (table[position].Value) {
-        memcpy(table[position].Value, value, value_length + 1);
-        table[position].DataLength = value_length + 1;
+        if (copy_luma) {
+            for (int i = 0; i < rows; i++) {
+                y_rows[i] = y_band + i * luma_pitch;
+                pad_row(y_rows[i], width, luma_width);
+            }
+        }
+
+        // rows past the bottom edge repeat the last one
+        for (int i = rows; i < ENCODER_BAND_ROWS; i++) {
+            y_rows[i] = y_rows[rows - 1];
+        }
+
+        // chroma, NV21 stores V first and NV12 U first
+        for (int i = 0; i < uv_rows; i++) {
+            cb_rows[i] = cb_band + i * chroma_width;
+            cr_rows[i] = cr_band + i * chroma_width;
+            if (FORMAT_NV12 == format) {
+                kernels.splitUV(cb_rows[i], cr_rows[i], uv_src + i * uv_pitch, chroma_pairs);
+            } else {
+                kernels.splitUV(cr_rows[i], cb_rows[i], uv_src + i * uv_pitch, chroma_pairs);
+            }
+            pad_row(cb_rows[i], chroma_pairs, chroma_width);
+            pad_row(cr_rows[i], chroma_pairs, chroma_width);
+        }
+
+        for (int i = uv_rows; i < ENCODER_BAND_ROWS / 2; i++) {
+            // no chroma produced for this band at all: the band buffers
+            // still hold the previous band, whose last row is the one to repeat
+            const int last = uv_rows > 0 ? uv_rows - 1 : ENCODER_BAND_ROWS / 2 - 1;
+            cb_rows[i] = cb_band + last * chroma_width;
+            cr_rows[i] = cr_band + last * chroma_width;
+        }
+
+        for (int mcu = 0; (mcu < rows) && !mCancelEncoding; mcu += ENCODER_MCU_ROWS) {
+            JSAMPARRAY planes[3] = { y_rows + mcu, cb_rows + mcu / 2, cr_rows + mcu / 2 };
+            jpeg_write_raw_data(cinfo, planes, ENCODER_MCU_ROWS);
+        }
     }
 
-    position++;
+    ret = true;
+
+ exit:
+    if (session) VT_resizeFrame_Video_close(session);
+
     return ret;
 }
 
-/* private member functions */
-size_t Encoder_libjpeg::encode(params* input) {
-    jpeg_compress_struct    cinfo;
-    jpeg_error_mgr jerr;
-    jpeg_destination_mgr jdest;
-    uint8_t* src = NULL, *resize_src = NULL;
-    uint8_t* row_tmp = NULL;
-    uint8_t* row_src = NULL;
-    uint8_t* row_uv = NULL; // used only for NV12
+bool Encoder_libjpeg::encodeScanlines422(jpeg_compress_struct* cinfo, params* input, format_t format, Context& context) {
+    const int width = cinfo->image_width;
+    const int pitch = input->out_width * 2;
+    void (*to_yuv)(uint8_t*, uint32_t*, int) =
+        (FORMAT_UYVY == format) ? uyvy_to_yuv : yuyv_to_yuv;
+    JSAMPROW rows[ENCODER_MCU_ROWS];
+    uint8_t* row_src = input->src + input->start_offset;
+    uint8_t* row_tmp = context.scratch(ENCODER_MCU_ROWS * width * 3);
+
+    if (!row_tmp) {
+        CAMHAL_LOGEA("Encoder: unable to allocate row buffer");
+        return false;
+    }
+
+    for (int i = 0; i < ENCODER_MCU_ROWS; i++) {
+        rows[i] = row_tmp + i * width * 3;
+    }
+
+    while ((cinfo->next_scanline < cinfo->image_height) && !mCancelEncoding) {
+        const int count = MIN(ENCODER_MCU_ROWS, (int) (cinfo->image_height - cinfo->next_scanline));
+
+        // convert input yuv format to yuv444
+        for (int i = 0; i < count; i++) {
+            to_yuv(rows[i], (uint32_t*) row_src, width);
+            row_src += pitch;
+        }
+
+        jpeg_write_scanlines(cinfo, rows, count);
+    }
+
+    return true;
+}
+
+size_t Encoder_libjpeg::encode(params* input, Context& context) {
+    jpeg_compress_struct& cinfo = *context.compressor();
+    format_t format = FORMAT_UNSUPPORTED;
     int out_width = 0, in_width = 0;
     int out_height = 0, in_height = 0;
-    int bpp = 2; // for uyvy
-    int right_crop = 0, start_offset = 0;
+    bool encoded = false;
 
     if (!input) {
         return 0;
@@ -446,41 +535,29 @@ size_t Encoder_libjpeg::encode(params* input) {
     in_width = input->in_width;
     out_height = input->out_height;
     in_height = input->in_height;
-    right_crop = input->right_crop;
-    start_offset = input->start_offset;
-    src = input->src;
     input->jpeg_size = 0;
 
     libjpeg_destination_mgr dest_mgr(input->dst, input->dst_size);
 
     // param check...
     if ((in_width < 2) || (out_width < 2) || (in_height < 2) || (out_height < 2) ||
-         (src == NULL) || (input->dst == NULL) || (input->quality < 1) || (input->src_size < 1) ||
+         (input->src == NULL) || (input->dst == NULL) || (input->quality < 1) || (input->src_size < 1) ||
          (input->dst_size < 1) || (input->format == NULL)) {
         goto exit;
     }
 
-    if (strcmp(input->format, android::CameraParameters::PIXEL_FORMAT_YUV420SP) == 0) {
-        bpp = 1;
-        if ((in_width != out_width) || (in_height != out_height)) {
-            resize_src = (uint8_t*) malloc(input->dst_size);
-            resize_nv12(input, resize_src);
-            if (resize_src) src = resize_src;
-        }
-    } else if (strcmp(input->format, android::CameraParameters::PIXEL_FORMAT_YUV422I) &&
-               strcmp(input->format, TICameraParameters::PIXEL_FORMAT_YUV422I_UYVY)) {
+    format = resolve_format(input->format);
+
+    if (FORMAT_UNSUPPORTED == format) {
         // we currently only support yuv422i and yuv420sp
         CAMHAL_LOGEB("Encoder: format not supported: %s", input->format);
         goto exit;
-    } else if ((in_width != out_width) || (in_height != out_height)) {
+    } else if ((FORMAT_NV21 != format) && (FORMAT_NV12 != format) &&
+               ((in_width != out_width) || (in_height != out_height))) {
         CAMHAL_LOGEB("Encoder: resizing is not supported for this format: %s", input->format);
         goto exit;
     }
 
-    cinfo.err = jpeg_std_error(&jerr);
-
-    jpeg_create_compress(&cinfo);
-
     CAMHAL_LOGDB("encoding...  \n\t"
                  "width: %d    \n\t"
                  "height:%d    \n\t"
@@ -489,10 +566,10 @@ size_t Encoder_libjpeg::encode(params* input) {
                  "mSrc %p \n\t"
                  "format: %s",
                  out_width, out_height, input->dst,
-                 input->dst_size, src, input->format);
+                 input->dst_size, input->src, input->format);
 
     cinfo.dest = &dest_mgr;
-    cinfo.image_width = out_width - right_crop;
+    cinfo.image_width = out_width - input->right_crop;
     cinfo.image_height = out_height;
     cinfo.input_components = 3;
     cinfo.in_color_space = JCS_YCbCr;
@@ -502,48 +579,218 @@ size_t Encoder_libjpeg::encode(params* input) {
     jpeg_set_quality(&cinfo, input->quality, TRUE);
     cinfo.dct_method = JDCT_IFAST;
 
-    jpeg_start_compress(&cinfo, TRUE);
-
-    row_tmp = (uint8_t*)malloc((out_width - right_crop) * 3);
-    row_src = src + start_offset;
-    row_uv = src + out_width * out_height * bpp;
-
-    while ((cinfo.next_scanline < cinfo.image_height) && !mCancelEncoding) {
-        JSAMPROW row[1];    /* pointer to JSAMPLE row[s] */
-
-        // convert input yuv format to yuv444
-        if (strcmp(input->format, android::CameraParameters::PIXEL_FORMAT_YUV420SP) == 0) {
-            nv21_to_yuv(row_tmp, row_src, row_uv, out_width - right_crop);
-        } else if (strcmp(input->format, TICameraParameters::PIXEL_FORMAT_YUV422I_UYVY) == 0) {
-            uyvy_to_yuv(row_tmp, (uint32_t*)row_src, out_width - right_crop);
-        } else if (strcmp(input->format, android::CameraParameters::PIXEL_FORMAT_YUV422I) == 0) {
-            yuyv_to_yuv(row_tmp, (uint32_t*)row_src, out_width - right_crop);
-        }
+    if ((FORMAT_NV21 == format) || (FORMAT_NV12 == format)) {
+        // 4:2:0 planes are handed to libjpeg as they are, one MCU row at a time
+        cinfo.raw_data_in = TRUE;
+        cinfo.comp_info[0].h_samp_factor = 2;
+        cinfo.comp_info[0].v_samp_factor = 2;
+        cinfo.comp_info[1].h_samp_factor = 1;
+        cinfo.comp_info[1].v_samp_factor = 1;
+        cinfo.comp_info[2].h_samp_factor = 1;
+        cinfo.comp_info[2].v_samp_factor = 1;
+    }
 
-        row[0] = row_tmp;
-        jpeg_write_scanlines(&cinfo, row, 1);
-        row_src = row_src + out_width*bpp;
+    jpeg_start_compress(&cinfo, TRUE);
 
-        // move uv row if input format needs it
-        if (strcmp(input->format, android::CameraParameters::PIXEL_FORMAT_YUV420SP) == 0) {
-            if (!(cinfo.next_scanline % 2))
-                row_uv = row_uv +  out_width * bpp;
-        }
+    if ((FORMAT_NV21 == format) || (FORMAT_NV12 == format)) {
+        encoded = encodeRaw420(&cinfo, input, format, context);
+    } else {
+        encoded = encodeScanlines422(&cinfo, input, format, context);
     }
 
     // no need to finish encoding routine if we are prematurely stopping
     // we will end up crashing in dest_mgr since data is incomplete
-    if (!mCancelEncoding)
+    if (encoded && !mCancelEncoding) {
         jpeg_finish_compress(&cinfo);
-    jpeg_destroy_compress(&cinfo);
+    } else {
+        // keeps the compressor usable for the next encode
+        jpeg_abort_compress(&cinfo);
+    }
 
-    if (resize_src) free(resize_src);
-    if (row_tmp) free(row_tmp);
+    if (!encoded) {
+        dest_mgr.jpegsize = 0;
+    }
 
  exit:
     input->jpeg_size = dest_mgr.jpegsize;
     return dest_mgr.jpegsize;
 }
 
+Encoder_libjpeg::Context::Context() : mScratch(NULL), mScratchSize(0) {
+    mCompressor = new jpeg_compress_struct;
+    mError = new jpeg_error_mgr;
+
+    mCompressor->err = jpeg_std_error(mError);
+    jpeg_create_compress(mCompressor);
+}
+
+Encoder_libjpeg::Context::~Context() {
+    jpeg_destroy_compress(mCompressor);
+
+    delete mCompressor;
+    delete mError;
+    free(mScratch);
+}
+
+uint8_t* Encoder_libjpeg::Context::scratch(size_t size) {
+    if (size > mScratchSize) {
+        free(mScratch);
+        mScratch = (uint8_t*) malloc(size);
+        mScratchSize = mScratch ? size : 0;
+    }
+
+    return mScratch;
+}
+
+void Encoder_libjpeg::setPooled() {
+    mPooled = true;
+    mPendingImages = mThumbnailInput ? 2 : 1;
+}
+
+bool Encoder_libjpeg::encodeImage(bool thumbnail, Context& context) {
+    encode(thumbnail ? mThumbnailInput : mMainInput, context);
+
+    // whoever finishes the last image of this encoder reports it
+    if (android_atomic_dec(&mPendingImages) != 1) {
+        return false;
+    }
+
+    if (mCb) {
+        mCb(mMainInput, mThumbnailInput, mType, mCookie1, mCookie2, mCookie3, mCookie4, mCancelEncoding);
+    }
+
+    // signal cancel semaphore incase somebody is waiting
+    mCancelSem.Signal();
+
+    // drop the reference taken at construction, as threadLoop does
+    this->decStrong(this);
+    return true;
+}
+
+/*--------------------EncoderPool Class STARTS here-----------------------------*/
+
+EncoderPool::EncoderPool(int numWorkers, int maxEncoders)
+    : mNumWorkers(numWorkers), mMaxEncoders(maxEncoders),
+      mInFlight(0), mReserved(0), mExiting(false) {
+}
+
+EncoderPool::~EncoderPool() {
+    {
+        android::AutoMutex lock(mLock);
+        mExiting = true;
+        mJobAvailable.broadcast();
+        mRoomAvailable.broadcast();
+    }
+
+    // workers drain the queued jobs before exiting, so every
+    // submitted encoder still gets its callback
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        mWorkers[i]->join();
+    }
+    mWorkers.clear();
+}
+
+status_t EncoderPool::initialize() {
+    for (int i = 0; i < mNumWorkers; i++) {
+        android::sp<Worker> worker = new Worker(this);
+        status_t ret = worker->run("EncoderPoolWorker");
+        if (NO_ERROR != ret) {
+            CAMHAL_LOGEB("Couldn't run encoder worker %d: %d", i, ret);
+            break;
+        }
+        mWorkers.push(worker);
+    }
+
+    return mWorkers.isEmpty() ? NO_INIT : NO_ERROR;
+}
+
+bool EncoderPool::reserve(nsecs_t timeout) {
+    android::AutoMutex lock(mLock);
+    const nsecs_t deadline = systemTime() + timeout;
+
+    while (((mInFlight + mReserved) >= mMaxEncoders) && !mExiting) {
+        const nsecs_t remaining = deadline - systemTime();
+        if (remaining <= 0) {
+            return false;
+        }
+        mRoomAvailable.waitRelative(mLock, remaining);
+    }
+
+    if (mExiting) {
+        return false;
+    }
+
+    mReserved++;
+    return true;
+}
+
+int EncoderPool::getEncodersInFlight() {
+    android::AutoMutex lock(mLock);
+    return mInFlight;
+}
+
+status_t EncoderPool::submit(const android::sp<Encoder_libjpeg>& encoder) {
+    android::AutoMutex lock(mLock);
+
+    if (mReserved <= 0) {
+        CAMHAL_LOGEA("Encoder submitted without a reservation");
+        return INVALID_OPERATION;
+    }
+
+    // the reservation turns into an encoder in flight
+    mReserved--;
+
+    if (!encoder.get() || mExiting) {
+        mRoomAvailable.broadcast();
+        return encoder.get() ? NO_INIT : BAD_VALUE;
+    }
+
+    encoder->setPooled();
+    mInFlight++;
+
+    Job job;
+    job.encoder = encoder;
+    job.thumbnail = false;
+    mJobs.push_back(job);
+
+    if (encoder->hasThumbnail()) {
+        job.thumbnail = true;
+        mJobs.push_back(job);
+    }
+
+    mJobAvailable.broadcast();
+
+    return NO_ERROR;
+}
+
+bool EncoderPool::workerLoop(Encoder_libjpeg::Context& context) {
+    Job job;
+
+    {
+        android::AutoMutex lock(mLock);
+
+        while (mJobs.empty() && !mExiting) {
+            mJobAvailable.wait(mLock);
+        }
+
+        if (mJobs.empty()) {
+            return false;
+        }
+
+        job = *mJobs.begin();
+        mJobs.erase(mJobs.begin());
+    }
+
+    if (job.encoder->encodeImage(job.thumbnail, context)) {
+        android::AutoMutex lock(mLock);
+        mInFlight--;
+        mRoomAvailable.broadcast();
+    }
+
+    return true;
+}
+
+/*--------------------EncoderPool Class ENDS here-----------------------------*/
+
 } // namespace Camera
 } // namespace Ti
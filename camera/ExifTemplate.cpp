@@ -0,0 +1,522 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file ExifTemplate.cpp
+*
+* Little endian TIFF serialization of the EXIF tags, laid out once per
+* set of tags and patched in place for every capture.
+*
+*/
+
+#include "ExifTemplate.h"
+#include "Encoder_libjpeg.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_SIZE(array) (sizeof((array)) / sizeof((array)[0]))
+
+namespace Ti {
+namespace Camera {
+
+// tags ExifElementsTable::insertElement accepts
+static const ExifTagInfo kTags[] = {
+    { TAG_IMAGE_WIDTH,           0x0100, ExifTemplate::IFD_0,    ExifTemplate::TYPE_LONG },
+    { TAG_IMAGE_LENGTH,          0x0101, ExifTemplate::IFD_0,    ExifTemplate::TYPE_LONG },
+    { TAG_MAKE,                  0x010F, ExifTemplate::IFD_0,    ExifTemplate::TYPE_ASCII },
+    { TAG_MODEL,                 0x0110, ExifTemplate::IFD_0,    ExifTemplate::TYPE_ASCII },
+    { TAG_ORIENTATION,           0x0112, ExifTemplate::IFD_0,    ExifTemplate::TYPE_SHORT },
+    { TAG_DATETIME,              0x0132, ExifTemplate::IFD_0,    ExifTemplate::TYPE_ASCII },
+    { TAG_EXPOSURETIME,          0x829A, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_RATIONAL },
+    { TAG_FNUMBER,               0x829D, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_RATIONAL },
+    { TAG_EXPOSURE_PROGRAM,      0x8822, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_SHORT },
+    { TAG_ISO_EQUIVALENT,        0x8827, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_SHORT },
+    { TAG_CPRS_BITS_PER_PIXEL,   0x9102, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_RATIONAL },
+    { TAG_SHUTTERSPEED,          0x9201, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_SRATIONAL },
+    { TAG_APERTURE,              0x9202, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_RATIONAL },
+    { TAG_METERING_MODE,         0x9207, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_SHORT },
+    { TAG_LIGHT_SOURCE,          0x9208, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_SHORT },
+    { TAG_FLASH,                 0x9209, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_SHORT },
+    { TAG_FOCALLENGTH,           0x920A, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_RATIONAL },
+    { TAG_COLOR_SPACE,           0xA001, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_SHORT },
+    { TAG_SENSING_METHOD,        0xA217, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_SHORT },
+    { TAG_CUSTOM_RENDERED,       0xA401, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_SHORT },
+    { TAG_WHITEBALANCE,          0xA403, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_SHORT },
+    { TAG_DIGITALZOOMRATIO,      0xA404, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_RATIONAL },
+    { TAG_GPS_VERSION_ID,        0x0000, ExifTemplate::IFD_GPS,  ExifTemplate::TYPE_BYTE },
+    { TAG_GPS_LAT_REF,           0x0001, ExifTemplate::IFD_GPS,  ExifTemplate::TYPE_ASCII },
+    { TAG_GPS_LAT,               0x0002, ExifTemplate::IFD_GPS,  ExifTemplate::TYPE_RATIONAL },
+    { TAG_GPS_LONG_REF,          0x0003, ExifTemplate::IFD_GPS,  ExifTemplate::TYPE_ASCII },
+    { TAG_GPS_LONG,              0x0004, ExifTemplate::IFD_GPS,  ExifTemplate::TYPE_RATIONAL },
+    { TAG_GPS_ALT_REF,           0x0005, ExifTemplate::IFD_GPS,  ExifTemplate::TYPE_BYTE },
+    { TAG_GPS_ALT,               0x0006, ExifTemplate::IFD_GPS,  ExifTemplate::TYPE_RATIONAL },
+    { TAG_GPS_TIMESTAMP,         0x0007, ExifTemplate::IFD_GPS,  ExifTemplate::TYPE_RATIONAL },
+    { TAG_GPS_MAP_DATUM,         0x0012, ExifTemplate::IFD_GPS,  ExifTemplate::TYPE_ASCII },
+    { TAG_GPS_PROCESSING_METHOD, 0x001B, ExifTemplate::IFD_GPS,  ExifTemplate::TYPE_UNDEFINED },
+    { TAG_GPS_DATESTAMP,         0x001D, ExifTemplate::IFD_GPS,  ExifTemplate::TYPE_ASCII },
+};
+
+// tags the writer adds itself
+static const ExifTagInfo kExifIfdPointer =
+    { "ExifOffset",                  0x8769, ExifTemplate::IFD_0,    ExifTemplate::TYPE_LONG };
+static const ExifTagInfo kGpsIfdPointer =
+    { "GPSInfo",                     0x8825, ExifTemplate::IFD_0,    ExifTemplate::TYPE_LONG };
+static const ExifTagInfo kExifVersion =
+    { "ExifVersion",                 0x9000, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_UNDEFINED };
+static const ExifTagInfo kDateTimeOriginal =
+    { "DateTimeOriginal",            0x9003, ExifTemplate::IFD_EXIF, ExifTemplate::TYPE_ASCII };
+static const ExifTagInfo kCompression =
+    { "Compression",                 0x0103, ExifTemplate::IFD_1,    ExifTemplate::TYPE_SHORT };
+static const ExifTagInfo kThumbnailOffset =
+    { "JPEGInterchangeFormat",       0x0201, ExifTemplate::IFD_1,    ExifTemplate::TYPE_LONG };
+static const ExifTagInfo kThumbnailLength =
+    { "JPEGInterchangeFormatLength", 0x0202, ExifTemplate::IFD_1,    ExifTemplate::TYPE_LONG };
+
+static const char kExifVersionValue[] = "0220";
+static const uint8_t kExifHeader[] = { 'E', 'x', 'i', 'f', 0, 0 };
+
+// SOI, APP1 marker and length, EXIF header
+static const size_t HEADER_SIZE = 2 + 4 + sizeof(kExifHeader);
+static const size_t MAX_SEGMENT_SIZE = 0xFFFF;
+static const size_t MAX_FIELDS = MAX_EXIF_TAGS_SUPPORTED + 7;
+static const size_t ENTRY_SIZE = 12;
+// compression tag value of a jpeg thumbnail
+static const uint32_t THUMBNAIL_JPEG = 6;
+
+static inline void put16(uint8_t *dst, uint32_t value)
+{
+    dst[0] = value & 0xFF;
+    dst[1] = ( value >> 8 ) & 0xFF;
+}
+
+static inline void put32(uint8_t *dst, uint32_t value)
+{
+    dst[0] = value & 0xFF;
+    dst[1] = ( value >> 8 ) & 0xFF;
+    dst[2] = ( value >> 16 ) & 0xFF;
+    dst[3] = ( value >> 24 ) & 0xFF;
+}
+
+ExifTemplate::ExifTemplate() :
+    mTiff(NULL),
+    mTiffSize(0),
+    mNextIfdOffset(0),
+    mThumbnailLengthOffset(0)
+{
+}
+
+ExifTemplate::~ExifTemplate()
+{
+    free(mTiff);
+}
+
+const ExifTagInfo *ExifTemplate::findTag(const char *name)
+{
+    for ( size_t i = 0; i < ARRAY_SIZE(kTags); i++ ) {
+        if ( 0 == strcmp(kTags[i].name, name) ) {
+            return &kTags[i];
+        }
+    }
+
+    return NULL;
+}
+
+size_t ExifTemplate::typeSize(uint8_t type)
+{
+    switch ( type ) {
+        case TYPE_SHORT:
+            return 2;
+        case TYPE_LONG:
+            return 4;
+        case TYPE_RATIONAL:
+        case TYPE_SRATIONAL:
+            return 8;
+        default:
+            return 1;
+    }
+}
+
+int ExifTemplate::countValues(const ExifTagInfo *info, const char *value, size_t length)
+{
+    int count = 1;
+
+    switch ( info->type ) {
+        case TYPE_ASCII:
+            return length + 1;
+        case TYPE_UNDEFINED:
+            return length;
+        default:
+            for ( size_t i = 0; i < length; i++ ) {
+                if ( ',' == value[i] ) {
+                    count++;
+                }
+            }
+            return count;
+    }
+}
+
+void ExifTemplate::encodeValues(uint8_t *dst, const ExifTagInfo *info, uint16_t count,
+                                const char *value, size_t length)
+{
+    const size_t size = typeSize(info->type);
+    const char *pos = value;
+    char *end;
+
+    if ( ( TYPE_ASCII == info->type ) || ( TYPE_UNDEFINED == info->type ) ) {
+        // count already accounts for the terminating zero
+        memcpy(dst, value, ( length < count ) ? length : count);
+        if ( length < count ) {
+            memset(dst + length, 0, count - length);
+        }
+        return;
+    }
+
+    // comma separated numbers, rationals as num/den
+    for ( uint16_t i = 0; i < count; i++, dst += size ) {
+        uint32_t num = 0, den = 1;
+
+        if ( TYPE_SRATIONAL == info->type ) {
+            num = strtol(pos, &end, 10);
+        } else {
+            num = strtoul(pos, &end, 10);
+        }
+        if ( '/' == *end ) {
+            pos = end + 1;
+            den = strtoul(pos, &end, 10);
+        }
+        pos = ( ',' == *end ) ? end + 1 : end;
+
+        switch ( info->type ) {
+            case TYPE_BYTE:
+                dst[0] = num & 0xFF;
+                break;
+            case TYPE_SHORT:
+                put16(dst, num);
+                break;
+            case TYPE_LONG:
+                put32(dst, num);
+                break;
+            default:
+                put32(dst, num);
+                put32(dst + 4, den);
+                break;
+        }
+    }
+}
+
+// Fields of the tags in IFD and tag order, with the ones the writer adds
+size_t ExifTemplate::collectFields(const ExifElementsTable &tags, Field *fields)
+{
+    size_t count = 0;
+    bool hasGps = false;
+
+    for ( unsigned int i = 0; i < tags.position; i++ ) {
+        const ExifElementsTable::Element &element = tags.table[i];
+        Field &field = fields[count++];
+
+        field.info = element.info;
+        field.count = countValues(element.info, tags.values + element.offset,
+                                                element.length);
+        field.offset = 0;
+        field.element = i;
+
+        if ( IFD_GPS == element.info->ifd ) {
+            hasGps = true;
+        }
+
+        if ( 0 == strcmp(element.info->name, TAG_DATETIME) ) {
+            // DateTimeOriginal carries the capture time as well
+            Field &original = fields[count++];
+            original = field;
+            original.info = &kDateTimeOriginal;
+        }
+    }
+
+    const ExifTagInfo *added[] = {
+        &kExifIfdPointer,
+        hasGps ? &kGpsIfdPointer : NULL,
+        &kExifVersion,
+        &kCompression,
+        &kThumbnailOffset,
+        &kThumbnailLength,
+    };
+
+    for ( size_t i = 0; i < ARRAY_SIZE(added); i++ ) {
+        if ( NULL == added[i] ) {
+            continue;
+        }
+
+        Field &field = fields[count++];
+        field.info = added[i];
+        field.count = ( &kExifVersion == added[i] ) ? sizeof(kExifVersionValue) - 1 : 1;
+        field.offset = 0;
+        field.element = -1;
+    }
+
+    // a handful of fields, insertion sort keeps equal layouts in the same order
+    for ( size_t i = 1; i < count; i++ ) {
+        Field field = fields[i];
+        size_t j = i;
+
+        while ( ( 0 < j ) &&
+                ( ( fields[j - 1].info->ifd > field.info->ifd ) ||
+                  ( ( fields[j - 1].info->ifd == field.info->ifd ) &&
+                    ( fields[j - 1].info->tag > field.info->tag ) ) ) ) {
+            fields[j] = fields[j - 1];
+            j--;
+        }
+        fields[j] = field;
+    }
+
+    return count;
+}
+
+bool ExifTemplate::matches(const ExifElementsTable &tags) const
+{
+    Field fields[MAX_FIELDS];
+    const size_t count = collectFields(tags, fields);
+
+    if ( ( NULL == mTiff ) || ( count != mFields.size() ) ) {
+        return false;
+    }
+
+    for ( size_t i = 0; i < count; i++ ) {
+        if ( ( fields[i].info != mFields[i].info ) ||
+             ( fields[i].count != mFields[i].count ) ||
+             ( fields[i].element != mFields[i].element ) ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+android::status_t ExifTemplate::layout(const ExifElementsTable &tags)
+{
+    Field fields[MAX_FIELDS];
+    const size_t count = collectFields(tags, fields);
+    uint32_t ifdOffset[IFD_MAX];
+    size_t ifdCount[IFD_MAX];
+    uint32_t offset = 8;
+    size_t first = 0;
+
+    memset(ifdOffset, 0, sizeof(ifdOffset));
+    memset(ifdCount, 0, sizeof(ifdCount));
+
+    for ( size_t i = 0; i < count; i++ ) {
+        ifdCount[fields[i].info->ifd]++;
+    }
+
+    // every directory is followed by the values which don't fit its entries
+    for ( int ifd = IFD_0; ifd < IFD_MAX; ifd++ ) {
+        const size_t last = first + ifdCount[ifd];
+
+        if ( 0 == ifdCount[ifd] ) {
+            continue;
+        }
+
+        ifdOffset[ifd] = offset;
+        offset += 2 + ifdCount[ifd] * ENTRY_SIZE + 4;
+
+        for ( size_t i = first; i < last; i++ ) {
+            const size_t size = typeSize(fields[i].info->type) * fields[i].count;
+
+            if ( 4 < size ) {
+                fields[i].offset = offset;
+                offset += ( size + 1 ) & ~1;
+            } else {
+                fields[i].offset = ifdOffset[ifd] + 2 + ( i - first ) * ENTRY_SIZE + 8;
+            }
+        }
+
+        first = last;
+    }
+
+    if ( HEADER_SIZE + offset > MAX_SEGMENT_SIZE ) {
+        CAMHAL_LOGEB("EXIF data doesn't fit the APP1 segment, %u bytes", offset);
+        return BAD_VALUE;
+    }
+
+    uint8_t *tiff = static_cast<uint8_t *>(calloc(1, offset));
+    if ( NULL == tiff ) {
+        CAMHAL_LOGEA("Couldn't allocate EXIF template");
+        return NO_MEMORY;
+    }
+
+    free(mTiff);
+    mTiff = tiff;
+    mTiffSize = offset;
+
+    tiff[0] = 'I';
+    tiff[1] = 'I';
+    put16(tiff + 2, 0x2A);
+    put32(tiff + 4, ifdOffset[IFD_0]);
+
+    first = 0;
+    for ( int ifd = IFD_0; ifd < IFD_MAX; ifd++ ) {
+        uint8_t *entry = tiff + ifdOffset[ifd];
+
+        if ( 0 == ifdCount[ifd] ) {
+            continue;
+        }
+
+        put16(entry, ifdCount[ifd]);
+        entry += 2;
+
+        for ( size_t i = first; i < first + ifdCount[ifd]; i++, entry += ENTRY_SIZE ) {
+            const Field &field = fields[i];
+
+            put16(entry, field.info->tag);
+            put16(entry + 2, field.info->type);
+            put32(entry + 4, field.count);
+            if ( typeSize(field.info->type) * field.count > 4 ) {
+                put32(entry + 8, field.offset);
+            }
+
+            // the values of the fields the writer adds only depend on the layout
+            if ( &kExifIfdPointer == field.info ) {
+                put32(tiff + field.offset, ifdOffset[IFD_EXIF]);
+            } else if ( &kGpsIfdPointer == field.info ) {
+                put32(tiff + field.offset, ifdOffset[IFD_GPS]);
+            } else if ( &kExifVersion == field.info ) {
+                memcpy(tiff + field.offset, kExifVersionValue, field.count);
+            } else if ( &kCompression == field.info ) {
+                put16(tiff + field.offset, THUMBNAIL_JPEG);
+            } else if ( &kThumbnailOffset == field.info ) {
+                // the thumbnail follows the TIFF data
+                put32(tiff + field.offset, mTiffSize);
+            } else if ( &kThumbnailLength == field.info ) {
+                mThumbnailLengthOffset = field.offset;
+            }
+        }
+
+        // only the 0th IFD links to the thumbnail one
+        if ( IFD_0 == ifd ) {
+            mNextIfdOffset = entry - tiff;
+            put32(entry, ifdOffset[IFD_1]);
+        }
+
+        first += ifdCount[ifd];
+    }
+
+    mFields.clear();
+    mFields.appendArray(fields, count);
+
+    CAMHAL_LOGDB("EXIF template laid out, %u fields, %u bytes", ( unsigned int ) count, ( unsigned int ) mTiffSize);
+
+    return NO_ERROR;
+}
+
+android::status_t ExifTemplate::update(const ExifElementsTable &tags)
+{
+    status_t ret = NO_ERROR;
+
+    if ( !matches(tags) ) {
+        ret = layout(tags);
+        if ( NO_ERROR != ret ) {
+            return ret;
+        }
+    }
+
+    for ( size_t i = 0; i < mFields.size(); i++ ) {
+        const Field &field = mFields[i];
+
+        if ( 0 > field.element ) {
+            continue;
+        }
+
+        const ExifElementsTable::Element &element = tags.table[field.element];
+        encodeValues(mTiff + field.offset, field.info, field.count,
+                     tags.values + element.offset, element.length);
+    }
+
+    return NO_ERROR;
+}
+
+bool ExifTemplate::thumbnailFits(size_t thumbnailSize) const
+{
+    return ( HEADER_SIZE + mTiffSize + thumbnailSize ) <= MAX_SEGMENT_SIZE;
+}
+
+size_t ExifTemplate::size(size_t thumbnailSize) const
+{
+    if ( NULL == mTiff ) {
+        return 0;
+    }
+
+    if ( !thumbnailFits(thumbnailSize) ) {
+        thumbnailSize = 0;
+    }
+
+    return HEADER_SIZE + mTiffSize + thumbnailSize;
+}
+
+size_t ExifTemplate::write(uint8_t *dst, const uint8_t *thumbnail, size_t thumbnailSize) const
+{
+    uint8_t *tiff = dst + HEADER_SIZE;
+
+    if ( NULL == mTiff ) {
+        return 0;
+    }
+
+    if ( ( NULL == thumbnail ) || !thumbnailFits(thumbnailSize) ) {
+        if ( 0 < thumbnailSize ) {
+            CAMHAL_LOGEB("Thumbnail of %u bytes doesn't fit the APP1 segment", ( unsigned int ) thumbnailSize);
+        }
+        thumbnailSize = 0;
+    }
+
+    const size_t segmentSize = 2 + sizeof(kExifHeader) + mTiffSize + thumbnailSize;
+
+    dst[0] = 0xFF;
+    dst[1] = 0xD8;
+    dst[2] = 0xFF;
+    dst[3] = 0xE1;
+    dst[4] = ( segmentSize >> 8 ) & 0xFF;
+    dst[5] = segmentSize & 0xFF;
+    memcpy(dst + 6, kExifHeader, sizeof(kExifHeader));
+
+    memcpy(tiff, mTiff, mTiffSize);
+
+    if ( 0 < thumbnailSize ) {
+        put32(tiff + mThumbnailLengthOffset, thumbnailSize);
+        memcpy(tiff + mTiffSize, thumbnail, thumbnailSize);
+    } else {
+        // no thumbnail directory
+        put32(tiff + mNextIfdOffset, 0);
+    }
+
+    return HEADER_SIZE + mTiffSize + thumbnailSize;
+}
+
+size_t ExifTemplate::jpegDataOffset(const uint8_t *jpeg, size_t size)
+{
+    size_t offset = 2;
+
+    // libjpeg puts a JFIF APP0 after SOI, EXIF wants APP1 right after it
+    if ( ( offset + 4 <= size ) && ( 0xFF == jpeg[offset] ) && ( 0xE0 == jpeg[offset + 1] ) ) {
+        const size_t length = ( jpeg[offset + 2] << 8 ) | jpeg[offset + 3];
+        if ( offset + 2 + length <= size ) {
+            offset += 2 + length;
+        }
+    }
+
+    return offset;
+}
+
+} // namespace Camera
+} // namespace Ti
@@ -0,0 +1,645 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file FormatConverter.cpp
+*
+* NV12 to NV21/YV12/YUYV and YUYV/UYVY to NV12 conversion kernels with a per
+* CPU dispatch table.
+*
+*/
+
+#include "FormatConverter.h"
+
+#include <string.h>
+#include <pthread.h>
+#include <camera/CameraParameters.h>
+
+#if defined(ARCH_ARM_HAVE_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Ti {
+namespace Camera {
+
+/*--------------------Scalar kernels---------------------------------*/
+
+static void swapUVScalar(uint8_t *dst, const uint8_t *src, int pairs)
+{
+    for ( int i = 0; i < pairs; i++ ) {
+        dst[0] = src[1];
+        dst[1] = src[0];
+        dst += 2;
+        src += 2;
+    }
+}
+
+static void splitUVScalar(uint8_t *dstU, uint8_t *dstV, const uint8_t *src, int pairs)
+{
+    for ( int i = 0; i < pairs; i++ ) {
+        dstU[i] = src[0];
+        dstV[i] = src[1];
+        src += 2;
+    }
+}
+
+static void packYUYVScalar(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, int width)
+{
+    for ( int i = 0; i < width / 2; i++ ) {
+        dst[0] = srcY[0];
+        dst[1] = srcUV[0];
+        dst[2] = srcY[1];
+        dst[3] = srcUV[1];
+        dst += 4;
+        srcY += 2;
+        srcUV += 2;
+    }
+}
+
+// lumaOffset is 0 for YUYV and 1 for UYVY
+static inline void unpack422Scalar(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src,
+                                   int width, int lumaOffset)
+{
+    const uint8_t *y = src + lumaOffset;
+    const uint8_t *uv = src + 1 - lumaOffset;
+
+    for ( int i = 0; i < width; i++ ) {
+        dstY[i] = y[i * 2];
+    }
+
+    if ( NULL != dstUV ) {
+        for ( int i = 0; i < width; i++ ) {
+            dstUV[i] = uv[i * 2];
+        }
+    }
+}
+
+static void unpackYUYVScalar(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, int width)
+{
+    unpack422Scalar(dstY, dstUV, src, width, 0);
+}
+
+static void unpackUYVYScalar(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, int width)
+{
+    unpack422Scalar(dstY, dstUV, src, width, 1);
+}
+
+static const FormatConverter::Kernels gScalarKernels = {
+    FormatConverter::KERNELS_SCALAR,
+    "scalar",
+    swapUVScalar,
+    splitUVScalar,
+    packYUYVScalar,
+    unpackYUYVScalar,
+    unpackUYVYScalar,
+};
+
+/*--------------------NEON kernels---------------------------------*/
+
+#if defined(ARCH_ARM_HAVE_NEON)
+
+static void swapUVNeon(uint8_t *dst, const uint8_t *src, int pairs)
+{
+    int i = 0;
+
+    for ( ; i + 16 <= pairs; i += 16 ) {
+        const uint8x16x2_t uv = vld2q_u8(src + i * 2);
+        uint8x16x2_t vu;
+        vu.val[0] = uv.val[1];
+        vu.val[1] = uv.val[0];
+        vst2q_u8(dst + i * 2, vu);
+    }
+
+    swapUVScalar(dst + i * 2, src + i * 2, pairs - i);
+}
+
+static void splitUVNeon(uint8_t *dstU, uint8_t *dstV, const uint8_t *src, int pairs)
+{
+    int i = 0;
+
+    for ( ; i + 16 <= pairs; i += 16 ) {
+        const uint8x16x2_t uv = vld2q_u8(src + i * 2);
+        vst1q_u8(dstU + i, uv.val[0]);
+        vst1q_u8(dstV + i, uv.val[1]);
+    }
+
+    splitUVScalar(dstU + i, dstV + i, src + i * 2, pairs - i);
+}
+
+static void packYUYVNeon(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, int width)
+{
+    int i = 0;
+
+    for ( ; i + 16 <= width; i += 16 ) {
+        const uint8x8x2_t y = vld2_u8(srcY + i);
+        const uint8x8x2_t uv = vld2_u8(srcUV + i);
+        uint8x8x4_t yuyv;
+        yuyv.val[0] = y.val[0];
+        yuyv.val[1] = uv.val[0];
+        yuyv.val[2] = y.val[1];
+        yuyv.val[3] = uv.val[1];
+        vst4_u8(dst + i * 2, yuyv);
+    }
+
+    packYUYVScalar(dst + i * 2, srcY + i, srcUV + i, width - i);
+}
+
+static void unpackYUYVNeon(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, int width)
+{
+    int i = 0;
+
+    for ( ; i + 16 <= width; i += 16 ) {
+        const uint8x16x2_t yuyv = vld2q_u8(src + i * 2);
+        vst1q_u8(dstY + i, yuyv.val[0]);
+        if ( NULL != dstUV ) {
+            vst1q_u8(dstUV + i, yuyv.val[1]);
+        }
+    }
+
+    unpackYUYVScalar(dstY + i, dstUV ? dstUV + i : NULL, src + i * 2, width - i);
+}
+
+static void unpackUYVYNeon(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, int width)
+{
+    int i = 0;
+
+    for ( ; i + 16 <= width; i += 16 ) {
+        const uint8x16x2_t uyvy = vld2q_u8(src + i * 2);
+        vst1q_u8(dstY + i, uyvy.val[1]);
+        if ( NULL != dstUV ) {
+            vst1q_u8(dstUV + i, uyvy.val[0]);
+        }
+    }
+
+    unpackUYVYScalar(dstY + i, dstUV ? dstUV + i : NULL, src + i * 2, width - i);
+}
+
+static const FormatConverter::Kernels gNeonKernels = {
+    FormatConverter::KERNELS_NEON,
+    "neon",
+    swapUVNeon,
+    splitUVNeon,
+    packYUYVNeon,
+    unpackYUYVNeon,
+    unpackUYVYNeon,
+};
+
+#endif
+
+/*--------------------SSE2 kernels---------------------------------*/
+
+#if defined(__SSE2__)
+
+static void swapUVSse2(uint8_t *dst, const uint8_t *src, int pairs)
+{
+    int i = 0;
+
+    for ( ; i + 8 <= pairs; i += 8 ) {
+        const __m128i uv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+        const __m128i vu = _mm_or_si128(_mm_slli_epi16(uv, 8), _mm_srli_epi16(uv, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 2), vu);
+    }
+
+    swapUVScalar(dst + i * 2, src + i * 2, pairs - i);
+}
+
+static void splitUVSse2(uint8_t *dstU, uint8_t *dstV, const uint8_t *src, int pairs)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+    int i = 0;
+
+    for ( ; i + 16 <= pairs; i += 16 ) {
+        const __m128i uv0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+        const __m128i uv1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2 + 16));
+        const __m128i u = _mm_packus_epi16(_mm_and_si128(uv0, lowBytes), _mm_and_si128(uv1, lowBytes));
+        const __m128i v = _mm_packus_epi16(_mm_srli_epi16(uv0, 8), _mm_srli_epi16(uv1, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dstU + i), u);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dstV + i), v);
+    }
+
+    splitUVScalar(dstU + i, dstV + i, src + i * 2, pairs - i);
+}
+
+static void packYUYVSse2(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, int width)
+{
+    int i = 0;
+
+    for ( ; i + 16 <= width; i += 16 ) {
+        const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(srcY + i));
+        const __m128i uv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(srcUV + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 2), _mm_unpacklo_epi8(y, uv));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 2 + 16), _mm_unpackhi_epi8(y, uv));
+    }
+
+    packYUYVScalar(dst + i * 2, srcY + i, srcUV + i, width - i);
+}
+
+// lumaOffset is 0 for YUYV and 1 for UYVY
+static inline void unpack422Sse2(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src,
+                                 int width, int lumaOffset)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+    int i = 0;
+
+    for ( ; i + 16 <= width; i += 16 ) {
+        const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+        const __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2 + 16));
+        const __m128i even = _mm_packus_epi16(_mm_and_si128(p0, lowBytes), _mm_and_si128(p1, lowBytes));
+        const __m128i odd = _mm_packus_epi16(_mm_srli_epi16(p0, 8), _mm_srli_epi16(p1, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dstY + i), lumaOffset ? odd : even);
+        if ( NULL != dstUV ) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dstUV + i), lumaOffset ? even : odd);
+        }
+    }
+
+    unpack422Scalar(dstY + i, dstUV ? dstUV + i : NULL, src + i * 2, width - i, lumaOffset);
+}
+
+static void unpackYUYVSse2(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, int width)
+{
+    unpack422Sse2(dstY, dstUV, src, width, 0);
+}
+
+static void unpackUYVYSse2(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, int width)
+{
+    unpack422Sse2(dstY, dstUV, src, width, 1);
+}
+
+static const FormatConverter::Kernels gSse2Kernels = {
+    FormatConverter::KERNELS_SSE2,
+    "sse2",
+    swapUVSse2,
+    splitUVSse2,
+    packYUYVSse2,
+    unpackYUYVSse2,
+    unpackUYVYSse2,
+};
+
+#endif
+
+/*--------------------Dispatch---------------------------------*/
+
+static pthread_once_t gKernelsOnce = PTHREAD_ONCE_INIT;
+static const FormatConverter::Kernels *gKernels = &gScalarKernels;
+
+static void selectKernels()
+{
+#if defined(ARCH_ARM_HAVE_NEON)
+    gKernels = &gNeonKernels;
+#elif defined(__SSE2__)
+    if ( __builtin_cpu_supports("sse2") ) {
+        gKernels = &gSse2Kernels;
+    }
+#endif
+
+    CAMHAL_LOGDB("Using %s format conversion kernels", gKernels->name);
+}
+
+const FormatConverter::Kernels & FormatConverter::kernels()
+{
+    pthread_once(&gKernelsOnce, selectKernels);
+    return *gKernels;
+}
+
+const FormatConverter::Kernels * FormatConverter::kernels(KernelSet type)
+{
+    switch ( type ) {
+        case KERNELS_AUTO:
+            return &kernels();
+        case KERNELS_SCALAR:
+            return &gScalarKernels;
+#if defined(ARCH_ARM_HAVE_NEON)
+        case KERNELS_NEON:
+            return &gNeonKernels;
+#endif
+#if defined(__SSE2__)
+        case KERNELS_SSE2:
+            return &gSse2Kernels;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+FormatConverter::Format FormatConverter::fromPixelFormat(const char *pixelFormat)
+{
+    if ( NULL == pixelFormat ) {
+        return FORMAT_UNKNOWN;
+    }
+
+    if ( 0 == strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV420SP) ) {
+        return FORMAT_NV21;
+    } else if ( 0 == strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV420P) ) {
+        return FORMAT_YV12;
+    } else if ( 0 == strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV422I) ) {
+        return FORMAT_YUYV;
+    } else if ( 0 == strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_RGB565) ) {
+        return FORMAT_RGB565;
+    } else if ( 0 == strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_BAYER_RGGB) ) {
+        return FORMAT_BAYER_RGGB;
+    }
+
+    return FORMAT_UNKNOWN;
+}
+
+void FormatConverter::alignYV12(int width,
+                                int height,
+                                size_t &yStride,
+                                size_t &uvStride,
+                                size_t &ySize,
+                                size_t &uvSize,
+                                size_t &size)
+{
+    yStride = ( width + 0xF ) & ~0xF;
+    uvStride = ( yStride / 2 + 0xF ) & ~0xF;
+    ySize = yStride * height;
+    uvSize = uvStride * height / 2;
+    size = ySize + uvSize * 2;
+}
+
+void FormatConverter::copyStrided(uint8_t *dst, const uint8_t *src,
+                                  size_t rowBytes, size_t srcStride, int height)
+{
+    if ( rowBytes == srcStride ) {
+        memcpy(dst, src, rowBytes * height);
+        return;
+    }
+
+    for ( int i = 0; i < height; i++ ) {
+        memcpy(dst, src, rowBytes);
+        dst += rowBytes;
+        src += srcStride;
+    }
+}
+
+status_t FormatConverter::convertFromNV12(Format format,
+                                          uint8_t *dst,
+                                          const uint8_t *srcY,
+                                          const uint8_t *srcUV,
+                                          int width,
+                                          int height,
+                                          size_t stride,
+                                          uint32_t offset,
+                                          size_t length,
+                                          const Kernels & k)
+{
+    if ( !dst || !srcY || !srcUV || (width <= 0) || (height <= 0) || (0 == stride) ) {
+        return BAD_VALUE;
+    }
+
+    const uint32_t xOff = offset % stride;
+    const uint32_t yOff = offset / stride;
+    const uint8_t *y = srcY + offset;
+    const uint8_t *uv = srcUV + (stride/2)*yOff + xOff;
+
+    switch ( format ) {
+        case FORMAT_NV21:
+        {
+            // never read past the end of the source buffer
+            const int maxRows = static_cast<int>((length + stride - 1) / stride);
+            const int lumaRows = height < maxRows ? height : maxRows;
+
+            copyStrided(dst, y, width, stride, lumaRows);
+
+            uint8_t *dstUV = dst + width * height;
+            for ( int i = 0; i < height / 2; i++ ) {
+                k.swapUV(dstUV, uv, width / 2);
+                dstUV += width;
+                uv += stride;
+            }
+            break;
+        }
+
+        case FORMAT_YV12:
+        {
+            size_t yStride, uvStride, ySize, uvSize, size;
+            alignYV12(width, height, yStride, uvStride, ySize, uvSize, size);
+
+            uint8_t *dstY = dst;
+            for ( int i = 0; i < height; i++ ) {
+                memcpy(dstY, y, width);
+                dstY += yStride;
+                y += stride;
+            }
+
+            uint8_t *dstV = dst + ySize;
+            uint8_t *dstU = dst + ySize + uvSize;
+            for ( int i = 0; i < height / 2; i++ ) {
+                k.splitUV(dstU, dstV, uv, width / 2);
+                dstU += uvStride;
+                dstV += uvStride;
+                uv += stride;
+            }
+            break;
+        }
+
+        case FORMAT_YUYV:
+        {
+            for ( int i = 0; i < height; i++ ) {
+                k.packYUYV(dst, y, uv, width);
+                dst += width * 2;
+                y += stride;
+                if ( i % 2 ) {
+                    uv += stride;
+                }
+            }
+            break;
+        }
+
+        default:
+        {
+            // no conversion, the frame already is in the requested format
+            const size_t row = width * 2;
+            const size_t alignedRow = ( row + ( stride - 1 ) ) & ( ~ ( stride - 1 ) );
+
+            copyStrided(dst, srcY, row, alignedRow, height);
+            break;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+status_t FormatConverter::convertToNV12(Format format,
+                                        uint8_t *dstY,
+                                        uint8_t *dstUV,
+                                        size_t dstStride,
+                                        const uint8_t *src,
+                                        size_t srcStride,
+                                        int width,
+                                        int height,
+                                        const Kernels & k)
+{
+    void (*unpack)(uint8_t *, uint8_t *, const uint8_t *, int) = NULL;
+
+    if ( !dstY || !dstUV || !src || (width <= 0) || (height <= 0) ||
+         (dstStride < static_cast<size_t>(width)) ||
+         (srcStride < static_cast<size_t>(width) * 2) ) {
+        return BAD_VALUE;
+    }
+
+    switch ( format ) {
+        case FORMAT_YUYV:
+            unpack = k.unpackYUYV;
+            break;
+        case FORMAT_UYVY:
+            unpack = k.unpackUYVY;
+            break;
+        default:
+            return BAD_VALUE;
+    }
+
+    for ( int i = 0; i < height; i++ ) {
+        unpack(dstY, (i & 1) ? NULL : dstUV, src, width);
+        dstY += dstStride;
+        src += srcStride;
+        if ( i & 1 ) {
+            dstUV += dstStride;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+/*--------------------NV12Converter---------------------------------*/
+
+NV12Converter::NV12Converter()
+    : mBandPending(false),
+      mBandStatus(NO_ERROR),
+      mExiting(false)
+{
+#ifdef PPM_PER_FRAME_CONVERSION
+    mFrameCount = 0;
+    mConversionTime = 0;
+#endif
+}
+
+NV12Converter::~NV12Converter()
+{
+    if ( mHelper.get() ) {
+        {
+            android::AutoMutex lock(mLock);
+            mExiting = true;
+            mCondition.broadcast();
+        }
+        mHelper->requestExitAndWait();
+        mHelper.clear();
+    }
+}
+
+bool NV12Converter::helperLoop()
+{
+    Band band;
+
+    {
+        android::AutoMutex lock(mLock);
+        while ( !mBandPending && !mExiting ) {
+            mCondition.wait(mLock);
+        }
+        if ( mExiting ) {
+            return false;
+        }
+        band = mBand;
+    }
+
+    status_t ret = FormatConverter::convertToNV12(band.format, band.dstY, band.dstUV, band.dstStride,
+                                                  band.src, band.width * 2, band.width, band.height);
+
+    {
+        android::AutoMutex lock(mLock);
+        mBandStatus = ret;
+        mBandPending = false;
+        mCondition.broadcast();
+    }
+
+    return true;
+}
+
+status_t NV12Converter::convert(FormatConverter::Format format,
+                                uint8_t *dstY,
+                                uint8_t *dstUV,
+                                size_t dstStride,
+                                const uint8_t *src,
+                                int width,
+                                int height)
+{
+    status_t ret = NO_ERROR;
+    // the bottom band has to start on an even row to keep chroma aligned
+    const int topRows = ( height / 2 ) & ~1;
+
+#ifdef PPM_PER_FRAME_CONVERSION
+    nsecs_t ppmStart = systemTime();
+#endif
+
+    if ( (width * height > SPLIT_THRESHOLD) && (topRows > 0) && !mHelper.get() ) {
+        mHelper = new Helper(this);
+        if ( NO_ERROR != mHelper->run("NV12Converter", android::PRIORITY_URGENT_DISPLAY) ) {
+            CAMHAL_LOGEA("Couldn't start conversion helper, converting on a single thread");
+            mHelper.clear();
+        }
+    }
+
+    if ( (width * height <= SPLIT_THRESHOLD) || (topRows <= 0) || !mHelper.get() ) {
+        ret = FormatConverter::convertToNV12(format, dstY, dstUV, dstStride,
+                                             src, width * 2, width, height);
+    } else {
+        {
+            android::AutoMutex lock(mLock);
+            mBand.format = format;
+            mBand.dstY = dstY + topRows * dstStride;
+            mBand.dstUV = dstUV + ( topRows / 2 ) * dstStride;
+            mBand.dstStride = dstStride;
+            mBand.src = src + topRows * width * 2;
+            mBand.width = width;
+            mBand.height = height - topRows;
+            mBandPending = true;
+            mCondition.broadcast();
+        }
+
+        ret = FormatConverter::convertToNV12(format, dstY, dstUV, dstStride,
+                                             src, width * 2, width, topRows);
+
+        android::AutoMutex lock(mLock);
+        while ( mBandPending ) {
+            mCondition.wait(mLock);
+        }
+        if ( NO_ERROR == ret ) {
+            ret = mBandStatus;
+        }
+    }
+
+#ifdef PPM_PER_FRAME_CONVERSION
+    mConversionTime += systemTime() - ppmStart;
+    mFrameCount++;
+
+    if ( mFrameCount >= 30 ) {
+        mConversionTime /= mFrameCount;
+        CAMHAL_LOGDB("PPM: YUV422i to NV12 Conversion(%d x %d): %llu us ( %llu ms )", width, height,
+                     ns2us(mConversionTime), ns2ms(mConversionTime));
+        mConversionTime = 0;
+        mFrameCount = 0;
+    }
+#endif
+
+    return ret;
+}
+
+} // namespace Camera
+} // namespace Ti
@@ -22,7 +22,7 @@ namespace Ti {
 namespace Camera {
 
 FrameDecoder::FrameDecoder()
-: mCameraHal(NULL), mState(DecoderState_Uninitialized) {
+: mCameraHal(NULL), mState(DecoderState_Uninitialized), mOutputReady(0) {
 }
 
 FrameDecoder::~FrameDecoder() {
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file FrameTrace.cpp
+*
+* Per thread stamp rings, latency histograms and Chrome trace output of
+* the frame timeline.
+*
+*/
+
+#include "FrameTrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <utils/threads.h>
+#include <utils/String8.h>
+
+namespace Ti {
+namespace Camera {
+
+const char FrameTrace::TRACE_FILE[] = "/data/misc/camera/frame_trace.json";
+
+volatile int32_t FrameTrace::sEnabled = 0;
+
+/*--------------------Stamp rings---------------------------------*/
+
+// Power of two, several seconds of 30 fps preview for any thread
+static const int32_t RING_SIZE = 1024;
+static const int MAX_RINGS = 32;
+
+// Bucket 0 holds latencies under 64 us, every further bucket doubles
+static const int HISTOGRAM_BUCKETS = 16;
+static const nsecs_t HISTOGRAM_BASE = 64000;
+
+struct TraceEvent {
+    nsecs_t time;
+    const void *buffer;
+    int32_t tid;
+    uint16_t stage;
+    uint16_t frameType;
+};
+
+// Written only by the thread owning it. A ring is handed to a new thread
+// once its owner exits, older events stay until they are overwritten.
+struct TraceRing {
+    volatile int32_t inUse;
+    volatile int32_t head;
+    int32_t tid;
+    TraceEvent events[RING_SIZE];
+};
+
+static const char * const kStageNames[FrameTrace::STAGE_MAX + 1] = {
+    "sensor",
+    "fill_buffer_done",
+    "subscribers",
+    "display",
+    "app_callback",
+    "return",
+    "total",
+};
+
+// Stage latencies are measured from this stage when the frame has it,
+// from the previous stamp otherwise. Display and application callbacks
+// both run from the subscriber notification.
+static const int kParentStage[FrameTrace::STAGE_MAX] = {
+    -1,
+    FrameTrace::STAGE_SENSOR,
+    FrameTrace::STAGE_FILL_BUFFER_DONE,
+    FrameTrace::STAGE_SUBSCRIBERS,
+    FrameTrace::STAGE_SUBSCRIBERS,
+    -1,
+};
+
+static android::Mutex gRingsLock;
+static TraceRing *gRings[MAX_RINGS];
+static volatile int32_t gRingCount = 0;
+static nsecs_t gStartTime = 0;
+
+static pthread_key_t gRingKey;
+static pthread_once_t gRingKeyOnce = PTHREAD_ONCE_INIT;
+
+static void releaseRing(void *ring)
+{
+    android_atomic_release_store(0, &static_cast<TraceRing *>(ring)->inUse);
+}
+
+static void createRingKey()
+{
+    pthread_key_create(&gRingKey, releaseRing);
+}
+
+static TraceRing *getRing()
+{
+    TraceRing *ring;
+
+    pthread_once(&gRingKeyOnce, createRingKey);
+
+    ring = static_cast<TraceRing *>(pthread_getspecific(gRingKey));
+    if ( NULL != ring ) {
+        return ring;
+    }
+
+    android::AutoMutex lock(gRingsLock);
+
+    for ( int i = 0; i < gRingCount; i++ ) {
+        if ( 0 == gRings[i]->inUse ) {
+            ring = gRings[i];
+            break;
+        }
+    }
+
+    if ( NULL == ring ) {
+        if ( MAX_RINGS <= gRingCount ) {
+            return NULL;
+        }
+
+        ring = static_cast<TraceRing *>(calloc(1, sizeof(TraceRing)));
+        if ( NULL == ring ) {
+            return NULL;
+        }
+
+        gRings[gRingCount] = ring;
+        android_atomic_release_store(gRingCount + 1, &gRingCount);
+    }
+
+    ring->inUse = 1;
+    ring->tid = gettid();
+    pthread_setspecific(gRingKey, ring);
+
+    return ring;
+}
+
+void FrameTrace::record(Stage stage, const void *buffer, int frameType, nsecs_t time)
+{
+    TraceRing *ring = getRing();
+    if ( NULL == ring ) {
+        return;
+    }
+
+    const int32_t head = ring->head;
+    TraceEvent &event = ring->events[head & ( RING_SIZE - 1 )];
+    event.time = time;
+    event.buffer = buffer;
+    event.tid = ring->tid;
+    event.stage = stage;
+    event.frameType = frameType;
+
+    android_atomic_release_store(head + 1, &ring->head);
+}
+
+void FrameTrace::setEnabled(bool enable)
+{
+    if ( enable == isEnabled() ) {
+        return;
+    }
+
+    if ( enable ) {
+        android::AutoMutex lock(gRingsLock);
+        gStartTime = systemTime();
+    }
+
+    android_atomic_release_store(enable ? 1 : 0, &sEnabled);
+
+    CAMHAL_LOGDB("Frame tracing %s", enable ? "enabled" : "disabled");
+}
+
+/*--------------------Dump---------------------------------*/
+
+struct Histogram {
+    uint32_t count;
+    nsecs_t sum;
+    nsecs_t max;
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+};
+
+static void addSample(Histogram &histogram, nsecs_t latency)
+{
+    int bucket = 0;
+
+    while ( ( bucket < HISTOGRAM_BUCKETS - 1 ) && ( latency >= ( HISTOGRAM_BASE << bucket ) ) ) {
+        bucket++;
+    }
+
+    histogram.count++;
+    histogram.sum += latency;
+    if ( latency > histogram.max ) {
+        histogram.max = latency;
+    }
+    histogram.buckets[bucket]++;
+}
+
+static int compareEvents(const void *a, const void *b)
+{
+    const TraceEvent *left = static_cast<const TraceEvent *>(a);
+    const TraceEvent *right = static_cast<const TraceEvent *>(b);
+
+    if ( left->buffer != right->buffer ) {
+        return ( left->buffer < right->buffer ) ? -1 : 1;
+    }
+
+    if ( left->time != right->time ) {
+        return ( left->time < right->time ) ? -1 : 1;
+    }
+
+    return ( left->stage < right->stage ) ? -1 : ( left->stage > right->stage );
+}
+
+static void writeTraceEvent(FILE *file, bool &first, const char *name,
+                            nsecs_t start, nsecs_t duration, const TraceEvent &event)
+{
+    fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\","
+                  "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                  "\"args\":{\"buffer\":\"%p\",\"type\":\"0x%x\"}}",
+            first ? "" : ",", name,
+            start / 1000.0, duration / 1000.0, getpid(), event.tid,
+            event.buffer, event.frameType);
+    first = false;
+}
+
+void FrameTrace::dump(int fd)
+{
+    TraceEvent *events;
+    Histogram histograms[STAGE_MAX + 1];
+    size_t eventCount = 0;
+    nsecs_t startTime;
+    int32_t ringCount;
+    FILE *file;
+    bool first = true;
+
+    {
+        android::AutoMutex lock(gRingsLock);
+        startTime = gStartTime;
+        ringCount = gRingCount;
+    }
+
+    events = static_cast<TraceEvent *>(malloc(ringCount * RING_SIZE * sizeof(TraceEvent)));
+    if ( ( NULL == events ) && ( 0 < ringCount ) ) {
+        CAMHAL_LOGEA("Couldn't allocate trace dump");
+        return;
+    }
+
+    // Entries being overwritten while they are copied may come out torn,
+    // which at worst adds a bogus sample
+    for ( int32_t i = 0; i < ringCount; i++ ) {
+        const TraceRing *ring = gRings[i];
+        const int32_t head = android_atomic_acquire_load(&ring->head);
+        const int32_t count = ( head < RING_SIZE ) ? head : RING_SIZE;
+
+        for ( int32_t j = head - count; j < head; j++ ) {
+            const TraceEvent &event = ring->events[j & ( RING_SIZE - 1 )];
+            if ( ( event.time >= startTime ) && ( STAGE_MAX > event.stage ) ) {
+                events[eventCount++] = event;
+            }
+        }
+    }
+
+    qsort(events, eventCount, sizeof(TraceEvent), compareEvents);
+
+    memset(histograms, 0, sizeof(histograms));
+
+    file = fopen(TRACE_FILE, "w");
+    if ( NULL == file ) {
+        CAMHAL_LOGEB("Couldn't open %s", TRACE_FILE);
+    } else {
+        fprintf(file, "{\"traceEvents\":[");
+    }
+
+    // Each pass of a buffer from the camera back to the adapter is one
+    // frame, it starts with its sensor or fill buffer done stamp
+    nsecs_t stageTimes[STAGE_MAX];
+    nsecs_t lastTime = 0;
+    nsecs_t frameStart = 0;
+    const void *buffer = NULL;
+
+    memset(stageTimes, 0, sizeof(stageTimes));
+
+    for ( size_t i = 0; i < eventCount; i++ ) {
+        const TraceEvent &event = events[i];
+        const int stage = event.stage;
+
+        bool newFrame = ( event.buffer != buffer ) || ( 0 == frameStart ) ||
+                        ( STAGE_SENSOR == stage );
+        if ( ( STAGE_FILL_BUFFER_DONE == stage ) &&
+             !( ( 0 != stageTimes[STAGE_SENSOR] ) && ( 0 == stageTimes[STAGE_FILL_BUFFER_DONE] ) ) ) {
+            newFrame = true;
+        }
+
+        if ( newFrame ) {
+            memset(stageTimes, 0, sizeof(stageTimes));
+            buffer = event.buffer;
+            frameStart = event.time;
+            lastTime = event.time;
+            stageTimes[stage] = event.time;
+            if ( STAGE_RETURN == stage ) {
+                frameStart = 0;
+            }
+            continue;
+        }
+
+        nsecs_t from = lastTime;
+        if ( ( 0 <= kParentStage[stage] ) && ( 0 != stageTimes[kParentStage[stage]] ) ) {
+            from = stageTimes[kParentStage[stage]];
+        }
+
+        addSample(histograms[stage], event.time - from);
+        if ( NULL != file ) {
+            writeTraceEvent(file, first, kStageNames[stage], from, event.time - from, event);
+        }
+
+        stageTimes[stage] = event.time;
+        lastTime = event.time;
+
+        if ( STAGE_RETURN == stage ) {
+            addSample(histograms[STAGE_MAX], event.time - frameStart);
+            frameStart = 0;
+        }
+    }
+
+    if ( NULL != file ) {
+        fprintf(file, "\n]}\n");
+        fclose(file);
+    }
+
+    free(events);
+
+    android::String8 out;
+    out.appendFormat("Frame trace: %s, %u events\n",
+                     isEnabled() ? "enabled" : "disabled", ( unsigned int ) eventCount);
+
+    for ( int stage = STAGE_FILL_BUFFER_DONE; stage <= STAGE_MAX; stage++ ) {
+        const Histogram &histogram = histograms[stage];
+        if ( 0 == histogram.count ) {
+            continue;
+        }
+
+        out.appendFormat("    %-16s n %u, avg %u us, max %u us\n       ",
+                         kStageNames[stage], histogram.count,
+                         ( unsigned int ) ns2us(histogram.sum / histogram.count),
+                         ( unsigned int ) ns2us(histogram.max));
+        for ( int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++ ) {
+            if ( 0 == histogram.buckets[bucket] ) {
+                continue;
+            }
+            if ( HISTOGRAM_BUCKETS - 1 == bucket ) {
+                out.appendFormat(" >=%uus:%u", ( unsigned int ) ns2us(HISTOGRAM_BASE << ( bucket - 1 )),
+                                 histogram.buckets[bucket]);
+            } else {
+                out.appendFormat(" <%uus:%u", ( unsigned int ) ns2us(HISTOGRAM_BASE << bucket),
+                                 histogram.buckets[bucket]);
+            }
+        }
+        out.append("\n");
+    }
+
+    if ( NULL != file ) {
+        out.appendFormat("    timeline written to %s\n", TRACE_FILE);
+    }
+
+    write(fd, out.string(), out.length());
+}
+
+} // namespace Camera
+} // namespace Ti
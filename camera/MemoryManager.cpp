@@ -17,6 +17,8 @@
 #include "CameraHal.h"
 #include "TICameraParameters.h"
 
+#include <cutils/properties.h>
+
 extern "C" {
 
 //#include <timm_osal_interfaces.h>
@@ -39,9 +41,21 @@ namespace Camera {
 /*--------------------MemoryManager Class STARTS here-----------------------------*/
 MemoryManager::MemoryManager() {
     mIonFd = -1;
+    mPoolLimit = DEFAULT_POOL_LIMIT;
+    mIdleBytes = 0;
+    mInUseBytes = 0;
+    mPeakBytes = 0;
+    mHits = 0;
+    mMisses = 0;
+    mTrimmed = 0;
 }
 
 MemoryManager::~MemoryManager() {
+    {
+        android::AutoMutex lock(mPoolLock);
+        trimPool(0);
+    }
+
     if ( mIonFd >= 0 ) {
         ion_close(mIonFd);
         mIonFd = -1;
@@ -58,9 +72,180 @@ status_t MemoryManager::initialize() {
         }
     }
 
+    char value[PROPERTY_VALUE_MAX];
+    if ( property_get("ro.camera.mempool.size", value, 0) > 0 ) {
+        setPoolLimit((size_t)atoi(value) * 1024 * 1024);
+    }
+
     return OK;
 }
 
+void MemoryManager::setPoolLimit(size_t bytes)
+{
+    android::AutoMutex lock(mPoolLock);
+
+    CAMHAL_LOGDB("Buffer pool limit %u KB", bytes / 1024);
+    mPoolLimit = bytes;
+    trimPool(mPoolLimit);
+}
+
+/**
+   @brief Rounds a buffer size up to its pool size class
+
+   There are eight classes for each power of two, so at most 1/8 of a
+   buffer is lost to rounding while similar sizes (e.g. the capture buffers
+   of neighbouring resolutions) can still share pooled buffers.
+ */
+size_t MemoryManager::sizeClass(size_t size)
+{
+    size_t step = 4096;
+
+    while ( ( step << 4 ) < size ) {
+        step <<= 1;
+    }
+
+    return ( size + step - 1 ) & ~( step - 1 );
+}
+
+status_t MemoryManager::allocateEntry(size_t size, PoolEntry &entry)
+{
+    struct ion_handle *handle;
+    unsigned char *data;
+    int mmap_fd;
+    size_t stride;
+
+#ifdef USE_LIBION_TI
+    int ret = ion_alloc(mIonFd, size, 0, 1 << ION_HEAP_TYPE_CARVEOUT,
+            &handle);
+#else
+    int ret = ion_alloc(mIonFd, size, 0, 1 << ION_HEAP_TYPE_CARVEOUT, 0,
+            &handle);
+#endif
+    if((ret < 0) || ((int)handle == -ENOMEM)) {
+        ret = ion_alloc_tiler(mIonFd, (size_t)size, 1, TILER_PIXEL_FMT_PAGE,
+        OMAP_ION_HEAP_TILER_MASK, &handle, &stride);
+    }
+
+    if((ret < 0) || ((int)handle == -ENOMEM)) {
+        CAMHAL_LOGEB("FAILED to allocate ion buffer of size=%d. ret=%d(0x%x)", size, ret, ret);
+        return NO_MEMORY;
+    }
+
+    CAMHAL_LOGDB("Before mapping, handle = %p, nSize = %d", handle, size);
+    if ((ret = ion_map(mIonFd, handle, size, PROT_READ | PROT_WRITE, MAP_SHARED, 0,
+                  &data, &mmap_fd)) < 0) {
+        CAMHAL_LOGEB("Userspace mapping of ION buffers returned error %d", ret);
+        ion_free(mIonFd, handle);
+        return NO_MEMORY;
+    }
+
+    entry.handle = handle;
+    entry.data = data;
+    entry.mmapFd = mmap_fd;
+    entry.size = size;
+
+    return NO_ERROR;
+}
+
+void MemoryManager::freeEntry(const PoolEntry &entry)
+{
+    munmap(entry.data, entry.size);
+    close(entry.mmapFd);
+    ion_free(mIonFd, entry.handle);
+}
+
+/**
+   @brief Drops least recently used idle buffers until the pool holds at most limit bytes
+
+   Must be called with mPoolLock held
+ */
+void MemoryManager::trimPool(size_t limit)
+{
+    while ( ( mIdleBytes > limit ) && !mIdle.isEmpty() ) {
+        const PoolEntry &entry = mIdle.itemAt(0);
+        mIdleBytes -= entry.size;
+        freeEntry(entry);
+        mIdle.removeAt(0);
+        mTrimmed++;
+    }
+}
+
+/**
+   @brief Gets a mapped buffer of at least requested bytes, from the pool if possible
+
+   Sizes are only rounded up to their size class while pooling is on,
+   otherwise the buffer is allocated with the exact size
+ */
+status_t MemoryManager::acquireEntry(size_t requested, PoolEntry &entry)
+{
+    android::AutoMutex lock(mPoolLock);
+    const size_t size = ( 0 < mPoolLimit ) ? sizeClass(requested) : requested;
+    status_t ret = NO_ERROR;
+    bool found = false;
+
+    // most recently released buffers first, they are the likeliest to be cache warm
+    for ( ssize_t i = mIdle.size() - 1 ; i >= 0 ; i-- ) {
+        if ( mIdle.itemAt(i).size == size ) {
+            entry = mIdle.itemAt(i);
+            mIdle.removeAt(i);
+            mIdleBytes -= size;
+            found = true;
+            break;
+        }
+    }
+
+    if ( found ) {
+        // like fresh carveout memory, reused buffers are handed out as they are
+        mHits++;
+    } else {
+        mMisses++;
+        ret = allocateEntry(size, entry);
+        if ( ( NO_ERROR != ret ) && !mIdle.isEmpty() ) {
+            // idle buffers of other sizes may be what keeps the heap full
+            CAMHAL_LOGDB("Releasing %u KB of pooled buffers and retrying", mIdleBytes / 1024);
+            trimPool(0);
+            ret = allocateEntry(size, entry);
+        }
+    }
+
+    if ( NO_ERROR == ret ) {
+        mInUse.add(entry.handle, entry);
+        mInUseBytes += size;
+        if ( mInUseBytes + mIdleBytes > mPeakBytes ) {
+            mPeakBytes = mInUseBytes + mIdleBytes;
+        }
+    }
+
+    return ret;
+}
+
+/**
+   @brief Returns a buffer to the pool, keeping it mapped for the next allocation
+ */
+void MemoryManager::releaseEntry(struct ion_handle *handle)
+{
+    android::AutoMutex lock(mPoolLock);
+
+    ssize_t index = mInUse.indexOfKey(handle);
+    if ( index < 0 ) {
+        CAMHAL_LOGEB("Buffer %p was not allocated by this memory manager", handle);
+        return;
+    }
+
+    PoolEntry entry = mInUse.valueAt(index);
+    mInUse.removeItemsAt(index);
+    mInUseBytes -= entry.size;
+
+    if ( entry.size > mPoolLimit ) {
+        freeEntry(entry);
+        return;
+    }
+
+    mIdle.push_back(entry);
+    mIdleBytes += entry.size;
+    trimPool(mPoolLimit);
+}
+
 CameraBuffer* MemoryManager::allocateBufferList(int width, int height, const char* format, int &size, int numBufs)
 {
     LOG_FUNCTION_NAME;
@@ -84,44 +269,20 @@ CameraBuffer* MemoryManager::allocateBufferList(int width, int height, const cha
 
     //2D Allocations are not supported currently
     if(size != 0) {
-        struct ion_handle *handle;
-        int mmap_fd;
-        size_t stride;
-
         ///1D buffers
         for (int i = 0; i < numBufs; i++) {
-            unsigned char *data;
-#ifdef USE_LIBION_TI
-            int ret = ion_alloc(mIonFd, size, 0, 1 << ION_HEAP_TYPE_CARVEOUT,
-                    &handle);
-#else
-            int ret = ion_alloc(mIonFd, size, 0, 1 << ION_HEAP_TYPE_CARVEOUT, 0,
-                    &handle);
-#endif
-            if((ret < 0) || ((int)handle == -ENOMEM)) {
-                ret = ion_alloc_tiler(mIonFd, (size_t)size, 1, TILER_PIXEL_FMT_PAGE,
-                OMAP_ION_HEAP_TILER_MASK, &handle, &stride);
-            }
-
-            if((ret < 0) || ((int)handle == -ENOMEM)) {
-                CAMHAL_LOGEB("FAILED to allocate ion buffer of size=%d. ret=%d(0x%x)", size, ret, ret);
-                goto error;
-            }
+            PoolEntry entry;
 
-            CAMHAL_LOGDB("Before mapping, handle = %p, nSize = %d", handle, size);
-            if ((ret = ion_map(mIonFd, handle, size, PROT_READ | PROT_WRITE, MAP_SHARED, 0,
-                          &data, &mmap_fd)) < 0) {
-                CAMHAL_LOGEB("Userspace mapping of ION buffers returned error %d", ret);
-                ion_free(mIonFd, handle);
+            if ( NO_ERROR != acquireEntry(size, entry) ) {
                 goto error;
             }
 
             buffers[i].type = CAMERA_BUFFER_ION;
-            buffers[i].opaque = data;
-            buffers[i].mapped = data;
-            buffers[i].ion_handle = handle;
+            buffers[i].opaque = entry.data;
+            buffers[i].mapped = entry.data;
+            buffers[i].ion_handle = entry.handle;
             buffers[i].ion_fd = mIonFd;
-            buffers[i].fd = mmap_fd;
+            buffers[i].fd = entry.mmapFd;
             buffers[i].size = size;
             buffers[i].format = CameraHal::getPixelFormatConstant(format);
 
@@ -191,9 +352,7 @@ int MemoryManager::freeBufferList(CameraBuffer *buffers)
         {
         if(buffers[i].size)
             {
-            munmap(buffers[i].opaque, buffers[i].size);
-            close(buffers[i].fd);
-            ion_free(mIonFd, buffers[i].ion_handle);
+            releaseEntry(buffers[i].ion_handle);
             }
         else
             {
@@ -208,6 +367,27 @@ int MemoryManager::freeBufferList(CameraBuffer *buffers)
     return ret;
 }
 
+void MemoryManager::dump(int fd) const
+{
+    android::AutoMutex lock(mPoolLock);
+    char buffer[256];
+
+    int len = snprintf(buffer, sizeof(buffer),
+            "MemoryManager buffer pool:\n"
+            "    limit %u KB, peak %u KB\n"
+            "    in use %u buffers, %u KB\n"
+            "    idle %u buffers, %u KB\n"
+            "    hits %u, misses %u, trimmed %u\n",
+            mPoolLimit / 1024, mPeakBytes / 1024,
+            mInUse.size(), mInUseBytes / 1024,
+            mIdle.size(), mIdleBytes / 1024,
+            mHits, mMisses, mTrimmed);
+
+    if ( len > 0 ) {
+        write(fd, buffer, len);
+    }
+}
+
 status_t MemoryManager::setErrorHandler(ErrorNotifier *errorNotifier)
 {
     status_t ret = NO_ERROR;
@@ -16,6 +16,20 @@
 
 #include "NV12_resize.h"
 
+#include <stdlib.h>
+#include <unistd.h>
+#include <utils/threads.h>
+
+#if defined(ARCH_ARM_HAVE_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NV12_RESIZE_HAVE_AVX2
+#endif
+#endif
+
 #ifdef LOG_TAG
 #undef LOG_TAG
 #endif
@@ -23,29 +37,400 @@
 
 #define STRIDE 4096
 
+/*
+ * The resize is a 2x2 bilinear filter with 3 bit fractional positions.
+ * bWeights[xf][yf] holds the products of the horizontal and vertical
+ * weights, so the filter can be split into a vertical pass producing
+ * 16 bit intermediates and a horizontal pass on top of it:
+ *
+ *   out = ((8-xf)*((8-yf)*A + yf*C) + xf*((8-yf)*B + yf*D)) >> 6
+ *
+ * which is exactly the sum computed by the reference implementation, so
+ * all kernels produce identical output.
+ */
+#define RESIZE_FRAC_BITS 3
+#define RESIZE_FRAC_ONE (1 << RESIZE_FRAC_BITS)
+
+/* Rows handed to a single worker are kept even, so luma and chroma stripes line up */
+#define RESIZE_MIN_STRIPE_ROWS 16
+
+namespace {
+
+template <typename T>
+inline T min(T a, T b) { return a < b ? a : b; }
+
+template <typename T>
+inline T max(T a, T b) { return a < b ? b : a; }
+
+/* Vertical blend of two source rows: dst[i] = top[i]*wTop + bottom[i]*wBottom */
+typedef void (*BlendRowsFunc)(const mmUchar *top, const mmUchar *bottom,
+                              mmUint16 *dst, mmInt32 count,
+                              mmUint16 wTop, mmUint16 wBottom);
+
+/* Per call resize description, shared by all stripes */
+struct ResizePlan {
+    const mmUchar *srcY;
+    const mmUchar *srcUV;
+    mmInt32 srcStride;
+
+    mmUchar *dstY;
+    mmUchar *dstUV;
+    mmInt32 dstStride;
+    /* output row stored at dstY, non zero when producing a band of the image */
+    mmInt32 dstFirstRow;
+
+    mmInt32 outWidth;
+    mmInt32 outHeight;
+
+    /* source column and fractional weight for every output column */
+    const mmUint16 *colIndex;
+    const mmUchar *colFrac;
+    /* source row and fractional weight for every output row */
+    const mmUint16 *rowIndex;
+    const mmUchar *rowFrac;
+
+    /* number of source bytes touched by one luma / chroma row */
+    mmInt32 lumaSpan;
+    mmInt32 chromaSpan;
+
+    BlendRowsFunc blendRows;
+};
+
+/* One horizontal band of the output image */
+struct ResizeStripe {
+    const ResizePlan *plan;
+    mmInt32 firstRow;
+    mmInt32 lastRow;        /* exclusive */
+    mmUint16 *scratch;      /* lumaSpan/chromaSpan sized intermediate row */
+};
+
+
+/*--------------------Vertical blend kernels---------------------------------*/
+
+void blendRowsScalar(const mmUchar *top, const mmUchar *bottom,
+                     mmUint16 *dst, mmInt32 count,
+                     mmUint16 wTop, mmUint16 wBottom)
+{
+    for ( mmInt32 i = 0; i < count; i++ ) {
+        dst[i] = (mmUint16) (top[i] * wTop + bottom[i] * wBottom);
+    }
+}
+
+#if defined(ARCH_ARM_HAVE_NEON)
+
+void blendRowsNeon(const mmUchar *top, const mmUchar *bottom,
+                   mmUint16 *dst, mmInt32 count,
+                   mmUint16 wTop, mmUint16 wBottom)
+{
+    const uint8x8_t vTop = vdup_n_u8((mmUchar) wTop);
+    const uint8x8_t vBottom = vdup_n_u8((mmUchar) wBottom);
+    mmInt32 i = 0;
+
+    for ( ; i + 16 <= count; i += 16 ) {
+        const uint8x16_t t = vld1q_u8(top + i);
+        const uint8x16_t b = vld1q_u8(bottom + i);
+
+        uint16x8_t lo = vmull_u8(vget_low_u8(t), vTop);
+        uint16x8_t hi = vmull_u8(vget_high_u8(t), vTop);
+        lo = vmlal_u8(lo, vget_low_u8(b), vBottom);
+        hi = vmlal_u8(hi, vget_high_u8(b), vBottom);
+
+        vst1q_u16(dst + i, lo);
+        vst1q_u16(dst + i + 8, hi);
+    }
+
+    blendRowsScalar(top + i, bottom + i, dst + i, count - i, wTop, wBottom);
+}
+
+#elif defined(__SSE2__)
+
+void blendRowsSse2(const mmUchar *top, const mmUchar *bottom,
+                   mmUint16 *dst, mmInt32 count,
+                   mmUint16 wTop, mmUint16 wBottom)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vTop = _mm_set1_epi16(wTop);
+    const __m128i vBottom = _mm_set1_epi16(wBottom);
+    mmInt32 i = 0;
+
+    for ( ; i + 16 <= count; i += 16 ) {
+        const __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(top + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom + i));
+
+        const __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(t, zero), vTop),
+                                         _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), vBottom));
+        const __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(t, zero), vTop),
+                                         _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), vBottom));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 8), hi);
+    }
+
+    blendRowsScalar(top + i, bottom + i, dst + i, count - i, wTop, wBottom);
+}
+
+#ifdef NV12_RESIZE_HAVE_AVX2
+
+__attribute__((target("avx2")))
+void blendRowsAvx2(const mmUchar *top, const mmUchar *bottom,
+                   mmUint16 *dst, mmInt32 count,
+                   mmUint16 wTop, mmUint16 wBottom)
+{
+    const __m256i vTop = _mm256_set1_epi16(wTop);
+    const __m256i vBottom = _mm256_set1_epi16(wBottom);
+    mmInt32 i = 0;
+
+    for ( ; i + 32 <= count; i += 32 ) {
+        const __m256i t0 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(top + i)));
+        const __m256i t1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(top + i + 16)));
+        const __m256i b0 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom + i)));
+        const __m256i b1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom + i + 16)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                            _mm256_add_epi16(_mm256_mullo_epi16(t0, vTop), _mm256_mullo_epi16(b0, vBottom)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 16),
+                            _mm256_add_epi16(_mm256_mullo_epi16(t1, vTop), _mm256_mullo_epi16(b1, vBottom)));
+    }
+
+    blendRowsSse2(top + i, bottom + i, dst + i, count - i, wTop, wBottom);
+}
+
+#endif // NV12_RESIZE_HAVE_AVX2
+
+#endif
+
+BlendRowsFunc selectBlendRows(enumResizeKernel kernel)
+{
+    if ( IC_RESIZE_KERNEL_SCALAR == kernel ) {
+        return blendRowsScalar;
+    }
+
+#if defined(ARCH_ARM_HAVE_NEON)
+    return blendRowsNeon;
+#elif defined(__SSE2__)
+#ifdef NV12_RESIZE_HAVE_AVX2
+    if ( __builtin_cpu_supports("avx2") ) {
+        return blendRowsAvx2;
+    }
+#endif
+    return blendRowsSse2;
+#else
+    return blendRowsScalar;
+#endif
+}
+
+
+/*--------------------Horizontal passes and stripe processing-----------------*/
+
+void resizeLumaRows(const ResizeStripe &stripe)
+{
+    const ResizePlan &plan = *stripe.plan;
+    mmUint16 *tmp = stripe.scratch;
+
+    for ( mmInt32 row = stripe.firstRow; row < stripe.lastRow; row++ ) {
+        const mmUchar *top = plan.srcY + plan.rowIndex[row] * plan.srcStride;
+        const mmUchar yf = plan.rowFrac[row];
+        mmUchar *out = plan.dstY + (row - plan.dstFirstRow) * plan.dstStride;
+
+        plan.blendRows(top, top + plan.srcStride, tmp, plan.lumaSpan,
+                       RESIZE_FRAC_ONE - yf, yf);
+
+        for ( mmInt32 col = 0; col < plan.outWidth; col++ ) {
+            const mmUint16 *p = tmp + plan.colIndex[col];
+            const mmUchar xf = plan.colFrac[col];
+            out[col] = (mmUchar) ((p[0] * (RESIZE_FRAC_ONE - xf) + p[1] * xf) >> 6);
+        }
+    }
+}
+
+void resizeChromaRows(const ResizeStripe &stripe)
+{
+    const ResizePlan &plan = *stripe.plan;
+    const mmInt32 firstRow = stripe.firstRow >> 1;
+    const mmInt32 lastRow = min(stripe.lastRow >> 1, plan.outHeight >> 1);
+    const mmInt32 outCols = plan.outWidth >> 1;
+    mmUint16 *tmp = stripe.scratch;
+
+    for ( mmInt32 row = firstRow; row < lastRow; row++ ) {
+        const mmUchar *top = plan.srcUV + plan.rowIndex[row] * plan.srcStride;
+        const mmUchar yf = plan.rowFrac[row];
+        mmUchar *out = plan.dstUV + (row - (plan.dstFirstRow >> 1)) * plan.dstStride;
+
+        plan.blendRows(top, top + plan.srcStride, tmp, plan.chromaSpan,
+                       RESIZE_FRAC_ONE - yf, yf);
+
+        for ( mmInt32 col = 0; col < outCols; col++ ) {
+            const mmUint16 *p = tmp + plan.colIndex[col] * 2;
+            const mmUint16 wl = RESIZE_FRAC_ONE - plan.colFrac[col];
+            const mmUint16 wr = plan.colFrac[col];
+            out[col * 2]     = (mmUchar) ((p[0] * wl + p[2] * wr) >> 6);
+            out[col * 2 + 1] = (mmUchar) ((p[1] * wl + p[3] * wr) >> 6);
+        }
+    }
+}
+
+void resizeStripe(const ResizeStripe &stripe)
+{
+    resizeLumaRows(stripe);
+    resizeChromaRows(stripe);
+}
+
+
+/*--------------------Worker pool---------------------------------*/
+
+/*
+ * Persistent pool of stripe workers. The caller always processes stripe 0
+ * itself; the remaining stripes are picked up by the workers. Only one
+ * resize can use the pool at a time, concurrent callers fall back to
+ * running all their stripes on their own thread instead of blocking.
+ */
+class ResizeWorkerPool
+{
+public:
+    ResizeWorkerPool() : mStripes(NULL), mStripeCount(0), mNextStripe(0),
+                         mPending(0), mWorkerCount(0) {}
+
+    void run(ResizeStripe *stripes, mmInt32 count);
+
+private:
+    class Worker : public android::Thread {
+    public:
+        Worker(ResizeWorkerPool *pool) : android::Thread(false), mPool(pool) {}
+        virtual bool threadLoop() { return mPool->workerLoop(); }
+    private:
+        ResizeWorkerPool *mPool;
+    };
+
+    bool workerLoop();
+    bool grabStripe(mmInt32 &index);
+    void ensureWorkers(mmInt32 count);
+
+    android::Mutex mSubmitLock;
+    android::Mutex mLock;
+    android::Condition mWorkAvailable;
+    android::Condition mWorkDone;
+
+    ResizeStripe *mStripes;
+    mmInt32 mStripeCount;
+    mmInt32 mNextStripe;
+    mmInt32 mPending;
+
+    android::sp<Worker> mWorkers[IC_RESIZE_MAX_THREADS - 1];
+    mmInt32 mWorkerCount;
+};
+
+void ResizeWorkerPool::ensureWorkers(mmInt32 count)
+{
+    while ( mWorkerCount < count ) {
+        android::sp<Worker> worker = new Worker(this);
+        if ( android::NO_ERROR != worker->run("NV12ResizeWorker", android::PRIORITY_URGENT_DISPLAY) ) {
+            CAMHAL_LOGE("Unable to start resize worker %d", mWorkerCount);
+            break;
+        }
+        mWorkers[mWorkerCount++] = worker;
+    }
+}
+
+bool ResizeWorkerPool::grabStripe(mmInt32 &index)
+{
+    android::AutoMutex lock(mLock);
+
+    if ( mNextStripe >= mStripeCount ) {
+        return false;
+    }
+
+    index = mNextStripe++;
+    return true;
+}
+
+bool ResizeWorkerPool::workerLoop()
+{
+    {
+        android::AutoMutex lock(mLock);
+        while ( mNextStripe >= mStripeCount ) {
+            mWorkAvailable.wait(mLock);
+        }
+    }
+
+    mmInt32 index;
+    while ( grabStripe(index) ) {
+        resizeStripe(mStripes[index]);
+
+        android::AutoMutex lock(mLock);
+        if ( 0 == --mPending ) {
+            mWorkDone.signal();
+        }
+    }
+
+    return true;
+}
+
+void ResizeWorkerPool::run(ResizeStripe *stripes, mmInt32 count)
+{
+    if ( (count <= 1) || (android::NO_ERROR != mSubmitLock.tryLock()) ) {
+        for ( mmInt32 i = 0; i < count; i++ ) {
+            resizeStripe(stripes[i]);
+        }
+        return;
+    }
+
+    ensureWorkers(min<mmInt32>(count - 1, IC_RESIZE_MAX_THREADS - 1));
+
+    {
+        android::AutoMutex lock(mLock);
+        mStripes = stripes;
+        mStripeCount = count;
+        mNextStripe = 0;
+        mPending = count;
+        mWorkAvailable.broadcast();
+    }
+
+    mmInt32 index;
+    while ( grabStripe(index) ) {
+        resizeStripe(stripes[index]);
+
+        android::AutoMutex lock(mLock);
+        --mPending;
+    }
+
+    {
+        android::AutoMutex lock(mLock);
+        while ( mPending > 0 ) {
+            mWorkDone.wait(mLock);
+        }
+        mStripes = NULL;
+        mStripeCount = 0;
+        mNextStripe = 0;
+    }
+
+    mSubmitLock.unlock();
+}
+
+ResizeWorkerPool gResizeWorkerPool;
+
+android::Mutex gResizeConfigLock;
+structResizeConfig gResizeConfig = {
+    IC_RESIZE_KERNEL_AUTO,
+    // OMAP4 is a dual core part, use both cores by default
+    2
+};
+
+} // anonymous namespace
+
+
 /*==========================================================================
-* Function Name  : VT_resizeFrame_Video_opt2_lp
-*
-* Description    : Resize a yuv frame.
-*
-* Input(s)       : input_img_ptr        -> Input Image Structure
-*                : output_img_ptr       -> Output Image Structure
-*                : cropout             -> crop structure
+* Function Name  : VT_resizeFrame_Video_reference
 *
-* Value Returned : mmBool               -> FALSE on error TRUE on success
-* NOTE:
-*            Not tested for crop funtionallity.
-*            faster version.
+* Description    : Per pixel reference implementation. All other kernels
+*                  have to match its output bit for bit.
 ============================================================================*/
-mmBool
-VT_resizeFrame_Video_opt2_lp(
+static mmBool
+VT_resizeFrame_Video_reference(
         structConvImage* i_img_ptr,      /* Points to the input image            */
         structConvImage* o_img_ptr,      /* Points to the output image           */
-        IC_rect_type*  cropout,          /* how much to resize to in final image */
-        mmUint16 dummy                   /* Transparent pixel value              */
+        mmUint32 cox, mmUint32 coy,      /* crop origin in the output image      */
+        mmUint32 codx, mmUint32 cody     /* crop size in the output image        */
         ) {
-    LOG_FUNCTION_NAME;
-
     mmUint16 row,col;
     mmUint32 resizeFactorX;
     mmUint32 resizeFactorY;
@@ -59,57 +444,18 @@ VT_resizeFrame_Video_opt2_lp(
     mmUchar* inImgPtrY;
     mmUchar* inImgPtrU;
     mmUchar* inImgPtrV;
-    mmUint32 cox, coy, codx, cody;
-    mmUint16 idx,idy, idxC;
-
-    if ( i_img_ptr->uWidth == o_img_ptr->uWidth ) {
-        if ( i_img_ptr->uHeight == o_img_ptr->uHeight ) {
-            CAMHAL_LOGV("************************f(i_img_ptr->uHeight == o_img_ptr->uHeight) are same *********************\n");
-            CAMHAL_LOGV("************************(i_img_ptr->width == %d" , i_img_ptr->uWidth );
-            CAMHAL_LOGV("************************(i_img_ptr->uHeight == %d" , i_img_ptr->uHeight );
-            CAMHAL_LOGV("************************(o_img_ptr->width == %d" ,o_img_ptr->uWidth );
-            CAMHAL_LOGV("************************(o_img_ptr->uHeight == %d" , o_img_ptr->uHeight );
-        }
-    }
-
-    if ( !i_img_ptr || !i_img_ptr->imgPtr || !o_img_ptr || !o_img_ptr->imgPtr ) {
-        CAMHAL_LOGE("Image Point NULL");
-        return false;
-    }
+    mmUint16 idx,idy;
 
     inImgPtrY = (mmUchar *) i_img_ptr->imgPtr + i_img_ptr->uOffset;
     inImgPtrU = (mmUchar *) i_img_ptr->clrPtr + i_img_ptr->uOffset/2;
     inImgPtrV = (mmUchar*)inImgPtrU + 1;
 
-    if ( !cropout ) {
-        cox = 0;
-        coy = 0;
-        codx = o_img_ptr->uWidth;
-        cody = o_img_ptr->uHeight;
-    } else {
-        cox = cropout->x;
-        coy = cropout->y;
-        codx = cropout->uWidth;
-        cody = cropout->uHeight;
-    }
     idx = i_img_ptr->uWidth;
     idy = i_img_ptr->uHeight;
 
-    /* make sure valid input size */
-    if ( idx < 1 || idy < 1 || i_img_ptr->uStride < 1 ) {
-        CAMHAL_LOGE("idx or idy less then 1 idx = %d idy = %d stride = %d", idx, idy, i_img_ptr->uStride);
-        return false;
-    }
-
     resizeFactorX = ((idx-1)<<9) / codx;
     resizeFactorY = ((idy-1)<<9) / cody;
 
-    if( i_img_ptr->eFormat != IC_FORMAT_YCbCr420_lp ||
-            o_img_ptr->eFormat != IC_FORMAT_YCbCr420_lp ) {
-        CAMHAL_LOGE("eFormat not supported");
-        return false;
-    }
-
     ptr8 = (mmUchar*)o_img_ptr->imgPtr + cox + coy*o_img_ptr->uWidth;
 
     ////////////////////////////for Y//////////////////////////
@@ -127,49 +473,34 @@ VT_resizeFrame_Video_opt2_lp(
             mmUchar *pu8ptr2 = NULL;
             mmUchar w;
             mmUint16 accum_1;
-            //mmUint32 accum_W;
 
             x  = (mmUint16) ((mmUint32)  (col*resizeFactorX) >> 9);
             xf = (mmUchar)  ((mmUint32) ((col*resizeFactorX) >> 6) & 0x7);
 
-            //accum_W = 0;
-            accum_1 =  0;
-
             pu8ptr1 = pu8Yrow1 + (x);
             pu8ptr2 = pu8Yrow2 + (x);
 
             /* A pixel */
-            //in = *(inImgPtrY + (y)*idx + (x));
             in11 = *(pu8ptr1);
-
             w = bWeights[xf][yf][0];
             accum_1 = (w * in11);
-            //accum_W += (w);
 
             /* B pixel */
-            //in = *(inImgPtrY + (y)*idx + (x+1));
             in12 = *(pu8ptr1+1);
             w = bWeights[xf][yf][1];
             accum_1 += (w * in12);
-            //accum_W += (w);
 
             /* C pixel */
-            //in = *(inImgPtrY + (y+1)*idx + (x));
             in21 = *(pu8ptr2);
             w = bWeights[xf][yf][3];
             accum_1 += (w * in21);
-            //accum_W += (w);
 
             /* D pixel */
-            //in = *(inImgPtrY + (y+1)*idx + (x+1));
             in22 = *(pu8ptr2+1);
             w = bWeights[xf][yf][2];
             accum_1 += (w * in22);
-            //accum_W += (w);
 
             /* divide by sum of the weights */
-            //accum_1 /= (accum_W);
-            //accum_1 = (accum_1/64);
             accum_1 = (accum_1>>6);
             *ptr8 = (mmUchar)accum_1 ;
 
@@ -185,7 +516,6 @@ VT_resizeFrame_Video_opt2_lp(
 
     ptr8Cr = (mmUchar*)(ptr8Cb+1);
 
-    idxC = (idx>>1);
     for ( row = 0; row < (((cody)>>1)); row++ ) {
         mmUchar *pu8Cbr1 = NULL;
         mmUchar *pu8Cbr2 = NULL;
@@ -209,14 +539,10 @@ VT_resizeFrame_Video_opt2_lp(
 
             mmUchar w;
             mmUint16 accum_1Cb, accum_1Cr;
-            //mmUint32 accum_WCb, accum_WCr;
 
             x  = (mmUint16) ((mmUint32)  (col*resizeFactorX) >> 9);
             xf = (mmUchar)  ((mmUint32) ((col*resizeFactorX) >> 6) & 0x7);
 
-            //accum_WCb = accum_WCr =  0;
-            accum_1Cb = accum_1Cr =  0;
-
             pu8Cbc1 = pu8Cbr1 + (x*2);
             pu8Cbc2 = pu8Cbr2 + (x*2);
             pu8Crc1 = pu8Crr1 + (x*2);
@@ -227,47 +553,38 @@ VT_resizeFrame_Video_opt2_lp(
 
             in11 = *(pu8Cbc1);
             accum_1Cb = (w * in11);
-            //    accum_WCb += (w);
 
             in11 = *(pu8Crc1);
             accum_1Cr = (w * in11);
-            //accum_WCr += (w);
 
             /* B pixel */
             w = bWeights[xf][yf][1];
 
             in12 = *(pu8Cbc1+2);
             accum_1Cb += (w * in12);
-            //accum_WCb += (w);
 
             in12 = *(pu8Crc1+2);
             accum_1Cr += (w * in12);
-            //accum_WCr += (w);
 
             /* C pixel */
             w = bWeights[xf][yf][3];
 
             in21 = *(pu8Cbc2);
             accum_1Cb += (w * in21);
-            //accum_WCb += (w);
 
             in21 = *(pu8Crc2);
             accum_1Cr += (w * in21);
-            //accum_WCr += (w);
 
             /* D pixel */
             w = bWeights[xf][yf][2];
 
             in22 = *(pu8Cbc2+2);
             accum_1Cb += (w * in22);
-            //accum_WCb += (w);
 
             in22 = *(pu8Crc2+2);
             accum_1Cr += (w * in22);
-            //accum_WCr += (w);
 
             /* divide by sum of the weights */
-            //accum_1Cb /= (accum_WCb);
             accum_1Cb = (accum_1Cb>>6);
             *ptr8Cb = (mmUchar)accum_1Cb ;
 
@@ -285,6 +602,332 @@ VT_resizeFrame_Video_opt2_lp(
     }
     ///////////////////For Cb- Cr////////////////////////////////////////
 
+    return true;
+}
+
+/* Coefficient tables and scratch rows of an open resize, see VT_resizeFrame_Video_open */
+struct structResizeSession {
+    ResizePlan plan;
+    mmInt32 numStripes;
+    mmInt32 scratchSize;
+    mmUint16 *scratch;
+};
+
+/*==========================================================================
+* Function Name  : VT_resizeFrame_Video_open
+*
+* Description    : Computes the coefficient tables of a resize once, so the
+*                  output can then be produced band by band.
+============================================================================*/
+structResizeSession*
+VT_resizeFrame_Video_open(
+        structConvImage* i_img_ptr,      /* Points to the input image            */
+        mmInt32 outWidth,                /* size of the complete output image    */
+        mmInt32 outHeight,
+        const structResizeConfig* config /* engine configuration, NULL for default */
+        ) {
+    structResizeConfig defaultConfig;
+
+    if ( !i_img_ptr || !i_img_ptr->imgPtr || !i_img_ptr->clrPtr ) {
+        CAMHAL_LOGE("Image Point NULL");
+        return NULL;
+    }
+
+    if ( i_img_ptr->uWidth < 1 || i_img_ptr->uHeight < 1 || i_img_ptr->uStride < 1 ||
+         outWidth < 1 || outHeight < 1 ) {
+        CAMHAL_LOGE("Invalid resize %dx%d -> %dx%d",
+                    i_img_ptr->uWidth, i_img_ptr->uHeight, outWidth, outHeight);
+        return NULL;
+    }
+
+    if ( !config ) {
+        VT_resizeFrame_getConfig(&defaultConfig);
+        config = &defaultConfig;
+    }
+
+    const mmUint32 idx = i_img_ptr->uWidth;
+    const mmUint32 idy = i_img_ptr->uHeight;
+    const mmUint32 codx = outWidth;
+    const mmUint32 cody = outHeight;
+    const mmUint32 resizeFactorX = ((idx-1)<<9) / codx;
+    const mmUint32 resizeFactorY = ((idy-1)<<9) / cody;
+
+    mmInt32 numStripes = config->uNumThreads;
+    if ( numStripes < 1 ) {
+        numStripes = 1;
+    } else if ( numStripes > IC_RESIZE_MAX_THREADS ) {
+        numStripes = IC_RESIZE_MAX_THREADS;
+    }
+
+    /* Source bytes touched per row, padded for the SIMD tails */
+    const mmUint32 lastX = ((codx - 1) * resizeFactorX) >> 9;
+    const mmUint32 lastXc = codx > 1 ? ((((codx >> 1) - 1) * resizeFactorX) >> 9) : 0;
+    const mmInt32 lumaSpan = lastX + 2;
+    const mmInt32 chromaSpan = lastXc * 2 + 4;
+    const mmInt32 scratchSize = (max(lumaSpan, chromaSpan) + 15) & ~15;
+
+    /* Session, tables and scratch rows live in a single allocation */
+    const size_t sessionBytes = (sizeof(structResizeSession) + 15) & ~15;
+    const size_t scratchBytes = numStripes * scratchSize * sizeof(mmUint16);
+    const size_t tableBytes = (codx + cody) * (sizeof(mmUint16) + sizeof(mmUchar));
+    mmUchar *mem = (mmUchar *) malloc(sessionBytes + scratchBytes + tableBytes);
+    if ( NULL == mem ) {
+        CAMHAL_LOGE("Unable to allocate resize tables");
+        return NULL;
+    }
+
+    structResizeSession *session = (structResizeSession *) mem;
+    mmUint16 *scratch = (mmUint16 *) (mem + sessionBytes);
+    mmUint16 *colIndex = scratch + numStripes * scratchSize;
+    mmUint16 *rowIndex = colIndex + codx;
+    mmUchar *colFrac = (mmUchar *) (rowIndex + cody);
+    mmUchar *rowFrac = colFrac + codx;
+
+    for ( mmUint32 col = 0; col < codx; col++ ) {
+        colIndex[col] = (mmUint16) ((col * resizeFactorX) >> 9);
+        colFrac[col] = (mmUchar) (((col * resizeFactorX) >> 6) & 0x7);
+    }
+    for ( mmUint32 row = 0; row < cody; row++ ) {
+        rowIndex[row] = (mmUint16) ((row * resizeFactorY) >> 9);
+        rowFrac[row] = (mmUchar) (((row * resizeFactorY) >> 6) & 0x7);
+    }
+
+    ResizePlan &plan = session->plan;
+    plan.srcY = (const mmUchar *) i_img_ptr->imgPtr + i_img_ptr->uOffset;
+    plan.srcUV = (const mmUchar *) i_img_ptr->clrPtr + i_img_ptr->uOffset/2;
+    plan.srcStride = i_img_ptr->uStride;
+    plan.dstY = NULL;
+    plan.dstUV = NULL;
+    plan.dstStride = 0;
+    plan.dstFirstRow = 0;
+    plan.outWidth = codx;
+    plan.outHeight = cody;
+    plan.colIndex = colIndex;
+    plan.colFrac = colFrac;
+    plan.rowIndex = rowIndex;
+    plan.rowFrac = rowFrac;
+    plan.lumaSpan = lumaSpan;
+    plan.chromaSpan = chromaSpan;
+    plan.blendRows = selectBlendRows(config->eKernel);
+
+    session->numStripes = numStripes;
+    session->scratchSize = scratchSize;
+    session->scratch = scratch;
+
+    return session;
+}
+
+/*==========================================================================
+* Function Name  : VT_resizeFrame_Video_rows
+*
+* Description    : Produces output rows [firstRow, firstRow + numRows) of an
+*                  open resize. Luma row firstRow is written at dstY and
+*                  chroma row firstRow/2 at dstUV. Bands large enough are
+*                  split between the worker pool threads.
+============================================================================*/
+mmBool
+VT_resizeFrame_Video_rows(
+        structResizeSession* session,
+        mmByte* dstY,                    /* first luma row of the band           */
+        mmByte* dstUV,                   /* first chroma row of the band         */
+        mmInt32 dstStride,
+        mmInt32 firstRow,                /* has to be even                       */
+        mmInt32 numRows
+        ) {
+    if ( !session || !dstY || !dstUV || (firstRow & 1) || (firstRow < 0) || (numRows < 1) ) {
+        CAMHAL_LOGE("Invalid resize band %d+%d", firstRow, numRows);
+        return false;
+    }
+
+    ResizePlan plan = session->plan;
+    const mmInt32 lastRow = min(firstRow + numRows, plan.outHeight);
+    if ( firstRow >= lastRow ) {
+        return true;
+    }
+
+    plan.dstY = dstY;
+    plan.dstUV = dstUV;
+    plan.dstStride = dstStride;
+    plan.dstFirstRow = firstRow;
+
+    const mmInt32 bandRows = lastRow - firstRow;
+    mmInt32 numStripes = session->numStripes;
+    if ( numStripes > bandRows / RESIZE_MIN_STRIPE_ROWS ) {
+        numStripes = max<mmInt32>(1, bandRows / RESIZE_MIN_STRIPE_ROWS);
+    }
+
+    ResizeStripe stripes[IC_RESIZE_MAX_THREADS];
+    const mmInt32 rowsPerStripe = ((bandRows / numStripes) + 1) & ~1;
+    for ( mmInt32 i = 0; i < numStripes; i++ ) {
+        stripes[i].plan = &plan;
+        stripes[i].firstRow = firstRow + min<mmInt32>(i * rowsPerStripe, bandRows);
+        stripes[i].lastRow = (i == numStripes - 1) ? lastRow :
+                             firstRow + min<mmInt32>((i + 1) * rowsPerStripe, bandRows);
+        stripes[i].scratch = session->scratch + i * session->scratchSize;
+    }
+
+    gResizeWorkerPool.run(stripes, numStripes);
+
+    return true;
+}
+
+void VT_resizeFrame_Video_close(structResizeSession* session)
+{
+    free(session);
+}
+
+/*==========================================================================
+* Function Name  : VT_resizeFrame_Video_striped
+*
+* Description    : Separable resize engine. Coefficients are computed once
+*                  per call, the vertical pass runs through the selected
+*                  SIMD kernel and the output is split into horizontal
+*                  stripes processed by the worker pool.
+============================================================================*/
+static mmBool
+VT_resizeFrame_Video_striped(
+        structConvImage* i_img_ptr,      /* Points to the input image            */
+        structConvImage* o_img_ptr,      /* Points to the output image           */
+        mmUint32 cox, mmUint32 coy,      /* crop origin in the output image      */
+        mmUint32 codx, mmUint32 cody,    /* crop size in the output image        */
+        const structResizeConfig* config /* engine configuration                 */
+        ) {
+    structResizeSession *session = VT_resizeFrame_Video_open(i_img_ptr, codx, cody, config);
+    if ( NULL == session ) {
+        return false;
+    }
+
+    const mmBool ret = VT_resizeFrame_Video_rows(session,
+                                                 o_img_ptr->imgPtr + cox + coy*o_img_ptr->uWidth,
+                                                 o_img_ptr->clrPtr + cox + coy*o_img_ptr->uWidth,
+                                                 o_img_ptr->uStride,
+                                                 0, cody);
+
+    VT_resizeFrame_Video_close(session);
+
+    return ret;
+}
+
+void VT_resizeFrame_setConfig(const structResizeConfig* config)
+{
+    if ( !config || (config->eKernel < IC_RESIZE_KERNEL_AUTO) ||
+         (config->eKernel >= IC_RESIZE_KERNEL_MAX) ) {
+        CAMHAL_LOGE("Invalid resize configuration");
+        return;
+    }
+
+    android::AutoMutex lock(gResizeConfigLock);
+    gResizeConfig = *config;
+}
+
+void VT_resizeFrame_getConfig(structResizeConfig* config)
+{
+    if ( !config ) {
+        return;
+    }
+
+    android::AutoMutex lock(gResizeConfigLock);
+    *config = gResizeConfig;
+}
+
+/*==========================================================================
+* Function Name  : VT_resizeFrame_Video_lp_ex
+*
+* Description    : Resize a yuv frame using an explicit engine configuration.
+*
+* Input(s)       : input_img_ptr        -> Input Image Structure
+*                : output_img_ptr       -> Output Image Structure
+*                : cropout             -> crop structure
+*                : config              -> engine configuration, NULL for default
+*
+* Value Returned : mmBool               -> FALSE on error TRUE on success
+============================================================================*/
+mmBool
+VT_resizeFrame_Video_lp_ex(
+        structConvImage* i_img_ptr,      /* Points to the input image            */
+        structConvImage* o_img_ptr,      /* Points to the output image           */
+        IC_rect_type*  cropout,          /* how much to resize to in final image */
+        const structResizeConfig* config /* engine configuration                 */
+        ) {
+    LOG_FUNCTION_NAME;
+
+    mmUint32 cox, coy, codx, cody;
+    structResizeConfig defaultConfig;
+
+    if ( !i_img_ptr || !i_img_ptr->imgPtr || !o_img_ptr || !o_img_ptr->imgPtr ) {
+        CAMHAL_LOGE("Image Point NULL");
+        return false;
+    }
+
+    if ( !cropout ) {
+        cox = 0;
+        coy = 0;
+        codx = o_img_ptr->uWidth;
+        cody = o_img_ptr->uHeight;
+    } else {
+        cox = cropout->x;
+        coy = cropout->y;
+        codx = cropout->uWidth;
+        cody = cropout->uHeight;
+    }
+
+    /* make sure valid input size */
+    if ( i_img_ptr->uWidth < 1 || i_img_ptr->uHeight < 1 || i_img_ptr->uStride < 1 ) {
+        CAMHAL_LOGE("idx or idy less then 1 idx = %d idy = %d stride = %d",
+                    i_img_ptr->uWidth, i_img_ptr->uHeight, i_img_ptr->uStride);
+        return false;
+    }
+
+    if ( codx < 1 || cody < 1 ) {
+        CAMHAL_LOGE("Invalid output size %dx%d", codx, cody);
+        return false;
+    }
+
+    if( i_img_ptr->eFormat != IC_FORMAT_YCbCr420_lp ||
+            o_img_ptr->eFormat != IC_FORMAT_YCbCr420_lp ) {
+        CAMHAL_LOGE("eFormat not supported");
+        return false;
+    }
+
+    if ( !config ) {
+        VT_resizeFrame_getConfig(&defaultConfig);
+        config = &defaultConfig;
+    }
+
+    if ( IC_RESIZE_KERNEL_SCALAR == config->eKernel ) {
+        return VT_resizeFrame_Video_reference(i_img_ptr, o_img_ptr, cox, coy, codx, cody);
+    }
+
+    if ( !VT_resizeFrame_Video_striped(i_img_ptr, o_img_ptr, cox, coy, codx, cody, config) ) {
+        return false;
+    }
+
     CAMHAL_LOGV("success");
     return true;
 }
+
+/*==========================================================================
+* Function Name  : VT_resizeFrame_Video_opt2_lp
+*
+* Description    : Resize a yuv frame.
+*
+* Input(s)       : input_img_ptr        -> Input Image Structure
+*                : output_img_ptr       -> Output Image Structure
+*                : cropout             -> crop structure
+*
+* Value Returned : mmBool               -> FALSE on error TRUE on success
+* NOTE:
+*            Not tested for crop funtionallity.
+*            faster version.
+============================================================================*/
+mmBool
+VT_resizeFrame_Video_opt2_lp(
+        structConvImage* i_img_ptr,      /* Points to the input image            */
+        structConvImage* o_img_ptr,      /* Points to the output image           */
+        IC_rect_type*  cropout,          /* how much to resize to in final image */
+        mmUint16 dummy                   /* Transparent pixel value              */
+        ) {
+    CAMHAL_UNUSED(dummy);
+
+    return VT_resizeFrame_Video_lp_ex(i_img_ptr, o_img_ptr, cropout, NULL);
+}
@@ -359,21 +359,17 @@ status_t OMXCameraAdapter::setParameters3A(const android::CameraParameters &para
     str = params.get(android::CameraParameters::KEY_METERING_AREAS);
     if ( (str != NULL) ) {
         size_t MAX_METERING_AREAS;
-        android::Vector<android::sp<CameraArea> > tempAreas;
+        bool areasChanged = false;
 
         MAX_METERING_AREAS = atoi(params.get(android::CameraParameters::KEY_MAX_NUM_METERING_AREAS));
 
         android::AutoMutex lock(mMeteringAreasLock);
 
-        ret = CameraArea::parseAreas(str, ( strlen(str) + 1 ), tempAreas);
+        ret = mMeteringAreas.parse(str, areasChanged);
 
-        CAMHAL_LOGVB("areAreasDifferent? = %d",
-                     CameraArea::areAreasDifferent(mMeteringAreas, tempAreas));
-
-        if ( (NO_ERROR == ret) && CameraArea::areAreasDifferent(mMeteringAreas, tempAreas) ) {
-            mMeteringAreas.clear();
-            mMeteringAreas = tempAreas;
+        CAMHAL_LOGVB("areAreasDifferent? = %d", areasChanged);
 
+        if ( (NO_ERROR == ret) && areasChanged ) {
             if ( MAX_METERING_AREAS >= mMeteringAreas.size() ) {
                 CAMHAL_LOGDB("Setting Metering Areas %s",
                         params.get(android::CameraParameters::KEY_METERING_AREAS));
@@ -810,7 +806,7 @@ status_t OMXCameraAdapter::setFocusMode(Gen3A_settings& Gen3A)
         ////FIXME: Check if the extended focus control is needed? this overrides caf
         //focusControl.eFocusControl = ( OMX_IMAGE_FOCUSCONTROLTYPE ) OMX_IMAGE_FocusControlExtended;
         }
-    else if ( (!mFocusAreas.isEmpty()) && (!mFocusAreas.itemAt(0)->isZeroArea()) )
+    else if ( (!mFocusAreas.isEmpty()) && (!mFocusAreas.itemAt(0).isZeroArea()) )
         {
 
         //Disable face priority first
@@ -1738,7 +1734,7 @@ status_t OMXCameraAdapter::setMeteringAreas(Gen3A_settings& Gen3A)
         }
 
       // transform the coordinates to 3A-type coordinates
-      mMeteringAreas.itemAt(n)->transfrom((size_t)mPreviewData->mWidth/widthDivisor,
+      mMeteringAreas.itemAt(n).transfrom((size_t)mPreviewData->mWidth/widthDivisor,
                                       (size_t)mPreviewData->mHeight/heightDivisor,
                                       (size_t&)meteringAreas->tAlgoAreas[n].nTop,
                                       (size_t&)meteringAreas->tAlgoAreas[n].nLeft,
@@ -1754,7 +1750,7 @@ status_t OMXCameraAdapter::setMeteringAreas(Gen3A_settings& Gen3A)
       meteringAreas->tAlgoAreas[n].nHeight =
               ( meteringAreas->tAlgoAreas[n].nHeight * METERING_AREAS_RANGE ) / mPreviewData->mHeight;
 
-      meteringAreas->tAlgoAreas[n].nPriority = mMeteringAreas.itemAt(n)->getWeight();
+      meteringAreas->tAlgoAreas[n].nPriority = mMeteringAreas.itemAt(n).getWeight();
 
       CAMHAL_LOGDB("Metering area %d : top = %d left = %d width = %d height = %d prio = %d",
               n, (int)meteringAreas->tAlgoAreas[n].nTop, (int)meteringAreas->tAlgoAreas[n].nLeft,
@@ -267,7 +267,7 @@ status_t OMXCameraAdapter::setAutoConvergence(const char *pValstr, const char *p
     OMX_ERRORTYPE eError = OMX_ErrorNone;
     OMX_TI_CONFIG_CONVERGENCETYPE ACParams;
     const char *str = NULL;
-    android::Vector<android::sp<CameraArea> > tempAreas;
+    bool areasChanged = false;
     int mode;
     int changed = 0;
 
@@ -303,7 +303,7 @@ status_t OMXCameraAdapter::setAutoConvergence(const char *pValstr, const char *p
         str = params.get(android::CameraParameters::KEY_METERING_AREAS);
 
         if ( NULL != str ) {
-            ret = CameraArea::parseAreas(str, ( strlen(str) + 1 ), tempAreas);
+            ret = mTouchAreas.parse(str, areasChanged);
         } else {
             CAMHAL_LOGEB("Touch areas not received in %s",
                          android::CameraParameters::KEY_METERING_AREAS);
@@ -311,9 +311,7 @@ status_t OMXCameraAdapter::setAutoConvergence(const char *pValstr, const char *p
             return BAD_VALUE;
         }
 
-        if ( CameraArea::areAreasDifferent(mTouchAreas, tempAreas) ) {
-            mTouchAreas.clear();
-            mTouchAreas = tempAreas;
+        if ( areasChanged ) {
             changed = 1;
         }
     }
@@ -349,7 +347,7 @@ status_t OMXCameraAdapter::setAutoConvergence(const char *pValstr, const char *p
         }
 
         // transform the coordinates to 3A-type coordinates
-        mTouchAreas.itemAt(0)->transfrom((size_t)mPreviewData->mWidth/widthDivisor,
+        mTouchAreas.itemAt(0).transfrom((size_t)mPreviewData->mWidth/widthDivisor,
                                          (size_t)mPreviewData->mHeight/heightDivisor,
                                          (size_t&) ACParams.nACProcWinStartY,
                                          (size_t&) ACParams.nACProcWinStartX,
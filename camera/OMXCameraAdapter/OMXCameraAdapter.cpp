@@ -64,6 +64,8 @@ status_t OMXCameraAdapter::initialize(CameraProperties::Properties* caps)
     mDebugFps = atoi(value);
     property_get("debug.camera.framecounts", value, "0");
     mDebugFcs = atoi(value);
+    property_get("camera.fd.delta", value, "10");
+    mFaceDeltaThreshold = atoi(value);
 
 #ifdef CAMERAHAL_OMX_PROFILING
 
@@ -130,6 +132,16 @@ status_t OMXCameraAdapter::initialize(CameraProperties::Properties* caps)
 
     mComponentState = OMX_StateLoaded;
 
+#ifndef USES_LEGACY_DOMX_DCC
+    // A cached capability probe never gets as far as loading DCC, so the
+    // first adapter does it. DCCHandler only loads the files once.
+    {
+        android::AutoMutex lock(gAdapterLock);
+        DCCHandler dcc_handler;
+        dcc_handler.loadDCC(mCameraAdapterParameters.mHandleComp);
+    }
+#endif
+
     CAMHAL_LOGVB("OMX_GetHandle -0x%x sensor_index = %lu", eError, mSensorIndex);
     initDccFileDataSave(&mCameraAdapterParameters.mHandleComp, mCameraAdapterParameters.mPrevPortIndex);
 
@@ -202,6 +214,8 @@ status_t OMXCameraAdapter::initialize(CameraProperties::Properties* caps)
     mBracketingRange = 1;
     mLastBracetingBufferIdx = 0;
     mBracketingBuffersQueued = NULL;
+    mBracketMergeEnabled = false;
+    mBracketMergeActive = false;
     mOMXStateSwitch = false;
     mBracketingSet = false;
 #ifdef CAMERAHAL_USE_RAW_IMAGE_SAVING
@@ -212,6 +226,13 @@ status_t OMXCameraAdapter::initialize(CameraProperties::Properties* caps)
     mCaptureSignalled = false;
     mCaptureConfigured = false;
     mReprocConfigured = false;
+    mReprocessRequestStart = 0;
+    mReprocessQueued = 0;
+    mReprocessRegistered = false;
+    mReprocessRequests = 0;
+    mReprocessRegistrations = 0;
+    mReprocessLatencyTotal = 0;
+    mReprocessLatencyMax = 0;
     mRecording = false;
     mWaitingForSnapshot = false;
     mPictureFormatFromClient = NULL;
@@ -264,6 +285,7 @@ status_t OMXCameraAdapter::initialize(CameraProperties::Properties* caps)
     mCapturedFrames = 0;
     mBurstFramesAccum = 0;
     mBurstFramesQueued = 0;
+    mCapturePipeline = false;
 
     //update the mDeviceOrientation with the sensor mount orientation.
     //So that the face detect will work before onOrientationEvent()
@@ -347,6 +369,8 @@ status_t OMXCameraAdapter::initialize(CameraProperties::Properties* caps)
     mFaceDetectionRunning = false;
     mFaceDetectionPaused = false;
     mFDSwitchAlgoPriority = false;
+    mFaceScaleWidth = 0;
+    mFaceScaleHeight = 0;
 
     metadataLastAnalogGain = -1;
     metadataLastExposureTime = -1;
@@ -488,8 +512,9 @@ status_t OMXCameraAdapter::fillThisBuffer(CameraBuffer * frameBuf, CameraFrame::
                 if ( isCaptureFrame && !mBracketingEnabled ) {
                     android::AutoMutex lock(mBurstLock);
                     if ((1 > mCapturedFrames) && !mBracketingEnabled && (mCapMode != CP_CAM)) {
-                        // Signal end of image capture
-                        if ( NULL != mEndImageCaptureCallback) {
+                        // Signal end of image capture, already done on frame
+                        // delivery in capture pipeline mode
+                        if ( !mCapturePipeline && (NULL != mEndImageCaptureCallback) ) {
                             mEndImageCaptureCallback(mEndCaptureData);
                         }
                         port->mStatus[i] = OMXCameraPortParameters::IDLE;
@@ -1876,7 +1901,7 @@ status_t OMXCameraAdapter::switchToLoaded(bool bPortEnableRequired) {
 
             {
                 android::AutoMutex lock(mPreviewDataBufferLock);
-                mPreviewDataBuffersAvailable.clear();
+                clearFrameBuffers(mPreviewDataBuffersAvailable, CameraFrame::FRAME_DATA_SYNC);
             }
 
         }
@@ -1919,7 +1944,7 @@ EXIT:
     {
         android::AutoMutex lock(mPreviewBufferLock);
         ///Clear all the available preview buffers
-        mPreviewBuffersAvailable.clear();
+        clearFrameBuffers(mPreviewBuffersAvailable, CameraFrame::PREVIEW_FRAME_SYNC);
     }
     performCleanupAfterError();
     LOG_FUNCTION_NAME_EXIT;
@@ -2468,7 +2493,7 @@ EXIT:
     {
         android::AutoMutex lock(mPreviewBufferLock);
         ///Clear all the available preview buffers
-        mPreviewBuffersAvailable.clear();
+        clearFrameBuffers(mPreviewBuffersAvailable, CameraFrame::PREVIEW_FRAME_SYNC);
     }
     performCleanupAfterError();
     LOG_FUNCTION_NAME_EXIT;
@@ -2485,6 +2510,10 @@ status_t OMXCameraAdapter::stopPreview() {
 #ifdef CAMERAHAL_OMX_PROFILING
     ret |= setExtraData(false, OMX_ALL, OMX_TI_ProfilerData);
 #endif
+
+    // The reprocess session outlives the captures, not the preview
+    stopReprocess();
+
     if (mTunnelDestroyed == false){
         ret = destroyTunnel();
         if (ret == ALREADY_EXISTS) {
@@ -2502,7 +2531,7 @@ status_t OMXCameraAdapter::stopPreview() {
     {
         android::AutoMutex lock(mPreviewBufferLock);
         ///Clear all the available preview buffers
-        mPreviewBuffersAvailable.clear();
+        clearFrameBuffers(mPreviewBuffersAvailable, CameraFrame::PREVIEW_FRAME_SYNC);
     }
 
     switchToLoaded();
@@ -3195,7 +3224,11 @@ OMX_ERRORTYPE OMXCameraAdapter::SignalEvent(OMX_IN OMX_HANDLETYPE hComponent,
                 msg.command = OMXCallbackHandler::CAMERA_FOCUS_STATUS;
                 msg.arg1 = NULL;
                 msg.arg2 = NULL;
-                mOMXCallbackHandler->put(&msg);
+                // Don't stall the OMX event thread, the focus status is
+                // read again when the next event gets through
+                if ( NO_ERROR != mOMXCallbackHandler->tryPut(&msg) ) {
+                    CAMHAL_LOGEA("Callback queue full, focus status event dropped");
+                }
         }
     }
 
@@ -3370,6 +3403,10 @@ OMX_ERRORTYPE OMXCameraAdapterFillBufferDone(OMX_IN OMX_HANDLETYPE hComponent,
         debugShowFPS();
     }
 
+    if ( NULL != pBuffHeader ) {
+        FrameTrace::stamp(FrameTrace::STAGE_FILL_BUFFER_DONE, pBuffHeader->pAppPrivate, 0);
+    }
+
     OMXCameraAdapter *adapter =  ( OMXCameraAdapter * ) pAppData;
     if ( NULL != adapter )
         {
@@ -3526,7 +3563,7 @@ OMX_ERRORTYPE OMXCameraAdapter::OMXCameraAdapterFillBufferDone(OMX_IN OMX_HANDLE
         if (mRecording)
             {
             mask |= (unsigned int)CameraFrame::VIDEO_FRAME_SYNC;
-            mFramesWithEncoder++;
+            android_atomic_inc(&mFramesWithEncoder);
             }
 
         //CAMHAL_LOGV("FBD pBuffer = 0x%x", pBuffHeader->pBuffer);
@@ -3543,7 +3580,7 @@ OMX_ERRORTYPE OMXCameraAdapter::OMXCameraAdapterFillBufferDone(OMX_IN OMX_HANDLE
             }
 
         stat = sendCallBacks(cameraFrame, pBuffHeader, mask, pPortParam);
-        mFramesWithDisplay++;
+        android_atomic_inc(&mFramesWithDisplay);
 
         mFramesWithDucati--;
 
@@ -3686,6 +3723,10 @@ OMX_ERRORTYPE OMXCameraAdapter::OMXCameraAdapterFillBufferDone(OMX_IN OMX_HANDLE
 
         mCapturedFrames--;
 
+        if ( ( REPROCESS_STATE == state ) && ( 1 > mCapturedFrames ) ) {
+            reprocessDone();
+        }
+
 #ifdef CAMERAHAL_USE_RAW_IMAGE_SAVING
         if (mYuvCapture) {
             struct timeval timeStampUsec;
@@ -3719,13 +3760,30 @@ OMX_ERRORTYPE OMXCameraAdapter::OMXCameraAdapterFillBufferDone(OMX_IN OMX_HANDLE
         }
 #endif
 
-        stat = sendCallBacks(cameraFrame, pBuffHeader, mask, pPortParam);
+        if ( mBracketMergeActive ) {
+            stat = holdBracketMergeFrame(pBuffHeader, pPortParam);
+        } else {
+            stat = sendCallBacks(cameraFrame, pBuffHeader, mask, pPortParam);
+        }
 #ifdef OMAP_ENHANCEMENT_CPCAM
         if ( NULL != cameraFrame.mMetaData.get() ) {
             cameraFrame.mMetaData.clear();
         }
 #endif
 
+        // In capture pipeline mode the shot ends as soon as its last frame is out,
+        // while the buffer is still being encoded or delivered. The next shot
+        // can then start on the other capture buffer. Stopping the capture needs
+        // OMX calls, so it is done from the command thread.
+        if ( mCapturePipeline && (1 > mCapturedFrames) && (mCapMode != CP_CAM) &&
+             (mCapMode != VIDEO_MODE) && (mCapMode != VIDEO_MODE_HQ) ) {
+            Utils::Message msg;
+            msg.command = CommandHandler::CAMERA_END_IMAGE_CAPTURE;
+            msg.arg1 = NULL;
+            msg.arg2 = NULL;
+            mCommandHandler->put(&msg);
+        }
+
         }
         else if (pBuffHeader->nOutputPortIndex == OMX_CAMERA_PORT_VIDEO_OUT_VIDEO) {
             typeOfFrame = CameraFrame::RAW_FRAME;
@@ -3882,6 +3940,13 @@ status_t OMXCameraAdapter::sendCallBacks(CameraFrame frame, OMX_IN OMX_BUFFERHEA
 
   frame.mTimestamp = (pBuffHeader->nTimeStamp * 1000) - mTimeSourceDelta;
 
+  // Sensor timestamps share the system time base only once recording
+  // has measured the offset between the two clocks
+  if ( !onlyOnce )
+    {
+      FrameTrace::stampAt(FrameTrace::STAGE_SENSOR, frame.mBuffer, mask, frame.mTimestamp);
+    }
+
   ret = setInitFrameRefCount(frame.mBuffer, mask);
 
   if (ret != NO_ERROR) {
@@ -3950,6 +4015,13 @@ bool OMXCameraAdapter::CommandHandler::Handler()
                 delete cap_params;
                 break;
             }
+            case CommandHandler::CAMERA_END_IMAGE_CAPTURE:
+            {
+                if ( NULL != mCameraAdapter->mEndImageCaptureCallback ) {
+                    mCameraAdapter->mEndImageCaptureCallback(mCameraAdapter->mEndCaptureData);
+                }
+                break;
+            }
         }
 
         }
@@ -4307,6 +4379,7 @@ public:
     CapabilitiesHandler()
     {
         mComponent = 0;
+        mRevision[0] = '\0';
     }
 
     const OMX_HANDLETYPE & component() const
@@ -4319,6 +4392,27 @@ public:
         return mComponent;
     }
 
+    // firmware revision, recorded with the capabilities of every mode
+    void fetchRevision()
+    {
+        char name[OMX_MAX_STRINGNAME_SIZE];
+        OMX_VERSIONTYPE specVersion;
+        OMX_VERSIONTYPE componentVersion;
+        OMX_UUIDTYPE uuid;
+
+        const OMX_ERRORTYPE eError = OMX_GetComponentVersion(component(), name,
+                &specVersion, &componentVersion, &uuid);
+        if ( OMX_ErrorNone != eError ) {
+            CAMHAL_LOGE("Error while getting camera component version 0x%x", eError);
+            return;
+        }
+
+        snprintf(mRevision, sizeof(mRevision), "%u.%u.%u.%u",
+                 componentVersion.s.nVersionMajor, componentVersion.s.nVersionMinor,
+                 componentVersion.s.nRevision, componentVersion.s.nStep);
+        CAMHAL_LOGD("Camera component %s revision %s", name, mRevision);
+    }
+
     status_t fetchCapabiltiesForMode(OMX_CAMOPERATINGMODETYPE mode,
                                      int sensorId,
                                      CameraProperties::Properties * properties)
@@ -4340,6 +4434,10 @@ public:
         // get and fill capabilities
         OMXCameraAdapter::getCaps(sensorId, properties, component());
 
+        if ( mRevision[0] ) {
+            properties->set(CameraProperties::REVISION, mRevision);
+        }
+
         return NO_ERROR;
     }
 
@@ -4439,6 +4537,7 @@ public:
 private:
     OMX_HANDLETYPE mComponent;
     OMX_STATETYPE mState;
+    char mRevision[32];
 };
 
 extern "C" status_t OMXCameraAdapter_Capabilities(
@@ -4483,6 +4582,8 @@ extern "C" status_t OMXCameraAdapter_Capabilities(
     dcc_handler.loadDCC(handler.componentRef());
 #endif
 
+    handler.fetchRevision();
+
     // Continue selecting sensor and then querying OMX Camera for it's capabilities
     // When sensor select returns an error, we know to break and stop
     while (eError == OMX_ErrorNone &&
@@ -25,6 +25,7 @@
 #include "OMXCameraAdapter.h"
 #include "ErrorUtils.h"
 
+#include <cutils/properties.h>
 
 namespace Ti {
 namespace Camera {
@@ -166,6 +167,13 @@ status_t OMXCameraAdapter::setParametersCapture(const android::CameraParameters
         mBracketingSet = false;
     }
 
+    str = params.get(TICameraParameters::KEY_EXP_BRACKETING_MERGE);
+    {
+        android::AutoMutex lock(mBracketMergeLock);
+        mBracketMergeEnabled = ( NULL != str ) &&
+                               ( strcmp(str, android::CameraParameters::TRUE) == 0 );
+    }
+
     if ( (str = params.get(TICameraParameters::KEY_EXP_BRACKETING_RANGE)) != NULL ) {
         parseExpRange(str, mExposureBracketingValues, NULL,
                       mExposureGainBracketingModes,
@@ -285,6 +293,18 @@ status_t OMXCameraAdapter::setParametersCapture(const android::CameraParameters
     CAMHAL_LOGVB("Burst Frames set %d", mBurstFrames);
 #endif
 
+    if ( (str = params.get(TICameraParameters::KEY_CAPTURE_PIPELINE)) != NULL ) {
+        bool pipeline = !strcmp(str, android::CameraParameters::TRUE);
+        // the number of capture buffers depends on the pipeline mode,
+        // so the image port has to be reconfigured
+        if ( pipeline != mCapturePipeline ) {
+            mPendingCaptureSettings |= SetFormat;
+        }
+        mCapturePipeline = pipeline;
+    }
+
+    CAMHAL_LOGVB("Capture pipeline %d", mCapturePipeline);
+
     varint = params.getInt(android::CameraParameters::KEY_JPEG_QUALITY);
     if ( varint >= MIN_JPEG_QUALITY && varint <= MAX_JPEG_QUALITY ) {
         if (varint != mPictureQuality) {
@@ -989,6 +1009,148 @@ status_t OMXCameraAdapter::sendBracketFrames(size_t &framesSent)
     return ret;
 }
 
+status_t OMXCameraAdapter::holdBracketMergeFrame(OMX_BUFFERHEADERTYPE *pBuffHeader,
+                                                 OMXCameraPortParameters *port)
+{
+    status_t ret = NO_ERROR;
+
+    LOG_FUNCTION_NAME;
+
+    android::AutoMutex lock(mBracketMergeLock);
+
+    mBracketMergeFrames.push_back(pBuffHeader);
+
+    // Nothing goes out before the last exposure of the burst is in
+    if ( 0 < mCapturedFrames )
+        {
+        LOG_FUNCTION_NAME_EXIT;
+        return NO_ERROR;
+        }
+
+    mBracketMergeActive = false;
+
+    ret = mergeBracketFrames(port);
+    if ( NO_ERROR != ret )
+        {
+        CAMHAL_LOGDA("Bracketing frames not merged, sending them separately");
+        for ( size_t i = 0 ; i < mBracketMergeFrames.size() ; i++ )
+            {
+            CameraFrame cameraFrame;
+            ret = sendCallBacks(cameraFrame, mBracketMergeFrames[i], port->mImageType, port);
+            }
+        }
+
+    mBracketMergeFrames.clear();
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return ret;
+}
+
+status_t OMXCameraAdapter::mergeBracketFrames(OMXCameraPortParameters *port)
+{
+    status_t ret = NO_ERROR;
+    const size_t count = mBracketMergeFrames.size();
+    BracketMerge::Frame frames[BracketMerge::MAX_FRAMES];
+    char value[PROPERTY_VALUE_MAX];
+    nsecs_t mergeStart;
+
+    LOG_FUNCTION_NAME;
+
+    if ( ( 2 > count ) || ( BracketMerge::MAX_FRAMES < count ) )
+        {
+        CAMHAL_LOGDB("%u bracketing frames, can't merge", ( unsigned int ) count);
+        return -EINVAL;
+        }
+
+    const size_t lumaSize = port->mStride * port->mHeight;
+
+    for ( size_t i = 0 ; i < count ; i++ )
+        {
+        OMX_BUFFERHEADERTYPE *header = mBracketMergeFrames[i];
+        uint8_t *base = ( uint8_t * ) ( ( CameraBuffer * ) header->pAppPrivate )->mapped;
+
+        // the encoder expects the chroma plane right after the luma one
+        if ( ( NULL == base ) || ( 0 != header->nOffset ) ||
+             ( ( lumaSize * 3 ) / 2 > header->nFilledLen ) )
+            {
+            CAMHAL_LOGDB("Bracketing buffer %p can't be merged", header);
+            return -EINVAL;
+            }
+
+        frames[i].y = base;
+        frames[i].uv = base + lumaSize;
+        frames[i].stride = port->mStride;
+        }
+
+    if ( 0 < property_get("camera.bracket.tone", value, NULL) )
+        {
+        mBracketMerge.setToneStrength(atoi(value));
+        }
+    else
+        {
+        mBracketMerge.setToneStrength(BracketMerge::DEFAULT_TONE_STRENGTH);
+        }
+
+    // The result goes into the last buffer of the burst
+    mergeStart = systemTime();
+    ret = mBracketMerge.merge(frames, count, frames[count - 1],
+                              port->mWidth, port->mHeight);
+    if ( NO_ERROR != ret )
+        {
+        CAMHAL_LOGEB("Bracketing merge failed %d", ret);
+        return ret;
+        }
+
+    CAMHAL_LOGDB("Merged %u bracketing frames in %u us",
+                 ( unsigned int ) count,
+                 ( unsigned int ) ( ( systemTime() - mergeStart ) / 1000 ));
+
+    // The shot is over, the other frames go straight back to idle
+    // instead of through returnFrame() which would end it once per frame
+    releaseBracketMergeFrames(port, count - 1);
+
+    CameraFrame cameraFrame;
+    cameraFrame.mQuirks |= CameraFrame::ENCODE_RAW_YUV422I_TO_JPEG;
+    cameraFrame.mQuirks |= CameraFrame::FORMAT_YUV420SP_NV12;
+
+    // subscriber is in charge of freeing exif data
+    ExifElementsTable* exif = new ExifElementsTable();
+    setupEXIF_libjpeg(exif, mCaptureAncillaryData, mWhiteBalanceData);
+    cameraFrame.mQuirks |= CameraFrame::HAS_EXIF_DATA;
+    cameraFrame.mCookie2 = (void*) exif;
+
+    ret = sendCallBacks(cameraFrame,
+                        mBracketMergeFrames[count - 1],
+                        ( unsigned int ) CameraFrame::IMAGE_FRAME,
+                        port);
+    if ( NO_ERROR != ret )
+        {
+        CAMHAL_LOGEB("Unable to send merged bracketing frame %d", ret);
+        returnFrame(( CameraBuffer * ) mBracketMergeFrames[count - 1]->pAppPrivate,
+                    CameraFrame::IMAGE_FRAME);
+        }
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+void OMXCameraAdapter::releaseBracketMergeFrames(OMXCameraPortParameters *port, size_t count)
+{
+    for ( size_t i = 0 ; i < count ; i++ )
+        {
+        for ( int index = 0 ; index < port->mNumBufs ; index++ )
+            {
+            if ( port->mBufferHeader[index] == mBracketMergeFrames[i] )
+                {
+                port->mStatus[index] = OMXCameraPortParameters::IDLE;
+                break;
+                }
+            }
+        }
+}
+
 status_t OMXCameraAdapter::startBracketing(int range)
 {
     status_t ret = NO_ERROR;
@@ -1273,6 +1435,23 @@ status_t OMXCameraAdapter::startImageCapture(bool bracketing, CachedCaptureParam
             index++;
         }
 
+        // An exposure bracketed burst is fused into one picture. All of
+        // its frames are held on the port until the last one is in, so
+        // they have to be queued at once and not mix with an earlier shot.
+        {
+        android::AutoMutex mergeLock(mBracketMergeLock);
+        releaseBracketMergeFrames(capData, mBracketMergeFrames.size());
+        mBracketMergeFrames.clear();
+        mBracketMergeActive = mBracketMergeEnabled && !mBracketingSet &&
+                              ( mCapMode != CP_CAM ) &&
+                              ( 1 < capParams->mExposureBracketingValidEntries ) &&
+                              ( OMX_COLOR_FormatYUV420SemiPlanar == capData->mColorFormat ) &&
+                              ( 1 < mCapturedFrames ) &&
+                              ( mCapturedFrames == mBurstFrames ) &&
+                              ( mCapturedFrames <= BracketMerge::MAX_FRAMES ) &&
+                              ( mBurstFramesQueued >= mBurstFramesAccum );
+        }
+
 #ifdef CAMERAHAL_USE_RAW_IMAGE_SAVING
         if (mRawCapture) {
             capData = &mCameraAdapterParameters.mCameraPortParams[mCameraAdapterParameters.mVideoPortIndex];
@@ -1384,9 +1563,8 @@ status_t OMXCameraAdapter::stopImageCapture()
     }
 
     // TODO(XXX): Reprocessing is currently piggy-backing capture commands
-    if (mAdapterState == REPROCESS_STATE) {
-        ret = stopReprocess();
-    }
+    // The video in port stays enabled after a reprocess, the next request
+    // reuses its buffers. UseBuffersReprocess() tears it down when they change.
 
     //Disable the callback first
     mWaitingForSnapshot = false;
@@ -1480,6 +1658,15 @@ status_t OMXCameraAdapter::stopImageCapture()
     // Workaround when doing many consecutive shots, CAF wasn't getting restarted.
     mPending3Asettings |= SetFocus;
 
+    // Frames held for a merge that didn't complete are dropped
+    {
+        android::AutoMutex mergeLock(mBracketMergeLock);
+        releaseBracketMergeFrames(&mCameraAdapterParameters.mCameraPortParams[mCameraAdapterParameters.mImagePortIndex],
+                                  mBracketMergeFrames.size());
+        mBracketMergeFrames.clear();
+        mBracketMergeActive = false;
+    }
+
     mCapturedFrames = 0;
     mBurstFramesAccum = 0;
     mBurstFramesQueued = 0;
@@ -1736,6 +1923,11 @@ status_t OMXCameraAdapter::UseBuffersCapture(CameraBuffer * bufArr, int num)
 
     CAMHAL_ASSERT(num > 0);
 
+    // A regular capture ends the reprocess session
+    if (mNextState != LOADED_REPROCESS_CAPTURE_STATE) {
+        stopReprocess();
+    }
+
     // if some setting that requires a SetParameter (including
     // changing buffer types) then we need to disable the port
     // before being allowed to apply the settings
@@ -1896,13 +2088,28 @@ status_t OMXCameraAdapter::UseBuffersCapture(CameraBuffer * bufArr, int num)
 
         mCaptureBuffersAvailable.clear();
         for (unsigned int i = 0; i < imgCaptureData->mMaxQueueable; i++ ) {
-            mCaptureBuffersAvailable.add(&mCaptureBuffers[i], 0);
+            int held = 0;
+
+            // In capture pipeline mode the previous shot ends before its buffer
+            // comes back, it may still be encoded or delivered. Keep its count
+            // and leave it out of the queue, fillThisBuffer() takes it back.
+            if ( mCapturePipeline ) {
+                held = getFrameRefCountByType(&mCaptureBuffers[i], CameraFrame::IMAGE_FRAME);
+                if ( 0 < held ) {
+                    CAMHAL_LOGDB("Capture buffer %u still held downstream (%d)", i, held);
+                    imgCaptureData->mStatus[i] = OMXCameraPortParameters::DONE;
+                } else {
+                    held = 0;
+                }
+            }
+
+            addFrameBuffer(mCaptureBuffersAvailable, &mCaptureBuffers[i], CameraFrame::IMAGE_FRAME, held);
         }
 
         // initial ref count for undeqeueued buffers is 1 since buffer provider
         // is still holding on to it
         for (unsigned int i = imgCaptureData->mMaxQueueable; i < imgCaptureData->mNumBufs; i++ ) {
-            mCaptureBuffersAvailable.add(&mCaptureBuffers[i], 1);
+            addFrameBuffer(mCaptureBuffersAvailable, &mCaptureBuffers[i], CameraFrame::IMAGE_FRAME, 1);
         }
     }
 
@@ -31,11 +31,7 @@
 namespace Ti {
 namespace Camera {
 
-#ifndef MOTOROLA_CAMERA
-android::String8 DCCHandler::DCCPath("/data/misc/camera/");
-#else
-android::String8 DCCHandler::DCCPath("/system/etc/omapcam/");
-#endif
+android::String8 DCCHandler::DCCPath(DCC_FILES_PATH);
 bool DCCHandler::mDCCLoaded = false;
 
 status_t DCCHandler::loadDCC(OMX_HANDLETYPE hComponent)
@@ -103,15 +103,18 @@ status_t OMXCameraAdapter::sniffDccFileDataSave(OMX_BUFFERHEADERTYPE* pBuffHeade
         return NO_ERROR;
     }
 
-    if (mDccData.pData) {
-        free(mDccData.pData);
+    // This runs for every preview frame, keep the copy while its size holds
+    OMX_PTR pData = mDccData.pData;
+    if (pData && (mDccData.nSize != dccData->nSize)) {
+        free(pData);
+        pData = NULL;
     }
 
     memcpy(&mDccData, dccData, sizeof(mDccData));
 
     int dccDataSize = (int)dccData->nSize - (int)(&(((OMX_TI_DCCDATATYPE*)0)->pData));
 
-    mDccData.pData = (OMX_PTR)malloc(dccDataSize);
+    mDccData.pData = pData ? pData : (OMX_PTR)malloc(dccDataSize);
 
     if (NULL == mDccData.pData) {
         CAMHAL_LOGVA("not enough memory for DCC data");
@@ -126,6 +129,168 @@ status_t OMXCameraAdapter::sniffDccFileDataSave(OMX_BUFFERHEADERTYPE* pBuffHeade
     return ret;
 }
 
+/*--------------------DCC data writer-----------------------------*/
+
+android::Mutex DccDataWriter::sInstanceLock;
+android::sp<DccDataWriter> DccDataWriter::sInstance;
+
+android::sp<DccDataWriter> DccDataWriter::getInstance()
+{
+    android::AutoMutex lock(sInstanceLock);
+
+    // Lives as long as the process, so saves from a closed camera still
+    // complete while the next one opens
+    if ( NULL == sInstance.get() ) {
+        android::sp<DccDataWriter> writer = new DccDataWriter();
+        if ( NO_ERROR != writer->run("DccDataWriter", android::PRIORITY_BACKGROUND) ) {
+            CAMHAL_LOGEA("Couldn't start the DCC data writer");
+            return NULL;
+        }
+        sInstance = writer;
+    }
+
+    return sInstance;
+}
+
+DccDataWriter::DccDataWriter()
+    : Thread(false),
+      mWritten(0),
+      mCoalesced(0),
+      mDropped(0),
+      mDelayed(0),
+      mMaxDelay(0)
+{
+}
+
+size_t DccDataWriter::dataSize(const OMX_TI_DCCDATATYPE &data)
+{
+    return (int)data.nSize - (int)(&(((OMX_TI_DCCDATATYPE*)0)->pData));
+}
+
+bool DccDataWriter::sameArea(const OMX_TI_DCCDATATYPE &a, const OMX_TI_DCCDATATYPE &b)
+{
+    // The file is found by the 3 ID words starting at nCameraModuleId
+    return ( 0 == memcmp(&a.nCameraModuleId, &b.nCameraModuleId, 3 * sizeof(OMX_U32)) ) &&
+           ( a.nUseCaseId == b.nUseCaseId ) &&
+           ( a.nOffset == b.nOffset ) &&
+           ( a.nSize == b.nSize );
+}
+
+status_t DccDataWriter::save(const OMX_TI_DCCDATATYPE &data)
+{
+    Request request;
+
+    LOG_FUNCTION_NAME;
+
+    android::AutoMutex lock(mLock);
+
+    for ( size_t i = 0; i < mPending.size(); i++ ) {
+        Request &pending = mPending.editItemAt(i);
+        if ( sameArea(pending.data, data) ) {
+            // Only the last data for an area ends up in the file anyway,
+            // the request keeps its place and age in the queue
+            free(pending.data.pData);
+            pending.data.pData = data.pData;
+            mCoalesced++;
+            CAMHAL_LOGDB("DCC data save coalesced, %u so far", mCoalesced);
+            LOG_FUNCTION_NAME_EXIT;
+            return NO_ERROR;
+        }
+    }
+
+    if ( MAX_PENDING <= (int) mPending.size() ) {
+        free(data.pData);
+        mDropped++;
+        CAMHAL_LOGEB("DCC data writer busy with %u saves, save dropped (%u dropped so far)",
+                     ( unsigned int ) mPending.size(), mDropped);
+        LOG_FUNCTION_NAME_EXIT;
+        return NO_MEMORY;
+    }
+
+    request.data = data;
+    request.queued = systemTime();
+    mPending.push_back(request);
+    mCondition.signal();
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+bool DccDataWriter::threadLoop()
+{
+    Request request;
+
+    {
+        android::AutoMutex lock(mLock);
+
+        while ( mPending.isEmpty() ) {
+            mCondition.wait(mLock);
+            if ( exitPending() ) {
+                return false;
+            }
+        }
+
+        request = mPending[0];
+        mPending.removeAt(0);
+    }
+
+    write(request.data);
+    free(request.data.pData);
+
+    const nsecs_t delay = systemTime() - request.queued;
+
+    android::AutoMutex lock(mLock);
+
+    mWritten++;
+    if ( delay > mMaxDelay ) {
+        mMaxDelay = delay;
+    }
+
+    if ( ms2ns(DELAY_THRESHOLD_MS) < delay ) {
+        mDelayed++;
+        CAMHAL_LOGDB("DCC data save took %u ms, %u of %u saves delayed, max %u ms",
+                     ( unsigned int ) ns2ms(delay), mDelayed, mWritten,
+                     ( unsigned int ) ns2ms(mMaxDelay));
+    }
+
+    return true;
+}
+
+status_t DccDataWriter::write(const OMX_TI_DCCDATATYPE &data)
+{
+    status_t ret = NO_ERROR;
+    FILE *fd = fopenCameraDCC(data, DCC_PATH);
+
+    LOG_FUNCTION_NAME;
+
+    if (fd)
+        {
+        if (!fseekDCCuseCasePos(data, fd))
+            {
+            if (fwrite(data.pData, dataSize(data), 1, fd) != 1)
+                {
+                CAMHAL_LOGEA("ERROR: Writing to DCC file failed");
+                ret = -EIO;
+                }
+            else
+                {
+                CAMHAL_LOGDA("DCC file successfully updated");
+                }
+            }
+        fclose(fd);
+        }
+    else
+        {
+        CAMHAL_LOGEA("ERROR: Correct DCC file not found or failed to open for modification");
+        ret = NAME_NOT_FOUND;
+        }
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return ret;
+}
+
 // Recursively searches given directory contents for the correct DCC file.
 // The directory must be opened and its stream pointer + path passed
 // as arguments. As this function is called recursively, to avoid excessive
@@ -134,7 +299,7 @@ status_t OMXCameraAdapter::sniffDccFileDataSave(OMX_BUFFERHEADERTYPE* pBuffHeade
 // The directory must also be closed in the caller function.
 // If the correct camera DCC file is found (based on the OMX measurement data)
 // its file stream pointer is returned. NULL is returned otherwise
-FILE * OMXCameraAdapter::parseDCCsubDir(DIR *pDir, char *path)
+FILE * DccDataWriter::parseDCCsubDir(const OMX_TI_DCCDATATYPE &data, DIR *pDir, char *path)
 {
     FILE *pFile;
     DIR *pSubDir;
@@ -155,7 +320,7 @@ FILE * OMXCameraAdapter::parseDCCsubDir(DIR *pDir, char *path)
         if (pSubDir) {
             // dirEntry is sub directory -> parse it
             strcat(path, "/");
-            pFile = parseDCCsubDir(pSubDir, path);
+            pFile = parseDCCsubDir(data, pSubDir, path);
             closedir(pSubDir);
             if (pFile) {
                 // the correct DCC file found!
@@ -168,7 +333,7 @@ FILE * OMXCameraAdapter::parseDCCsubDir(DIR *pDir, char *path)
             if (pFile) {
                 // now check if this is the correct DCC file for that camera
                 OMX_U32 dccFileIDword;
-                OMX_U32 *dccFileDesc = (OMX_U32 *) &mDccData.nCameraModuleId;
+                const OMX_U32 *dccFileDesc = (const OMX_U32 *) &data.nCameraModuleId;
                 int i;
 
                 // DCC file ID is 3 4-byte words
@@ -212,7 +377,7 @@ FILE * OMXCameraAdapter::parseDCCsubDir(DIR *pDir, char *path)
 // OMX measurement data, opens it and returns the file stream pointer
 // (NULL on error or if file not found).
 // The folder string dccFolderPath must end with "/"
-FILE * OMXCameraAdapter::fopenCameraDCC(const char *dccFolderPath)
+FILE * DccDataWriter::fopenCameraDCC(const OMX_TI_DCCDATATYPE &data, const char *dccFolderPath)
 {
     FILE *pFile;
     DIR *pDir;
@@ -229,7 +394,7 @@ FILE * OMXCameraAdapter::fopenCameraDCC(const char *dccFolderPath)
         return NULL;
     }
 
-    pFile = parseDCCsubDir(pDir, dccPath);
+    pFile = parseDCCsubDir(data, pDir, dccPath);
     closedir(pDir);
     if (pFile) {
         CAMHAL_LOGDB("DCC file %s opened for modification", dccPath);
@@ -242,7 +407,7 @@ FILE * OMXCameraAdapter::fopenCameraDCC(const char *dccFolderPath)
 
 // Positions the DCC file stream pointer to the correct offset within the
 // correct usecase based on the OMX mesurement data. Returns 0 on success
-status_t OMXCameraAdapter::fseekDCCuseCasePos(FILE *pFile)
+status_t DccDataWriter::fseekDCCuseCasePos(const OMX_TI_DCCDATATYPE &data, FILE *pFile)
 {
     OMX_U32 dccNumUseCases = 0;
     OMX_U32 dccUseCaseData[3];
@@ -271,24 +436,24 @@ status_t OMXCameraAdapter::fseekDCCuseCasePos(FILE *pFile)
             return -EINVAL;
         }
 
-        if (dccUseCaseData[0] == mDccData.nUseCaseId) {
+        if (dccUseCaseData[0] == data.nUseCaseId) {
             // DCC use case match!
             break;
         }
     }
 
     if (i == dccNumUseCases) {
-        CAMHAL_LOGEB("ERROR: Use case ID %lu not found in DCC file", mDccData.nUseCaseId);
+        CAMHAL_LOGEB("ERROR: Use case ID %lu not found in DCC file", data.nUseCaseId);
         LOG_FUNCTION_NAME_EXIT;
         return -EINVAL;
     }
 
     // dccUseCaseData[1] is the offset to the beginning of the actual use case
     // from the beginning of the file
-    // mDccData.nOffset is the offset within the actual use case (from the
+    // data.nOffset is the offset within the actual use case (from the
     // beginning of the use case to the data to be modified)
 
-    if (fseek(pFile,dccUseCaseData[1] + mDccData.nOffset, SEEK_SET ))
+    if (fseek(pFile,dccUseCaseData[1] + data.nOffset, SEEK_SET ))
     {
         CAMHAL_LOGEA("ERROR: Error setting the correct offset");
         LOG_FUNCTION_NAME_EXIT;
@@ -310,29 +475,21 @@ status_t OMXCameraAdapter::saveDccFileDataSave()
 
     if (mDccData.pData)
         {
-        FILE *fd = fopenCameraDCC(DCC_PATH);
+        android::sp<DccDataWriter> writer = DccDataWriter::getInstance();
 
-        if (fd)
+        if ( NULL != writer.get() )
             {
-            if (!fseekDCCuseCasePos(fd))
-                {
-                int dccDataSize = (int)mDccData.nSize - (int)(&(((OMX_TI_DCCDATATYPE*)0)->pData));
-
-                if (fwrite(mDccData.pData, dccDataSize, 1, fd) != 1)
-                    {
-                    CAMHAL_LOGEA("ERROR: Writing to DCC file failed");
-                    }
-                else
-                    {
-                    CAMHAL_LOGDA("DCC file successfully updated");
-                    }
-                }
-            fclose(fd);
+            // the writer owns the data from here on
+            ret = writer->save(mDccData);
             }
         else
             {
-            CAMHAL_LOGEA("ERROR: Correct DCC file not found or failed to open for modification");
+            CAMHAL_LOGEA("ERROR: DCC data writer not available, DCC data not saved");
+            free(mDccData.pData);
+            ret = NO_MEMORY;
             }
+
+        mDccData.pData = NULL;
         }
 
     LOG_FUNCTION_NAME_EXIT;
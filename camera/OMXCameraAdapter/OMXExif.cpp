@@ -57,6 +57,12 @@ status_t OMXCameraAdapter::setParametersEXIF(const android::CameraParameters &pa
                 strncpy(mEXIFData.mGPSData.mLatRef, GPS_SOUTH_REF, GPS_REF_SIZE);
                 }
 
+            snprintf(mEXIFData.mGPSData.mLatRational, GPS_RATIONAL_SIZE,
+                     "%d/%d,%d/%d,%d/%d",
+                     abs(mEXIFData.mGPSData.mLatDeg), 1,
+                     abs(mEXIFData.mGPSData.mLatMin), 1,
+                     abs(mEXIFData.mGPSData.mLatSec), abs(mEXIFData.mGPSData.mLatSecDiv));
+
             mEXIFData.mGPSData.mLatValid = true;
             }
         else
@@ -89,6 +95,12 @@ status_t OMXCameraAdapter::setParametersEXIF(const android::CameraParameters &pa
                 strncpy(mEXIFData.mGPSData.mLongRef, GPS_WEST_REF, GPS_REF_SIZE);
                 }
 
+            snprintf(mEXIFData.mGPSData.mLongRational, GPS_RATIONAL_SIZE,
+                     "%d/%d,%d/%d,%d/%d",
+                     abs(mEXIFData.mGPSData.mLongDeg), 1,
+                     abs(mEXIFData.mGPSData.mLongMin), 1,
+                     abs(mEXIFData.mGPSData.mLongSec), abs(mEXIFData.mGPSData.mLongSecDiv));
+
             mEXIFData.mGPSData.mLongValid= true;
             }
         else
@@ -110,6 +122,8 @@ status_t OMXCameraAdapter::setParametersEXIF(const android::CameraParameters &pa
         } else {
             mEXIFData.mGPSData.mAltitudeRef = 0;
         }
+        snprintf(mEXIFData.mGPSData.mAltRational, GPS_RATIONAL_SIZE,
+                 "%d/%d", abs(mEXIFData.mGPSData.mAltitude), 1);
         mEXIFData.mGPSData.mAltitudeValid = true;
         }
     else
@@ -126,6 +140,11 @@ status_t OMXCameraAdapter::setParametersEXIF(const android::CameraParameters &pa
             mEXIFData.mGPSData.mTimeStampHour = timeinfo->tm_hour;
             mEXIFData.mGPSData.mTimeStampMin = timeinfo->tm_min;
             mEXIFData.mGPSData.mTimeStampSec = timeinfo->tm_sec;
+            snprintf(mEXIFData.mGPSData.mTimeStampRational, GPS_RATIONAL_SIZE,
+                     "%d/%d,%d/%d,%d/%d",
+                     mEXIFData.mGPSData.mTimeStampHour, 1,
+                     mEXIFData.mGPSData.mTimeStampMin, 1,
+                     mEXIFData.mGPSData.mTimeStampSec, 1);
             mEXIFData.mGPSData.mTimeStampValid = true;
             }
         else
@@ -571,14 +590,7 @@ status_t OMXCameraAdapter::setupEXIF_libjpeg(ExifElementsTable* exifTable,
      }
 
     if ((NO_ERROR == ret) && (mEXIFData.mGPSData.mLatValid)) {
-        char temp_value[256]; // arbitrarily long string
-        snprintf(temp_value,
-                 sizeof(temp_value)/sizeof(char) - 1,
-                 "%d/%d,%d/%d,%d/%d",
-                 abs(mEXIFData.mGPSData.mLatDeg), 1,
-                 abs(mEXIFData.mGPSData.mLatMin), 1,
-                 abs(mEXIFData.mGPSData.mLatSec), abs(mEXIFData.mGPSData.mLatSecDiv));
-        ret = exifTable->insertElement(TAG_GPS_LAT, temp_value);
+        ret = exifTable->insertElement(TAG_GPS_LAT, mEXIFData.mGPSData.mLatRational);
     }
 
     if ((NO_ERROR == ret) && (mEXIFData.mGPSData.mLatValid)) {
@@ -586,14 +598,7 @@ status_t OMXCameraAdapter::setupEXIF_libjpeg(ExifElementsTable* exifTable,
     }
 
     if ((NO_ERROR == ret) && (mEXIFData.mGPSData.mLongValid)) {
-        char temp_value[256]; // arbitrarily long string
-        snprintf(temp_value,
-                 sizeof(temp_value)/sizeof(char) - 1,
-                 "%d/%d,%d/%d,%d/%d",
-                 abs(mEXIFData.mGPSData.mLongDeg), 1,
-                 abs(mEXIFData.mGPSData.mLongMin), 1,
-                 abs(mEXIFData.mGPSData.mLongSec), abs(mEXIFData.mGPSData.mLongSecDiv));
-        ret = exifTable->insertElement(TAG_GPS_LONG, temp_value);
+        ret = exifTable->insertElement(TAG_GPS_LONG, mEXIFData.mGPSData.mLongRational);
     }
 
     if ((NO_ERROR == ret) && (mEXIFData.mGPSData.mLongValid)) {
@@ -601,12 +606,7 @@ status_t OMXCameraAdapter::setupEXIF_libjpeg(ExifElementsTable* exifTable,
     }
 
     if ((NO_ERROR == ret) && (mEXIFData.mGPSData.mAltitudeValid)) {
-        char temp_value[256]; // arbitrarily long string
-        snprintf(temp_value,
-                 sizeof(temp_value)/sizeof(char) - 1,
-                 "%d/%d",
-                 abs( mEXIFData.mGPSData.mAltitude), 1);
-        ret = exifTable->insertElement(TAG_GPS_ALT, temp_value);
+        ret = exifTable->insertElement(TAG_GPS_ALT, mEXIFData.mGPSData.mAltRational);
     }
 
     if ((NO_ERROR == ret) && (mEXIFData.mGPSData.mAltitudeValid)) {
@@ -644,14 +644,7 @@ status_t OMXCameraAdapter::setupEXIF_libjpeg(ExifElementsTable* exifTable,
     }
 
     if ((NO_ERROR == ret) && (mEXIFData.mGPSData.mTimeStampValid)) {
-        char temp_value[256]; // arbitrarily long string
-        snprintf(temp_value,
-                 sizeof(temp_value)/sizeof(char) - 1,
-                 "%d/%d,%d/%d,%d/%d",
-                 mEXIFData.mGPSData.mTimeStampHour, 1,
-                 mEXIFData.mGPSData.mTimeStampMin, 1,
-                 mEXIFData.mGPSData.mTimeStampSec, 1);
-        ret = exifTable->insertElement(TAG_GPS_TIMESTAMP, temp_value);
+        ret = exifTable->insertElement(TAG_GPS_TIMESTAMP, mEXIFData.mGPSData.mTimeStampRational);
     }
 
     if ((NO_ERROR == ret) && (mEXIFData.mGPSData.mDatestampValid) ) {
@@ -260,15 +260,14 @@ status_t OMXCameraAdapter::createPreviewMetadata(OMX_BUFFERHEADERTYPE* pBuffHead
         }
     }
 
-    result = new (std::nothrow) CameraMetadataResult;
+    result = mMetadataResultPool.acquire();
     if(NULL == result.get()) {
         ret = NO_MEMORY;
         return ret;
     }
 
     //Encode face coordinates
-    faceRet = encodeFaceCoordinates(faceData, result->getMetadataResult()
-                                            , previewWidth, previewHeight);
+    faceRet = encodeFaceCoordinates(faceData, result.get(), previewWidth, previewHeight);
     if ((NO_ERROR == faceRet) || (NOT_ENOUGH_DATA == faceRet)) {
         // Ignore harmless errors (no error and no update) and go ahead and encode
         // the preview meta data
@@ -299,11 +298,12 @@ status_t OMXCameraAdapter::createPreviewMetadata(OMX_BUFFERHEADERTYPE* pBuffHead
 }
 
 status_t OMXCameraAdapter::encodeFaceCoordinates(const OMX_FACEDETECTIONTYPE *faceData,
-                                                 camera_frame_metadata_t *metadataResult,
+                                                 CameraMetadataResult *result,
                                                  size_t previewWidth,
                                                  size_t previewHeight)
 {
     status_t ret = NO_ERROR;
+    camera_frame_metadata_t *metadataResult = result->getMetadataResult();
     camera_face_t *faces;
     size_t hRange, vRange;
     double tmp;
@@ -316,23 +316,28 @@ status_t OMXCameraAdapter::encodeFaceCoordinates(const OMX_FACEDETECTIONTYPE *fa
 
     android::AutoMutex lock(mFaceDetectionLock);
 
-    // Avoid memory leak if called twice on same CameraMetadataResult
-    if ( (0 < metadataResult->number_of_faces) && (NULL != metadataResult->faces) ) {
-        free(metadataResult->faces);
-        metadataResult->number_of_faces = 0;
-        metadataResult->faces = NULL;
+    // Scale factors only change along with the preview size
+    if ( ( mFaceScaleWidth != previewWidth ) || ( mFaceScaleHeight != previewHeight ) ) {
+        mFaceScaleWidth = previewWidth;
+        mFaceScaleHeight = previewHeight;
+        mFaceHScale = ( double ) hRange / ( double ) previewWidth;
+        mFaceVScale = ( double ) vRange / ( double ) previewHeight;
     }
 
+    metadataResult->number_of_faces = 0;
+    metadataResult->faces = NULL;
+
     if ( (NULL != faceData) && (0 < faceData->ulFaceCount) ) {
         int orient_mult;
         int trans_left, trans_top, trans_right, trans_bot;
+        OMX_U32 faceCount = faceData->ulFaceCount;
 
-        faces = ( camera_face_t * ) malloc(sizeof(camera_face_t)*faceData->ulFaceCount);
-        if ( NULL == faces ) {
-            ret = NO_MEMORY;
-            goto out;
+        if ( CameraMetadataResult::MAX_FACES < faceCount ) {
+            faceCount = CameraMetadataResult::MAX_FACES;
         }
 
+        faces = result->getFaceBuffer();
+
         /**
         / * When device is 180 degrees oriented to the sensor, need to translate
         / * the output from Ducati to what Android expects
@@ -381,7 +386,7 @@ status_t OMXCameraAdapter::encodeFaceCoordinates(const OMX_FACEDETECTIONTYPE *fa
         }
 
         int j = 0, i = 0;
-        for ( ; j < faceData->ulFaceCount ; j++)
+        for ( ; j < faceCount ; j++)
             {
              OMX_S32 nLeft = 0;
              OMX_S32 nTop = 0;
@@ -402,23 +407,19 @@ status_t OMXCameraAdapter::encodeFaceCoordinates(const OMX_FACEDETECTIONTYPE *fa
                 nTop =  faceData->tFacePosition[j].nTop;
             }
 
-            tmp = ( double ) nLeft / ( double ) previewWidth;
-            tmp *= hRange;
+            tmp = ( double ) nLeft * mFaceHScale;
             tmp -= hRange/2;
             faces[i].rect[trans_left] = tmp;
 
-            tmp = ( double ) nTop / ( double )previewHeight;
-            tmp *= vRange;
+            tmp = ( double ) nTop * mFaceVScale;
             tmp -= vRange/2;
             faces[i].rect[trans_top] = tmp;
 
-            tmp = ( double ) faceData->tFacePosition[j].nWidth / ( double ) previewWidth;
-            tmp *= hRange;
+            tmp = ( double ) faceData->tFacePosition[j].nWidth * mFaceHScale;
             tmp *= orient_mult;
             faces[i].rect[trans_right] = faces[i].rect[trans_left] + tmp;
 
-            tmp = ( double ) faceData->tFacePosition[j].nHeight / ( double ) previewHeight;
-            tmp *= vRange;
+            tmp = ( double ) faceData->tFacePosition[j].nHeight * mFaceVScale;
             tmp *= orient_mult;
             faces[i].rect[trans_bot] = faces[i].rect[trans_top] + tmp;
 
@@ -456,13 +457,13 @@ status_t OMXCameraAdapter::encodeFaceCoordinates(const OMX_FACEDETECTIONTYPE *fa
                 int tempSizeY = (faceDetectionLastOutput[j].rect[trans_bot] -
                                 faceDetectionLastOutput[j].rect[trans_top] ) ;
 
-                if ( ( tempCenterX == centerX) &&
-                     ( tempCenterY == centerY) ) {
+                if ( ( abs(tempCenterX - centerX) <= mFaceDeltaThreshold ) &&
+                     ( abs(tempCenterY - centerY) <= mFaceDeltaThreshold ) ) {
                     // Found Face.
                     // Now check size of rectangle
                     // compare to last output.
-                    if ( ( tempSizeX == sizeX ) &&
-                         ( tempSizeY == sizeY ) ) {
+                    if ( ( abs(tempSizeX - sizeX) <= mFaceDeltaThreshold ) &&
+                         ( abs(tempSizeY - sizeY) <= mFaceDeltaThreshold ) ) {
                         faceChanged = false;
                     }
                 }
@@ -472,31 +473,27 @@ status_t OMXCameraAdapter::encodeFaceCoordinates(const OMX_FACEDETECTIONTYPE *fa
                 faceArrayChanged = true;
             }
         }
-
-        // Save this output for next iteration
-        for (int i = 0; i  < metadataResult->number_of_faces; i++)
-        {
-            faceDetectionLastOutput[i] = faces[i];
-        }
-    } else {
-        metadataResult->number_of_faces = 0;
-        metadataResult->faces = NULL;
     }
 
     // Send face detection data after face count changes
     if (faceDetectionNumFacesLastOutput != metadataResult->number_of_faces) {
         faceArrayChanged = true;
     }
-    faceDetectionNumFacesLastOutput = metadataResult->number_of_faces;
 
-    if ( !faceArrayChanged ) {
+    if ( faceArrayChanged ) {
+        // Only delivered output is saved for the next iteration, so
+        // movements below the threshold still add up
+        for (int i = 0; i  < metadataResult->number_of_faces; i++)
+        {
+            faceDetectionLastOutput[i] = metadataResult->faces[i];
+        }
+        faceDetectionNumFacesLastOutput = metadataResult->number_of_faces;
+    } else {
         ret = NOT_ENOUGH_DATA;
     }
 
     LOG_FUNCTION_NAME_EXIT;
 
-out:
-
     return ret;
 }
 
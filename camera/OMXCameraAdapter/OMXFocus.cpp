@@ -40,7 +40,7 @@ status_t OMXCameraAdapter::setParametersFocus(const android::CameraParameters &p
 {
     status_t ret = NO_ERROR;
     const char *str = NULL;
-    android::Vector<android::sp<CameraArea> > tempAreas;
+    bool areasChanged = false;
     size_t MAX_FOCUS_AREAS;
 
     LOG_FUNCTION_NAME;
@@ -52,12 +52,13 @@ status_t OMXCameraAdapter::setParametersFocus(const android::CameraParameters &p
     MAX_FOCUS_AREAS = atoi(params.get(android::CameraParameters::KEY_MAX_NUM_FOCUS_AREAS));
 
     if ( NULL != str ) {
-        ret = CameraArea::parseAreas(str, ( strlen(str) + 1 ), tempAreas);
+        ret = mFocusAreas.parse(str, areasChanged);
+    } else if ( !mFocusAreas.isEmpty() ) {
+        mFocusAreas.clear();
+        areasChanged = true;
     }
 
-    if ( (NO_ERROR == ret) && CameraArea::areAreasDifferent(mFocusAreas, tempAreas) ) {
-        mFocusAreas.clear();
-        mFocusAreas = tempAreas;
+    if ( (NO_ERROR == ret) && areasChanged ) {
         if ( MAX_FOCUS_AREAS < mFocusAreas.size() ) {
             CAMHAL_LOGEB("Focus areas supported %d, focus areas set %d",
                          MAX_FOCUS_AREAS,
@@ -121,7 +122,7 @@ status_t OMXCameraAdapter::doAutoFocus()
     pauseFaceDetection(true);
 
     // This is needed for applying FOCUS_REGION correctly
-    if ( (!mFocusAreas.isEmpty()) && (!mFocusAreas.itemAt(0)->isZeroArea()))
+    if ( (!mFocusAreas.isEmpty()) && (!mFocusAreas.itemAt(0).isZeroArea()))
     {
     //Disable face priority
     setAlgoPriority(FACE_PRIORITY, FOCUS_ALGO, false);
@@ -751,7 +752,7 @@ status_t OMXCameraAdapter::setTouchFocus()
         // If the area is the special case of (0, 0, 0, 0, 0), then
         // the algorithm needs nNumAreas to be set to 0,
         // in order to automatically choose the best fitting areas.
-        if ( mFocusAreas.itemAt(0)->isZeroArea() )
+        if ( mFocusAreas.itemAt(0).isZeroArea() )
             {
             focusAreas->nNumAreas = 0;
             }
@@ -768,7 +769,7 @@ status_t OMXCameraAdapter::setTouchFocus()
             }
 
             // transform the coordinates to 3A-type coordinates
-            mFocusAreas.itemAt(n)->transfrom((size_t)mPreviewData->mWidth/widthDivisor,
+            mFocusAreas.itemAt(n).transfrom((size_t)mPreviewData->mWidth/widthDivisor,
                                             (size_t)mPreviewData->mHeight/heightDivisor,
                                             (size_t&)focusAreas->tAlgoAreas[n].nTop,
                                             (size_t&)focusAreas->tAlgoAreas[n].nLeft,
@@ -783,7 +784,7 @@ status_t OMXCameraAdapter::setTouchFocus()
                     ( focusAreas->tAlgoAreas[n].nWidth * TOUCH_FOCUS_RANGE ) / mPreviewData->mWidth;
             focusAreas->tAlgoAreas[n].nHeight =
                     ( focusAreas->tAlgoAreas[n].nHeight * TOUCH_FOCUS_RANGE ) / mPreviewData->mHeight;
-            focusAreas->tAlgoAreas[n].nPriority = mFocusAreas.itemAt(n)->getWeight();
+            focusAreas->tAlgoAreas[n].nPriority = mFocusAreas.itemAt(n).getWeight();
 
              CAMHAL_LOGDB("Focus area %d : top = %d left = %d width = %d height = %d prio = %d",
                     n, (int)focusAreas->tAlgoAreas[n].nTop, (int)focusAreas->tAlgoAreas[n].nLeft,
@@ -112,6 +112,8 @@ status_t OMXCameraAdapter::startReprocess()
     if (NO_ERROR == ret) {
         android::AutoMutex lock(mBurstLock);
 
+        mReprocessQueued = systemTime();
+
         for ( int index = 0 ; index < portData->mMaxQueueable ; index++ ) {
             CAMHAL_LOGDB("Queuing buffer on video input port - %p, offset: %d, length: %d",
                          portData->mBufferHeader[index]->pBuffer,
@@ -162,8 +164,9 @@ status_t OMXCameraAdapter::stopReprocess()
                                 mCameraAdapterParameters.mVideoInPortIndex,
                                 NULL);
     if (portData) {
-        CAMHAL_LOGDB("Freeing buffers on reproc port - num: %d", portData->mNumBufs);
-        for (int index = 0 ; index < portData->mNumBufs ; index++) {
+        // the port may hold more buffers than the last request used
+        CAMHAL_LOGDB("Freeing buffers on reproc port - num: %d", (int) mReprocessBuffers.size());
+        for (int index = 0 ; index < (int) mReprocessBuffers.size() ; index++) {
             CAMHAL_LOGDB("Freeing buffer on reproc port - 0x%x",
                          ( unsigned int ) portData->mBufferHeader[index]->pBuffer);
             eError = OMX_FreeBuffer(mCameraAdapterParameters.mHandleComp,
@@ -192,8 +195,27 @@ status_t OMXCameraAdapter::stopReprocess()
 
     deinitInternalBuffers(mCameraAdapterParameters.mVideoInPortIndex);
 
+    mReprocessBuffers.clear();
     mReprocConfigured = false;
 
+    {
+        android::AutoMutex lock(mBurstLock);
+
+        if ( 0 < mReprocessRequests ) {
+            CAMHAL_LOGI("Reprocess session: %u requests, %u registrations, average %.2f ms, max %.2f ms",
+                        mReprocessRequests,
+                        mReprocessRegistrations,
+                        ns2us(mReprocessLatencyTotal / mReprocessRequests) / 1000.0,
+                        ns2us(mReprocessLatencyMax) / 1000.0);
+        }
+
+        mReprocessQueued = 0;
+        mReprocessRequests = 0;
+        mReprocessRegistrations = 0;
+        mReprocessLatencyTotal = 0;
+        mReprocessLatencyMax = 0;
+    }
+
 EXIT:
     CAMHAL_LOGEB("Exiting function %s because of ret %d eError=%x", __FUNCTION__, ret, eError);
     LOG_FUNCTION_NAME_EXIT;
@@ -210,6 +232,107 @@ EXIT:
     return (ret | Utils::ErrorUtils::omxToAndroidError(eError));
 }
 
+status_t OMXCameraAdapter::releaseReprocessBuffers()
+{
+    status_t ret = NO_ERROR;
+
+    LOG_FUNCTION_NAME;
+
+    // The tap in is going away with its buffers, Ducati has to let go of them
+    if (mAdapterState == REPROCESS_STATE) {
+        stopImageCapture();
+    }
+
+    ret = stopReprocess();
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return ret;
+}
+
+status_t OMXCameraAdapter::reuseReprocessBuffers(CameraBuffer *bufArr, int num)
+{
+    OMXCameraPortParameters *portData = NULL;
+    const int registered = mReprocessBuffers.size();
+
+    portData = &mCameraAdapterParameters.mCameraPortParams[mCameraAdapterParameters.mVideoInPortIndex];
+
+    if ( num > registered ) {
+        return NAME_NOT_FOUND;
+    }
+
+    // startReprocess() queues from the start of the header array, so the
+    // requested buffers are moved there in request order
+    for ( int i = 0 ; i < num ; i++ ) {
+        void *omxBuffer = camera_buffer_get_omx_ptr(&bufArr[i]);
+        int match = -1;
+
+        for ( int j = i ; j < registered ; j++ ) {
+            if ( ( mReprocessBuffers[j].opaque == bufArr[i].opaque ) &&
+                 ( mReprocessBuffers[j].omxBuffer == omxBuffer ) ) {
+                match = j;
+                break;
+            }
+        }
+
+        if ( 0 > match ) {
+            CAMHAL_LOGDB("Buffer %p isn't registered on the reproc port", bufArr[i].opaque);
+            return NAME_NOT_FOUND;
+        }
+
+        if ( match != i ) {
+            ReprocessBuffer buffer = mReprocessBuffers[i];
+            mReprocessBuffers.editItemAt(i) = mReprocessBuffers[match];
+            mReprocessBuffers.editItemAt(match) = buffer;
+
+            OMX_BUFFERHEADERTYPE *header = portData->mBufferHeader[i];
+            portData->mBufferHeader[i] = portData->mBufferHeader[match];
+            portData->mBufferHeader[match] = header;
+        }
+    }
+
+    for ( int i = 0 ; i < num ; i++ ) {
+        OMX_BUFFERHEADERTYPE *pBufferHdr = portData->mBufferHeader[i];
+
+        pBufferHdr->pAppPrivate = (OMX_PTR) &bufArr[i];
+        pBufferHdr->nOffset = bufArr[i].offset;
+        pBufferHdr->nFilledLen = bufArr[i].actual_size;
+        bufArr[i].index = i;
+    }
+
+    // All of the registered buffers stay on the port, only the requested
+    // ones get queued
+    portData->mNumBufs = registered;
+
+    return NO_ERROR;
+}
+
+void OMXCameraAdapter::reprocessDone()
+{
+    android::AutoMutex lock(mBurstLock);
+
+    if ( 0 == mReprocessQueued ) {
+        return;
+    }
+
+    const nsecs_t latency = systemTime() - mReprocessRequestStart;
+
+    mReprocessRequests++;
+    mReprocessLatencyTotal += latency;
+    if ( latency > mReprocessLatencyMax ) {
+        mReprocessLatencyMax = latency;
+    }
+
+    // setup covers the buffer registration and the image port configuration
+    CAMHAL_LOGI("Reprocess request %u: %s buffers, setup %.2f ms, total %.2f ms",
+                mReprocessRequests,
+                mReprocessRegistered ? "registered" : "reused",
+                ns2us(mReprocessQueued - mReprocessRequestStart) / 1000.0,
+                ns2us(latency) / 1000.0);
+
+    mReprocessQueued = 0;
+}
+
 status_t OMXCameraAdapter::UseBuffersReprocess(CameraBuffer *bufArr, int num)
 {
     LOG_FUNCTION_NAME;
@@ -217,6 +340,7 @@ status_t OMXCameraAdapter::UseBuffersReprocess(CameraBuffer *bufArr, int num)
     status_t ret = NO_ERROR;
     OMX_ERRORTYPE eError = OMX_ErrorNone;
     OMXCameraPortParameters *portData = NULL;
+    const nsecs_t requestStart = systemTime();
 
     portData = &mCameraAdapterParameters.mCameraPortParams[mCameraAdapterParameters.mVideoInPortIndex];
 
@@ -227,9 +351,7 @@ status_t OMXCameraAdapter::UseBuffersReprocess(CameraBuffer *bufArr, int num)
 
     CAMHAL_ASSERT(num > 0);
 
-    if (mAdapterState == REPROCESS_STATE) {
-        stopReprocess();
-    } else if (mAdapterState == CAPTURE_STATE) {
+    if (mAdapterState == CAPTURE_STATE) {
         stopImageCapture();
         stopReprocess();
     }
@@ -240,20 +362,30 @@ status_t OMXCameraAdapter::UseBuffersReprocess(CameraBuffer *bufArr, int num)
 
 #endif
 
-    portData->mNumBufs = num;
-
     // Configure
     ret = setParametersReprocess(mParams, bufArr, mAdapterState);
 
     if (mReprocConfigured) {
-        if (mPendingReprocessSettings & ECaptureParamSettings) {
-            stopReprocess();
-        } else {
-            // Tap in port has been already configured.
+        if ( !(mPendingReprocessSettings & ECaptureParamSettings) &&
+             ( NO_ERROR == reuseReprocessBuffers(bufArr, num) ) ) {
+            // Tap in port has been already configured with these buffers.
+            android::AutoMutex lock(mBurstLock);
+            mReprocessRequestStart = requestStart;
+            mReprocessRegistered = false;
+            LOG_FUNCTION_NAME_EXIT;
             return NO_ERROR;
         }
+
+        // the buffer count of the port follows the new set
+        if ( num != (int) mReprocessBuffers.size() ) {
+            mPendingReprocessSettings |= SetFormat;
+        }
+
+        stopReprocess();
     }
 
+    portData->mNumBufs = num;
+
     if (mPendingReprocessSettings & SetFormat) {
         mPendingReprocessSettings &= ~SetFormat;
         ret = setFormat(OMX_CAMERA_PORT_VIDEO_IN_VIDEO, *portData);
@@ -305,6 +437,7 @@ status_t OMXCameraAdapter::UseBuffersReprocess(CameraBuffer *bufArr, int num)
                              NULL);
     GOTO_EXIT_IF(( eError != OMX_ErrorNone ), eError);
 
+    mReprocessBuffers.clear();
     for (int index = 0 ; index < portData->mNumBufs ; index++)
     {
         OMX_BUFFERHEADERTYPE *pBufferHdr;
@@ -332,6 +465,11 @@ status_t OMXCameraAdapter::UseBuffersReprocess(CameraBuffer *bufArr, int num)
         pBufferHdr->nOffset = bufArr[index].offset;
         pBufferHdr->nFilledLen = bufArr[index].actual_size;
         portData->mBufferHeader[index] = pBufferHdr;
+
+        ReprocessBuffer registered;
+        registered.opaque = bufArr[index].opaque;
+        registered.omxBuffer = camera_buffer_get_omx_ptr(&bufArr[index]);
+        mReprocessBuffers.add(registered);
     }
 
     // Wait for port enable event
@@ -358,6 +496,13 @@ status_t OMXCameraAdapter::UseBuffersReprocess(CameraBuffer *bufArr, int num)
 
     mReprocConfigured = true;
 
+    {
+        android::AutoMutex lock(mBurstLock);
+        mReprocessRequestStart = requestStart;
+        mReprocessRegistered = true;
+        mReprocessRegistrations++;
+    }
+
 #if PPM_INSTRUMENTATION || PPM_INSTRUMENTATION_ABS
 
     CameraHal::PPM("Reprocess video port enabled and buffers registered: ", &bufArr->ppmStamp);
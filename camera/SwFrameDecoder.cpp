@@ -20,64 +20,222 @@
 namespace Ti {
 namespace Camera {
 
+// preview buffers are allocated with a 4096 bytes stride
+#define DECODE_STRIDE 4096
+
 SwFrameDecoder::SwFrameDecoder()
-: mjpegWithHdrSize(0), mJpegWithHeaderBuffer(NULL) {
+: mDecoding(false), mExiting(false), mMaxInFlight(1), mDroppedFrames(0) {
 }
 
 SwFrameDecoder::~SwFrameDecoder() {
-    delete [] mJpegWithHeaderBuffer;
-    mJpegWithHeaderBuffer = NULL;
+    doStop();
 }
 
 
 void SwFrameDecoder::doConfigure(const DecoderParameters& params) {
     LOG_FUNCTION_NAME;
 
-    mjpegWithHdrSize = (mParams.width * mParams.height / 2) +
-            mJpgdecoder.readDHTSize();
-    if (mJpegWithHeaderBuffer != NULL) {
-        delete [] mJpegWithHeaderBuffer;
-        mJpegWithHeaderBuffer = NULL;
+    mMaxInFlight = (params.maxFramesInFlight > 0) ? params.maxFramesInFlight : 1;
+    mJpgdecoder.startStream(params.width, params.height);
+
+    CAMHAL_LOGD("Decoding %dx%d MJPEG, up to %d frames in flight",
+            params.width, params.height, mMaxInFlight);
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+status_t SwFrameDecoder::doStart() {
+    LOG_FUNCTION_NAME;
+
+    {
+        android::AutoMutex lock(mJobLock);
+        mJobs.clear();
+        mDecoding = false;
+        mExiting = false;
+        mDroppedFrames = 0;
+    }
+
+    mDecodeThread = new DecodeThread(this);
+    status_t ret = mDecodeThread->run("SwFrameDecoder", android::PRIORITY_URGENT_DISPLAY);
+    if ( NO_ERROR != ret ) {
+        CAMHAL_LOGEB("Couldn't run decode thread (%d)", ret);
+        mDecodeThread.clear();
     }
-    mJpegWithHeaderBuffer = new unsigned char[mjpegWithHdrSize];
 
     LOG_FUNCTION_NAME_EXIT;
+    return ret;
 }
 
+void SwFrameDecoder::doStop() {
+    LOG_FUNCTION_NAME;
 
-void SwFrameDecoder::doProcessInputBuffer() {
+    {
+        android::AutoMutex lock(mJobLock);
+        mExiting = true;
+        mJobs.clear();
+        mJobAvailable.signal();
+    }
+
+    if ( mDecodeThread.get() ) {
+        mDecodeThread->requestExitAndWait();
+        mDecodeThread.clear();
+
+        if ( mDroppedFrames ) {
+            CAMHAL_LOGD("Decoder dropped %d frames", mDroppedFrames);
+        }
+    }
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+void SwFrameDecoder::doFlush() {
     LOG_FUNCTION_NAME;
-    nsecs_t timestamp = 0;
 
-    CAMHAL_LOGV("Will add header to MJPEG");
-    int final_jpg_sz = 0;
+    android::AutoMutex lock(mJobLock);
+    mJobs.clear();
+    while ( mDecoding ) {
+        mJobDone.wait(mJobLock);
+    }
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+void SwFrameDecoder::dropJob(const Job& job) {
+    {
+        android::sp<MediaBuffer>& inBuffer = mInBuffers->editItemAt(job.inIndex);
+        android::AutoMutex lock(inBuffer->getLock());
+        inBuffer->setStatus(BufferStatus_InDecoded);
+    }
     {
-        int inIndex = mInQueue.itemAt(0);
+        android::sp<MediaBuffer>& outBuffer = mOutBuffers->editItemAt(job.outIndex);
+        android::AutoMutex lock(outBuffer->getLock());
+        outBuffer->setStatus(BufferStatus_OutQueued);
+    }
+    mDroppedFrames++;
+}
+
+void SwFrameDecoder::doProcessInputBuffer() {
+    LOG_FUNCTION_NAME;
+
+    android::AutoMutex lock(mJobLock);
+
+    // Pair queued frames with free output buffers, oldest first. Frames
+    // left without an output buffer are dropped, except the newest one.
+    size_t out = 0;
+    for (size_t i = 0; i < mInQueue.size(); i++) {
+        int inIndex = mInQueue[i];
         android::sp<MediaBuffer>& inBuffer = mInBuffers->editItemAt(inIndex);
+        android::AutoMutex inLock(inBuffer->getLock());
+        if (inBuffer->getStatus() != BufferStatus_InQueued) {
+            continue;
+        }
+
+        int outIndex = -1;
+        for (; (out < mOutQueue.size()) && (outIndex < 0); out++) {
+            android::sp<MediaBuffer>& outBuffer = mOutBuffers->editItemAt(mOutQueue[out]);
+            android::AutoMutex outLock(outBuffer->getLock());
+            if (outBuffer->getStatus() == BufferStatus_OutQueued) {
+                outBuffer->setStatus(BufferStatus_OutWaitForFill);
+                outIndex = mOutQueue[out];
+            }
+        }
+
+        if (outIndex < 0) {
+            if (i + 1 < mInQueue.size()) {
+                inBuffer->setStatus(BufferStatus_InDecoded);
+                mDroppedFrames++;
+            }
+            continue;
+        }
+
+        inBuffer->setStatus(BufferStatus_InWaitForEmpty);
+        Job job;
+        job.inIndex = inIndex;
+        job.outIndex = outIndex;
+        mJobs.push_back(job);
+    }
+
+    // The decoder fell behind, keep the newest frames only
+    while ( (mJobs.size() > 1) && ((int)mJobs.size() + (mDecoding ? 1 : 0) > mMaxInFlight) ) {
+        CAMHAL_LOGV("Decoder busy, dropping frame %d", mJobs.begin()->inIndex);
+        dropJob(*mJobs.begin());
+        mJobs.erase(mJobs.begin());
+    }
+
+    if ( !mJobs.empty() ) {
+        mJobAvailable.signal();
+    }
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+bool SwFrameDecoder::decodeLoop() {
+    Job job;
+    {
+        android::AutoMutex lock(mJobLock);
+        while ( mJobs.empty() && !mExiting ) {
+            mJobAvailable.wait(mJobLock);
+        }
+        if ( mExiting ) {
+            return false;
+        }
+        job = *mJobs.begin();
+        mJobs.erase(mJobs.begin());
+        mDecoding = true;
+    }
+
+    // Both buffers belong to this job until their status changes, see Job
+    unsigned char *src = NULL;
+    int filledLen = 0;
+    nsecs_t timestamp = 0;
+    {
+        android::sp<MediaBuffer>& inBuffer = mInBuffers->editItemAt(job.inIndex);
         android::AutoMutex lock(inBuffer->getLock());
+        src = reinterpret_cast<unsigned char*>(inBuffer->buffer);
+        filledLen = inBuffer->filledLen;
         timestamp = inBuffer->getTimestamp();
-        final_jpg_sz = mJpgdecoder.appendDHT(
-                reinterpret_cast<unsigned char*>(inBuffer->buffer),
-                inBuffer->filledLen, mJpegWithHeaderBuffer, mjpegWithHdrSize);
-        inBuffer->setStatus(BufferStatus_InDecoded);
     }
-    CAMHAL_LOGV("Added header to MJPEG");
+    unsigned char *dst = NULL;
     {
-        int outIndex = mOutQueue.itemAt(0);
-        android::sp<MediaBuffer>& outBuffer = mOutBuffers->editItemAt(outIndex);
+        android::sp<MediaBuffer>& outBuffer = mOutBuffers->editItemAt(job.outIndex);
         android::AutoMutex lock(outBuffer->getLock());
         CameraBuffer* buffer = reinterpret_cast<CameraBuffer*>(outBuffer->buffer);
-        if (!mJpgdecoder.decode(mJpegWithHeaderBuffer, final_jpg_sz,
-                reinterpret_cast<unsigned char*>(buffer->mapped), 4096)) {
-            CAMHAL_LOGEA("Error while decoding JPEG");
-            return;
+        dst = reinterpret_cast<unsigned char*>(buffer->mapped);
+    }
+
+    bool decoded = mJpgdecoder.decode(src, filledLen, dst, DECODE_STRIDE);
+    if ( !decoded ) {
+        CAMHAL_LOGEA("Error while decoding JPEG");
+    }
+
+    {
+        android::AutoMutex lock(mJobLock);
+        {
+            android::sp<MediaBuffer>& inBuffer = mInBuffers->editItemAt(job.inIndex);
+            android::AutoMutex bufferLock(inBuffer->getLock());
+            inBuffer->setStatus(BufferStatus_InDecoded);
         }
-        outBuffer->setTimestamp(timestamp);
-        outBuffer->setStatus(BufferStatus_OutFilled);
+        {
+            android::sp<MediaBuffer>& outBuffer = mOutBuffers->editItemAt(job.outIndex);
+            android::AutoMutex bufferLock(outBuffer->getLock());
+            if ( decoded ) {
+                outBuffer->setTimestamp(timestamp);
+                outBuffer->setStatus(BufferStatus_OutFilled);
+            } else {
+                outBuffer->setStatus(BufferStatus_OutQueued);
+            }
+        }
+        mDecoding = false;
+        mJobDone.signal();
+    }
+
+    if ( decoded ) {
+        // the preview thread hands the frame on without waiting for the next one
+        signalOutputReady();
     }
     CAMHAL_LOGV("JPEG decoded!");
 
-    LOG_FUNCTION_NAME_EXIT;
+    return true;
 }
 
 
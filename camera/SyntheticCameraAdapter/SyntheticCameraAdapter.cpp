@@ -0,0 +1,708 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file SyntheticCameraAdapter.cpp
+*
+* This file implements a camera adapter generating its own frames.
+*
+*/
+
+
+#include "SyntheticCameraAdapter.h"
+#include "CameraHal.h"
+#include "TICameraParameters.h"
+#include "FrameTrace.h"
+#include "DebugUtils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cutils/properties.h>
+
+namespace Ti {
+namespace Camera {
+
+//rate used when the parameters don't carry a valid one
+#define DEFAULT_FRAME_RATE 30
+
+android::Mutex gSyntheticAdapterLock;
+
+/*--------------------Camera Adapter Class STARTS here-----------------------------*/
+
+SyntheticCameraAdapter::SyntheticCameraAdapter(size_t sensor_index)
+    : mSensorIndex(sensor_index),
+      mPreviewing(false),
+      mPreviewWidth(0),
+      mPreviewHeight(0),
+      mForcedFrameRate(-1),
+      mFrameInterval(0),
+      mNextFrameTime(0),
+      mFrameCount(0),
+      mDroppedFrames(0),
+      mLateFrames(0),
+      mCapturesPending(0),
+      mCapturesInFlight(0),
+      mSource(NULL),
+      mSourceSize(0),
+      mSourceFrameSize(0),
+      mSourceFrames(0)
+{
+    LOG_FUNCTION_NAME;
+
+    mFramesWithEncoder = 0;
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+SyntheticCameraAdapter::~SyntheticCameraAdapter()
+{
+    LOG_FUNCTION_NAME;
+
+    unmapSource();
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+/*--------------------Camera Adapter Functions-----------------------------*/
+status_t SyntheticCameraAdapter::initialize(CameraProperties::Properties* caps)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    LOG_FUNCTION_NAME;
+
+    android::AutoMutex lock(mFrameLock);
+
+    property_get("camera.synthetic.fps", value, "-1");
+    mForcedFrameRate = atoi(value);
+
+    mPreviewing = false;
+    mRecording = false;
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+status_t SyntheticCameraAdapter::setParameters(const android::CameraParameters &params)
+{
+    LOG_FUNCTION_NAME;
+
+    android::AutoMutex lock(mFrameLock);
+
+    // Udpate the current parameter set
+    mParams = params;
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+void SyntheticCameraAdapter::getParameters(android::CameraParameters& params)
+{
+    LOG_FUNCTION_NAME;
+
+    android::AutoMutex lock(mFrameLock);
+    // Return the current parameter set
+    params = mParams;
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+///API to give the buffers to Adapter
+status_t SyntheticCameraAdapter::useBuffers(CameraMode mode, CameraBuffer *bufArr, int num, size_t length, unsigned int queueable)
+{
+    status_t ret = NO_ERROR;
+
+    LOG_FUNCTION_NAME;
+
+    if ( NULL == bufArr ) {
+        return BAD_VALUE;
+    }
+
+    android::AutoMutex lock(mFrameLock);
+
+    switch(mode)
+        {
+        case CAMERA_PREVIEW:
+        case CAMERA_VIDEO:
+            // BaseCameraAdapter holds the undequeued buffers until the
+            // display gives them to us
+            mPreviewBufs.clear();
+            for ( unsigned int i = 0; i < queueable; i++ ) {
+                mPreviewBufs.push_back(&bufArr[i]);
+            }
+            break;
+
+        case CAMERA_IMAGE_CAPTURE:
+            {
+            android::AutoMutex captureLock(mCaptureBufferLock);
+
+            mCaptureBufs.clear();
+            mCaptureBuffersAvailable.clear();
+            for ( unsigned int i = 0; i < queueable; i++ ) {
+                addFrameBuffer(mCaptureBuffersAvailable, &bufArr[i], CameraFrame::IMAGE_FRAME, 0);
+                mCaptureBufs.push_back(&bufArr[i]);
+            }
+
+            // initial ref count for undeqeueued buffers is 1 since buffer provider
+            // is still holding on to it
+            for ( int i = queueable; i < num; i++ ) {
+                addFrameBuffer(mCaptureBuffersAvailable, &bufArr[i], CameraFrame::IMAGE_FRAME, 1);
+            }
+            }
+            break;
+
+        case CAMERA_MEASUREMENT:
+            break;
+
+        default:
+            break;
+        }
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return ret;
+}
+
+status_t SyntheticCameraAdapter::fillThisBuffer(CameraBuffer *frameBuf, CameraFrame::FrameType frameType)
+{
+    bool captureDone = false;
+
+    LOG_FUNCTION_NAME;
+
+    {
+        android::AutoMutex lock(mFrameLock);
+
+        if ( CameraFrame::IMAGE_FRAME == frameType ) {
+            mCaptureBufs.push_back(frameBuf);
+            mCapturesInFlight--;
+            captureDone = ( 0 == mCapturesPending ) && ( 0 == mCapturesInFlight );
+        } else if ( mPreviewing ) {
+            mPreviewBufs.push_back(frameBuf);
+        }
+
+        mFrameCondition.signal();
+    }
+
+    // Signal end of image capture once the last picture of the burst is back
+    if ( captureDone && ( NULL != mEndImageCaptureCallback ) ) {
+        CAMHAL_LOGDA("Signal end of image capture");
+        mEndImageCaptureCallback(mEndCaptureData);
+    }
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+status_t SyntheticCameraAdapter::startPreview()
+{
+    status_t ret = NO_ERROR;
+    int minFps = 0, maxFps = 0;
+    int frameRate;
+
+    LOG_FUNCTION_NAME;
+
+    android::AutoMutex lock(mFrameLock);
+
+    if ( mPreviewing ) {
+        return BAD_VALUE;
+    }
+
+    mParams.getPreviewSize(&mPreviewWidth, &mPreviewHeight);
+
+    frameRate = mForcedFrameRate;
+    if ( 0 > frameRate ) {
+        const char *frameRateRange = mParams.get(TICameraParameters::KEY_PREVIEW_FRAME_RATE_RANGE);
+        if ( CameraHal::parsePair(frameRateRange, &minFps, &maxFps, ',') && ( 0 < maxFps ) ) {
+            frameRate = maxFps / CameraHal::VFR_SCALE;
+        }
+        if ( 0 >= frameRate ) {
+            frameRate = DEFAULT_FRAME_RATE;
+        }
+    }
+
+    mFrameInterval = ( 0 < frameRate ) ? ( s2ns(1) / frameRate ) : 0;
+    mNextFrameTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    mFrameCount = 0;
+    mDroppedFrames = 0;
+    mLateFrames = 0;
+
+    mapSource(mPreviewWidth, mPreviewHeight);
+
+    CAMHAL_LOGDB("Synthetic preview %dx%d at %d fps from %s",
+                 mPreviewWidth, mPreviewHeight, frameRate,
+                 ( NULL != mSource ) ? "file" : "pattern");
+
+    mPreviewing = true;
+    mFrameThread = new FrameThread(this);
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return ret;
+}
+
+status_t SyntheticCameraAdapter::stopPreview()
+{
+    android::sp<FrameThread> thread;
+
+    LOG_FUNCTION_NAME;
+
+    {
+        android::AutoMutex lock(mFrameLock);
+
+        if ( !mPreviewing ) {
+            return NO_INIT;
+        }
+
+        mPreviewing = false;
+        mFrameCondition.signal();
+        thread = mFrameThread;
+        mFrameThread.clear();
+    }
+
+    if ( NULL != thread.get() ) {
+        thread->requestExitAndWait();
+    }
+
+    android::AutoMutex lock(mFrameLock);
+
+    CAMHAL_LOGDB("Synthetic preview stopped after %u frames, %u dropped, %u late",
+                 mFrameCount, mDroppedFrames, mLateFrames);
+
+    mPreviewBufs.clear();
+    mCapturesPending = 0;
+    mFramesWithEncoder = 0;
+    unmapSource();
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+status_t SyntheticCameraAdapter::takePicture()
+{
+    int burst;
+
+    LOG_FUNCTION_NAME;
+
+    android::AutoMutex lock(mFrameLock);
+
+    if ( !mPreviewing ) {
+        CAMHAL_LOGEA("Pictures are generated from the preview thread, preview isn't running");
+        return NO_INIT;
+    }
+
+    if ( ( 0 < mCapturesPending ) || ( 0 < mCapturesInFlight ) ) {
+        CAMHAL_LOGEA("Already Capture in Progress...");
+        return BAD_VALUE;
+    }
+
+    burst = mParams.getInt(TICameraParameters::KEY_BURST);
+    mCapturesPending = ( 0 < burst ) ? burst : 1;
+    mFrameCondition.signal();
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+status_t SyntheticCameraAdapter::stopImageCapture()
+{
+    LOG_FUNCTION_NAME;
+
+    {
+        android::AutoMutex lock(mFrameLock);
+        mCapturesPending = 0;
+        mCaptureBufs.clear();
+    }
+
+    //Release image buffers
+    if ( NULL != mReleaseImageBuffersCallback ) {
+        mReleaseImageBuffersCallback(mReleaseData);
+    }
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+status_t SyntheticCameraAdapter::autoFocus()
+{
+    LOG_FUNCTION_NAME;
+
+    // Nothing to focus, report the lens locked right away
+    notifyFocusSubscribers(CameraHalEvent::FOCUS_STATUS_SUCCESS);
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+//API to get the frame size required to be allocated. This size is used to override the size passed
+//by camera service when VSTAB/VNF is turned ON for example
+status_t SyntheticCameraAdapter::getFrameSize(size_t &width, size_t &height)
+{
+    int w = 0, h = 0;
+
+    LOG_FUNCTION_NAME;
+
+    android::AutoMutex lock(mFrameLock);
+
+    mParams.getPreviewSize(&w, &h);
+    width = w;
+    height = h;
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+status_t SyntheticCameraAdapter::getFrameDataSize(size_t &dataFrameSize, size_t bufferCount)
+{
+    // We don't support meta data
+    dataFrameSize = 0;
+    return NO_ERROR;
+}
+
+status_t SyntheticCameraAdapter::getPictureBufferSize(CameraFrame &frame, size_t bufferCount)
+{
+    int width = 0;
+    int height = 0;
+    int bytesPerPixel = 2; // for YUV422i
+
+    LOG_FUNCTION_NAME;
+
+    android::AutoMutex lock(mFrameLock);
+
+    mParams.getPictureSize( &width, &height );
+    frame.mLength = width * height * bytesPerPixel;
+    frame.mWidth = width;
+    frame.mHeight = height;
+    frame.mAlignment = width * bytesPerPixel;
+
+    CAMHAL_LOGDB("Picture size: W x H = %u x %u (size=%u bytes, alignment=%u bytes)",
+                 frame.mWidth, frame.mHeight, ( unsigned int ) frame.mLength, frame.mAlignment);
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+void SyntheticCameraAdapter::onOrientationEvent(uint32_t orientation, uint32_t tilt)
+{
+    LOG_FUNCTION_NAME;
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+/*--------------------Frame source-----------------------------*/
+
+status_t SyntheticCameraAdapter::mapSource(int width, int height)
+{
+    char path[PROPERTY_VALUE_MAX];
+    struct stat st;
+    void *data;
+    int fd;
+
+    unmapSource();
+
+    if ( ( 0 >= property_get("camera.synthetic.source", path, "") ) || ( '\0' == path[0] ) ) {
+        return NO_ERROR;
+    }
+
+    fd = open(path, O_RDONLY);
+    if ( 0 > fd ) {
+        CAMHAL_LOGEB("Couldn't open %s: %s, using the pattern", path, strerror(errno));
+        return BAD_VALUE;
+    }
+
+    mSourceFrameSize = width * height * 3 / 2;
+    if ( ( 0 != fstat(fd, &st) ) || ( ( size_t ) st.st_size < mSourceFrameSize ) ) {
+        CAMHAL_LOGEB("%s doesn't hold a %dx%d NV12 frame, using the pattern", path, width, height);
+        close(fd);
+        return BAD_VALUE;
+    }
+
+    // The page cache keeps the frames around, no need to copy them
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( MAP_FAILED == data ) {
+        CAMHAL_LOGEB("Couldn't map %s: %s, using the pattern", path, strerror(errno));
+        return NO_MEMORY;
+    }
+
+    mSource = static_cast<uint8_t *>(data);
+    mSourceSize = st.st_size;
+    mSourceFrames = mSourceSize / mSourceFrameSize;
+
+    return NO_ERROR;
+}
+
+void SyntheticCameraAdapter::unmapSource()
+{
+    if ( NULL != mSource ) {
+        munmap(mSource, mSourceSize);
+        mSource = NULL;
+    }
+
+    mSourceSize = 0;
+    mSourceFrames = 0;
+}
+
+void SyntheticCameraAdapter::renderPreview(uint8_t *dst, int width, int height, int stride)
+{
+    uint8_t *uv = dst + height * stride;
+
+    if ( NULL != mSource ) {
+        const uint8_t *src = mSource + ( mFrameCount % mSourceFrames ) * mSourceFrameSize;
+
+        for ( int y = 0; y < height; y++ ) {
+            memcpy(dst + y * stride, src + y * width, width);
+        }
+
+        src += width * height;
+        for ( int y = 0; y < height / 2; y++ ) {
+            memcpy(uv + y * stride, src + y * width, width);
+        }
+
+        return;
+    }
+
+    // Diagonal ramp moving a couple of pixels per frame on a grey background
+    const int shift = mFrameCount * 2;
+
+    for ( int y = 0; y < height; y++ ) {
+        uint8_t *row = dst + y * stride;
+        for ( int x = 0; x < width; x++ ) {
+            row[x] = static_cast<uint8_t>(x + y + shift);
+        }
+    }
+
+    for ( int y = 0; y < height / 2; y++ ) {
+        memset(uv + y * stride, 128, width);
+    }
+}
+
+void SyntheticCameraAdapter::renderPicture(uint8_t *dst, int width, int height)
+{
+    for ( int y = 0; y < height; y++ ) {
+        uint8_t *row = dst + y * width * 2;
+        for ( int x = 0; x < width; x += 2 ) {
+            row[x * 2] = 128;
+            row[x * 2 + 1] = static_cast<uint8_t>(x + y);
+            row[x * 2 + 2] = 128;
+            row[x * 2 + 3] = static_cast<uint8_t>(x + y + 1);
+        }
+    }
+}
+
+/*--------------------Frame thread-----------------------------*/
+
+status_t SyntheticCameraAdapter::sendPreviewFrame(CameraBuffer *buffer, nsecs_t timestamp)
+{
+    status_t ret = NO_ERROR;
+    CameraFrame frame;
+
+    frame.mFrameType = CameraFrame::PREVIEW_FRAME_SYNC;
+    frame.mBuffer = buffer;
+    frame.mLength = mPreviewWidth * mPreviewHeight * 3 / 2;
+    frame.mWidth = mPreviewWidth;
+    frame.mHeight = mPreviewHeight;
+    frame.mAlignment = PREVIEW_STRIDE;
+    frame.mOffset = 0;
+    frame.mTimestamp = timestamp;
+    frame.mFrameMask = (unsigned int)CameraFrame::PREVIEW_FRAME_SYNC;
+
+    if ( mRecording ) {
+        frame.mFrameMask |= (unsigned int)CameraFrame::VIDEO_FRAME_SYNC;
+        android_atomic_inc(&mFramesWithEncoder);
+    }
+
+    // The tick the frame was due at stands in for the sensor timestamp
+    FrameTrace::stampAt(FrameTrace::STAGE_SENSOR, buffer, frame.mFrameMask, timestamp);
+    FrameTrace::stamp(FrameTrace::STAGE_FILL_BUFFER_DONE, buffer, frame.mFrameMask);
+
+    ret = setInitFrameRefCount(frame.mBuffer, frame.mFrameMask);
+    if ( NO_ERROR != ret ) {
+        CAMHAL_LOGDB("Error in setInitFrameRefCount %d", ret);
+    } else {
+        ret = sendFrameToSubscribers(&frame);
+    }
+
+    return ret;
+}
+
+status_t SyntheticCameraAdapter::sendImageFrame(CameraBuffer *buffer)
+{
+    status_t ret = NO_ERROR;
+    int width = 0;
+    int height = 0;
+    CameraFrame frame;
+
+    {
+        android::AutoMutex lock(mFrameLock);
+        mParams.getPictureSize(&width, &height);
+    }
+
+    renderPicture(static_cast<uint8_t *>(buffer->mapped), width, height);
+
+    notifyShutterSubscribers();
+
+    frame.mFrameType = CameraFrame::IMAGE_FRAME;
+    frame.mBuffer = buffer;
+    frame.mLength = width * height * 2;
+    frame.mWidth = width;
+    frame.mHeight = height;
+    frame.mAlignment = width * 2;
+    frame.mOffset = 0;
+    frame.mTimestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    frame.mFrameMask = (unsigned int)CameraFrame::IMAGE_FRAME;
+    frame.mQuirks |= CameraFrame::ENCODE_RAW_YUV422I_TO_JPEG;
+    frame.mQuirks |= CameraFrame::FORMAT_YUV422I_UYVY;
+
+    ret = setInitFrameRefCount(frame.mBuffer, frame.mFrameMask);
+    if ( NO_ERROR != ret ) {
+        CAMHAL_LOGDB("Error in setInitFrameRefCount %d", ret);
+    } else {
+        ret = sendFrameToSubscribers(&frame);
+    }
+
+    return ret;
+}
+
+int SyntheticCameraAdapter::frameThread()
+{
+    CameraBuffer *buffer = NULL;
+    bool picture = false;
+    nsecs_t timestamp = 0;
+
+    {
+        android::AutoMutex lock(mFrameLock);
+
+        if ( !mPreviewing ) {
+            return NO_ERROR;
+        }
+
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        // Pictures go out as soon as there is a buffer for them, the
+        // encoder pool paces bursts
+        if ( ( 0 < mCapturesPending ) && !mCaptureBufs.isEmpty() ) {
+            buffer = mCaptureBufs[0];
+            mCaptureBufs.removeAt(0);
+            mCapturesPending--;
+            mCapturesInFlight++;
+            picture = true;
+        } else if ( now < mNextFrameTime ) {
+            mFrameCondition.waitRelative(mFrameLock, mNextFrameTime - now);
+            return NO_ERROR;
+        } else if ( mPreviewBufs.isEmpty() ) {
+            if ( 0 == mFrameInterval ) {
+                // Unpaced, the next frame is due once a buffer comes back
+                mFrameCondition.wait(mFrameLock);
+                return NO_ERROR;
+            }
+            // The tick passes without a frame like a sensor overrun
+            mDroppedFrames++;
+            mNextFrameTime += mFrameInterval;
+            return NO_ERROR;
+        } else {
+            buffer = mPreviewBufs[0];
+            mPreviewBufs.removeAt(0);
+
+            if ( 0 == mFrameInterval ) {
+                timestamp = now;
+            } else {
+                timestamp = mNextFrameTime;
+                mNextFrameTime += mFrameInterval;
+                if ( mNextFrameTime < now ) {
+                    // Fell more than a frame behind, don't send a catch up burst
+                    mLateFrames++;
+                    mNextFrameTime = now + mFrameInterval;
+                }
+            }
+        }
+    }
+
+    if ( picture ) {
+        return sendImageFrame(buffer);
+    }
+
+    renderPreview(static_cast<uint8_t *>(buffer->mapped), mPreviewWidth, mPreviewHeight, PREVIEW_STRIDE);
+    mFrameCount++;
+
+    return sendPreviewFrame(buffer, timestamp);
+}
+
+extern "C" CameraAdapter* SyntheticCameraAdapter_Factory(size_t sensor_index)
+{
+    CameraAdapter *adapter = NULL;
+    android::AutoMutex lock(gSyntheticAdapterLock);
+
+    LOG_FUNCTION_NAME;
+
+    adapter = new SyntheticCameraAdapter(sensor_index);
+    if ( adapter ) {
+        CAMHAL_LOGDB("New synthetic camera adapter instance created for sensor %d", sensor_index);
+    } else {
+        CAMHAL_LOGEB("Synthetic camera adapter create failed for sensor index = %d!", sensor_index);
+    }
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return adapter;
+}
+
+extern "C" status_t SyntheticCameraAdapter_Capabilities(
+        CameraProperties::Properties * const properties_array,
+        const int starting_camera, const int max_camera, int & supportedCameras)
+{
+    status_t ret = NO_ERROR;
+
+    LOG_FUNCTION_NAME;
+
+    supportedCameras = 0;
+
+    if ( !properties_array ) {
+        CAMHAL_LOGEB("invalid param: properties = 0x%p", properties_array);
+        LOG_FUNCTION_NAME_EXIT;
+        return BAD_VALUE;
+    }
+
+    if ( starting_camera < max_camera ) {
+        ret = SyntheticCameraAdapter::getCaps(starting_camera, properties_array + starting_camera);
+        if ( NO_ERROR == ret ) {
+            supportedCameras = 1;
+        }
+    }
+
+    CAMHAL_LOGDB("Number of synthetic cameras =%d", supportedCameras);
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return ret;
+}
+
+} // namespace Camera
+} // namespace Ti
+
+
+/*--------------------Camera Adapter Class ENDS here-----------------------------*/
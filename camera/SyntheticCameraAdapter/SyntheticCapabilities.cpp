@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file SyntheticCapabilities.cpp
+*
+* This file implements the capabilities of the synthetic camera.
+*
+*/
+
+#include "CameraHal.h"
+#include "SyntheticCameraAdapter.h"
+#include "ErrorUtils.h"
+#include "TICameraParameters.h"
+
+namespace Ti {
+namespace Camera {
+
+/************************************
+ * global constants and variables
+ *************************************/
+
+//Capabilities
+const char SyntheticCameraAdapter::SUPPORTED_PREVIEW_SIZES[] =
+        "1920x1080,1280x720,800x480,720x480,640x480,352x288,320x240,176x144";
+const char SyntheticCameraAdapter::SUPPORTED_PICTURE_SIZES[] =
+        "3264x2448,2592x1944,2048x1536,1920x1080,1280x960,640x480,320x240";
+const char SyntheticCameraAdapter::SUPPORTED_FRAMERATES[] = "15,24,30,60";
+const char SyntheticCameraAdapter::SUPPORTED_FRAMERATE_RANGES[] =
+        "(15000,15000),(24000,24000),(30000,30000),(60000,60000)";
+
+//Camera defaults
+const char SyntheticCameraAdapter::DEFAULT_PICTURE_FORMAT[] = "jpeg";
+const char SyntheticCameraAdapter::DEFAULT_PICTURE_SIZE[] = "2592x1944";
+const char SyntheticCameraAdapter::DEFAULT_PREVIEW_FORMAT[] = "yuv420sp";
+const char SyntheticCameraAdapter::DEFAULT_PREVIEW_SIZE[] = "640x480";
+const char SyntheticCameraAdapter::DEFAULT_NUM_PREV_BUFS[] = "6";
+const char SyntheticCameraAdapter::DEFAULT_FRAMERATE[] = "30";
+const char SyntheticCameraAdapter::DEFAULT_FOCUS_MODE[] = "infinity";
+const char SyntheticCameraAdapter::DEFAULT_FRAMERATE_RANGE[] = "30000,30000";
+
+/*****************************************
+ * public exposed function declarations
+ *****************************************/
+
+status_t SyntheticCameraAdapter::getCaps(const int sensorId, CameraProperties::Properties* params)
+{
+    LOG_FUNCTION_NAME;
+
+    params->set(CameraProperties::SUPPORTED_PREVIEW_FORMATS, android::CameraParameters::PIXEL_FORMAT_YUV420SP);
+    params->set(CameraProperties::SUPPORTED_PREVIEW_SIZES, SUPPORTED_PREVIEW_SIZES);
+    params->set(CameraProperties::SUPPORTED_PREVIEW_SUBSAMPLED_SIZES, SUPPORTED_PREVIEW_SIZES);
+    params->set(CameraProperties::SUPPORTED_PICTURE_SIZES, SUPPORTED_PICTURE_SIZES);
+    params->set(CameraProperties::SUPPORTED_PREVIEW_FRAME_RATES, SUPPORTED_FRAMERATES);
+    params->set(CameraProperties::FRAMERATE_RANGE_SUPPORTED, SUPPORTED_FRAMERATE_RANGES);
+    params->set(CameraProperties::SUPPORTED_FOCUS_MODES, DEFAULT_FOCUS_MODE);
+    params->set(CameraProperties::SUPPORTED_PICTURE_FORMATS, DEFAULT_PICTURE_FORMAT);
+
+    params->set(CameraProperties::PREVIEW_FORMAT, DEFAULT_PREVIEW_FORMAT);
+    params->set(CameraProperties::PICTURE_FORMAT, DEFAULT_PICTURE_FORMAT);
+    params->set(CameraProperties::PICTURE_SIZE, DEFAULT_PICTURE_SIZE);
+    params->set(CameraProperties::PREVIEW_SIZE, DEFAULT_PREVIEW_SIZE);
+    params->set(CameraProperties::PREVIEW_FRAME_RATE, DEFAULT_FRAMERATE);
+    params->set(CameraProperties::REQUIRED_PREVIEW_BUFS, DEFAULT_NUM_PREV_BUFS);
+    params->set(CameraProperties::FOCUS_MODE, DEFAULT_FOCUS_MODE);
+
+    params->set(CameraProperties::CAMERA_NAME, SYNTHETIC_CAMERA_NAME);
+    params->set(CameraProperties::JPEG_THUMBNAIL_SIZE, "320x240");
+    params->set(CameraProperties::JPEG_QUALITY, "90");
+    params->set(CameraProperties::JPEG_THUMBNAIL_QUALITY, "50");
+    params->set(CameraProperties::FRAMERATE_RANGE, DEFAULT_FRAMERATE_RANGE);
+    params->set(CameraProperties::S3D_PRV_FRAME_LAYOUT, "none");
+    params->set(CameraProperties::SUPPORTED_EXPOSURE_MODES, "auto");
+    params->set(CameraProperties::SUPPORTED_ISO_VALUES, "auto");
+    params->set(CameraProperties::SUPPORTED_ANTIBANDING, "auto");
+    params->set(CameraProperties::SUPPORTED_EFFECTS, "none");
+    params->set(CameraProperties::SUPPORTED_IPP_MODES, "ldc-nsf");
+    params->set(CameraProperties::FACING_INDEX, TICameraParameters::FACING_BACK);
+    params->set(CameraProperties::ORIENTATION_INDEX, 0);
+    params->set(CameraProperties::SENSOR_ORIENTATION, "0");
+    params->set(CameraProperties::VSTAB, android::CameraParameters::FALSE);
+    params->set(CameraProperties::VNF, android::CameraParameters::FALSE);
+
+    //For compatibility
+    params->set(CameraProperties::SUPPORTED_ZOOM_RATIOS,"0");
+    params->set(CameraProperties::SUPPORTED_ZOOM_STAGES, "0");
+    params->set(CameraProperties::ZOOM, "0");
+    params->set(CameraProperties::ZOOM_SUPPORTED, "true");
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+} // namespace Camera
+} // namespace Ti
@@ -42,6 +42,7 @@ const char TICameraParameters::KEY_CAMERA[] = "camera-index";
 const char TICameraParameters::KEY_SHUTTER_ENABLE[] = "shutter-enable";
 const char TICameraParameters::KEY_CAMERA_NAME[] = "camera-name";
 const char TICameraParameters::KEY_BURST[] = "burst-capture";
+const char TICameraParameters::KEY_CAPTURE_PIPELINE[] = "capture-pipeline";
 const char TICameraParameters::KEY_CAP_MODE[] = "mode";
 const char TICameraParameters::KEY_CAP_MODE_VALUES[] = "mode-values";
 const char TICameraParameters::KEY_VNF[] = "vnf";
@@ -69,6 +70,7 @@ const char TICameraParameters::KEY_IPP[] = "ipp";
 const char TICameraParameters::KEY_METERING_MODE[] = "meter-mode";
 const char TICameraParameters::KEY_EXP_BRACKETING_RANGE[] = "exp-bracketing-range";
 const char TICameraParameters::KEY_EXP_GAIN_BRACKETING_RANGE[] = "exp-gain-bracketing-range";
+const char TICameraParameters::KEY_EXP_BRACKETING_MERGE[] = "exp-bracketing-merge";
 const char TICameraParameters::KEY_ZOOM_BRACKETING_RANGE[] = "zoom-bracketing-range";
 const char TICameraParameters::KEY_TEMP_BRACKETING[] = "temporal-bracketing";
 const char TICameraParameters::KEY_TEMP_BRACKETING_RANGE_POS[] = "temporal-bracketing-range-positive";
@@ -136,6 +138,7 @@ const char TICameraParameters::PIXEL_FORMAT_UNUSED[] = "unused";
 const char TICameraParameters::PIXEL_FORMAT_JPS[] = "jps";
 const char TICameraParameters::PIXEL_FORMAT_MPO[] = "mpo";
 const char TICameraParameters::PIXEL_FORMAT_YUV422I_UYVY[] = "yuv422i-uyvy";
+const char TICameraParameters::PIXEL_FORMAT_YUV420SP_NV12[] = "yuv420sp-nv12";
 
 // TI extensions to standard android scene mode settings
 const char TICameraParameters::SCENE_MODE_CLOSEUP[] = "closeup";
@@ -55,8 +55,6 @@ namespace Camera {
 
 //Proto Types
 static void convertYUV422i_yuyvTouyvy(uint8_t *src, uint8_t *dest, size_t size );
-static void convertYUV422ToNV12Tiler(unsigned char *src, unsigned char *dest, int width, int height );
-static void convertYUV422ToNV12(unsigned char *src, unsigned char *dest, int width, int height );
 
 android::Mutex gV4LAdapterLock;
 char device[15];
@@ -86,7 +84,7 @@ static void debugShowFPS()
 /*--------------------V4L wrapper functions -------------------------------*/
 
 bool V4LCameraAdapter::isNeedToUseDecoder() const {
-    return mPixelFormat != V4L2_PIX_FMT_YUYV;
+    return (mPixelFormat != V4L2_PIX_FMT_YUYV) && (mPixelFormat != V4L2_PIX_FMT_UYVY);
 }
 
 status_t V4LCameraAdapter::v4lIoctl (int fd, int req, void* argp) {
@@ -163,6 +161,10 @@ status_t V4LCameraAdapter::v4lInitMmap(int& count, int width, int height) {
         params.height = height;
         params.inputBufferCount = count;
         params.outputBufferCount = count;
+        // frames waiting for the decoder before the oldest ones get dropped
+        char value[PROPERTY_VALUE_MAX];
+        property_get("camera.v4l.decode.inflight", value, "2");
+        params.maxFramesInFlight = atoi(value);
         mDecoder->configure(params);
     }
 
@@ -612,13 +614,13 @@ status_t V4LCameraAdapter::UseBuffersCapture(CameraBuffer *bufArr, int num) {
 
     mCaptureBuffersAvailable.clear();
     for (int i = 0; i < mCaptureBufferCountQueueable; i++ ) {
-        mCaptureBuffersAvailable.add(&mCaptureBuffers[i], 0);
+        addFrameBuffer(mCaptureBuffersAvailable, &mCaptureBuffers[i], CameraFrame::IMAGE_FRAME, 0);
     }
 
     // initial ref count for undeqeueued buffers is 1 since buffer provider
     // is still holding on to it
     for (int i = mCaptureBufferCountQueueable; i < num; i++ ) {
-        mCaptureBuffersAvailable.add(&mCaptureBuffers[i], 1);
+        addFrameBuffer(mCaptureBuffersAvailable, &mCaptureBuffers[i], CameraFrame::IMAGE_FRAME, 1);
     }
 
     // Update the preview buffer count
@@ -977,7 +979,7 @@ void saveFile(unsigned char* buff, int buff_size) {
     LOG_FUNCTION_NAME_EXIT;
 }
 
-char * V4LCameraAdapter::GetFrame(int &index, int &filledLen)
+char * V4LCameraAdapter::GetFrame(int &index, int &filledLen, bool stopOnDecoded)
 {
     int ret = NO_ERROR;
     LOG_FUNCTION_NAME;
@@ -999,6 +1001,11 @@ char * V4LCameraAdapter::GetFrame(int &index, int &filledLen)
       if((ret == 0) || (errno != EAGAIN)) {
         break;
       }
+
+      // a decoded frame is waiting, the caller delivers it first
+      if (stopOnDecoded && mDecoder && mDecoder->takeOutputReady()) {
+        return NULL;
+      }
     }
 
     if (ret < 0) {
@@ -1151,6 +1158,13 @@ void V4LCameraAdapter::setupWorkingMode() {
             CAMHAL_LOGI("Using V4L preview format: V4L2_PIX_FMT_H264");
             break;
         }
+
+        case 4 : {
+            mCameraHal->setExternalLocking(false);
+            mPixelFormat = V4L2_PIX_FMT_UYVY;
+            CAMHAL_LOGI("Using V4L preview format: V4L2_PIX_FMT_UYVY");
+            break;
+        }
         default:
         case 3 : {
             mCameraHal->setExternalLocking(false);
@@ -1225,157 +1239,6 @@ static void convertYUV422i_yuyvTouyvy(uint8_t *src, uint8_t *dest, size_t size )
     LOG_FUNCTION_NAME_EXIT;
 }
 
-static void convertYUV422ToNV12Tiler(unsigned char *src, unsigned char *dest, int width, int height ) {
-    //convert YUV422I to YUV420 NV12 format and copies directly to preview buffers (Tiler memory).
-    int stride = 4096;
-    unsigned char *bf = src;
-    unsigned char *dst_y = dest;
-    unsigned char *dst_uv = dest + ( height * stride);
-#ifdef PPM_PER_FRAME_CONVERSION
-    static int frameCount = 0;
-    static nsecs_t ppm_diff = 0;
-    nsecs_t ppm_start  = systemTime();
-#endif
-
-    LOG_FUNCTION_NAME;
-
-    if (width % 16 ) {
-        for(int i = 0; i < height; i++) {
-            for(int j = 0; j < width; j++) {
-                *dst_y = *bf;
-                dst_y++;
-                bf = bf + 2;
-            }
-            dst_y += (stride - width);
-        }
-
-        bf = src;
-        bf++;  //UV sample
-        for(int i = 0; i < height/2; i++) {
-            for(int j=0; j<width; j++) {
-                *dst_uv = *bf;
-                dst_uv++;
-                bf = bf + 2;
-            }
-            bf = bf + width*2;
-            dst_uv = dst_uv + (stride - width);
-        }
-    } else {
-        //neon conversion
-        for(int i = 0; i < height; i++) {
-            int n = width;
-            int skip = i & 0x1;       // skip uv elements for the odd rows
-            asm volatile (
-                "   pld [%[src], %[src_stride], lsl #2]                         \n\t"
-                "   cmp %[n], #16                                               \n\t"
-                "   blt 5f                                                      \n\t"
-                "0: @ 16 pixel copy                                             \n\t"
-                "   vld2.8  {q0, q1} , [%[src]]! @ q0 = yyyy.. q1 = uvuv..      \n\t"
-                "                                @ now q0 = y q1 = uv           \n\t"
-                "   vst1.32   {d0,d1}, [%[dst_y]]!                              \n\t"
-                "   cmp    %[skip], #0                                          \n\t"
-                "   bne 1f                                                      \n\t"
-                "   vst1.32  {d2,d3},[%[dst_uv]]!                               \n\t"
-                "1: @ skip odd rows for UV                                      \n\t"
-                "   sub %[n], %[n], #16                                         \n\t"
-                "   cmp %[n], #16                                               \n\t"
-                "   bge 0b                                                      \n\t"
-                "5: @ end                                                       \n\t"
-#ifdef NEEDS_ARM_ERRATA_754319_754320
-                "   vmov s0,s0  @ add noop for errata item                      \n\t"
-#endif
-                : [dst_y] "+r" (dst_y), [dst_uv] "+r" (dst_uv), [src] "+r" (src), [n] "+r" (n)
-                : [src_stride] "r" (width), [skip] "r" (skip)
-                : "cc", "memory", "q0", "q1", "q2", "d0", "d1", "d2", "d3"
-            );
-            dst_y = dst_y + (stride - width);
-            if (skip == 0) {
-                dst_uv = dst_uv + (stride - width);
-            }
-        } //end of for()
-    }
-
-#ifdef PPM_PER_FRAME_CONVERSION
-    ppm_diff += (systemTime() - ppm_start);
-    frameCount++;
-
-    if (frameCount >= 30) {
-        ppm_diff = ppm_diff / frameCount;
-        LOGD("PPM: YUV422i to NV12 Conversion(%d x %d): %llu us ( %llu ms )", width, height,
-                ns2us(ppm_diff), ns2ms(ppm_diff) );
-        ppm_diff = 0;
-        frameCount = 0;
-    }
-#endif
-
-    LOG_FUNCTION_NAME_EXIT;
-}
-
-static void convertYUV422ToNV12(unsigned char *src, unsigned char *dest, int width, int height ) {
-    //convert YUV422I to YUV420 NV12 format.
-    unsigned char *bf = src;
-    unsigned char *dst_y = dest;
-    unsigned char *dst_uv = dest + (width * height);
-
-    LOG_FUNCTION_NAME;
-
-    if (width % 16 ) {
-        for(int i = 0; i < height; i++) {
-            for(int j = 0; j < width; j++) {
-                *dst_y = *bf;
-                dst_y++;
-                bf = bf + 2;
-            }
-        }
-
-        bf = src;
-        bf++;  //UV sample
-        for(int i = 0; i < height/2; i++) {
-            for(int j=0; j<width; j++) {
-                *dst_uv = *bf;
-                dst_uv++;
-                bf = bf + 2;
-            }
-            bf = bf + width*2;
-        }
-    } else {
-        //neon conversion
-        for(int i = 0; i < height; i++) {
-            int n = width;
-            int skip = i & 0x1;       // skip uv elements for the odd rows
-            asm volatile (
-                "   pld [%[src], %[src_stride], lsl #2]                         \n\t"
-                "   cmp %[n], #16                                               \n\t"
-                "   blt 5f                                                      \n\t"
-                "0: @ 16 pixel copy                                             \n\t"
-                "   vld2.8  {q0, q1} , [%[src]]! @ q0 = yyyy.. q1 = uvuv..      \n\t"
-                "                                @ now q0 = y q1 = uv           \n\t"
-                "   vst1.32   {d0,d1}, [%[dst_y]]!                              \n\t"
-                "   cmp    %[skip], #0                                          \n\t"
-                "   bne 1f                                                      \n\t"
-                "   vst1.32  {d2,d3},[%[dst_uv]]!                               \n\t"
-                "1: @ skip odd rows for UV                                      \n\t"
-                "   sub %[n], %[n], #16                                         \n\t"
-                "   cmp %[n], #16                                               \n\t"
-                "   bge 0b                                                      \n\t"
-                "5: @ end                                                       \n\t"
-#ifdef NEEDS_ARM_ERRATA_754319_754320
-                "   vmov s0,s0  @ add noop for errata item                      \n\t"
-#endif
-                : [dst_y] "+r" (dst_y), [dst_uv] "+r" (dst_uv), [src] "+r" (src), [n] "+r" (n)
-                : [src_stride] "r" (width), [skip] "r" (skip)
-                : "cc", "memory", "q0", "q1", "q2", "d0", "d1", "d2", "d3"
-            );
-        }
-    }
-
-    LOG_FUNCTION_NAME_EXIT;
-}
-
-
-
-
-
 /* Preview Thread */
 // ---------------------------------------------------------------------------
 
@@ -1411,7 +1274,7 @@ void V4LCameraAdapter::returnOutputBuffer(int index)
     if (mRecording)
     {
         frame.mFrameMask |= (unsigned int)CameraFrame::VIDEO_FRAME_SYNC;
-        mFramesWithEncoder++;
+        android_atomic_inc(&mFramesWithEncoder);
     }
 
     int ret = setInitFrameRefCount(frame.mBuffer, frame.mFrameMask);
@@ -1475,7 +1338,7 @@ int V4LCameraAdapter::previewThread()
         CAMHAL_LOGV("########### Decoder ###########");
         int inIndex = -1, outIndex = -1;
 
-        if (GetFrame(index, filledLen) != NULL) {
+        if (GetFrame(index, filledLen, true) != NULL) {
             CAMHAL_LOGD("Dequeued buffer from V4L with ID=%d", index);
             mDecoder->queueInputBuffer(index);
         }
@@ -1502,15 +1365,21 @@ int V4LCameraAdapter::previewThread()
         CAMHAL_LOGD("GOT IN frame with ID=%d",index);
 
         CameraBuffer *buffer = mPreviewBufs[index];
-        if (mPixelFormat == V4L2_PIX_FMT_YUYV) {
-            convertYUV422ToNV12Tiler(reinterpret_cast<unsigned char*>(fp), reinterpret_cast<unsigned char*>(buffer->mapped), width, height);
-        }
+        const FormatConverter::Format format = ( V4L2_PIX_FMT_UYVY == mPixelFormat ) ?
+                FormatConverter::FORMAT_UYVY : FormatConverter::FORMAT_YUYV;
+        // preview buffers have a 4096 bytes stride, convert straight into them
+        uint8_t *dst = reinterpret_cast<uint8_t*>(buffer->mapped);
+        mConverter.convert(format,
+                           dst, dst + height * stride, stride,
+                           reinterpret_cast<const uint8_t*>(fp), width, height);
         CAMHAL_LOGVB("##...index= %d.;camera buffer= 0x%x; mapped= 0x%x.",index, buffer, buffer->mapped);
 
 #ifdef SAVE_RAW_FRAMES
         unsigned char* nv12_buff = (unsigned char*) malloc(width*height*3/2);
         //Convert yuv422i to yuv420sp(NV12) & dump the frame to a file
-        convertYUV422ToNV12 ( (unsigned char*)fp, nv12_buff, width, height);
+        FormatConverter::convertToNV12(format,
+                                       nv12_buff, nv12_buff + width * height, width,
+                                       reinterpret_cast<const uint8_t*>(fp), width * 2, width, height);
         saveFile( nv12_buff, ((width*height)*3/2) );
         free (nv12_buff);
 #endif
@@ -1528,7 +1397,7 @@ int V4LCameraAdapter::previewThread()
         if (mRecording)
         {
             frame.mFrameMask |= (unsigned int)CameraFrame::VIDEO_FRAME_SYNC;
-            mFramesWithEncoder++;
+            android_atomic_inc(&mFramesWithEncoder);
         }
 
         ret = setInitFrameRefCount(frame.mBuffer, frame.mFrameMask);
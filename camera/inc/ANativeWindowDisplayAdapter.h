@@ -41,6 +41,7 @@ public:
         int mWidthStride;
         int mHeightStride;
         int mLength;
+        nsecs_t mTimestamp;
         CameraFrame::FrameType mType;
         } DisplayFrame;
 
@@ -89,6 +90,8 @@ public:
     // If set to true ANativeWindowDisplayAdapter will not lock/unlock graphic buffers
     void setExternalLocking(bool extBuffLocking);
 
+    virtual void dump(int fd) const;
+
     ///Class specific functions
     static void frameCallbackRelay(CameraFrame* caFrame);
     void frameCallback(CameraFrame* caFrame);
@@ -101,11 +104,19 @@ public:
     status_t PostFrame(ANativeWindowDisplayAdapter::DisplayFrame &dispFrame);
     bool handleFrameReturn();
     status_t returnBuffersToWindow();
+    status_t queueBuffer(int index, uint32_t offset);
+    status_t cancelBuffer(int index);
+    nsecs_t schedulePacedFrame(nsecs_t timestamp, nsecs_t arrival);
+    int postPacedFrames();
+    void dropPacedFrames();
+    void dequeueAhead();
 
 public:
 
     static const int DISPLAY_TIMEOUT;
     static const int FAILED_DQS_TO_SUSPEND;
+    static const nsecs_t PACING_MARGIN;
+    static const int MAX_PACING_REFRESHES;
 
     class DisplayThread : public android::Thread
         {
@@ -114,7 +125,9 @@ public:
 
         public:
             DisplayThread(ANativeWindowDisplayAdapter* da)
-            : Thread(false), mDisplayAdapter(da) { }
+            : Thread(false), mDisplayAdapter(da),
+              mDisplayThreadQ(Utils::MessageQueue::DEFAULT_CAPACITY,
+                              Utils::MessageQueue::SINGLE_CONSUMER) { }
 
         ///Returns a reference to the display message Q for display adapter to post messages
             Utils::MessageQueue& msgQ()
@@ -143,6 +156,12 @@ friend class DisplayThread;
 private:
     int postBuffer(void* displayBuf);
 
+    struct PacedFrame {
+        int index;
+        uint32_t offset;
+        nsecs_t target;
+    };
+
 private:
     bool mFirstInit;
     bool mSuspend;
@@ -151,7 +170,7 @@ private:
     preview_stream_ops_t*  mANativeWindow;
     android::sp<DisplayThread> mDisplayThread;
     FrameProvider *mFrameProvider; ///Pointer to the frame provider interface
-    Utils::MessageQueue mDisplayQ;
+    Utils::MessageQueue mDisplayQ; ///Read by the display thread only
     unsigned int mDisplayState;
     ///@todo Have a common class for these members
     mutable android::Mutex mLock;
@@ -180,6 +199,28 @@ private:
     //DOMX will handle lock/unlock of graphic buffers
     bool mUseExternalBufferLocking;
 
+    //Display pacing, enabled with the camera.display.pacing property.
+    //Frames are queued to the window on a cadence of whole refresh
+    //periods derived from their timestamps, so every frame stays on
+    //screen for the same number of refreshes
+    bool mPacing;
+    nsecs_t mRefreshPeriod;
+    //Buffers left queued to the window beyond the ones it has to keep,
+    //so dequeueing doesn't wait for the compositor
+    int mDequeueDepth;
+    int mMinUndequeued;
+    android::Vector<PacedFrame> mPacedFrames;
+    nsecs_t mLastTarget;
+    nsecs_t mLastTimestamp;
+    nsecs_t mLastQueued;
+    nsecs_t mLastQueuedTarget;
+    uint32_t mFramesQueued;
+    //Every frame queued to the window, paced or not, kept across restarts
+    uint32_t mFramesDisplayed;
+    uint32_t mFramesDropped;
+    uint32_t mCadenceBreaks;
+    nsecs_t mMaxIntervalError;
+
 #if PPM_INSTRUMENTATION || PPM_INSTRUMENTATION_ABS
     //Used for calculating standby to first shot
     struct timeval mStandbyToShot;
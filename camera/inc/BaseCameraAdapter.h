@@ -19,6 +19,8 @@
 #ifndef BASE_CAMERA_ADAPTER_H
 #define BASE_CAMERA_ADAPTER_H
 
+#include <cutils/atomic.h>
+
 #include "CameraHal.h"
 
 namespace Ti {
@@ -159,6 +161,9 @@ protected:
 
     virtual status_t cameraPreviewInitialization();
 
+    // Lets go of the tap in buffers kept registered between reprocess requests
+    virtual status_t releaseReprocessBuffers();
+
     // Receive orientation events from CameraHal
     virtual void onOrientationEvent(uint32_t orientation, uint32_t tilt);
 
@@ -180,6 +185,13 @@ protected:
     int getFrameRefCount(CameraBuffer* frameBuf);
     int getFrameRefCountByType(CameraBuffer* frameBuf, CameraFrame::FrameType frameType);
     int setInitFrameRefCount(CameraBuffer* buf, unsigned int mask);
+    //Registers a buffer for frameType with an initial reference count,
+    //the caller holds the lock protecting buffers
+    void addFrameBuffer(android::Vector<CameraBuffer *> &buffers, CameraBuffer* frameBuf,
+                        CameraFrame::FrameType frameType, int refCount);
+    //Drops all references of frameType still held on the registered buffers
+    //and forgets them, the buffers must still be allocated
+    void clearFrameBuffers(android::Vector<CameraBuffer *> &buffers, CameraFrame::FrameType frameType);
     static const char* getLUTvalue_translateHAL(int Value, LUTtypeHAL LUT);
 
 // private member functions
@@ -219,8 +231,6 @@ protected:
 
 #endif
 
-    mutable android::Mutex mReturnFrameLock;
-
     //Lock protecting the Adapter state
     mutable android::Mutex mLock;
     AdapterState mAdapterState;
@@ -239,41 +249,44 @@ protected:
     android::KeyedVector<int, event_callback> mShutterSubscribers;
     android::KeyedVector<int, event_callback> mMetadataSubscribers;
 
+    //Buffer management data. The vectors hold the buffers registered for each
+    //use, the reference counts themselves live in CameraBuffer and are atomic
+
     //Preview buffer management data
     CameraBuffer *mPreviewBuffers;
     int mPreviewBufferCount;
     size_t mPreviewBuffersLength;
-    android::KeyedVector<CameraBuffer *, int> mPreviewBuffersAvailable;
+    android::Vector<CameraBuffer *> mPreviewBuffersAvailable;
     mutable android::Mutex mPreviewBufferLock;
 
     //Snapshot buffer management data
-    android::KeyedVector<CameraBuffer *, int> mSnapshotBuffersAvailable;
+    android::Vector<CameraBuffer *> mSnapshotBuffersAvailable;
     mutable android::Mutex mSnapshotBufferLock;
 
     //Video buffer management data
     CameraBuffer *mVideoBuffers;
-    android::KeyedVector<CameraBuffer *, int> mVideoBuffersAvailable;
+    android::Vector<CameraBuffer *> mVideoBuffersAvailable;
     int mVideoBuffersCount;
     size_t mVideoBuffersLength;
     mutable android::Mutex mVideoBufferLock;
 
     //Image buffer management data
     CameraBuffer *mCaptureBuffers;
-    android::KeyedVector<CameraBuffer *, int> mCaptureBuffersAvailable;
+    android::Vector<CameraBuffer *> mCaptureBuffersAvailable;
     int mCaptureBuffersCount;
     size_t mCaptureBuffersLength;
     mutable android::Mutex mCaptureBufferLock;
 
     //Metadata buffermanagement
     CameraBuffer *mPreviewDataBuffers;
-    android::KeyedVector<CameraBuffer *, int> mPreviewDataBuffersAvailable;
+    android::Vector<CameraBuffer *> mPreviewDataBuffersAvailable;
     int mPreviewDataBuffersCount;
     size_t mPreviewDataBuffersLength;
     mutable android::Mutex mPreviewDataBufferLock;
 
     //Video input buffer management data (used for reproc pipe)
     CameraBuffer *mVideoInBuffers;
-    android::KeyedVector<CameraBuffer *, int> mVideoInBuffersAvailable;
+    android::Vector<CameraBuffer *> mVideoInBuffersAvailable;
     mutable android::Mutex mVideoInBufferLock;
 
     Utils::MessageQueue mFrameQ;
@@ -289,8 +302,8 @@ protected:
     camera_request_memory mSharedAllocator;
 
     uint32_t mFramesWithDucati;
-    uint32_t mFramesWithDisplay;
-    uint32_t mFramesWithEncoder;
+    volatile int32_t mFramesWithDisplay;
+    volatile int32_t mFramesWithEncoder;
 
 #ifdef CAMERAHAL_DEBUG
     android::Mutex mBuffersWithDucatiLock;
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file BracketMerge.h
+*
+* This defines the fusion of exposure bracketed NV12 frames into a single
+* tone mapped NV12 frame
+*
+*/
+
+#ifndef ANDROID_CAMERA_HARDWARE_BRACKET_MERGE_H
+#define ANDROID_CAMERA_HARDWARE_BRACKET_MERGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "Common.h"
+
+namespace Ti {
+namespace Camera {
+
+/**
+ * Exposure fusion of bracketed frames. Every output sample is a weighted
+ * average of the input samples, well exposed ones (close to mid grey)
+ * weighing the most, and the fused luma then goes through a global tone
+ * curve which lifts the shadows. Chroma samples use the weight of the
+ * co-sited luma sample.
+ */
+class BracketMerge
+{
+public:
+    static const size_t MAX_FRAMES = 8;
+
+    ///Tone curve strength in percent, 0 leaves the fused luma untouched
+    static const int DEFAULT_TONE_STRENGTH = 50;
+    static const int MAX_TONE_STRENGTH = 400;
+
+    enum KernelSet {
+        KERNELS_AUTO = 0,   // best implementation for the running CPU
+        KERNELS_SCALAR,     // portable C implementation, the reference
+        KERNELS_NEON,
+        KERNELS_SSE2,
+    };
+
+    /**
+     * Row kernels. All of them work on a single row and do not
+     * require any particular alignment.
+     */
+    struct Kernels {
+        KernelSet type;
+        const char *name;
+
+        // luma row -> weights in the 1..129 range
+        void (*weigh)(uint8_t *weights, const uint8_t *srcY, int width);
+        // even luma row weights -> weights of the NV12 chroma row below it
+        void (*chromaWeights)(uint8_t *dst, const uint8_t *lumaWeights, int width);
+        // sum += weights * src and weightSum += weights
+        void (*accumulate)(uint32_t *sum, uint16_t *weightSum,
+                           const uint8_t *src, const uint8_t *weights, int width);
+        // dst = sum / weightSum, rounded to nearest
+        void (*normalize)(uint8_t *dst, const uint32_t *sum, const uint16_t *weightSum, int width);
+    };
+
+    /** An NV12 frame, both planes share the stride */
+    struct Frame {
+        uint8_t *y;
+        uint8_t *uv;
+        size_t stride;
+    };
+
+    BracketMerge();
+    ~BracketMerge();
+
+    /** Kernel table for the running CPU. Selection happens once, on first use */
+    static const Kernels & kernels();
+
+    /** Kernel table for a given implementation, NULL if it isn't available on this CPU */
+    static const Kernels * kernels(KernelSet type);
+
+    void setToneStrength(int strength);
+
+    /**
+     * Fuses count frames into dst. dst may be one of the sources, every
+     * row pair is read from all the sources before it is written.
+     *
+     * @param width     luma width, even
+     * @param height    luma height, even
+     */
+    status_t merge(const Frame *src,
+                   size_t count,
+                   const Frame &dst,
+                   int width,
+                   int height,
+                   const Kernels & kernels = BracketMerge::kernels());
+
+private:
+    status_t allocRows(int width);
+    void applyToneCurve(uint8_t *row, int width);
+
+    // three rows each, the two luma rows of a pair and their chroma row
+    uint32_t *mSum;
+    uint16_t *mWeightSum;
+    // weights of the luma row being accumulated and of its chroma row
+    uint8_t *mWeights;
+    int mRowCapacity;
+
+    int mToneStrength;
+    uint8_t mToneCurve[256];
+};
+
+} // namespace Camera
+} // namespace Ti
+
+#endif
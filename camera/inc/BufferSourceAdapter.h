@@ -54,9 +54,9 @@ private:
             android::AutoMutex lock(mReturnFrameMutex);
          }
 
-        void signal() {
+        void signal(int count = 1) {
             android::AutoMutex lock(mReturnFrameMutex);
-            mFrameCount++;
+            mFrameCount += count;
             mReturnFrameCondition.signal();
         }
 
@@ -69,14 +69,24 @@ private:
         }
 
         virtual bool threadLoop() {
-            android::AutoMutex lock(mReturnFrameMutex);
-            if ( 0 >= mFrameCount ) {
-                mReturnFrameCondition.wait(mReturnFrameMutex);
+            int count = 0;
+            {
+                android::AutoMutex lock(mReturnFrameMutex);
+                if ( 0 >= mFrameCount ) {
+                    mReturnFrameCondition.wait(mReturnFrameMutex);
+                }
+                if (mDestroying) {
+                    return true;
+                }
+                // every buffer enqueued since the last wake up is dequeued in one go
+                count = mFrameCount;
+                mFrameCount = 0;
             }
-            if (!mDestroying) {
-                mBufferSourceAdapter->handleFrameReturn();
-                mFrameCount--;
+
+            if ( 0 < count ) {
+                mBufferSourceAdapter->handleFrameReturn(count);
             }
+
             return true;
         }
 
@@ -92,6 +102,7 @@ private:
     class QueueFrame : public android::Thread {
     public:
         QueueFrame(BufferSourceAdapter* __this) : mBufferSourceAdapter(__this) {
+            mOldestFrameTime = 0;
             mDestroying = false;
         }
 
@@ -100,6 +111,9 @@ private:
 
         void addFrame(CameraFrame *frame) {
             android::AutoMutex lock(mFramesMutex);
+            if (mFrames.empty()) {
+                mOldestFrameTime = systemTime();
+            }
             mFrames.add(new CameraFrame(*frame));
             mFramesCondition.signal();
         }
@@ -120,26 +134,21 @@ private:
         }
 
         virtual bool threadLoop() {
-            CameraFrame *frame = NULL;
+            android::Vector<CameraFrame *> frames;
+            nsecs_t wait = 0;
             {
                 android::AutoMutex lock(mFramesMutex);
                 while (mFrames.empty() && !mDestroying) mFramesCondition.wait(mFramesMutex);
                 if (!mDestroying) {
-                    frame = mFrames.itemAt(0);
-                    mFrames.removeAt(0);
+                    // everything queued since the last wake up is handled in one go
+                    frames = mFrames;
+                    mFrames.clear();
+                    wait = systemTime() - mOldestFrameTime;
                 }
             }
 
-            if (frame) {
-                mBufferSourceAdapter->handleFrameCallback(frame);
-                frame->mMetaData.clear();
-
-                if (frame->mFrameType != CameraFrame::REPROCESS_INPUT_FRAME) {
-                    // signal return frame thread that it can dequeue a buffer now
-                    mBufferSourceAdapter->mReturnFrame->signal();
-                }
-
-                delete frame;
+            if (!frames.empty()) {
+                mBufferSourceAdapter->handleFrameCallbacks(frames, wait);
             }
 
             return true;
@@ -150,6 +159,7 @@ private:
         android::Vector<CameraFrame *> mFrames;
         android::Condition mFramesCondition;
         android::Mutex mFramesMutex;
+        nsecs_t mOldestFrameTime;
         bool mDestroying;
     };
 
@@ -183,19 +193,24 @@ public:
     virtual int maxQueueableBuffers(unsigned int& queueable);
     virtual int minUndequeueableBuffers(int& unqueueable);
     virtual bool match(const char * str);
+    virtual uint32_t getBufferGeneration() const;
 
     virtual CameraBuffer * getBuffers(bool reset = false);
     virtual unsigned int getSize();
     virtual int getBufferCount();
 
+    virtual void dump(int fd) const;
+
     static void frameCallback(CameraFrame* caFrame);
     void addFrame(CameraFrame* caFrame);
-    void handleFrameCallback(CameraFrame* caFrame);
-    bool handleFrameReturn();
+    void handleFrameCallbacks(android::Vector<CameraFrame *> &frames, nsecs_t wait);
+    int handleFrameReturn(int count);
 
 private:
     void destroy();
     status_t returnBuffersToWindow();
+    bool handleFrameCallback(CameraFrame* caFrame, bool &queued);
+    void updateBufferIndices();
 
 private:
     preview_stream_ops_t*  mBufferSource;
@@ -206,6 +221,10 @@ private:
     CameraBuffer *mBuffers;
 
     android::KeyedVector<buffer_handle_t *, int> mFramesWithCameraAdapterMap;
+    // handle -> index in mBuffers, built when the buffer list changes
+    android::KeyedVector<buffer_handle_t *, int> mBufferIndices;
+    // bumped whenever the tap in buffer table starts over
+    uint32_t mBufferGeneration;
     android::sp<ErrorNotifier> mErrorNotifier;
     android::sp<ReturnFrame> mReturnFrame;
     android::sp<QueueFrame> mQueueFrame;
@@ -218,6 +237,17 @@ private:
     int mBufferSourceDirection;
 
     const char *mPixelFormat;
+
+    //Batching counters, guarded by mLock
+    unsigned int mQueueBatches;
+    unsigned int mFramesQueued;
+    unsigned int mMaxQueueDepth;
+    nsecs_t mQueueWaitTotal;
+    nsecs_t mQueueWaitMax;
+    unsigned int mReturnBatches;
+    unsigned int mFramesReturned;
+    nsecs_t mDequeueWaitTotal;
+    nsecs_t mDequeueWaitMax;
 };
 
 } // namespace Camera
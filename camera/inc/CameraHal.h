@@ -59,6 +59,9 @@
 #include "Semaphore.h"
 #include "CameraProperties.h"
 #include "SensorListener.h"
+#include "FormatConverter.h"
+#include "CapabilityIndex.h"
+#include "FrameTrace.h"
 
 //temporarily define format here
 #define HAL_PIXEL_FORMAT_TI_NV12 0x100
@@ -121,6 +124,7 @@ extern const char * const kRawImagesOutputDirPath;
 extern const char * const kYuvImagesOutputDirPath;
 #endif
 #define V4L_CAMERA_NAME_USB     "USBCAMERA"
+#define SYNTHETIC_CAMERA_NAME   "SYNTHETIC"
 #define OMX_CAMERA_NAME_OV      "OV5640"
 #define OMX_CAMERA_NAME_SONY    "IMX060"
 #ifdef MOTOROLA_CAMERA
@@ -197,10 +201,16 @@ inline int FpsRange::min() const { return mMin; }
 
 inline int FpsRange::max() const { return mMax; }
 
-class CameraArea : public android::RefBase
+class CameraArea
 {
 public:
 
+    CameraArea() : mTop(0),
+                   mLeft(0),
+                   mBottom(0),
+                   mRight(0),
+                   mWeight(0) {}
+
     CameraArea(ssize_t top,
                ssize_t left,
                ssize_t bottom,
@@ -216,29 +226,31 @@ public:
                        size_t &top,
                        size_t &left,
                        size_t &areaWidth,
-                       size_t &areaHeight);
+                       size_t &areaHeight) const;
 
-    bool isValid()
+    bool isValid() const
         {
         return ( ( 0 != mTop ) || ( 0 != mLeft ) || ( 0 != mBottom ) || ( 0 != mRight) );
         }
 
-    bool isZeroArea()
+    bool isZeroArea() const
     {
         return  ( (0 == mTop ) && ( 0 == mLeft ) && ( 0 == mBottom )
                  && ( 0 == mRight ) && ( 0 == mWeight ));
     }
 
-    size_t getWeight()
+    size_t getWeight() const
         {
         return mWeight;
         }
 
-    bool compare(const android::sp<CameraArea> &area);
+    bool compare(const CameraArea &area) const;
 
+    // Parses up to maxAreas areas in place, without allocating
     static status_t parseAreas(const char *area,
-                               size_t areaLength,
-                               android::Vector< android::sp<CameraArea> > &areas);
+                               CameraArea *areas,
+                               size_t maxAreas,
+                               size_t &count);
 
     static status_t checkArea(ssize_t top,
                               ssize_t left,
@@ -246,8 +258,6 @@ public:
                               ssize_t right,
                               ssize_t weight);
 
-    static bool areAreasDifferent(android::Vector< android::sp<CameraArea> > &, android::Vector< android::sp<CameraArea> > &);
-
 protected:
     static const ssize_t TOP = -1000;
     static const ssize_t LEFT = -1000;
@@ -263,6 +273,50 @@ protected:
     size_t mWeight;
 };
 
+/**
+  * Fixed capacity set of camera areas. It remembers a hash of the string it was
+  * last parsed from, so parsing the same string again returns right away.
+  */
+class CameraAreas
+{
+public:
+
+    // Same as the number of areas the OMX algorithms accept
+    static const size_t MAX_AREAS = 35;
+
+    CameraAreas() : mCount(0), mHash(0), mLength(0), mHashValid(false) {}
+
+    // changed is set when the parsed areas differ from the current ones. The
+    // current areas are kept if the string is malformed.
+    status_t parse(const char *area, bool &changed);
+
+    void clear();
+
+    size_t size() const
+        {
+        return mCount;
+        }
+
+    bool isEmpty() const
+        {
+        return ( 0 == mCount );
+        }
+
+    const CameraArea & itemAt(size_t index) const
+        {
+        return mAreas[index];
+        }
+
+private:
+    static uint64_t hash(const char *area, size_t &length);
+
+    CameraArea mAreas[MAX_AREAS];
+    size_t mCount;
+    uint64_t mHash;
+    size_t mLength;
+    bool mHashValid;
+};
+
 class CameraMetadataResult : public android::RefBase
 {
 public:
@@ -292,18 +346,39 @@ public:
    }
 
     virtual ~CameraMetadataResult() {
-        if ( NULL != mMetadata.faces ) {
+        if ( ( NULL != mMetadata.faces ) && ( mFaceBuffer != mMetadata.faces ) ) {
+            free(mMetadata.faces);
+        }
+#ifdef OMAP_ENHANCEMENT_CPCAM
+        if ( NULL != mExtendedMetadata ) {
+            mExtendedMetadata->release(mExtendedMetadata);
+        }
+#endif
+    }
+
+    // Brings a recycled result back to the state of a new one
+    void reset() {
+        if ( ( NULL != mMetadata.faces ) && ( mFaceBuffer != mMetadata.faces ) ) {
             free(mMetadata.faces);
         }
+        mMetadata.faces = NULL;
+        mMetadata.number_of_faces = 0;
 #ifdef OMAP_ENHANCEMENT_CPCAM
+        mMetadata.analog_gain = 0;
+        mMetadata.exposure_time = 0;
+
         if ( NULL != mExtendedMetadata ) {
             mExtendedMetadata->release(mExtendedMetadata);
+            mExtendedMetadata = NULL;
         }
 #endif
     }
 
     camera_frame_metadata_t *getMetadataResult() { return &mMetadata; };
 
+    // Storage for up to MAX_FACES faces owned by the result
+    camera_face_t *getFaceBuffer() { return mFaceBuffer; };
+
 #ifdef OMAP_ENHANCEMENT_CPCAM
     camera_memory_t *getExtendedMetadata() { return mExtendedMetadata; };
 #endif
@@ -313,15 +388,35 @@ public:
     static const ssize_t BOTTOM = 1000;
     static const ssize_t RIGHT = 1000;
     static const ssize_t INVALID_DATA = -2000;
+    static const size_t MAX_FACES = 35;
 
 private:
 
     camera_frame_metadata_t mMetadata;
+    camera_face_t mFaceBuffer[MAX_FACES];
 #ifdef OMAP_ENHANCEMENT_CPCAM
     camera_memory_t *mExtendedMetadata;
 #endif
 };
 
+/**
+  * Fixed set of metadata results, recycled once all their users
+  * released them. Meant to be used from a single thread.
+  */
+class CameraMetadataResultPool
+{
+public:
+
+    static const size_t POOL_SIZE = 8;
+
+    // Returns a reset result, a new one is allocated only when all
+    // pooled results are still in use
+    android::sp<CameraMetadataResult> acquire();
+
+private:
+    android::sp<CameraMetadataResult> mResults[POOL_SIZE];
+};
+
 typedef enum {
     CAMERA_BUFFER_NONE = 0,
     CAMERA_BUFFER_GRALLOC,
@@ -330,6 +425,9 @@ typedef enum {
     CAMERA_BUFFER_ION
 } CameraBufferType;
 
+// one reference count per CameraFrame::FrameType bit
+#define CAMERA_BUFFER_FRAME_TYPES 16
+
 typedef struct _CameraBuffer {
     CameraBufferType type;
     /* opaque is the generic drop-in replacement for the pointers
@@ -375,6 +473,14 @@ typedef struct _CameraBuffer {
     int offset; // where valid data starts
     int actual_size; // size of the entire buffer with borders
     int privateData;
+
+    /* Outstanding references held by frame subscribers, indexed by the
+     * bit position of the frame type. refCountTotal is the sum of all of
+     * them, the buffer can be refilled once it drops to zero. Both are
+     * only accessed with android_atomic_* and start out zeroed like the
+     * rest of the structure */
+    volatile int32_t refCount[CAMERA_BUFFER_FRAME_TYPES];
+    volatile int32_t refCountTotal;
 } CameraBuffer;
 
 void * camera_buffer_get_omx_ptr (CameraBuffer *buffer);
@@ -405,6 +511,7 @@ class CameraFrame
         HAS_EXIF_DATA = 0x1 << 1,
         FORMAT_YUV422I_YUYV = 0x1 << 2,
         FORMAT_YUV422I_UYVY = 0x1 << 3,
+        FORMAT_YUV420SP_NV12 = 0x1 << 4,
     };
 
     //default contrustor
@@ -651,6 +758,9 @@ public:
     virtual ~BufferProvider() {}
 };
 
+class EncoderPool;
+class ExifTemplate;
+
 /**
   * Class for handling data and notify callbacks to application
   */
@@ -662,6 +772,10 @@ public:
     ///Constants
     static const int NOTIFIER_TIMEOUT;
     static const int32_t MAX_BUFFERS = 8;
+    static const int32_t ENCODER_THREADS = 2;
+    static const int32_t MAX_ENCODERS = 4;
+    ///Video frame being resized plus the one queued behind it
+    static const int32_t VIDEO_SCALER_DEPTH = 2;
 
     enum NotifierCommands
         {
@@ -707,6 +821,7 @@ public:
 
     //thread loops
     bool notificationThread();
+    bool videoScalerThread();
 
     ///Notification callback functions
     static void frameCallbackRelay(CameraFrame* caFrame);
@@ -743,6 +858,9 @@ public:
     void flushEventQueue();
     void setExternalLocking(bool extBuffLocking);
 
+    //Writes preview callback statistics to fd
+    void dump(int fd) const;
+
     //Internal class definitions
     class NotificationThread : public android::Thread {
         AppCallbackNotifier* mAppCallbackNotifier;
@@ -756,7 +874,9 @@ public:
         };
     public:
         NotificationThread(AppCallbackNotifier* nh)
-            : Thread(false), mAppCallbackNotifier(nh) { }
+            : Thread(false), mAppCallbackNotifier(nh),
+              mNotificationThreadQ(Utils::MessageQueue::DEFAULT_CAPACITY,
+                                   Utils::MessageQueue::SINGLE_CONSUMER) { }
         virtual bool threadLoop() {
             return mAppCallbackNotifier->notificationThread();
         }
@@ -764,10 +884,34 @@ public:
         Utils::MessageQueue &msgQ() { return mNotificationThreadQ;}
     };
 
+    class VideoScalerThread : public android::Thread {
+        AppCallbackNotifier* mAppCallbackNotifier;
+    public:
+        VideoScalerThread(AppCallbackNotifier* nh)
+            : Thread(false), mAppCallbackNotifier(nh) { }
+        virtual bool threadLoop() {
+            return mAppCallbackNotifier->videoScalerThread();
+        }
+    };
+
     //Friend declarations
     friend class NotificationThread;
+    friend class VideoScalerThread;
 
 private:
+    struct VideoScaleJob {
+        CameraFrame frame;
+        CameraBuffer *videoBuffer;
+        int slot;
+    };
+
+    struct VideoSlot {
+        CameraBuffer *buffer;
+        CameraBuffer *videoBuffer;
+        //handle at initSharedVideoBuffers() time, debug builds check it
+        void *opaque;
+    };
+
     void notifyEvent();
     void notifyFrame();
     bool processMessage();
@@ -779,6 +923,14 @@ private:
     const char* getContstantForPixelFormat(const char *pixelFormat);
     void lockBufferAndUpdatePtrs(CameraFrame* frame);
     void unlockBufferAndUpdatePtrs(CameraFrame* frame);
+    void startVideoScaler();
+    void stopVideoScaler();
+    void queueVideoScale(const VideoScaleJob &job);
+    void scaleAndSendVideoFrame(VideoScaleJob &job, int threads);
+    int getVideoSlot(const CameraBuffer *buffer) const;
+    int getVideoMetadataSlot(const void *metadata) const;
+    void sendVideoMetadata(CameraFrame *frame, int slot);
+    camera_memory_t *getVideoHandleMemory(CameraBuffer *buffer);
 
 private:
     mutable android::Mutex mLock;
@@ -790,23 +942,29 @@ private:
     camera_request_memory mRequestMemory;
     void *mCallbackCookie;
 
-    //Keeps Video MemoryHeaps and Buffers within
-    //these objects
-    android::KeyedVector<unsigned int, unsigned int> mVideoHeaps;
-    android::KeyedVector<unsigned int, unsigned int> mVideoBuffers;
-    android::KeyedVector<void *, CameraBuffer *> mVideoMap;
+    //Recording buffers in metadata mode, one slot per buffer given to
+    //initSharedVideoBuffers(). The slot of a frame is the offset of its
+    //buffer in that array and slot i owns the i-th video_metadata_t of
+    //mVideoMetadataMemory, so both per frame lookups are plain indexing.
+    VideoSlot *mVideoSlots;
+    size_t mVideoSlotCount;
+    camera_memory_t *mVideoMetadataMemory;
+#ifdef CAMERAHAL_DEBUG
+    //Recording frames held by the application per slot, catches stale releases
+    volatile int32_t *mVideoSlotsWithApp;
+#endif
 
-    //Keeps list of Gralloc handles and associated Video Metadata Buffers
-    android::KeyedVector<void *, camera_memory_t *> mVideoMetadataBufferMemoryMap;
-    android::KeyedVector<void *, CameraBuffer *> mVideoMetadataBufferReverseMap;
+    //Buffer handle holders passed with video frames when metadata mode is off
+    android::KeyedVector<void *, camera_memory_t *> mVideoHandleMemoryMap;
 
     bool mBufferReleased;
 
     android::sp< NotificationThread> mNotificationThread;
     EventProvider *mEventProvider;
     FrameProvider *mFrameProvider;
-    Utils::MessageQueue mEventQ;
-    Utils::MessageQueue mFrameQ;
+    //Only the notification thread gets from these, flushes hold mLock
+    Utils::SingleConsumerMessageQueue mEventQ;
+    Utils::SingleConsumerMessageQueue mFrameQ;
     NotifierState mNotifierState;
 
     bool mPreviewing;
@@ -817,11 +975,15 @@ private:
     int mPreviewHeight;
     int mPreviewStride;
     const char *mPreviewPixelFormat;
+    FormatConverter::Format mPreviewFormat;
     android::KeyedVector<unsigned int, android::sp<android::MemoryHeapBase> > mSharedPreviewHeaps;
     android::KeyedVector<unsigned int, android::sp<android::MemoryBase> > mSharedPreviewBuffers;
 
     //Burst mode active
     bool mBurst;
+    EncoderPool *mEncoderPool;
+    // APP1 layout reused by the captures of the session, guarded by mLock
+    ExifTemplate *mExifTemplate;
     mutable android::Mutex mRecordingLock;
     bool mRecording;
     bool mMeasurementEnabled;
@@ -834,8 +996,38 @@ private:
     int mVideoWidth;
     int mVideoHeight;
 
+    //Video frames are resized on their own thread when the video size
+    //differs from the preview size. Frames arriving while the scaler is
+    //a full frame behind are dropped and the resize gets more threads
+    android::sp<VideoScalerThread> mVideoScalerThread;
+    mutable android::Mutex mVideoScalerLock;
+    android::Condition mVideoScalerCondition;
+    VideoScaleJob mVideoScaleJobs[VIDEO_SCALER_DEPTH];
+    int mVideoScaleJobHead;
+    int mVideoScaleJobCount;
+    bool mVideoScalerExiting;
+    int mVideoScalerThreads;
+    nsecs_t mVideoScaleTime;
+    nsecs_t mVideoScaleTimeMax;
+    uint32_t mVideoFramesScaled;
+    uint32_t mVideoFramesDropped;
+
     bool mExternalLocking;
 
+    //With camera.preview.cb.adaptive set, preview frames closer than the
+    //measured callback latency to the last frame sent are dropped without
+    //being copied. The latency is the time mDataCb takes, the framework
+    //copies the frame out there; the application consumes it asynchronously
+    bool mPreviewCallbackAdaptive;
+    nsecs_t mLastPreviewCallbackTimestamp;
+    nsecs_t mPreviewCallbackLatency;
+    nsecs_t mPreviewCallbackLatencyMax;
+    uint32_t mPreviewCallbacksSent;
+    uint32_t mPreviewCallbacksDropped;
+
+    //Streaming frames returned unprocessed because mFrameQ was full
+    volatile int32_t mFramesQueueDropped;
+
 };
 
 
@@ -857,9 +1049,45 @@ public:
     virtual int getFd() ;
     virtual int freeBufferList(CameraBuffer * buflist);
 
+    ///Upper bound in bytes for memory kept mapped in the pool while unused
+    void setPoolLimit(size_t bytes);
+    ///Writes pool statistics to fd
+    void dump(int fd) const;
+
+    ///Default pool limit, can be overriden with the ro.camera.mempool.size property (MB).
+    ///The pool is off by default, idle buffers would be pinned out of the OMAP4 carveout
+    static const size_t DEFAULT_POOL_LIMIT = 0;
+
 private:
+    ///ION buffer which stays allocated and mapped between uses
+    struct PoolEntry {
+        struct ion_handle *handle;
+        unsigned char *data;
+        int mmapFd;
+        size_t size;
+    };
+
+    static size_t sizeClass(size_t size);
+    status_t acquireEntry(size_t requested, PoolEntry &entry);
+    void releaseEntry(struct ion_handle *handle);
+    status_t allocateEntry(size_t size, PoolEntry &entry);
+    void freeEntry(const PoolEntry &entry);
+    void trimPool(size_t limit);
+
     android::sp<ErrorNotifier> mErrorNotifier;
     int mIonFd;
+
+    mutable android::Mutex mPoolLock;
+    ///Unused buffers, least recently released first
+    android::Vector<PoolEntry> mIdle;
+    android::KeyedVector<struct ion_handle *, PoolEntry> mInUse;
+    size_t mPoolLimit;
+    size_t mIdleBytes;
+    size_t mInUseBytes;
+    size_t mPeakBytes;
+    uint32_t mHits;
+    uint32_t mMisses;
+    uint32_t mTrimmed;
 };
 
 
@@ -934,6 +1162,9 @@ public:
         CAMERA_DESTROY_TUNNEL                       = 29,
 #endif
         CAMERA_PREVIEW_INITIALIZATION               = 30,
+#ifdef OMAP_ENHANCEMENT_CPCAM
+        CAMERA_RELEASE_BUFFERS_REPROCESS            = 31,
+#endif
         };
 
     enum CameraMode
@@ -1070,6 +1301,13 @@ public:
     // Given a vector of DisplayAdapters find the one corresponding to str
     virtual bool match(const char * str) { return false; }
 
+    // Changes whenever buffers handed out by getBufferList() may have been
+    // replaced, so a buffer pointer seen before can't be trusted anymore
+    virtual uint32_t getBufferGeneration() const { return 0; }
+
+    // Writes display statistics to fd
+    virtual void dump(int fd) const { }
+
 private:
 #ifdef OMAP_ENHANCEMENT_CPCAM
     preview_stream_extended_ops_t * mExtendedOps;
@@ -1104,6 +1342,7 @@ public:
     static const int NO_BUFFERS_PREVIEW;
     static const int NO_BUFFERS_IMAGE_CAPTURE;
     static const int NO_BUFFERS_IMAGE_CAPTURE_SYSTEM_HEAP;
+    static const int NO_BUFFERS_IMAGE_CAPTURE_PIPELINE;
     static const uint32_t VFR_SCALE = 1000;
 
 
@@ -1240,6 +1479,7 @@ public:
     /** Set the camera parameters. */
     int    setParameters(const char* params);
     int    setParameters(const android::CameraParameters& params);
+    int    setParameters(const android::CameraParameters& params, const android::String8 *source);
 
     /** Return the camera parameters. */
     char*  getParameters();
@@ -1312,6 +1552,9 @@ public:
     /** Free image bufs */
     status_t freeImageBufs();
 
+    /** Free image buffer lists released while still held downstream */
+    void freeHeldImageBufs(bool force);
+
     //Signals the end of image capture
     status_t signalEndImageCapture();
 
@@ -1363,6 +1606,12 @@ private:
     status_t allocImageBufs(unsigned int width, unsigned int height, size_t length,
                             const char* previewFormat, unsigned int bufferCount);
 
+    /** Capture pipeline mode, see TICameraParameters::KEY_CAPTURE_PIPELINE */
+    bool capturePipelineEnabled() const;
+
+    /** Queries the capture buffer size and allocates the capture buffers ahead of takePicture */
+    status_t prepareImageCapture();
+
     /** Allocate Raw buffers */
     status_t allocRawBufs(int width, int height, const char* previewFormat, int bufferCount);
 
@@ -1376,17 +1625,25 @@ private:
     status_t freeRawBufs();
 
     //Check if a given resolution is supported by the current camera
-    //instance
-    bool isResolutionValid(unsigned int width, unsigned int height, const char *supportedResolutions);
+    //instance, capability is the CameraProperties key of the supported list
+    bool isResolutionValid(unsigned int width, unsigned int height, const char *capability);
 
     //Check if a given variable frame rate range is supported by the current camera
     //instance
-    bool isFpsRangeValid(int fpsMin, int fpsMax, const char *supportedFpsRanges);
+    bool isFpsRangeValid(int fpsMin, int fpsMax, const char *capability);
 
     //Check if a given parameter is supported by the current camera
     // instance
-    bool isParameterValid(const char *param, const char *supportedParams);
-    bool isParameterValid(int param, const char *supportedParams);
+    bool isParameterValid(const char *param, const char *capability);
+    bool isParameterValid(int param, const char *capability);
+
+    //Check if a parameter differs from the value accepted last time, unchanged
+    //values were validated already
+    bool isParameterChanged(const char *key) const;
+
+    //Forwards parameters to the camera adapter, skipping the call when they
+    //match the ones forwarded last time and skipUnchanged is set
+    status_t setAdapterParameters(const android::CameraParameters &params, bool skipUnchanged = false);
     status_t doesSetParameterNeedUpdate(const char *new_param, const char *old_params, bool &update);
 
     /** Initialize default parameters */
@@ -1412,6 +1669,9 @@ private:
     status_t releaseTapoutLocked(struct preview_stream_ops *out);
     status_t setTapinLocked(struct preview_stream_ops *in);
     status_t releaseTapinLocked(struct preview_stream_ops *in);
+#ifdef OMAP_ENHANCEMENT_CPCAM
+    void releaseReprocessSourceLocked();
+#endif
 
     static SocFamily getSocFamily();
 
@@ -1453,6 +1713,11 @@ public:
 
 #ifdef OMAP_ENHANCEMENT_CPCAM
     preview_stream_extended_ops_t * mExtendedPreviewStreamOps;
+
+    // Tap in whose buffers the adapter keeps registered between reprocess
+    // requests, and the buffer generation they were registered with
+    android::sp<DisplayAdapter> mReprocessSource;
+    uint32_t mReprocessGeneration;
 #endif
 
     android::sp<android::IMemoryHeap> mPictureHeap;
@@ -1518,6 +1783,8 @@ private:
     int mImageFd;
     int mImageLength;
     unsigned int mImageCount;
+    // released image buffer lists still read downstream, with their counts
+    android::KeyedVector<CameraBuffer *, unsigned int> mHeldImageBuffers;
     CameraBuffer *mPreviewBuffers;
     uint32_t *mPreviewOffsets;
     int mPreviewLength;
@@ -1536,6 +1803,11 @@ private:
 
 
     CameraProperties::Properties* mCameraProperties;
+    CapabilityIndex mCapabilityIndex;
+    ParametersDiff mParametersDiff;
+    //Capability mode the current parameters were validated in, MODE_MAX
+    //when the last setParameters() failed
+    OperatingMode mValidatedMode;
 
     bool mPreviewStartInProgress;
     bool mPreviewInitializationDone;
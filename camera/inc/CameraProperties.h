@@ -42,6 +42,13 @@ namespace Camera {
 #define MAX_PROP_NAME_LENGTH 50
 #define MAX_PROP_VALUE_LENGTH 2048
 
+// DCC tuning files live in one subdirectory of this per DCC URI
+#ifndef MOTOROLA_CAMERA
+#define DCC_FILES_PATH "/data/misc/camera/"
+#else
+#define DCC_FILES_PATH "/system/etc/omapcam/"
+#endif
+
 #define REMAINING_BYTES(buff) ((((int)sizeof(buff) - 1 - (int)strlen(buff)) < 0) ? 0 : (sizeof(buff) - 1 - strlen(buff)))
 
 enum OperatingMode {
@@ -217,6 +224,9 @@ public:
             const char* valueAt(const unsigned int) const;
 
         private:
+            // capability cache reads and writes the properties of all modes
+            friend class CameraProperties;
+
             OperatingMode mCurrentMode;
             android::DefaultKeyedVector<android::String8, android::String8> mProperties[MODE_MAX];
 
@@ -229,12 +239,18 @@ public:
     int getProperties(int cameraIndex, Properties** properties);
 
 private:
+    class CacheWriter;
+
+    status_t loadCache();
+    status_t parseCache(const uint8_t *data, size_t size);
+    void saveCache();
 
     int mCamerasSupported;
     int mInitialized;
     mutable android::Mutex mLock;
 
     Properties mCameraProps[MAX_CAMERAS_SUPPORTED];
+    android::sp<android::Thread> mCacheWriter;
 
 };
 
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file CapabilityIndex.h
+*
+* This defines the lookup structures camerahal uses to validate parameters
+* against the camera capabilities, and the parameter diff used to skip
+* the parameters that didn't change
+*
+*/
+
+#ifndef ANDROID_CAMERA_HARDWARE_CAPABILITY_INDEX_H
+#define ANDROID_CAMERA_HARDWARE_CAPABILITY_INDEX_H
+
+#include <stdint.h>
+
+#include <utils/Vector.h>
+#include <utils/String8.h>
+#include <camera/CameraParameters.h>
+
+#include "CameraProperties.h"
+
+namespace Ti {
+namespace Camera {
+
+/**
+ * Supported value lists of the camera capabilities, parsed once for all
+ * operating modes: string lists become hashed sets, resolution lists
+ * sorted tables and frame rate range lists interval lists. Lookups use
+ * the current mode of the properties the index was built from.
+ */
+class CapabilityIndex
+{
+public:
+    CapabilityIndex();
+
+    void build(CameraProperties::Properties *properties);
+
+    // capability is one of the CameraProperties supported value keys,
+    // unknown keys are never supported
+    bool isValueSupported(const char *capability, const char *value) const;
+    bool isValueSupported(const char *capability, int value) const;
+    bool isResolutionSupported(const char *capability, unsigned int width, unsigned int height) const;
+    bool isFpsRangeSupported(const char *capability, int fpsMin, int fpsMax) const;
+
+private:
+    enum EntryType {
+        ENTRY_VALUES,
+        ENTRY_RESOLUTIONS,
+        ENTRY_FPS_RANGES
+    };
+
+    struct FpsRange {
+        int min;
+        int max;
+    };
+
+    struct Entry {
+        // values sorted by hash
+        android::Vector<uint32_t> hashes;
+        android::Vector<android::String8> values;
+        // width << 16 | height, sorted
+        android::Vector<uint32_t> resolutions;
+        android::Vector<FpsRange> ranges;
+    };
+
+    struct Capability {
+        const char *key;
+        EntryType type;
+    };
+
+    static const Capability kCapabilities[];
+    static const int kCapabilityCount;
+    static const int MAX_CAPABILITIES = 24;
+
+    static uint32_t hash(const char *value, size_t length);
+    static void parseValues(const char *list, Entry &entry);
+    static void parseResolutions(const char *list, Entry &entry);
+    static void parseFpsRanges(const char *list, Entry &entry);
+
+    const Entry *find(const char *capability, EntryType type) const;
+
+    CameraProperties::Properties *mProperties;
+    Entry mEntries[MODE_MAX][MAX_CAPABILITIES];
+};
+
+/**
+ * Keys whose values differ between two sets of parameters, keys present
+ * in only one of them included. Keys are looked up in both sets as they
+ * are asked for, nothing is flattened.
+ *
+ * CameraParameters can't list its keys, so whether any key changed at all
+ * is told from the flat string the new set was parsed from, when there is
+ * one: the set is unchanged when that string is the one last applied.
+ */
+class ParametersDiff
+{
+public:
+    ParametersDiff() : mAllChanged(true) {}
+
+    void compute(const android::CameraParameters &oldParams, const android::CameraParameters &newParams,
+                 const android::String8 *source = NULL);
+    // every key counts as changed until the next compute(), and the set
+    // applied last is forgotten
+    void invalidate();
+    bool changed(const char *key) const;
+    bool anyChanged() const;
+    // the new set was applied
+    void applied();
+
+private:
+    // copies share their storage with the originals until those are modified
+    android::CameraParameters mOld;
+    android::CameraParameters mNew;
+    // strings share their storage as well
+    android::String8 mSource;
+    android::String8 mAppliedSource;
+    bool mAllChanged;
+};
+
+} // namespace Camera
+} // namespace Ti
+
+#endif
@@ -19,14 +19,8 @@
 
 #include "CameraHal.h"
 
-extern "C" {
-#include "jhead.h"
-
-#undef TRUE
-#undef FALSE
-
-}
-
+struct jpeg_decompress_struct;
+struct jpeg_error_mgr;
 
 namespace Ti {
 namespace Camera {
@@ -40,14 +34,32 @@ public:
     static int readDHTSize();
     static bool isDhtExist(unsigned char *jpeg_src,  int filled_len);
     static int appendDHT(unsigned char *jpeg_src, int filled_len, unsigned char *jpeg_with_dht_buffer, int buff_size);
+
+    /**
+     * Starts a new MJPEG stream decoded into out_width x out_height frames.
+     * Frames exactly 2 or 4 times larger are decoded scaled down, and the
+     * faster integer DCT is used from 720p up. The decompressor is kept for
+     * the whole stream, so the default huffman tables are loaded only once
+     * for cameras that leave them out of their frames.
+     */
+    void startStream(unsigned int out_width, unsigned int out_height);
     bool decode(unsigned char *jpeg_src, int filled_len, unsigned char *nv12_buffer, int stride);
 
 private:
+    bool loadDefaultTables();
+    bool allocatePlanes(unsigned int width, unsigned int height);
     void release();
+
+    jpeg_decompress_struct *mInfo;
+    jpeg_error_mgr *mError;
+    bool mTablesChecked;
+    unsigned int mOutWidth, mOutHeight;
+
     unsigned char **Y_Plane;
     unsigned char **U_Plane;
     unsigned char **V_Plane;
     unsigned char *UV_Plane;
+    unsigned char *mPadRow;
     unsigned int mWidth, mHeight;
 };
 
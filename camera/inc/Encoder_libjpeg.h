@@ -26,19 +26,17 @@
 
 #include <utils/threads.h>
 #include <utils/RefBase.h>
-
-extern "C" {
-#include "jhead.h"
-
-#undef TRUE
-#undef FALSE
-
-}
+#include <utils/List.h>
+#include <utils/Vector.h>
 
 #include "CameraHal.h"
+#include "ExifTemplate.h"
 
 #define CANCEL_TIMEOUT 5000000 // 5 seconds
 
+struct jpeg_compress_struct;
+struct jpeg_error_mgr;
+
 namespace Ti {
 namespace Camera {
 
@@ -47,6 +45,7 @@ namespace Camera {
  */
 
 #define MAX_EXIF_TAGS_SUPPORTED 30
+#define EXIF_VALUES_SIZE 2048
 typedef void (*encoder_libjpeg_callback_t) (void* main_jpeg,
                                             void* thumb_jpeg,
                                             CameraFrame::FrameType type,
@@ -56,7 +55,7 @@ typedef void (*encoder_libjpeg_callback_t) (void* main_jpeg,
                                             void* cookie4,
                                             bool canceled);
 
-// these have to match strings defined in external/jhead/exif.c
+// names of the tags ExifTemplate knows, see its tag table
 static const char TAG_MODEL[] = "Model";
 static const char TAG_MAKE[] = "Make";
 static const char TAG_FOCALLENGTH[] = "FocalLength";
@@ -94,31 +93,28 @@ static const char TAG_CUSTOM_RENDERED[] = "CustomRendered";
 class ExifElementsTable {
     public:
         ExifElementsTable() :
-           gps_tag_count(0), exif_tag_count(0), position(0),
-           jpeg_opened(false)
+           position(0), values_size(0)
         {
-#ifdef ANDROID_API_JB_OR_LATER
-            has_datetime_tag = false;
-#endif
         }
-        ~ExifElementsTable();
 
         status_t insertElement(const char* tag, const char* value);
-        void insertExifToJpeg(unsigned char* jpeg, size_t jpeg_size);
-        status_t insertExifThumbnailImage(const char*, int);
-        void saveJpeg(unsigned char* picture, size_t jpeg_size);
         static const char* degreesToExifOrientation(unsigned int);
         static void stringToRational(const char*, unsigned int*, unsigned int*);
         static bool isAsciiTag(const char* tag);
     private:
-        ExifElement_t table[MAX_EXIF_TAGS_SUPPORTED];
-        unsigned int gps_tag_count;
-        unsigned int exif_tag_count;
+        friend class ExifTemplate;
+
+        // values are kept in the table itself, zero terminated
+        struct Element {
+            const ExifTagInfo* info;
+            uint16_t offset;
+            uint16_t length;
+        };
+
+        Element table[MAX_EXIF_TAGS_SUPPORTED];
+        char values[EXIF_VALUES_SIZE];
         unsigned int position;
-        bool jpeg_opened;
-#ifdef ANDROID_API_JB_OR_LATER
-        bool has_datetime_tag;
-#endif
+        size_t values_size;
 };
 
 class Encoder_libjpeg : public android::Thread {
@@ -139,6 +135,35 @@ class Encoder_libjpeg : public android::Thread {
             const char* format;
             size_t jpeg_size;
          };
+        // input format, resolved once per encode
+        enum format_t {
+            FORMAT_UNSUPPORTED,
+            FORMAT_NV21,
+            FORMAT_NV12,
+            FORMAT_YUYV,
+            FORMAT_UYVY,
+        };
+
+        /**
+         * libjpeg compressor and scratch memory, kept alive between
+         * encodes so consecutive images don't pay for their setup again
+         */
+        class Context {
+            public:
+                Context();
+                ~Context();
+
+                jpeg_compress_struct* compressor() { return mCompressor; }
+                // returns a buffer of at least size bytes, valid until the next call
+                uint8_t* scratch(size_t size);
+
+            private:
+                jpeg_compress_struct* mCompressor;
+                jpeg_error_mgr* mError;
+                uint8_t* mScratch;
+                size_t mScratchSize;
+        };
+
     /* public member functions */
     public:
         Encoder_libjpeg(params* main_jpeg,
@@ -150,7 +175,7 @@ class Encoder_libjpeg : public android::Thread {
                         void* cookie3, void *cookie4)
             : android::Thread(false), mMainInput(main_jpeg), mThumbnailInput(tn_jpeg), mCb(cb),
               mCancelEncoding(false), mCookie1(cookie1), mCookie2(cookie2), mCookie3(cookie3), mCookie4(cookie4),
-              mType(type), mThumb(NULL) {
+              mType(type), mThumb(NULL), mPooled(false), mPendingImages(0) {
             this->incStrong(this);
             mCancelSem.Create(0);
         }
@@ -161,6 +186,8 @@ class Encoder_libjpeg : public android::Thread {
 
         virtual bool threadLoop() {
             size_t size = 0;
+            Context context;
+
             if (mThumbnailInput) {
                 // start thread to encode thumbnail
                 mThumb = new Encoder_libjpeg(mThumbnailInput, NULL, NULL, mType, NULL, NULL, NULL, NULL);
@@ -168,7 +195,7 @@ class Encoder_libjpeg : public android::Thread {
             }
 
             // encode our main image
-            size = encode(mMainInput);
+            size = encode(mMainInput, context);
 
             // signal cancel semaphore incase somebody is waiting
             mCancelSem.Signal();
@@ -190,10 +217,19 @@ class Encoder_libjpeg : public android::Thread {
             return false;
         }
 
-        void cancel() {
+        // stops encoding at the next band without waiting for it
+        void requestCancel() {
            mCancelEncoding = true;
            if (mThumb.get()) {
-               mThumb->cancel();
+               mThumb->requestCancel();
+           }
+        }
+
+        void cancel() {
+           requestCancel();
+           if (mThumb.get() || mPooled) {
+               // the thumbnail thread or pool workers may still be writing
+               // into the output buffers
                mCancelSem.WaitTimeout(CANCEL_TIMEOUT);
            }
         }
@@ -204,6 +240,12 @@ class Encoder_libjpeg : public android::Thread {
             if (cookie3) *cookie3 = mCookie3;
         }
 
+        bool hasThumbnail() const { return mThumbnailInput != NULL; }
+
+        // EncoderPool interface, see below
+        void setPooled();
+        bool encodeImage(bool thumbnail, Context& context);
+
     private:
         params* mMainInput;
         params* mThumbnailInput;
@@ -216,8 +258,67 @@ class Encoder_libjpeg : public android::Thread {
         CameraFrame::FrameType mType;
         android::sp<Encoder_libjpeg> mThumb;
         Utils::Semaphore mCancelSem;
+        bool mPooled;
+        volatile int32_t mPendingImages;
+
+        size_t encode(params*, Context&);
+        bool encodeRaw420(jpeg_compress_struct*, params*, format_t, Context&);
+        bool encodeScanlines422(jpeg_compress_struct*, params*, format_t, Context&);
+};
+
+/**
+ * Persistent set of encoder threads. The main image and the thumbnail of
+ * an encoder are separate jobs, so they run in parallel on different
+ * workers. Each worker keeps its own libjpeg context between jobs.
+ *
+ * The number of encoders in flight is bounded: reserve() blocks the
+ * caller until there is room, which is how frame producers get throttled
+ * when encoding can't keep up. Each reservation belongs to the caller that
+ * took it, who uses it up with submit().
+ */
+class EncoderPool {
+    public:
+        EncoderPool(int numWorkers, int maxEncoders);
+        ~EncoderPool();
+
+        status_t initialize();
+
+        // waits up to timeout for room for one more encoder, false on timeout
+        bool reserve(nsecs_t timeout);
+        // queues both images of the encoder on a reservation from reserve(),
+        // the reservation is used up even when this fails
+        status_t submit(const android::sp<Encoder_libjpeg>& encoder);
+
+        int getEncodersInFlight();
+
+    private:
+        class Worker : public android::Thread {
+            public:
+                Worker(EncoderPool* pool) : android::Thread(false), mPool(pool) {}
+                virtual bool threadLoop() { return mPool->workerLoop(mContext); }
+            private:
+                EncoderPool* mPool;
+                Encoder_libjpeg::Context mContext;
+        };
+
+        struct Job {
+            android::sp<Encoder_libjpeg> encoder;
+            bool thumbnail;
+        };
+
+        bool workerLoop(Encoder_libjpeg::Context& context);
+
+        const int mNumWorkers;
+        const int mMaxEncoders;
 
-        size_t encode(params*);
+        android::Mutex mLock;
+        android::Condition mJobAvailable;
+        android::Condition mRoomAvailable;
+        android::List<Job> mJobs;
+        android::Vector< android::sp<Worker> > mWorkers;
+        int mInFlight;
+        int mReserved;
+        bool mExiting;
 };
 
 } // namespace Camera
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file ExifTemplate.h
+*
+* This defines the EXIF APP1 writer camerahal uses to put the EXIF data
+* in front of the jpegs it encodes
+*
+*/
+
+#ifndef ANDROID_CAMERA_HARDWARE_EXIF_TEMPLATE_H
+#define ANDROID_CAMERA_HARDWARE_EXIF_TEMPLATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <utils/Errors.h>
+#include <utils/Vector.h>
+
+namespace Ti {
+namespace Camera {
+
+class ExifElementsTable;
+
+struct ExifTagInfo {
+    const char *name;
+    uint16_t tag;
+    uint8_t ifd;
+    uint8_t type;
+};
+
+/**
+ * Serialized APP1 segment for a set of EXIF tags. The layout, offsets of
+ * all directories and values included, is computed once and reused for
+ * as long as the captures carry the same tags with the same value counts.
+ * Each capture then only patches the values and the thumbnail length.
+ */
+class ExifTemplate
+{
+public:
+    enum Ifd {
+        IFD_0 = 0,
+        IFD_EXIF,
+        IFD_GPS,
+        IFD_1,
+        IFD_MAX
+    };
+
+    enum Type {
+        TYPE_BYTE = 1,
+        TYPE_ASCII = 2,
+        TYPE_SHORT = 3,
+        TYPE_LONG = 4,
+        TYPE_RATIONAL = 5,
+        TYPE_UNDEFINED = 7,
+        TYPE_SRATIONAL = 10
+    };
+
+    ExifTemplate();
+    ~ExifTemplate();
+
+    /** Lays the tags out again if they don't fit the current layout, then patches their values */
+    android::status_t update(const ExifElementsTable &tags);
+
+    /** Bytes write() puts in front of the jpeg data, see jpegDataOffset */
+    size_t size(size_t thumbnailSize) const;
+
+    /** Writes SOI and the APP1 segment with the thumbnail, returns the bytes written */
+    size_t write(uint8_t *dst, const uint8_t *thumbnail, size_t thumbnailSize) const;
+
+    /** Offset of the jpeg data following SOI and JFIF APP0 */
+    static size_t jpegDataOffset(const uint8_t *jpeg, size_t size);
+
+    /** NULL for tags the writer doesn't know */
+    static const ExifTagInfo *findTag(const char *name);
+
+private:
+    struct Field {
+        const ExifTagInfo *info;
+        uint16_t count;
+        // value offset from the TIFF header, in the entry itself for values up to 4 bytes
+        uint32_t offset;
+        // element of the table the value comes from, negative for the fields the writer adds
+        int element;
+    };
+
+    static size_t typeSize(uint8_t type);
+    static int countValues(const ExifTagInfo *info, const char *value, size_t length);
+    static void encodeValues(uint8_t *dst, const ExifTagInfo *info, uint16_t count,
+                             const char *value, size_t length);
+    static size_t collectFields(const ExifElementsTable &tags, Field *fields);
+
+    bool matches(const ExifElementsTable &tags) const;
+    android::status_t layout(const ExifElementsTable &tags);
+    bool thumbnailFits(size_t thumbnailSize) const;
+
+    android::Vector<Field> mFields;
+    uint8_t *mTiff;
+    size_t mTiffSize;
+    // entry offsets patched by write()
+    uint32_t mNextIfdOffset;
+    uint32_t mThumbnailLengthOffset;
+};
+
+} // namespace Camera
+} // namespace Ti
+
+#endif
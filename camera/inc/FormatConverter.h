@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file FormatConverter.h
+*
+* This defines the pixel format conversions used by camerahal when copying
+* NV12 camera buffers into application visible memory
+*
+*/
+
+#ifndef ANDROID_CAMERA_HARDWARE_FORMAT_CONVERTER_H
+#define ANDROID_CAMERA_HARDWARE_FORMAT_CONVERTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <utils/threads.h>
+
+#include "Common.h"
+
+namespace Ti {
+namespace Camera {
+
+class FormatConverter
+{
+public:
+    enum Format {
+        FORMAT_UNKNOWN = 0,
+        FORMAT_NV21,        // CameraParameters::PIXEL_FORMAT_YUV420SP
+        FORMAT_YV12,        // CameraParameters::PIXEL_FORMAT_YUV420P
+        FORMAT_YUYV,        // CameraParameters::PIXEL_FORMAT_YUV422I
+        FORMAT_RGB565,      // CameraParameters::PIXEL_FORMAT_RGB565
+        FORMAT_BAYER_RGGB,  // CameraParameters::PIXEL_FORMAT_BAYER_RGGB
+        FORMAT_UYVY,        // V4L2_PIX_FMT_UYVY, sources only
+    };
+
+    enum KernelSet {
+        KERNELS_AUTO = 0,   // best implementation for the running CPU
+        KERNELS_SCALAR,     // portable C implementation
+        KERNELS_NEON,
+        KERNELS_SSE2,
+    };
+
+    /**
+     * Row kernels. All of them work on a single row and do not
+     * require any particular alignment.
+     */
+    struct Kernels {
+        KernelSet type;
+        const char *name;
+
+        // NV12 UV row -> NV21 VU row
+        void (*swapUV)(uint8_t *dst, const uint8_t *srcUV, int pairs);
+        // NV12 UV row -> separate U and V rows
+        void (*splitUV)(uint8_t *dstU, uint8_t *dstV, const uint8_t *srcUV, int pairs);
+        // NV12 Y row + UV row -> YUYV row
+        void (*packYUYV)(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, int width);
+        // YUYV row -> NV12 Y row + UV row, chroma is skipped when dstUV is NULL
+        void (*unpackYUYV)(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, int width);
+        // UYVY row -> NV12 Y row + UV row, chroma is skipped when dstUV is NULL
+        void (*unpackUYVY)(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, int width);
+    };
+
+    /** Resolves a CameraParameters pixel format string, meant to be called once per configuration */
+    static Format fromPixelFormat(const char *pixelFormat);
+
+    /** Kernel table for the running CPU. Selection happens once, on first use */
+    static const Kernels & kernels();
+
+    /** Kernel table for a given implementation, NULL if it isn't available on this CPU */
+    static const Kernels * kernels(KernelSet type);
+
+    /**
+     * Converts an NV12 frame into a tightly packed buffer of the requested format.
+     * Formats without an NV12 conversion are copied as 2 bytes per pixel rows.
+     *
+     * @param dst       destination, typically the data of a camera_memory_t
+     * @param srcY      start of the luma plane
+     * @param srcUV     start of the chroma plane
+     * @param offset    byte offset of the valid region inside the luma plane
+     * @param length    length of the source buffer, used for bounds checking
+     */
+    static status_t convertFromNV12(Format format,
+                                    uint8_t *dst,
+                                    const uint8_t *srcY,
+                                    const uint8_t *srcUV,
+                                    int width,
+                                    int height,
+                                    size_t stride,
+                                    uint32_t offset,
+                                    size_t length,
+                                    const Kernels & kernels = FormatConverter::kernels());
+
+    /**
+     * Converts a packed YUYV or UYVY frame into NV12. Chroma of the odd rows
+     * is dropped. The destination planes may be strided, which is how frames
+     * are written straight into preview buffers.
+     *
+     * @param srcStride bytes per source row, usually width * 2
+     * @param dstStride bytes per row of both destination planes
+     */
+    static status_t convertToNV12(Format format,
+                                  uint8_t *dstY,
+                                  uint8_t *dstUV,
+                                  size_t dstStride,
+                                  const uint8_t *src,
+                                  size_t srcStride,
+                                  int width,
+                                  int height,
+                                  const Kernels & kernels = FormatConverter::kernels());
+
+    /** Copies height rows of rowBytes from a strided buffer into a packed one */
+    static void copyStrided(uint8_t *dst, const uint8_t *src,
+                            size_t rowBytes, size_t srcStride, int height);
+
+    /** YV12 plane layout as expected by the framework */
+    static void alignYV12(int width,
+                          int height,
+                          size_t &yStride,
+                          size_t &uvStride,
+                          size_t &ySize,
+                          size_t &uvSize,
+                          size_t &size);
+
+private:
+    FormatConverter();
+};
+
+/**
+ * Packed 4:2:2 to NV12 conversion of whole frames. Frames larger than 720p
+ * are split in two bands and the bottom band is converted on a helper
+ * thread, which is started on first use.
+ */
+class NV12Converter
+{
+public:
+    NV12Converter();
+    ~NV12Converter();
+
+    /** Same arguments as FormatConverter::convertToNV12, the source is tightly packed */
+    status_t convert(FormatConverter::Format format,
+                     uint8_t *dstY,
+                     uint8_t *dstUV,
+                     size_t dstStride,
+                     const uint8_t *src,
+                     int width,
+                     int height);
+
+private:
+    struct Band {
+        FormatConverter::Format format;
+        uint8_t *dstY;
+        uint8_t *dstUV;
+        size_t dstStride;
+        const uint8_t *src;
+        int width;
+        int height;
+    };
+
+    class Helper : public android::Thread {
+        public:
+            Helper(NV12Converter *converter) : android::Thread(false), mConverter(converter) {}
+            virtual bool threadLoop() { return mConverter->helperLoop(); }
+        private:
+            NV12Converter *mConverter;
+    };
+
+    bool helperLoop();
+
+    static const int SPLIT_THRESHOLD = 1280 * 720;
+
+    android::Mutex mLock;
+    android::Condition mCondition;
+    android::sp<Helper> mHelper;
+    Band mBand;
+    bool mBandPending;
+    status_t mBandStatus;
+    bool mExiting;
+
+#ifdef PPM_PER_FRAME_CONVERSION
+    int mFrameCount;
+    nsecs_t mConversionTime;
+#endif
+};
+
+} // namespace Camera
+} // namespace Ti
+
+#endif
@@ -19,6 +19,7 @@
 
 #include <utils/Vector.h>
 #include <utils/StrongPointer.h>
+#include <cutils/atomic.h>
 #include "CameraHal.h"
 
 
@@ -108,6 +109,8 @@ struct DecoderParameters {
     int height;
     int inputBufferCount;
     int outputBufferCount;
+    // decoders running asynchronously drop the oldest frames beyond this
+    int maxFramesInFlight;
 };
 
 class FrameDecoder {
@@ -144,6 +147,14 @@ public:
         mCameraHal = hal;
     }
 
+    /**
+     * True once after an asynchronous decoder filled an output buffer,
+     * so a caller waiting for input can stop and dequeue it right away
+     */
+    bool takeOutputReady() {
+        return android_atomic_and(0, &mOutputReady) != 0;
+    }
+
 protected:
     virtual void doConfigure(const DecoderParameters& config) = 0;
     virtual void doProcessInputBuffer() = 0;
@@ -152,6 +163,10 @@ protected:
     virtual void doFlush() = 0;
     virtual void doRelease() = 0;
 
+    void signalOutputReady() {
+        android_atomic_or(1, &mOutputReady);
+    }
+
     DecoderParameters mParams;
 
     android::Vector<int> mInQueue;
@@ -165,6 +180,7 @@ protected:
 private:
     DecoderState mState;
     android::Mutex mLock;
+    volatile int32_t mOutputReady;
 };
 
 }  // namespace Camera
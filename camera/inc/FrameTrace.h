@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file FrameTrace.h
+*
+* This defines the per frame tracing camerahal uses to time the stages a
+* buffer goes through between the sensor and its return to the adapter
+*
+*/
+
+#ifndef ANDROID_CAMERA_HARDWARE_FRAME_TRACE_H
+#define ANDROID_CAMERA_HARDWARE_FRAME_TRACE_H
+
+#include <stdint.h>
+
+#include <utils/Timers.h>
+#include <cutils/atomic.h>
+
+#include "Common.h"
+
+namespace Ti {
+namespace Camera {
+
+/**
+ * Timeline of the camera buffers. Stamps are written to a ring owned by
+ * the calling thread, so recording never takes a lock. Tracing is off
+ * by default and is switched with the camera.trace property when preview
+ * starts; a disabled stamp costs a single load.
+ */
+class FrameTrace
+{
+public:
+    enum Stage {
+        STAGE_SENSOR = 0,           // sensor timestamp of the frame
+        STAGE_FILL_BUFFER_DONE,     // buffer handed back by the camera
+        STAGE_SUBSCRIBERS,          // BaseCameraAdapter::sendFrameToSubscribers
+        STAGE_DISPLAY,              // posted to the preview window
+        STAGE_APP_CALLBACK,         // data callback to the application
+        STAGE_RETURN,               // last reference dropped, back to the adapter
+        STAGE_MAX
+    };
+
+    static inline bool isEnabled() {
+        return 0 != android_atomic_acquire_load(&sEnabled);
+    }
+
+    /** Stamps the buffer with the current time. The buffer identifies the frame */
+    static inline void stamp(Stage stage, const void *buffer, int frameType) {
+        if ( isEnabled() ) {
+            record(stage, buffer, frameType, systemTime());
+        }
+    }
+
+    /** Same as stamp, for events which happened at a known earlier time */
+    static inline void stampAt(Stage stage, const void *buffer, int frameType, nsecs_t time) {
+        if ( isEnabled() ) {
+            record(stage, buffer, frameType, time);
+        }
+    }
+
+    /** Enabling clears what was recorded before */
+    static void setEnabled(bool enable);
+
+    /**
+     * Writes per stage latency histograms to fd and the timeline to
+     * TRACE_FILE in the Chrome trace event format
+     */
+    static void dump(int fd);
+
+    static const char TRACE_FILE[];
+
+private:
+    FrameTrace();
+
+    static void record(Stage stage, const void *buffer, int frameType, nsecs_t time);
+
+    static volatile int32_t sEnabled;
+};
+
+} // namespace Camera
+} // namespace Ti
+
+#endif
@@ -110,6 +110,33 @@ typedef struct IC_crop_struct {
     mmUint32 uHeight;       /* dy of rectangle                                 */
 } IC_rect_type;
 
+/* Inner loop implementation used by the resize engine */
+typedef enum {
+    IC_RESIZE_KERNEL_AUTO,          /* best SIMD kernel for the running CPU    */
+    IC_RESIZE_KERNEL_SCALAR,        /* per pixel C reference, for bit-exactness */
+    IC_RESIZE_KERNEL_MAX
+} enumResizeKernel;
+
+/* Resize engine configuration */
+typedef struct {
+    enumResizeKernel              eKernel;
+    mmInt32                       uNumThreads;   /* <= 1 runs on the caller's thread */
+} structResizeConfig;
+
+/* Upper bound for structResizeConfig::uNumThreads */
+#define IC_RESIZE_MAX_THREADS 4
+
+/*==========================================================================
+* Function Name  : VT_resizeFrame_setConfig / VT_resizeFrame_getConfig
+*
+* Description    : Set or query the configuration used by
+*                  VT_resizeFrame_Video_opt2_lp.
+*
+* Input(s)       : config               -> Resize engine configuration
+============================================================================*/
+void VT_resizeFrame_setConfig(const structResizeConfig* config);
+void VT_resizeFrame_getConfig(structResizeConfig* config);
+
 /*==========================================================================
 * Function Name  : VT_resizeFrame_Video_opt2_lp
 *
@@ -132,4 +159,66 @@ VT_resizeFrame_Video_opt2_lp(
         mmUint16 dummy                         /* Transparent pixel value              */
         );
 
+/*==========================================================================
+* Function Name  : VT_resizeFrame_Video_lp_ex
+*
+* Description    : Resize a yuv frame using an explicit engine configuration.
+*
+* Input(s)       : input_img_ptr        -> Input Image Structure
+*                : output_img_ptr       -> Output Image Structure
+*                : cropout             -> crop structure
+*                : config              -> engine configuration, NULL for default
+*
+* Value Returned : mmBool               -> FALSE on error TRUE on success
+* NOTE:
+*            Output is bit-exact between all kernels.
+============================================================================*/
+mmBool
+VT_resizeFrame_Video_lp_ex(
+        structConvImage* i_img_ptr,        /* Points to the input image           */
+        structConvImage* o_img_ptr,        /* Points to the output image          */
+        IC_rect_type*  cropout,          /* how much to resize to in final image */
+        const structResizeConfig* config /* engine configuration                 */
+        );
+
+/* Opaque state of a resize produced band by band */
+typedef struct structResizeSession structResizeSession;
+
+/*==========================================================================
+* Function Name  : VT_resizeFrame_Video_open / rows / close
+*
+* Description    : Band wise resize. open computes the coefficients for the
+*                  complete output size, rows then produces any band of
+*                  output rows, close releases the session.
+*
+* Input(s)       : input_img_ptr        -> Input Image Structure
+*                : outWidth, outHeight  -> size of the complete output image
+*                : config              -> engine configuration, NULL for default
+*                : dstY, dstUV         -> destination of the band's first luma
+*                                         and chroma rows
+*                : firstRow, numRows   -> band to produce, firstRow even
+*
+* NOTE:
+*            Output is bit-exact with VT_resizeFrame_Video_lp_ex.
+============================================================================*/
+structResizeSession*
+VT_resizeFrame_Video_open(
+        structConvImage* i_img_ptr,        /* Points to the input image           */
+        mmInt32 outWidth,
+        mmInt32 outHeight,
+        const structResizeConfig* config  /* engine configuration                 */
+        );
+
+mmBool
+VT_resizeFrame_Video_rows(
+        structResizeSession* session,
+        mmByte* dstY,
+        mmByte* dstUV,
+        mmInt32 dstStride,
+        mmInt32 firstRow,
+        mmInt32 numRows
+        );
+
+void VT_resizeFrame_Video_close(structResizeSession* session);
+
 #endif //#define NV12_RESIZE_H_
@@ -36,6 +36,7 @@
 
 #include "BaseCameraAdapter.h"
 #include "Encoder_libjpeg.h"
+#include "BracketMerge.h"
 #include "DebugUtils.h"
 
 
@@ -90,6 +91,7 @@ namespace Camera {
 #define GPS_MAPDATUM_SIZE           100
 #define GPS_PROCESSING_SIZE         100
 #define GPS_VERSION_SIZE            4
+#define GPS_RATIONAL_SIZE           80
 #define GPS_NORTH_REF               "N"
 #define GPS_SOUTH_REF               "S"
 #define GPS_EAST_REF                "E"
@@ -191,6 +193,57 @@ typedef CapU32 CapISO;
 typedef CapU32 CapSensorName;
 typedef CapS32 CapZoom;
 
+/**
+  * Writes DCC data back to the tuning files on its own thread, so the flash
+  * writes don't hold up closing one camera and opening the next. Saves still
+  * waiting for the same area of the same file are replaced by newer data,
+  * and once MAX_PENDING saves are waiting further ones are dropped.
+  */
+class DccDataWriter : public android::Thread
+{
+public:
+    static const int MAX_PENDING = 4;
+
+    ///Saves taking longer than this from the request are reported as delayed
+    static const int DELAY_THRESHOLD_MS = 100;
+
+    static android::sp<DccDataWriter> getInstance();
+
+    ///Takes over data.pData, also when the save is dropped
+    status_t save(const OMX_TI_DCCDATATYPE &data);
+
+private:
+    struct Request {
+        OMX_TI_DCCDATATYPE data;
+        nsecs_t queued;
+    };
+
+    DccDataWriter();
+
+    virtual bool threadLoop();
+
+    static size_t dataSize(const OMX_TI_DCCDATATYPE &data);
+    static bool sameArea(const OMX_TI_DCCDATATYPE &a, const OMX_TI_DCCDATATYPE &b);
+
+    static status_t write(const OMX_TI_DCCDATATYPE &data);
+    static status_t fseekDCCuseCasePos(const OMX_TI_DCCDATATYPE &data, FILE *pFile);
+    static FILE * fopenCameraDCC(const OMX_TI_DCCDATATYPE &data, const char *dccFolderPath);
+    static FILE * parseDCCsubDir(const OMX_TI_DCCDATATYPE &data, DIR *pDir, char *path);
+
+    android::Mutex mLock;
+    android::Condition mCondition;
+    android::Vector<Request> mPending;
+
+    uint32_t mWritten;
+    uint32_t mCoalesced;
+    uint32_t mDropped;
+    uint32_t mDelayed;
+    nsecs_t mMaxDelay;
+
+    static android::Mutex sInstanceLock;
+    static android::sp<DccDataWriter> sInstance;
+};
+
 /**
   * Class which completely abstracts the camera hardware interaction from camera hal
   * TODO: Need to list down here, all the message types that will be supported by this class
@@ -311,6 +364,11 @@ public:
                 uint32_t mTimeStampMin;
                 uint32_t mTimeStampSec;
                 bool mTimeStampValid;
+                // EXIF rationals of the values above, formatted when they are set
+                char mLatRational[GPS_RATIONAL_SIZE];
+                char mLongRational[GPS_RATIONAL_SIZE];
+                char mAltRational[GPS_RATIONAL_SIZE];
+                char mTimeStampRational[GPS_RATIONAL_SIZE];
     };
 
     class EXIFData
@@ -456,6 +514,7 @@ protected:
     virtual status_t startFaceDetection();
     virtual status_t stopFaceDetection();
     virtual status_t switchToExecuting();
+    virtual status_t releaseReprocessBuffers();
     virtual void onOrientationEvent(uint32_t orientation, uint32_t tilt);
 
 private:
@@ -642,7 +701,7 @@ private:
                          size_t previewWidth,
                          size_t previewHeight);
     status_t encodeFaceCoordinates(const OMX_FACEDETECTIONTYPE *faceData,
-                                   camera_frame_metadata_t *metadataResult,
+                                   CameraMetadataResult *result,
                                    size_t previewWidth,
                                    size_t previewHeight);
     status_t encodePreviewMetadata(camera_frame_metadata_t *meta, const OMX_PTR plat_pvt);
@@ -744,6 +803,11 @@ private:
     status_t doBracketing(OMX_BUFFERHEADERTYPE *pBuffHeader, CameraFrame::FrameType typeOfFrame);
     status_t sendBracketFrames(size_t &framesSent);
 
+    //Exposure bracketing merge
+    status_t holdBracketMergeFrame(OMX_BUFFERHEADERTYPE *pBuffHeader, OMXCameraPortParameters *port);
+    status_t mergeBracketFrames(OMXCameraPortParameters *port);
+    void releaseBracketMergeFrames(OMXCameraPortParameters *port, size_t count);
+
     // Image Capture Service
     status_t startImageCapture(bool bracketing, CachedCaptureParameters*);
     status_t disableImagePort();
@@ -785,9 +849,6 @@ private:
     status_t sniffDccFileDataSave(OMX_BUFFERHEADERTYPE* pBuffHeader);
     status_t saveDccFileDataSave();
     status_t closeDccFileDataSave();
-    status_t fseekDCCuseCasePos(FILE *pFile);
-    FILE * fopenCameraDCC(const char *dccFolderPath);
-    FILE * parseDCCsubDir(DIR *pDir, char *path);
 
 #ifdef CAMERAHAL_OMX_PROFILING
     status_t storeProfilingData(OMX_BUFFERHEADERTYPE* pBuffHeader);
@@ -804,11 +865,13 @@ private:
     status_t disableReprocess();
     status_t stopReprocess();
     status_t UseBuffersReprocess(CameraBuffer *bufArr, int num);
+    status_t reuseReprocessBuffers(CameraBuffer *bufArr, int num);
+    void reprocessDone();
 
     class CommandHandler : public android::Thread {
         public:
             CommandHandler(OMXCameraAdapter* ca)
-                : android::Thread(false), mCameraAdapter(ca) { }
+                : android::Thread(false), mCommandMsgQ(QUEUE_CAPACITY), mCameraAdapter(ca) { }
 
             virtual bool threadLoop() {
                 bool ret;
@@ -832,10 +895,14 @@ private:
                 CAMERA_START_IMAGE_CAPTURE = 0,
                 CAMERA_PERFORM_AUTOFOCUS,
                 CAMERA_SWITCH_TO_EXECUTING,
-                CAMERA_START_REPROCESS
+                CAMERA_START_REPROCESS,
+                CAMERA_END_IMAGE_CAPTURE
             };
 
         private:
+            ///Commands come from client calls and one end of capture per shot
+            static const unsigned int QUEUE_CAPACITY = 32;
+
             bool Handler();
             Utils::MessageQueue mCommandMsgQ;
             OMXCameraAdapter* mCameraAdapter;
@@ -857,7 +924,7 @@ public:
     class OMXCallbackHandler : public android::Thread {
         public:
         OMXCallbackHandler(OMXCameraAdapter* ca)
-            : Thread(false), mCameraAdapter(ca)
+            : Thread(false), mCommandMsgQ(QUEUE_CAPACITY), mCameraAdapter(ca)
         {
             mIsProcessed = true;
         }
@@ -874,6 +941,15 @@ public:
             return mCommandMsgQ.put(msg);
         }
 
+        status_t tryPut(Utils::Message* msg){
+            android::AutoMutex lock(mLock);
+            status_t ret = mCommandMsgQ.tryPut(msg);
+            if ( NO_ERROR == ret ) {
+                mIsProcessed = false;
+            }
+            return ret;
+        }
+
         void clearCommandQ()
             {
             android::AutoMutex lock(mLock);
@@ -889,6 +965,10 @@ public:
         };
 
     private:
+        ///Every buffer of every port can have its fill buffer done pending
+        ///at once, the rest is room for focus status events
+        static const unsigned int QUEUE_CAPACITY = 2 * MAX_NO_PORTS * MAX_NO_BUFFERS;
+
         bool Handler();
         Utils::MessageQueue mCommandMsgQ;
         OMXCameraAdapter* mCameraAdapter;
@@ -1015,15 +1095,15 @@ private:
     char mFocusDistBuffer[FOCUS_DIST_BUFFER_SIZE];
 
     // Current Focus areas
-    android::Vector<android::sp<CameraArea> > mFocusAreas;
+    CameraAreas mFocusAreas;
     mutable android::Mutex mFocusAreasLock;
 
     // Current Touch convergence areas
-    android::Vector<android::sp<CameraArea> > mTouchAreas;
+    CameraAreas mTouchAreas;
     mutable android::Mutex mTouchAreasLock;
 
     // Current Metering areas
-    android::Vector<android::sp<CameraArea> > mMeteringAreas;
+    CameraAreas mMeteringAreas;
     mutable android::Mutex mMeteringAreasLock;
 
     OperatingMode mCapabilitiesOpMode;
@@ -1037,6 +1117,8 @@ private:
     size_t mBurstFramesQueued;
     size_t mCapturedFrames;
     bool mFlushShotConfigQueue;
+    // end single shots once their frames are delivered, not when the buffers come back
+    bool mCapturePipeline;
 
     bool mMeasurementEnabled;
 
@@ -1060,6 +1142,14 @@ private:
 
     camera_face_t  faceDetectionLastOutput[MAX_NUM_FACES_SUPPORTED];
     int faceDetectionNumFacesLastOutput;
+    //Faces moving or resizing less than this are not reported again
+    int mFaceDeltaThreshold;
+    //Preview to face coordinate scale factors
+    size_t mFaceScaleWidth;
+    size_t mFaceScaleHeight;
+    double mFaceHScale;
+    double mFaceVScale;
+    CameraMetadataResultPool mMetadataResultPool;
     int metadataLastAnalogGain;
     int metadataLastExposureTime;
 
@@ -1124,6 +1214,22 @@ private:
     OMX_TI_WHITEBALANCERESULTTYPE* mWhiteBalanceData;
     bool mReprocConfigured;
 
+    //Reprocess session, the video in port keeps its buffers registered
+    //for as long as the requests come with the same buffers. CameraHal
+    //ends it when the tap in or its buffer generation changes.
+    struct ReprocessBuffer {
+        void *opaque;
+        void *omxBuffer;
+    };
+    android::Vector<ReprocessBuffer> mReprocessBuffers;
+    nsecs_t mReprocessRequestStart;
+    nsecs_t mReprocessQueued;
+    bool mReprocessRegistered;
+    unsigned int mReprocessRequests;
+    unsigned int mReprocessRegistrations;
+    nsecs_t mReprocessLatencyTotal;
+    nsecs_t mReprocessLatencyMax;
+
     //Temporal bracketing management data
     bool mBracketingSet;
     mutable android::Mutex mBracketingLock;
@@ -1134,6 +1240,13 @@ private:
     bool mZoomBracketingEnabled;
     size_t mBracketingRange;
     int mCurrentZoomBracketing;
+
+    //NV12 exposure bracketing frames are fused into a single picture
+    android::Mutex mBracketMergeLock;
+    bool mBracketMergeEnabled;
+    bool mBracketMergeActive;
+    BracketMerge mBracketMerge;
+    android::Vector<OMX_BUFFERHEADERTYPE *> mBracketMergeFrames;
     android::CameraParameters mParameters;
 
 #ifdef CAMERAHAL_TUNA
@@ -17,12 +17,21 @@
 #ifndef SWFRAMEDECODER_H_
 #define SWFRAMEDECODER_H_
 
+#include <utils/threads.h>
+#include <utils/List.h>
+
 #include "FrameDecoder.h"
 #include "Decoder_libjpeg.h"
 
 namespace Ti {
 namespace Camera {
 
+/**
+ * Decodes MJPEG frames with libjpeg on its own thread, so the preview
+ * thread can go back to V4L while a frame is being decoded. When the
+ * decoder falls behind, the oldest frames waiting for it are dropped
+ * and their buffers handed back as if they were decoded.
+ */
 class SwFrameDecoder: public FrameDecoder {
 public:
     SwFrameDecoder();
@@ -31,15 +40,47 @@ public:
 protected:
     virtual void doConfigure(const DecoderParameters& config);
     virtual void doProcessInputBuffer();
-    virtual status_t doStart() { return NO_ERROR; }
-    virtual void doStop() { }
-    virtual void doFlush() { }
+    virtual status_t doStart();
+    virtual void doStop();
+    virtual void doFlush();
     virtual void doRelease() { }
 
 private:
-    int mjpegWithHdrSize;
+    class DecodeThread : public android::Thread {
+    public:
+        DecodeThread(SwFrameDecoder* decoder) : android::Thread(false), mDecoder(decoder) {}
+        virtual bool threadLoop() { return mDecoder->decodeLoop(); }
+    private:
+        SwFrameDecoder* mDecoder;
+    };
+
+    /**
+     * A queued frame paired with the output buffer it is decoded into.
+     * While a job exists its input buffer is InWaitForEmpty and its output
+     * buffer OutWaitForFill, no one else reads or writes their memory in
+     * those states, and the buffer lists are only registered again after
+     * doStop() or doFlush(), both of which wait for the job being decoded.
+     * That is what lets decodeLoop() use the memory without buffer locks.
+     */
+    struct Job {
+        int inIndex;
+        int outIndex;
+    };
+
+    bool decodeLoop();
+    void dropJob(const Job& job);
+
     Decoder_libjpeg mJpgdecoder;
-    unsigned char* mJpegWithHeaderBuffer;
+    android::sp<DecodeThread> mDecodeThread;
+
+    android::Mutex mJobLock;
+    android::Condition mJobAvailable;
+    android::Condition mJobDone;
+    android::List<Job> mJobs;
+    bool mDecoding;
+    bool mExiting;
+    int mMaxInFlight;
+    int mDroppedFrames;
 };
 
 }  // namespace Camera
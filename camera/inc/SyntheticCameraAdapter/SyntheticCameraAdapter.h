@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#ifndef SYNTHETIC_CAMERA_ADAPTER_H
+#define SYNTHETIC_CAMERA_ADAPTER_H
+
+#include "CameraHal.h"
+#include "BaseCameraAdapter.h"
+#include "DebugUtils.h"
+
+
+namespace Ti {
+namespace Camera {
+
+/**
+  * Camera adapter without any camera behind it. Preview frames are generated
+  * at the configured size and rate, either as a moving pattern or from a raw
+  * NV12 file, and pictures are sent as YUV422i frames for the software jpeg
+  * encoder. This drives the rest of the HAL the same way a sensor would, so
+  * the pipeline can be exercised and timed on boards without camera hardware.
+  */
+class SyntheticCameraAdapter : public BaseCameraAdapter
+{
+public:
+
+    /*--------------------Constant declarations----------------------------------------*/
+    static const int32_t MAX_NO_BUFFERS = 20;
+
+    ///Preview buffers come from TILER, like for the V4L adapter
+    static const int PREVIEW_STRIDE = 4096;
+
+public:
+
+    SyntheticCameraAdapter(size_t sensor_index);
+    ~SyntheticCameraAdapter();
+
+
+    ///Initialzes the camera adapter creates any resources required
+    virtual status_t initialize(CameraProperties::Properties*);
+
+    //APIs to configure Camera adapter and get the current parameter set
+    virtual status_t setParameters(const android::CameraParameters& params);
+    virtual void getParameters(android::CameraParameters& params);
+
+    static status_t getCaps(const int sensorId, CameraProperties::Properties* params);
+
+protected:
+
+//----------Parent class method implementation------------------------------------
+    virtual status_t startPreview();
+    virtual status_t stopPreview();
+    virtual status_t takePicture();
+    virtual status_t stopImageCapture();
+    virtual status_t autoFocus();
+    virtual status_t useBuffers(CameraMode mode, CameraBuffer *bufArr, int num, size_t length, unsigned int queueable);
+    virtual status_t fillThisBuffer(CameraBuffer *frameBuf, CameraFrame::FrameType frameType);
+    virtual status_t getFrameSize(size_t &width, size_t &height);
+    virtual status_t getPictureBufferSize(CameraFrame &frame, size_t bufferCount);
+    virtual status_t getFrameDataSize(size_t &dataFrameSize, size_t bufferCount);
+    virtual void onOrientationEvent(uint32_t orientation, uint32_t tilt);
+//-----------------------------------------------------------------------------
+
+
+private:
+
+    class FrameThread : public android::Thread {
+            SyntheticCameraAdapter* mAdapter;
+        public:
+            FrameThread(SyntheticCameraAdapter* hw) :
+                    Thread(false), mAdapter(hw) { }
+            virtual void onFirstRef() {
+                run("CameraSyntheticThread", android::PRIORITY_URGENT_DISPLAY);
+            }
+            virtual bool threadLoop() {
+                mAdapter->frameThread();
+                // loop until we need to quit
+                return true;
+            }
+        };
+
+    int frameThread();
+
+    status_t sendPreviewFrame(CameraBuffer *buffer, nsecs_t timestamp);
+    status_t sendImageFrame(CameraBuffer *buffer);
+
+    void renderPreview(uint8_t *dst, int width, int height, int stride);
+    void renderPicture(uint8_t *dst, int width, int height);
+
+    status_t mapSource(int width, int height);
+    void unmapSource();
+
+private:
+    //capabilities data
+    static const char SUPPORTED_PREVIEW_SIZES[];
+    static const char SUPPORTED_PICTURE_SIZES[];
+    static const char SUPPORTED_FRAMERATES[];
+    static const char SUPPORTED_FRAMERATE_RANGES[];
+
+    //camera defaults
+    static const char DEFAULT_PREVIEW_FORMAT[];
+    static const char DEFAULT_PREVIEW_SIZE[];
+    static const char DEFAULT_FRAMERATE[];
+    static const char DEFAULT_NUM_PREV_BUFS[];
+
+    static const char DEFAULT_PICTURE_FORMAT[];
+    static const char DEFAULT_PICTURE_SIZE[];
+    static const char DEFAULT_FOCUS_MODE[];
+    static const char DEFAULT_FRAMERATE_RANGE[];
+
+    int mSensorIndex;
+
+    // everything below is protected by mFrameLock
+    android::Mutex mFrameLock;
+    android::Condition mFrameCondition;
+
+    android::CameraParameters mParams;
+
+    bool mPreviewing;
+    int mPreviewWidth;
+    int mPreviewHeight;
+    android::sp<FrameThread> mFrameThread;
+
+    // buffers which can be filled, in the order they came back
+    android::Vector<CameraBuffer *> mPreviewBufs;
+    android::Vector<CameraBuffer *> mCaptureBufs;
+
+    // frame rate forced with camera.synthetic.fps, -1 if the parameters decide
+    // and 0 to send frames as soon as a buffer is free
+    int mForcedFrameRate;
+    nsecs_t mFrameInterval;
+    nsecs_t mNextFrameTime;
+    uint32_t mFrameCount;
+
+    // ticks without a free preview buffer and ticks sent late
+    uint32_t mDroppedFrames;
+    uint32_t mLateFrames;
+
+    // pictures left to send and pictures still with the encoder
+    int mCapturesPending;
+    int mCapturesInFlight;
+
+    // NV12 frames mapped from camera.synthetic.source
+    uint8_t *mSource;
+    size_t mSourceSize;
+    size_t mSourceFrameSize;
+    size_t mSourceFrames;
+};
+
+} // namespace Camera
+} // namespace Ti
+
+#endif //SYNTHETIC_CAMERA_ADAPTER_H
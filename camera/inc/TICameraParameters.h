@@ -35,6 +35,7 @@ static const  char KEY_SUPPORTED_CAMERAS[];
 static const char KEY_CAMERA[];
 static const char KEY_CAMERA_NAME[];
 static const char  KEY_BURST[];
+static const char  KEY_CAPTURE_PIPELINE[];
 static const  char KEY_CAP_MODE[];
 static const  char KEY_CAP_MODE_VALUES[];
 static const  char KEY_VNF[];
@@ -62,6 +63,7 @@ static const  char KEY_IPP[];
 static const  char KEY_METERING_MODE[];
 static const char  KEY_EXP_BRACKETING_RANGE[];
 static const char  KEY_EXP_GAIN_BRACKETING_RANGE[];
+static const char  KEY_EXP_BRACKETING_MERGE[];
 static const char  KEY_ZOOM_BRACKETING_RANGE[];
 static const char  KEY_TEMP_BRACKETING[];
 static const char  KEY_TEMP_BRACKETING_RANGE_POS[];
@@ -145,6 +147,7 @@ static const char PIXEL_FORMAT_UNUSED[];
 static const char PIXEL_FORMAT_JPS[];
 static const char PIXEL_FORMAT_MPO[];
 static const char PIXEL_FORMAT_YUV422I_UYVY[];
+static const char PIXEL_FORMAT_YUV420SP_NV12[];
 
 // TI extensions to standard android scene mode settings
 static const  char SCENE_MODE_CLOSEUP[];
@@ -26,6 +26,7 @@
 #include "DebugUtils.h"
 #include "Decoder_libjpeg.h"
 #include "FrameDecoder.h"
+#include "FormatConverter.h"
 
 
 namespace Ti {
@@ -163,7 +164,7 @@ private:
     //Used for calculation of the average frame rate during preview
     status_t recalculateFPS();
 
-    char * GetFrame(int &index, int &filledLen);
+    char * GetFrame(int &index, int &filledLen, bool stopOnDecoded = false);
 
     int previewThread();
 
@@ -249,6 +250,9 @@ private:
     int mPixelFormat;
     int mFrameRate;
 
+    // packed preview frames -> NV12 preview buffers
+    NV12Converter mConverter;
+
     android::Mutex mStopLock;
     android::Condition mStopCondition;
 
@@ -16,10 +16,16 @@
 
 
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/poll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
 #include <unistd.h>
+#include <cutils/atomic.h>
 #include <utils/Errors.h>
 
 
@@ -32,41 +38,87 @@
 namespace Ti {
 namespace Utils {
 
+// Ring positions are free running 32 bit counters, compare them modulo 2^32
+static inline int32_t seqDiff(int32_t a, int32_t b)
+{
+    return (int32_t) ((uint32_t) a - (uint32_t) b);
+}
+
+static inline int32_t seqAdd(int32_t a, uint32_t b)
+{
+    return (int32_t) ((uint32_t) a + b);
+}
+
+static inline void futexWait(volatile int32_t *addr, int32_t value)
+{
+    syscall(__NR_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static inline void futexWake(volatile int32_t *addr)
+{
+    syscall(__NR_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static int64_t monotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 /**
    @brief Constructor for the message queue class
 
-   @param none
+   @param capacity Number of messages the ring holds, rounded up to a power of two
+   @param mode Which sides of the queue may be used by more than one thread
    @return none
  */
-MessageQueue::MessageQueue()
+MessageQueue::MessageQueue(unsigned int capacity, Mode mode)
+    : mMode(mode),
+      mSlots(NULL),
+      mMask(0),
+      mHead(0),
+      mTail(0),
+      mSleeping(0),
+      mWakeFd(-1),
+      mEventFd(-1),
+      mPutWaiters(0),
+      mRoom(0),
+      mHasMsg(false)
 {
     LOG_FUNCTION_NAME;
 
-    int fds[2] = {-1,-1};
-    android::status_t stat;
+    uint32_t size = 2;
+
+    while ( ( size < capacity ) && ( size < ( 1U << 30 ) ) )
+        {
+        size <<= 1;
+        }
 
-    stat = pipe(fds);
+    mEventFd = eventfd(0, EFD_NONBLOCK);
 
-    if ( 0 > stat )
+    if ( 0 > mEventFd )
         {
-        MSGQ_LOGEB("Error while openning pipe: %s", strerror(stat) );
-        this->fd_read = 0;
-        this->fd_write = 0;
-        mHasMsg = false;
+        MSGQ_LOGEB("Error while opening eventfd: %s", strerror(errno) );
         }
     else
         {
-        this->fd_read = fds[0];
-        this->fd_write = fds[1];
+        mSlots = new Slot[size];
+        mMask = size - 1;
 
-        mHasMsg = false;
+        for ( uint32_t i = 0 ; i < size ; i++ )
+            {
+            mSlots[i].seq = i;
+            }
         }
 
+    mWakeFd = mEventFd;
+
     LOG_FUNCTION_NAME_EXIT;
 }
 
 /**
-   @brief Destructor for the semaphore class
+   @brief Destructor for the message queue class
 
    @param none
    @return none
@@ -75,27 +127,153 @@ MessageQueue::~MessageQueue()
 {
     LOG_FUNCTION_NAME;
 
-    if(this->fd_read >= 0)
+    if(this->mEventFd >= 0)
         {
-        close(this->fd_read);
+        close(this->mEventFd);
         }
 
-    if(this->fd_write >= 0)
+    delete [] mSlots;
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+/**
+   @brief Copies a message into the ring without blocking
+
+   @param msg Message to queue
+   @return true if the message was queued, false if the ring is full
+ */
+bool MessageQueue::enqueue(const Message* msg)
+{
+    Slot *slot;
+    int32_t pos = android_atomic_acquire_load(&mTail);
+
+    for ( ;; )
         {
-        close(this->fd_write);
+        slot = &mSlots[(uint32_t) pos & mMask];
+        int32_t dif = seqDiff(android_atomic_acquire_load(&slot->seq), pos);
+
+        if ( 0 == dif )
+            {
+            // slot is free, claim it
+            if ( SINGLE_PRODUCER == mMode )
+                {
+                android_atomic_release_store(seqAdd(pos, 1), &mTail);
+                break;
+                }
+            else if ( 0 == android_atomic_cas(pos, seqAdd(pos, 1), &mTail) )
+                {
+                break;
+                }
+            }
+        else if ( 0 > dif )
+            {
+            // the consumer hasn't released this slot yet
+            return false;
+            }
+
+        pos = android_atomic_acquire_load(&mTail);
         }
 
-    LOG_FUNCTION_NAME_EXIT;
+    slot->msg = *msg;
+    android_atomic_release_store(seqAdd(pos, 1), &slot->seq);
+
+    return true;
+}
+
+/**
+   @brief Copies the oldest message out of the ring without blocking
+
+   @param msg Message structure to hold the message to be retrieved
+   @return true if a message was retrieved, false if the ring is empty
+ */
+bool MessageQueue::dequeue(Message* msg)
+{
+    Slot *slot;
+    int32_t pos = android_atomic_acquire_load(&mHead);
+
+    for ( ;; )
+        {
+        slot = &mSlots[(uint32_t) pos & mMask];
+        int32_t dif = seqDiff(android_atomic_acquire_load(&slot->seq), seqAdd(pos, 1));
+
+        if ( 0 == dif )
+            {
+            if ( MULTI_PRODUCER != mMode )
+                {
+                android_atomic_release_store(seqAdd(pos, 1), &mHead);
+                break;
+                }
+            else if ( 0 == android_atomic_cas(pos, seqAdd(pos, 1), &mHead) )
+                {
+                break;
+                }
+            }
+        else if ( 0 > dif )
+            {
+            return false;
+            }
+
+        pos = android_atomic_acquire_load(&mHead);
+        }
+
+    *msg = slot->msg;
+    android_atomic_release_store(seqAdd(pos, mMask + 1), &slot->seq);
+
+    wakeProducers();
+
+    return true;
 }
 
 /**
-   @brief Get a message from the queue
+   @brief Wakes up the consumer if it is sleeping on this queue
+
+   @param none
+   @return none
+ */
+void MessageQueue::wakeConsumer()
+{
+    // pairs with the barrier in waitForMsg(), either the consumer sees
+    // the new message or we see it sleeping
+    android_memory_barrier();
+
+    if ( android_atomic_acquire_load(&mSleeping) &&
+         ( 0 == android_atomic_acquire_cas(1, 0, &mSleeping) ) )
+        {
+        uint64_t count = 1;
+
+        if ( sizeof(count) != write(android_atomic_acquire_load(&mWakeFd), &count, sizeof(count)) )
+            {
+            MSGQ_LOGEB("write() error: %s", strerror(errno));
+            }
+        }
+}
+
+/**
+   @brief Wakes up producers blocked on a full ring
+
+   @param none
+   @return none
+ */
+void MessageQueue::wakeProducers()
+{
+    android_memory_barrier();
+
+    if ( android_atomic_acquire_load(&mPutWaiters) )
+        {
+        android_atomic_inc(&mRoom);
+        futexWake(&mRoom);
+        }
+}
+
+/**
+   @brief Get a message from the queue, blocks until one is available
 
    @param msg Message structure to hold the message to be retrieved
    @return android::NO_ERROR On success
    @return android::BAD_VALUE if the message pointer is NULL
-   @return android::NO_INIT If the file read descriptor is not set
-   @return android::UNKNOWN_ERROR if the read operation fromthe file read descriptor fails
+   @return android::NO_INIT If the message queue could not be initialized
+   @return android::UNKNOWN_ERROR if waiting for a message fails
  */
 android::status_t MessageQueue::get(Message* msg)
 {
@@ -108,29 +286,20 @@ android::status_t MessageQueue::get(Message* msg)
         return android::BAD_VALUE;
         }
 
-    if(!this->fd_read)
+    if(!this->mSlots)
         {
-        MSGQ_LOGEA("read descriptor not initialized for message queue");
+        MSGQ_LOGEA("message queue not initialized");
         LOG_FUNCTION_NAME_EXIT;
         return android::NO_INIT;
         }
 
-    char* p = (char*) msg;
-    size_t read_bytes = 0;
-
-    while( read_bytes  < sizeof(*msg) )
+    while ( !dequeue(msg) )
         {
-        int err = read(this->fd_read, p, sizeof(*msg) - read_bytes);
-
-        if( err < 0 )
+        if ( 0 > waitForMsg(this, NULL, NULL, -1) )
             {
-            MSGQ_LOGEB("read() error: %s", strerror(errno));
+            LOG_FUNCTION_NAME_EXIT;
             return android::UNKNOWN_ERROR;
             }
-        else
-            {
-            read_bytes += err;
-            }
         }
 
     MSGQ_LOGDB("MQ.get(%d,%p,%p,%p,%p)", msg->command, msg->arg1,msg->arg2,msg->arg3,msg->arg4);
@@ -143,21 +312,24 @@ android::status_t MessageQueue::get(Message* msg)
 }
 
 /**
-   @brief Get the input file descriptor of the message queue
+   @brief Get the file descriptor signalled when a waiter on this queue is woken up
 
    @param none
-   @return file read descriptor
+   @return eventfd descriptor
  */
 
 int MessageQueue::getInFd()
 {
-    return this->fd_read;
+    return this->mEventFd;
 }
 
 /**
-   @brief Constructor for the message queue class
+   @brief Replace the file descriptor signalled when a waiter on this queue is woken up
+
+   The previous descriptor is closed and the queue takes ownership of fd,
+   which is closed with the queue.
 
-   @param fd file read descriptor
+   @param fd eventfd compatible descriptor
    @return none
  */
 
@@ -165,33 +337,30 @@ void MessageQueue::setInFd(int fd)
 {
     LOG_FUNCTION_NAME;
 
-    if ( -1 != this->fd_read )
+    if ( -1 != this->mEventFd )
         {
-        close(this->fd_read);
+        close(this->mEventFd);
         }
 
-    this->fd_read = fd;
+    this->mEventFd = fd;
+    android_atomic_release_store(fd, &mWakeFd);
 
     LOG_FUNCTION_NAME_EXIT;
 }
 
 /**
-   @brief Queue a message
+   @brief Queue a message, blocks while the ring is full
 
    @param msg Message structure to hold the message to be retrieved
    @return android::NO_ERROR On success
    @return android::BAD_VALUE if the message pointer is NULL
-   @return android::NO_INIT If the file write descriptor is not set
-   @return android::UNKNOWN_ERROR if the write operation fromthe file write descriptor fails
+   @return android::NO_INIT If the message queue could not be initialized
  */
 
 android::status_t MessageQueue::put(Message* msg)
 {
     LOG_FUNCTION_NAME;
 
-    char* p = (char*) msg;
-    size_t bytes = 0;
-
     if(!msg)
         {
         MSGQ_LOGEA("msg is NULL");
@@ -199,80 +368,106 @@ android::status_t MessageQueue::put(Message* msg)
         return android::BAD_VALUE;
         }
 
-    if(!this->fd_write)
+    if(!this->mSlots)
         {
-        MSGQ_LOGEA("write descriptor not initialized for message queue");
+        MSGQ_LOGEA("message queue not initialized");
         LOG_FUNCTION_NAME_EXIT;
         return android::NO_INIT;
         }
 
-
     MSGQ_LOGDB("MQ.put(%d,%p,%p,%p,%p)", msg->command, msg->arg1,msg->arg2,msg->arg3,msg->arg4);
 
-    while( bytes  < sizeof(msg) )
+    while ( !enqueue(msg) )
         {
-        int err = write(this->fd_write, p, sizeof(*msg) - bytes);
+        // ring is full, sleep until the consumer releases a slot. mRoom is
+        // sampled before retrying so a release in between isn't missed
+        android_atomic_inc(&mPutWaiters);
+        int32_t room = android_atomic_acquire_load(&mRoom);
 
-        if( err < 0 )
-            {
-            MSGQ_LOGEB("write() error: %s", strerror(errno));
-            LOG_FUNCTION_NAME_EXIT;
-            return android::UNKNOWN_ERROR;
-            }
-        else
+        if ( enqueue(msg) )
             {
-            bytes += err;
+            android_atomic_dec(&mPutWaiters);
+            break;
             }
+
+        futexWait(&mRoom, room);
+        android_atomic_dec(&mPutWaiters);
         }
 
+    wakeConsumer();
+
     MSGQ_LOGDA("MessageQueue::put EXIT");
 
     LOG_FUNCTION_NAME_EXIT;
     return 0;
 }
 
-
 /**
-   @brief Returns if the message queue is empty or not
+   @brief Queue a message without waiting for room
 
-   @param none
-   @return true If the queue is empty
-   @return false If the queue has at least one message
+   @param msg Message structure holding the message to be queued
+   @return android::NO_ERROR On success
+   @return android::WOULD_BLOCK If the queue is full, the message is not queued
+   @return android::BAD_VALUE if the message pointer is NULL
+   @return android::NO_INIT If the message queue could not be initialized
  */
-bool MessageQueue::isEmpty()
+
+android::status_t MessageQueue::tryPut(Message* msg)
 {
     LOG_FUNCTION_NAME;
 
-    struct pollfd pfd;
-
-    pfd.fd = this->fd_read;
-    pfd.events = POLLIN;
-    pfd.revents = 0;
-
-    if(!this->fd_read)
+    if(!msg)
         {
-        MSGQ_LOGEA("read descriptor not initialized for message queue");
+        MSGQ_LOGEA("msg is NULL");
         LOG_FUNCTION_NAME_EXIT;
-        return android::NO_INIT;
+        return android::BAD_VALUE;
         }
 
-
-    if( -1 == poll(&pfd,1,0) )
+    if(!this->mSlots)
         {
-        MSGQ_LOGEB("poll() error: %s", strerror(errno));
+        MSGQ_LOGEA("message queue not initialized");
         LOG_FUNCTION_NAME_EXIT;
-        return false;
+        return android::NO_INIT;
         }
 
-    if(pfd.revents & POLLIN)
+    if ( !enqueue(msg) )
         {
-        mHasMsg = true;
+        LOG_FUNCTION_NAME_EXIT;
+        return android::WOULD_BLOCK;
         }
-    else
+
+    MSGQ_LOGDB("MQ.tryPut(%d,%p,%p,%p,%p)", msg->command, msg->arg1,msg->arg2,msg->arg3,msg->arg4);
+
+    wakeConsumer();
+
+    LOG_FUNCTION_NAME_EXIT;
+    return android::NO_ERROR;
+}
+
+
+/**
+   @brief Returns if the message queue is empty or not
+
+   @param none
+   @return true If the queue is empty
+   @return false If the queue has at least one message
+ */
+bool MessageQueue::isEmpty()
+{
+    LOG_FUNCTION_NAME;
+
+    if(!this->mSlots)
         {
-        mHasMsg = false;
+        MSGQ_LOGEA("message queue not initialized");
+        LOG_FUNCTION_NAME_EXIT;
+        return true;
         }
 
+    int32_t pos = android_atomic_acquire_load(&mHead);
+    Slot *slot = &mSlots[(uint32_t) pos & mMask];
+
+    mHasMsg = ( 0 <= seqDiff(android_atomic_acquire_load(&slot->seq), seqAdd(pos, 1)) );
+
     LOG_FUNCTION_NAME_EXIT;
     return !mHasMsg;
 }
@@ -281,19 +476,21 @@ void MessageQueue::clear()
 {
     LOG_FUNCTION_NAME;
 
-    if(!this->fd_read)
+    if(!this->mSlots)
         {
-        MSGQ_LOGEA("read descriptor not initialized for message queue");
+        MSGQ_LOGEA("message queue not initialized");
         LOG_FUNCTION_NAME_EXIT;
         return;
         }
 
     Message msg;
-    while(!isEmpty())
+    while ( dequeue(&msg) )
         {
-        get(&msg);
         }
 
+    mHasMsg = false;
+
+    LOG_FUNCTION_NAME_EXIT;
 }
 
 
@@ -310,22 +507,29 @@ void MessageQueue::setMsg(bool hasMsg)
 
 
 /**
-   @briefWait for message in maximum three different queues with a timeout
+   @brief Wait for message in maximum three different queues with a timeout
+
+   All queues share the eventfd of queue1 for the wait. Before sleeping the
+   consumer marks each queue as sleeping and checks them once more, the first
+   producer which then finds a queue marked signals the eventfd.
 
    @param queue1 First queue. At least this should be set to a valid queue pointer
    @param queue2 Second queue. Optional.
    @param queue3 Third queue. Optional.
-   @param timeout The timeout value (in micro secs) to wait for a message in any of the queues
-   @return android::NO_ERROR On success
+   @param timeout The timeout value (in milli secs) to wait for a message in any of the queues,
+                  negative to wait forever
+   @return Number of queues with messages, 0 on timeout
    @return android::BAD_VALUE If queue1 is NULL
-   @return android::NO_INIT If the file read descriptor of any of the provided queues is not set
+   @return android::NO_INIT If any of the provided queues is not initialized
  */
 android::status_t MessageQueue::waitForMsg(MessageQueue *queue1, MessageQueue *queue2, MessageQueue *queue3, int timeout)
     {
     LOG_FUNCTION_NAME;
 
-    int n =1;
-    struct pollfd pfd[3];
+    MessageQueue *queues[3];
+    int n = 0;
+    int ret = 0;
+    int64_t deadline = 0;
 
     if(!queue1)
         {
@@ -334,80 +538,106 @@ android::status_t MessageQueue::waitForMsg(MessageQueue *queue1, MessageQueue *q
         return android::BAD_VALUE;
         }
 
-    pfd[0].fd = queue1->getInFd();
-    if(!pfd[0].fd)
-        {
-        MSGQ_LOGEA("read descriptor not initialized for message queue1");
-        LOG_FUNCTION_NAME_EXIT;
-        return android::NO_INIT;
-        }
-    pfd[0].events = POLLIN;
-    pfd[0].revents = 0;
+    queues[n++] = queue1;
     if(queue2)
         {
         MSGQ_LOGDA("queue2 not-null");
-        pfd[1].fd = queue2->getInFd();
-        if(!pfd[1].fd)
-            {
-            MSGQ_LOGEA("read descriptor not initialized for message queue2");
-            LOG_FUNCTION_NAME_EXIT;
-            return android::NO_INIT;
-            }
-
-        pfd[1].events = POLLIN;
-        pfd[1].revents = 0;
-        n++;
+        queues[n++] = queue2;
         }
-
     if(queue3)
         {
         MSGQ_LOGDA("queue3 not-null");
-        pfd[2].fd = queue3->getInFd();
-        if(!pfd[2].fd)
+        queues[n++] = queue3;
+        }
+
+    for ( int i = 0 ; i < n ; i++ )
+        {
+        if ( !queues[i]->mSlots || ( 0 > queues[i]->mEventFd ) )
             {
-            MSGQ_LOGEA("read descriptor not initialized for message queue3");
+            MSGQ_LOGEB("message queue%d not initialized", i + 1);
             LOG_FUNCTION_NAME_EXIT;
             return android::NO_INIT;
             }
-
-        pfd[2].events = POLLIN;
-        pfd[2].revents = 0;
-        n++;
         }
 
-
-    int ret = poll(pfd, n, timeout);
-    if(ret==0)
+    if ( 0 < timeout )
         {
-        LOG_FUNCTION_NAME_EXIT;
-        return ret;
+        deadline = monotonicMs() + timeout;
         }
 
-    if(ret<android::NO_ERROR)
+    for ( ;; )
         {
-        MSGQ_LOGEB("Message queue returned error %d", ret);
-        LOG_FUNCTION_NAME_EXIT;
-        return ret;
-        }
+        ret = 0;
+        for ( int i = 0 ; i < n ; i++ )
+            {
+            if ( !queues[i]->isEmpty() )
+                {
+                ret++;
+                }
+            }
 
-    if (pfd[0].revents & POLLIN)
-        {
-        queue1->setMsg(true);
-        }
+        if ( ret || ( 0 == timeout ) )
+            {
+            break;
+            }
 
-    if(queue2)
-        {
-        if (pfd[1].revents & POLLIN)
+        int remaining = -1;
+        if ( 0 < timeout )
             {
-            queue2->setMsg(true);
+            int64_t left = deadline - monotonicMs();
+            if ( 0 >= left )
+                {
+                break;
+                }
+            remaining = (int) left;
             }
-        }
 
-    if(queue3)
-        {
-        if (pfd[2].revents & POLLIN)
+        // announce that we are going to sleep, then look once more so a
+        // message queued in between isn't missed
+        for ( int i = 0 ; i < n ; i++ )
+            {
+            android_atomic_release_store(queue1->mEventFd, &queues[i]->mWakeFd);
+            android_atomic_release_store(1, &queues[i]->mSleeping);
+            }
+
+        android_memory_barrier();
+
+        bool ready = false;
+        for ( int i = 0 ; i < n ; i++ )
+            {
+            if ( !queues[i]->isEmpty() )
+                {
+                ready = true;
+                }
+            }
+
+        if ( !ready )
+            {
+            struct pollfd pfd;
+            pfd.fd = queue1->mEventFd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+
+            if ( ( 0 > poll(&pfd, 1, remaining) ) && ( EINTR != errno ) )
+                {
+                MSGQ_LOGEB("poll() error: %s", strerror(errno));
+                ret = -errno;
+                }
+            }
+
+        for ( int i = 0 ; i < n ; i++ )
+            {
+            android_atomic_release_store(0, &queues[i]->mSleeping);
+            }
+
+        // reset the eventfd counter, a wakeup racing with this read only
+        // causes one more pass through the loop
+        uint64_t count;
+        read(queue1->mEventFd, &count, sizeof(count));
+
+        if ( 0 > ret )
             {
-            queue3->setMsg(true);
+            break;
             }
         }
 
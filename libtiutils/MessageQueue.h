@@ -48,25 +48,49 @@ struct Message
 };
 
 ///Message queue implementation
+///
+///Messages are copied into a fixed size ring in process memory. Producers
+///only enter the kernel when the consumer is sleeping in get() or
+///waitForMsg(), the consumer only when there is nothing to read. A full
+///ring blocks put() until the consumer makes room, producers which must
+///not stall use tryPut() and handle the message themselves.
 class MessageQueue
 {
 public:
 
-    MessageQueue();
+    enum Mode
+    {
+        ///Any number of threads may put and get
+        MULTI_PRODUCER = 0,
+        ///Any number of threads may put, gets are made by one thread or
+        ///serialized by the caller
+        SINGLE_CONSUMER,
+        ///Exactly one producer thread and one consumer thread, no atomic
+        ///read-modify-write on the fast path
+        SINGLE_PRODUCER
+    };
+
+    static const unsigned int DEFAULT_CAPACITY = 256;
+
+    explicit MessageQueue(unsigned int capacity = DEFAULT_CAPACITY, Mode mode = MULTI_PRODUCER);
     ~MessageQueue();
 
     ///Get a message from the queue
     android::status_t get(Message*);
 
-    ///Get the input file descriptor of the message queue
+    ///Get the file descriptor signalled when a waiter on this queue is woken up
     int getInFd();
 
-    ///Set the input file descriptor for the message queue
+    ///Set the file descriptor signalled when a waiter on this queue is woken up,
+    ///closes the previous one and takes ownership of fd
     void setInFd(int fd);
 
-    ///Queue a message
+    ///Queue a message, blocks while the queue is full
     android::status_t put(Message*);
 
+    ///Queue a message, fails with WOULD_BLOCK instead of waiting for room
+    android::status_t tryPut(Message*);
+
     ///Returns if the message queue is empty or not
     bool isEmpty();
 
@@ -84,11 +108,44 @@ public:
     }
 
 private:
-    int fd_read;
-    int fd_write;
+    struct Slot
+    {
+        volatile int32_t seq;
+        Message msg;
+    };
+
+    bool enqueue(const Message *msg);
+    bool dequeue(Message *msg);
+    void wakeConsumer();
+    void wakeProducers();
+
+    Mode mMode;
+    Slot *mSlots;
+    uint32_t mMask;
+    volatile int32_t mHead;
+    volatile int32_t mTail;
+
+    ///Consumer side sleep state, see waitForMsg()
+    volatile int32_t mSleeping;
+    volatile int32_t mWakeFd;
+    int mEventFd;
+
+    ///Producers blocked on a full ring sleep on mRoom
+    volatile int32_t mPutWaiters;
+    volatile int32_t mRoom;
+
     bool mHasMsg;
 };
 
+///Message queue read by a single thread, for members of classes which
+///rely on the implicit constructor
+class SingleConsumerMessageQueue : public MessageQueue
+{
+public:
+    explicit SingleConsumerMessageQueue(unsigned int capacity = DEFAULT_CAPACITY)
+        : MessageQueue(capacity, SINGLE_CONSUMER) { }
+};
+
 } // namespace Utils
 } // namespace Ti
 
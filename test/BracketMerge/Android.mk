@@ -0,0 +1,27 @@
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    BracketMergeBenchmark.cpp \
+    ../../camera/BracketMerge.cpp
+
+LOCAL_SHARED_LIBRARIES:= \
+    libutils \
+    libcutils \
+    liblog
+
+LOCAL_C_INCLUDES += \
+    $(HARDWARE_TI_OMAP4_BASE)/camera/inc \
+    $(HARDWARE_TI_OMAP4_BASE)/libtiutils
+
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2 $(ANDROID_API_CFLAGS)
+
+ifdef ARCH_ARM_HAVE_NEON
+    LOCAL_CFLAGS += -DARCH_ARM_HAVE_NEON
+endif
+
+LOCAL_MODULE:= bracket_merge_benchmark
+LOCAL_MODULE_TAGS:= optional
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file BracketMergeBenchmark.cpp
+*
+* Times Ti::Camera::BracketMerge on canned bracket sets with every kernel
+* set available on the CPU, and checks them against the scalar reference.
+*
+* Usage: bracket_merge_benchmark [-s WxH] [-n iterations] [-t tone]
+*                                [-f frames.nv12] [-o merged.nv12]
+*
+* A file given with -f holds the frames of one bracket set back to back,
+* tightly packed NV12 at the -s size. It replaces the generated sets.
+*
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "BracketMerge.h"
+
+using Ti::Camera::BracketMerge;
+
+#define DEFAULT_WIDTH 2592
+#define DEFAULT_HEIGHT 1944
+#define DEFAULT_ITERATIONS 10
+#define SET_FRAMES 3
+
+static double nowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+/**
+ * A bracket set: count NV12 frames with a stride wider than the
+ * picture, like the ones coming from the image port
+ */
+struct BracketSet
+{
+    const char *name;
+    int width;
+    int height;
+    size_t stride;
+    size_t count;
+    uint8_t *data[BracketMerge::MAX_FRAMES];
+    BracketMerge::Frame frames[BracketMerge::MAX_FRAMES];
+};
+
+static size_t frameSize(const BracketSet &set)
+{
+    return set.stride * set.height * 3 / 2;
+}
+
+static void freeSet(BracketSet &set)
+{
+    for ( size_t i = 0; i < set.count; i++ ) {
+        free(set.data[i]);
+    }
+    set.count = 0;
+}
+
+static bool allocSet(BracketSet &set, const char *name, int width, int height, size_t count)
+{
+    set.name = name;
+    set.width = width;
+    set.height = height;
+    set.stride = ( width + 127 ) & ~127;
+    set.count = 0;
+
+    for ( size_t i = 0; i < count; i++ ) {
+        set.data[i] = (uint8_t *) malloc(frameSize(set));
+        if ( NULL == set.data[i] ) {
+            freeSet(set);
+            return false;
+        }
+        set.count++;
+        set.frames[i].y = set.data[i];
+        set.frames[i].uv = set.data[i] + set.stride * height;
+        set.frames[i].stride = set.stride;
+    }
+
+    return true;
+}
+
+// Scene radiance in 0..16, mid grey at 1
+typedef float (*Scene)(int x, int y, int width, int height);
+
+static float gradientScene(int x, int y, int width, int height)
+{
+    (void) y;
+    (void) height;
+    return 16.0f * powf((float) x / width, 3.0f);
+}
+
+// dim room with a bright window, textured so the weights vary per pixel
+static float windowScene(int x, int y, int width, int height)
+{
+    const bool window = ( x > width / 2 ) && ( x < width * 7 / 8 ) &&
+                        ( y > height / 8 ) && ( y < height / 2 );
+    const float texture = 1.0f + 0.25f * sinf(x * 0.05f) * sinf(y * 0.07f);
+    return ( window ? 12.0f : 0.15f ) * texture;
+}
+
+static float flatScene(int x, int y, int width, int height)
+{
+    (void) x;
+    (void) y;
+    (void) width;
+    (void) height;
+    return 1.0f;
+}
+
+// Renders the scene at -2, 0 and +2 EV with a gamma encode and clipping
+static void renderSet(BracketSet &set, Scene scene)
+{
+    static const float ev[SET_FRAMES] = { 0.25f, 1.0f, 4.0f };
+
+    for ( size_t i = 0; i < set.count; i++ ) {
+        uint8_t *luma = set.frames[i].y;
+        uint8_t *chroma = set.frames[i].uv;
+
+        for ( int y = 0; y < set.height; y++ ) {
+            for ( int x = 0; x < set.width; x++ ) {
+                const float v = 0.18f * scene(x, y, set.width, set.height) * ev[i % SET_FRAMES];
+                const float encoded = 255.0f * powf(v > 1.0f ? 1.0f : v, 1.0f / 2.2f);
+                luma[y * set.stride + x] = (uint8_t) ( encoded + 0.5f );
+            }
+        }
+
+        // a slight colour cast which fades out as the exposure clips
+        for ( int y = 0; y < set.height / 2; y++ ) {
+            for ( int x = 0; x < set.width; x += 2 ) {
+                const int l = luma[2 * y * set.stride + x];
+                chroma[y * set.stride + x] = 128 - ( 255 - l ) / 16;
+                chroma[y * set.stride + x + 1] = 128 + ( 255 - l ) / 12;
+            }
+        }
+    }
+}
+
+static bool loadSet(BracketSet &set, const char *path, int width, int height)
+{
+    FILE *file = fopen(path, "rb");
+    if ( NULL == file ) {
+        printf("Unable to open %s\n", path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    const size_t packed = (size_t) width * height * 3 / 2;
+    size_t count = size / packed;
+    if ( count > BracketMerge::MAX_FRAMES ) {
+        count = BracketMerge::MAX_FRAMES;
+    }
+
+    if ( ( count < 2 ) || !allocSet(set, path, width, height, count) ) {
+        printf("%s doesn't hold a bracket set of %dx%d frames\n", path, width, height);
+        fclose(file);
+        return false;
+    }
+
+    bool ok = true;
+    for ( size_t i = 0; ( i < count ) && ok; i++ ) {
+        // luma rows, then the chroma rows
+        for ( int y = 0; ( y < height * 3 / 2 ) && ok; y++ ) {
+            ok = ( 1 == fread(set.data[i] + y * set.stride, width, 1, file) );
+        }
+    }
+
+    fclose(file);
+
+    if ( !ok ) {
+        printf("Short read from %s\n", path);
+    }
+
+    return ok;
+}
+
+static void saveFrame(const BracketSet &set, const BracketMerge::Frame &frame, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if ( NULL == file ) {
+        printf("Unable to create %s\n", path);
+        return;
+    }
+
+    for ( int y = 0; y < set.height; y++ ) {
+        fwrite(frame.y + y * frame.stride, set.width, 1, file);
+    }
+    for ( int y = 0; y < set.height / 2; y++ ) {
+        fwrite(frame.uv + y * frame.stride, set.width, 1, file);
+    }
+
+    fclose(file);
+}
+
+static int maxDifference(const BracketSet &set, const BracketMerge::Frame &a, const BracketMerge::Frame &b)
+{
+    int maxDiff = 0;
+
+    for ( int y = 0; y < set.height * 3 / 2; y++ ) {
+        const uint8_t *rowA = ( y < set.height ) ? a.y + y * a.stride : a.uv + ( y - set.height ) * a.stride;
+        const uint8_t *rowB = ( y < set.height ) ? b.y + y * b.stride : b.uv + ( y - set.height ) * b.stride;
+        for ( int x = 0; x < set.width; x++ ) {
+            const int diff = abs(rowA[x] - rowB[x]);
+            if ( diff > maxDiff ) {
+                maxDiff = diff;
+            }
+        }
+    }
+
+    return maxDiff;
+}
+
+static void runSet(BracketSet &set, int iterations, int tone, const char *output)
+{
+    static const BracketMerge::KernelSet types[] = {
+        BracketMerge::KERNELS_SCALAR,
+        BracketMerge::KERNELS_NEON,
+        BracketMerge::KERNELS_SSE2,
+    };
+
+    BracketMerge merge;
+    BracketMerge::Frame reference, result;
+    uint8_t *referenceData = (uint8_t *) malloc(frameSize(set));
+    uint8_t *resultData = (uint8_t *) malloc(frameSize(set));
+
+    if ( ( NULL == referenceData ) || ( NULL == resultData ) ) {
+        printf("Out of memory\n");
+        free(referenceData);
+        free(resultData);
+        return;
+    }
+
+    reference.y = referenceData;
+    reference.uv = referenceData + set.stride * set.height;
+    reference.stride = set.stride;
+    result.y = resultData;
+    result.uv = resultData + set.stride * set.height;
+    result.stride = set.stride;
+
+    merge.setToneStrength(tone);
+
+    const double megapixels = set.width * set.height * set.count / 1000000.0;
+
+    for ( size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++ ) {
+        const BracketMerge::Kernels *kernels = BracketMerge::kernels(types[t]);
+        if ( NULL == kernels ) {
+            continue;
+        }
+
+        BracketMerge::Frame &dst = ( BracketMerge::KERNELS_SCALAR == types[t] ) ? reference : result;
+
+        // first run outside of the timing, it allocates the row buffers
+        merge.merge(set.frames, set.count, dst, set.width, set.height, *kernels);
+
+        const double start = nowUs();
+        for ( int i = 0; i < iterations; i++ ) {
+            merge.merge(set.frames, set.count, dst, set.width, set.height, *kernels);
+        }
+        const double us = ( nowUs() - start ) / iterations;
+
+        printf("%-10s %-8s %10.2f %10.1f",
+               set.name, kernels->name, us / 1000.0, megapixels / ( us / 1000000.0 ));
+        if ( BracketMerge::KERNELS_SCALAR == types[t] ) {
+            printf("          -\n");
+        } else {
+            printf(" %10d\n", maxDifference(set, reference, result));
+        }
+    }
+
+    if ( NULL != output ) {
+        saveFrame(set, reference, output);
+    }
+
+    free(referenceData);
+    free(resultData);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [-s WxH] [-n iterations] [-t tone] [-f frames.nv12] [-o merged.nv12]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    int width = DEFAULT_WIDTH;
+    int height = DEFAULT_HEIGHT;
+    int iterations = DEFAULT_ITERATIONS;
+    int tone = BracketMerge::DEFAULT_TONE_STRENGTH;
+    const char *input = NULL;
+    const char *output = NULL;
+    int opt;
+
+    while ( ( opt = getopt(argc, argv, "s:n:t:f:o:") ) != -1 ) {
+        switch ( opt ) {
+            case 's':
+                if ( 2 != sscanf(optarg, "%dx%d", &width, &height) ) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 't':
+                tone = atoi(optarg);
+                break;
+            case 'f':
+                input = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if ( ( width < 2 ) || ( height < 2 ) || ( width & 1 ) || ( height & 1 ) || ( iterations < 1 ) ) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("%dx%d, tone %d, %d iterations, ms per merge, input Mpixel/s, max difference to scalar\n\n",
+           width, height, tone, iterations);
+    printf("%-10s %-8s %10s %10s %10s\n", "set", "kernels", "ms", "Mpix/s", "diff");
+
+    if ( NULL != input ) {
+        BracketSet set;
+        if ( !loadSet(set, input, width, height) ) {
+            return 1;
+        }
+        set.name = "file";
+        runSet(set, iterations, tone, output);
+        freeSet(set);
+        return 0;
+    }
+
+    static const struct {
+        const char *name;
+        Scene scene;
+    } scenes[] = {
+        { "gradient", gradientScene },
+        { "window", windowScene },
+        { "flat", flatScene },
+    };
+
+    for ( size_t i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++ ) {
+        BracketSet set;
+        if ( !allocSet(set, scenes[i].name, width, height, SET_FRAMES) ) {
+            printf("Out of memory\n");
+            return 1;
+        }
+        renderSet(set, scenes[i].scene);
+        // only the window scene is written out, it shows the merge best
+        runSet(set, iterations, tone, ( scenes[i].scene == windowScene ) ? output : NULL);
+        freeSet(set);
+    }
+
+    return 0;
+}
@@ -12,7 +12,8 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= \
 	camera_test_surfacetexture.cpp \
 	camera_test_menu.cpp \
-	camera_test_script.cpp
+	camera_test_script.cpp \
+	camera_test_perf.cpp
 
 LOCAL_SHARED_LIBRARIES:= \
 	libdl \
@@ -98,3 +99,25 @@ endif
 include $(BUILD_HEAPTRACKED_EXECUTABLE)
 
 endif
+
+
+# HAL benchmark, loads the camera HAL directly and doesn't need CPCAM
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	camera_bench.cpp
+
+LOCAL_SHARED_LIBRARIES:= \
+	libhardware \
+	libui \
+	libutils \
+	libcutils \
+	liblog \
+	libcamera_client
+
+LOCAL_MODULE:= camera_bench
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2 -D___ANDROID___ $(ANDROID_API_CFLAGS)
+
+include $(BUILD_HEAPTRACKED_EXECUTABLE)
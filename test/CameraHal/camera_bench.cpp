@@ -0,0 +1,817 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Loads the camera HAL straight into this process, without camera service
+ * or surfaceflinger, and times preview, recording, single shot and burst
+ * capture. The preview window is a stub which gives buffers back as soon
+ * as the next one is queued, so the numbers are those of the HAL alone.
+ *
+ * Meant to be run against the synthetic camera of a HAL built with
+ * TI_CAMERAHAL_SYNTHETIC_CAMERA, it works with any camera of the HAL.
+ * Per stage latencies come from the HAL frame trace, which is switched on
+ * with camera.trace for the duration of each scenario.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <hardware/hardware.h>
+#include <hardware/camera.h>
+#include <hardware/gralloc.h>
+#include <cutils/properties.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <ui/GraphicBufferAllocator.h>
+#include <camera/CameraParameters.h>
+
+#define MAX_WINDOW_BUFFERS 16
+#define DEQUEUE_TIMEOUT ms2ns(1000)
+#define PICTURE_TIMEOUT s2ns(10)
+
+/*--------------------Stub preview window---------------------------------*/
+
+// preview_stream_ops has to come first, the HAL only hands that back to us
+struct BenchWindow {
+    preview_stream_ops ops;
+
+    android::Mutex lock;
+    android::Condition freed;
+
+    int width;
+    int height;
+    int format;
+    int usage;
+    int count;
+    int stride;
+    buffer_handle_t handles[MAX_WINDOW_BUFFERS];
+    android::Vector<buffer_handle_t *> available;
+    buffer_handle_t *front;
+
+    uint32_t queued;
+    uint32_t cancelled;
+    nsecs_t lastQueue;
+    nsecs_t maxInterval;
+};
+
+static BenchWindow *toWindow(preview_stream_ops *w)
+{
+    return reinterpret_cast<BenchWindow *>(w);
+}
+
+static void freeWindowBuffers(BenchWindow *win)
+{
+    android::GraphicBufferAllocator &allocator = android::GraphicBufferAllocator::get();
+
+    for ( int i = 0; i < MAX_WINDOW_BUFFERS; i++ ) {
+        if ( NULL != win->handles[i] ) {
+            allocator.free(win->handles[i]);
+            win->handles[i] = NULL;
+        }
+    }
+
+    win->available.clear();
+    win->front = NULL;
+}
+
+static int allocWindowBuffers(BenchWindow *win)
+{
+    android::GraphicBufferAllocator &allocator = android::GraphicBufferAllocator::get();
+
+    freeWindowBuffers(win);
+
+    if ( ( 0 >= win->width ) || ( 0 >= win->height ) || ( 0 >= win->count ) ) {
+        return 0;
+    }
+
+    for ( int i = 0; i < win->count; i++ ) {
+        int err = allocator.alloc(win->width, win->height, win->format,
+                                  win->usage | GRALLOC_USAGE_SW_READ_OFTEN,
+                                  &win->handles[i], &win->stride);
+        if ( 0 != err ) {
+            printf("Couldn't allocate %dx%d window buffer: %d\n", win->width, win->height, err);
+            freeWindowBuffers(win);
+            return err;
+        }
+        win->available.push_back(&win->handles[i]);
+    }
+
+    return 0;
+}
+
+static int windowDequeue(preview_stream_ops *w, buffer_handle_t **buffer, int *stride)
+{
+    BenchWindow *win = toWindow(w);
+    android::AutoMutex lock(win->lock);
+
+    while ( win->available.isEmpty() ) {
+        if ( 0 != win->freed.waitRelative(win->lock, DEQUEUE_TIMEOUT) ) {
+            return -EBUSY;
+        }
+    }
+
+    *buffer = win->available[0];
+    win->available.removeAt(0);
+    *stride = win->stride;
+
+    return 0;
+}
+
+static int windowEnqueue(preview_stream_ops *w, buffer_handle_t *buffer)
+{
+    BenchWindow *win = toWindow(w);
+    android::AutoMutex lock(win->lock);
+    nsecs_t now = systemTime();
+
+    if ( ( 0 < win->queued ) && ( ( now - win->lastQueue ) > win->maxInterval ) ) {
+        win->maxInterval = now - win->lastQueue;
+    }
+    win->lastQueue = now;
+    win->queued++;
+
+    // A display keeps scanning out the front buffer until the next one
+    // replaces it
+    if ( NULL != win->front ) {
+        win->available.push_back(win->front);
+        win->freed.signal();
+    }
+    win->front = buffer;
+
+    return 0;
+}
+
+static int windowCancel(preview_stream_ops *w, buffer_handle_t *buffer)
+{
+    BenchWindow *win = toWindow(w);
+    android::AutoMutex lock(win->lock);
+
+    win->cancelled++;
+    win->available.push_back(buffer);
+    win->freed.signal();
+
+    return 0;
+}
+
+static int windowSetBufferCount(preview_stream_ops *w, int count)
+{
+    BenchWindow *win = toWindow(w);
+    android::AutoMutex lock(win->lock);
+
+    if ( MAX_WINDOW_BUFFERS < count ) {
+        return -EINVAL;
+    }
+
+    win->count = count;
+
+    return allocWindowBuffers(win);
+}
+
+static int windowSetGeometry(preview_stream_ops *w, int width, int height, int format)
+{
+    BenchWindow *win = toWindow(w);
+    android::AutoMutex lock(win->lock);
+
+    win->width = width;
+    win->height = height;
+    win->format = format;
+
+    return allocWindowBuffers(win);
+}
+
+static int windowSetCrop(preview_stream_ops *w, int left, int top, int right, int bottom)
+{
+    return 0;
+}
+
+static int windowSetUsage(preview_stream_ops *w, int usage)
+{
+    BenchWindow *win = toWindow(w);
+    android::AutoMutex lock(win->lock);
+
+    win->usage = usage;
+
+    return 0;
+}
+
+static int windowSetSwapInterval(preview_stream_ops *w, int interval)
+{
+    return 0;
+}
+
+static int windowGetMinUndequeued(preview_stream_ops *w, int *count)
+{
+    // the front buffer
+    *count = 1;
+    return 0;
+}
+
+static int windowLock(preview_stream_ops *w, buffer_handle_t *buffer)
+{
+    return 0;
+}
+
+static int windowSetTimestamp(preview_stream_ops *w, int64_t timestamp)
+{
+    return 0;
+}
+
+static void initWindow(BenchWindow *win)
+{
+    memset(&win->ops, 0, sizeof(win->ops));
+    win->ops.dequeue_buffer = windowDequeue;
+    win->ops.enqueue_buffer = windowEnqueue;
+    win->ops.cancel_buffer = windowCancel;
+    win->ops.set_buffer_count = windowSetBufferCount;
+    win->ops.set_buffers_geometry = windowSetGeometry;
+    win->ops.set_crop = windowSetCrop;
+    win->ops.set_usage = windowSetUsage;
+    win->ops.set_swap_interval = windowSetSwapInterval;
+    win->ops.get_min_undequeued_buffer_count = windowGetMinUndequeued;
+    win->ops.lock_buffer = windowLock;
+    win->ops.set_timestamp = windowSetTimestamp;
+
+    win->width = 0;
+    win->height = 0;
+    win->format = 0;
+    win->usage = 0;
+    win->count = 0;
+    win->stride = 0;
+    memset(win->handles, 0, sizeof(win->handles));
+    win->front = NULL;
+}
+
+static void resetWindowStats(BenchWindow *win)
+{
+    android::AutoMutex lock(win->lock);
+
+    win->queued = 0;
+    win->cancelled = 0;
+    win->lastQueue = 0;
+    win->maxInterval = 0;
+}
+
+/*--------------------Stub memory and callbacks---------------------------------*/
+
+struct BenchMemory {
+    camera_memory_t mem;
+    size_t bufferSize;
+    bool mapped;
+};
+
+static void releaseMemory(camera_memory_t *mem)
+{
+    BenchMemory *memory = reinterpret_cast<BenchMemory *>(mem);
+
+    if ( memory->mapped ) {
+        munmap(mem->data, mem->size);
+    } else {
+        free(mem->data);
+    }
+
+    delete memory;
+}
+
+static camera_memory_t *requestMemory(int fd, size_t bufferSize, unsigned int count, void *user)
+{
+    BenchMemory *memory = new BenchMemory;
+
+    memory->mem.size = bufferSize * count;
+    memory->mem.handle = NULL;
+    memory->mem.release = releaseMemory;
+    memory->bufferSize = bufferSize;
+    memory->mapped = ( 0 <= fd );
+
+    if ( memory->mapped ) {
+        memory->mem.data = mmap(NULL, memory->mem.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if ( MAP_FAILED == memory->mem.data ) {
+            delete memory;
+            return NULL;
+        }
+    } else {
+        memory->mem.data = malloc(memory->mem.size);
+        if ( NULL == memory->mem.data ) {
+            delete memory;
+            return NULL;
+        }
+    }
+
+    return &memory->mem;
+}
+
+struct Latency {
+    uint32_t count;
+    nsecs_t sum;
+    nsecs_t max;
+};
+
+static void addLatency(Latency &latency, nsecs_t value)
+{
+    latency.count++;
+    latency.sum += value;
+    if ( value > latency.max ) {
+        latency.max = value;
+    }
+}
+
+static void printLatency(const char *name, const Latency &latency)
+{
+    if ( 0 == latency.count ) {
+        return;
+    }
+
+    printf("    %-20s n %u, avg %.2f ms, max %.2f ms\n", name, latency.count,
+           ns2us(latency.sum / latency.count) / 1000.0, ns2us(latency.max) / 1000.0);
+}
+
+struct Bench {
+    camera_device_t *device;
+    BenchWindow window;
+
+    android::Mutex lock;
+    android::Condition pictureDone;
+
+    uint32_t previewCallbacks;
+    uint32_t videoFrames;
+    uint32_t shutters;
+    uint32_t pictures;
+    size_t pictureBytes;
+    nsecs_t captureStart;
+    nsecs_t lastShutter;
+    Latency videoLatency;
+    Latency shutterLatency;
+    Latency pictureLatency;
+    Latency shotInterval;
+    nsecs_t lastPicture;
+};
+
+static void notifyCallback(int32_t msgType, int32_t ext1, int32_t ext2, void *user)
+{
+    Bench *bench = static_cast<Bench *>(user);
+    android::AutoMutex lock(bench->lock);
+
+    if ( CAMERA_MSG_SHUTTER == msgType ) {
+        nsecs_t now = systemTime();
+        addLatency(bench->shutterLatency, now - bench->captureStart);
+        bench->lastShutter = now;
+        bench->shutters++;
+    } else if ( CAMERA_MSG_ERROR == msgType ) {
+        printf("Camera error %d\n", ext1);
+    }
+}
+
+static void dataCallback(int32_t msgType, const camera_memory_t *data, unsigned int index,
+                         camera_frame_metadata_t *metadata, void *user)
+{
+    Bench *bench = static_cast<Bench *>(user);
+    android::AutoMutex lock(bench->lock);
+
+    if ( CAMERA_MSG_PREVIEW_FRAME == msgType ) {
+        bench->previewCallbacks++;
+    } else if ( CAMERA_MSG_COMPRESSED_IMAGE == msgType ) {
+        nsecs_t now = systemTime();
+        addLatency(bench->pictureLatency, now - bench->lastShutter);
+        if ( 0 != bench->lastPicture ) {
+            addLatency(bench->shotInterval, now - bench->lastPicture);
+        }
+        bench->lastPicture = now;
+        bench->pictureBytes += ( NULL != data ) ? data->size : 0;
+        bench->pictures++;
+        bench->pictureDone.signal();
+    }
+}
+
+static void dataTimestampCallback(int64_t timestamp, int32_t msgType, const camera_memory_t *data,
+                                  unsigned int index, void *user)
+{
+    Bench *bench = static_cast<Bench *>(user);
+    const BenchMemory *memory = reinterpret_cast<const BenchMemory *>(data);
+
+    {
+        android::AutoMutex lock(bench->lock);
+        addLatency(bench->videoLatency, systemTime() - timestamp);
+        bench->videoFrames++;
+    }
+
+    // Nothing encodes the frames, they go back right away
+    bench->device->ops->release_recording_frame(bench->device,
+            static_cast<uint8_t *>(data->data) + index * memory->bufferSize);
+}
+
+static void resetStats(Bench *bench)
+{
+    android::AutoMutex lock(bench->lock);
+
+    bench->previewCallbacks = 0;
+    bench->videoFrames = 0;
+    bench->shutters = 0;
+    bench->pictures = 0;
+    bench->pictureBytes = 0;
+    bench->captureStart = 0;
+    bench->lastShutter = 0;
+    bench->lastPicture = 0;
+    memset(&bench->videoLatency, 0, sizeof(Latency));
+    memset(&bench->shutterLatency, 0, sizeof(Latency));
+    memset(&bench->pictureLatency, 0, sizeof(Latency));
+    memset(&bench->shotInterval, 0, sizeof(Latency));
+
+    resetWindowStats(&bench->window);
+}
+
+/*--------------------Scenarios---------------------------------*/
+
+struct Options {
+    int camera;
+    int previewWidth;
+    int previewHeight;
+    int pictureWidth;
+    int pictureHeight;
+    int fps;
+    int seconds;
+    int shots;
+    int burst;
+};
+
+static nsecs_t cpuTime()
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return s2ns(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           us2ns(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+static int setParameters(Bench *bench, const Options &options, int burst)
+{
+    camera_device_t *device = bench->device;
+    char *flat = device->ops->get_parameters(device);
+    android::CameraParameters params;
+    char range[32];
+    int ret;
+
+    params.unflatten(android::String8(flat));
+    if ( NULL != device->ops->put_parameters ) {
+        device->ops->put_parameters(device, flat);
+    } else {
+        free(flat);
+    }
+
+    snprintf(range, sizeof(range), "%d,%d", options.fps * 1000, options.fps * 1000);
+
+    params.setPreviewSize(options.previewWidth, options.previewHeight);
+    params.setPictureSize(options.pictureWidth, options.pictureHeight);
+    params.setPreviewFrameRate(options.fps);
+    params.set(android::CameraParameters::KEY_PREVIEW_FPS_RANGE, range);
+    params.set("burst-capture", burst);
+
+    ret = device->ops->set_parameters(device, params.flatten().string());
+    if ( 0 != ret ) {
+        printf("set_parameters failed: %d\n", ret);
+    }
+
+    return ret;
+}
+
+static void report(Bench *bench, const char *scenario, uint32_t frames, nsecs_t elapsed, nsecs_t cpu)
+{
+    printf("%s:\n", scenario);
+    printf("    %u frames in %.2f s, %.2f fps\n", frames,
+           ns2ms(elapsed) / 1000.0, ( 0 < elapsed ) ? frames * 1e9 / elapsed : 0.0);
+    printf("    cpu %.2f ms total, %.3f ms per frame, %.1f%% of one core\n",
+           ns2us(cpu) / 1000.0, ( 0 < frames ) ? ns2us(cpu) / 1000.0 / frames : 0.0,
+           ( 0 < elapsed ) ? 100.0 * cpu / elapsed : 0.0);
+
+    {
+        android::AutoMutex lock(bench->window.lock);
+        printf("    display %u queued, %u cancelled, max interval %.2f ms\n",
+               bench->window.queued, bench->window.cancelled,
+               ns2us(bench->window.maxInterval) / 1000.0);
+    }
+
+    android::AutoMutex lock(bench->lock);
+
+    if ( 0 < bench->previewCallbacks ) {
+        printf("    %u preview callbacks\n", bench->previewCallbacks);
+    }
+    if ( 0 < bench->pictures ) {
+        printf("    %u pictures, %u bytes avg\n", bench->pictures,
+               ( unsigned int ) ( bench->pictureBytes / bench->pictures ));
+    }
+    printLatency("sensor to recorder", bench->videoLatency);
+    printLatency("shutter", bench->shutterLatency);
+    printLatency("shutter to jpeg", bench->pictureLatency);
+    printLatency("shot to shot", bench->shotInterval);
+}
+
+static void dumpTrace(Bench *bench)
+{
+    // the HAL writes its frame trace histograms along with the rest
+    fflush(stdout);
+    bench->device->ops->dump(bench->device, STDOUT_FILENO);
+}
+
+static int startPreview(Bench *bench, const Options &options, int burst)
+{
+    camera_device_t *device = bench->device;
+    int ret;
+
+    ret = setParameters(bench, options, burst);
+    if ( 0 != ret ) {
+        return ret;
+    }
+
+    property_set("camera.trace", "1");
+
+    ret = device->ops->set_preview_window(device, &bench->window.ops);
+    if ( 0 == ret ) {
+        ret = device->ops->start_preview(device);
+    }
+    if ( 0 != ret ) {
+        printf("start_preview failed: %d\n", ret);
+    }
+
+    return ret;
+}
+
+static void stopPreview(Bench *bench)
+{
+    bench->device->ops->stop_preview(bench->device);
+    property_set("camera.trace", "0");
+}
+
+static int runStreaming(Bench *bench, const Options &options, bool recording)
+{
+    camera_device_t *device = bench->device;
+    nsecs_t start, cpu;
+    uint32_t frames;
+    int ret;
+
+    ret = startPreview(bench, options, 0);
+    if ( 0 != ret ) {
+        return ret;
+    }
+
+    if ( recording ) {
+        device->ops->enable_msg_type(device, CAMERA_MSG_VIDEO_FRAME);
+        ret = device->ops->start_recording(device);
+        if ( 0 != ret ) {
+            printf("start_recording failed: %d\n", ret);
+            stopPreview(bench);
+            return ret;
+        }
+    } else {
+        device->ops->enable_msg_type(device, CAMERA_MSG_PREVIEW_FRAME);
+    }
+
+    // let the pipeline fill up before measuring
+    sleep(1);
+    resetStats(bench);
+
+    start = systemTime();
+    cpu = cpuTime();
+    sleep(options.seconds);
+    cpu = cpuTime() - cpu;
+
+    {
+        android::AutoMutex lock(bench->lock);
+        frames = recording ? bench->videoFrames : bench->window.queued;
+    }
+    report(bench, recording ? "recording" : "preview", frames, systemTime() - start, cpu);
+    dumpTrace(bench);
+
+    if ( recording ) {
+        device->ops->stop_recording(device);
+        device->ops->disable_msg_type(device, CAMERA_MSG_VIDEO_FRAME);
+    } else {
+        device->ops->disable_msg_type(device, CAMERA_MSG_PREVIEW_FRAME);
+    }
+
+    stopPreview(bench);
+
+    return 0;
+}
+
+static int runCapture(Bench *bench, const Options &options, int shots, int burst)
+{
+    camera_device_t *device = bench->device;
+    nsecs_t start, cpu;
+    uint32_t pictures = 0;
+    int ret;
+
+    ret = startPreview(bench, options, burst);
+    if ( 0 != ret ) {
+        return ret;
+    }
+
+    device->ops->enable_msg_type(device, CAMERA_MSG_SHUTTER | CAMERA_MSG_COMPRESSED_IMAGE);
+
+    sleep(1);
+    resetStats(bench);
+
+    start = systemTime();
+    cpu = cpuTime();
+
+    for ( int i = 0; ( i < shots ) && ( 0 == ret ); i++ ) {
+        const uint32_t expected = ( i + 1 ) * ( ( 0 < burst ) ? burst : 1 );
+
+        {
+            android::AutoMutex lock(bench->lock);
+            bench->captureStart = systemTime();
+            bench->lastShutter = bench->captureStart;
+            bench->lastPicture = 0;
+        }
+
+        ret = device->ops->take_picture(device);
+        if ( 0 != ret ) {
+            printf("take_picture failed: %d\n", ret);
+            break;
+        }
+
+        android::AutoMutex lock(bench->lock);
+        while ( bench->pictures < expected ) {
+            if ( 0 != bench->pictureDone.waitRelative(bench->lock, PICTURE_TIMEOUT) ) {
+                printf("Timed out waiting for picture %u\n", bench->pictures + 1);
+                ret = -ETIMEDOUT;
+                break;
+            }
+        }
+        pictures = bench->pictures;
+
+        // the application restarts preview after each picture
+        if ( ( 0 == ret ) && ( i + 1 < shots ) ) {
+            bench->lock.unlock();
+            ret = device->ops->start_preview(device);
+            bench->lock.lock();
+        }
+    }
+
+    cpu = cpuTime() - cpu;
+
+    report(bench, ( 0 < burst ) ? "burst" : "capture", pictures, systemTime() - start, cpu);
+    dumpTrace(bench);
+
+    device->ops->disable_msg_type(device, CAMERA_MSG_SHUTTER | CAMERA_MSG_COMPRESSED_IMAGE);
+    stopPreview(bench);
+
+    return ret;
+}
+
+/*--------------------Main---------------------------------*/
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [options] [preview] [record] [capture] [burst]\n"
+           "    -c <id>    camera, defaults to the last one\n"
+           "    -s <WxH>   preview size, 640x480\n"
+           "    -p <WxH>   picture size, 2592x1944\n"
+           "    -f <fps>   preview frame rate, 30\n"
+           "    -d <s>     seconds of preview and recording, 10\n"
+           "    -n <n>     pictures, or bursts, to take, 5\n"
+           "    -b <n>     pictures per burst, 10\n"
+           "Scenarios all run when none is given.\n", name);
+}
+
+static const char * const kAllScenarios[] = { "preview", "record", "capture", "burst" };
+
+static bool parseSize(const char *str, int &width, int &height)
+{
+    return 2 == sscanf(str, "%dx%d", &width, &height);
+}
+
+int main(int argc, char **argv)
+{
+    Options options = { -1, 640, 480, 2592, 1944, 30, 10, 5, 10 };
+    const camera_module_t *module = NULL;
+    hw_device_t *device = NULL;
+    Bench bench;
+    char id[8];
+    int opt;
+    int ret;
+
+    while ( -1 != ( opt = getopt(argc, argv, "c:s:p:f:d:n:b:h") ) ) {
+        switch ( opt ) {
+            case 'c': options.camera = atoi(optarg); break;
+            case 's':
+                if ( !parseSize(optarg, options.previewWidth, options.previewHeight) ) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'p':
+                if ( !parseSize(optarg, options.pictureWidth, options.pictureHeight) ) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'f': options.fps = atoi(optarg); break;
+            case 'd': options.seconds = atoi(optarg); break;
+            case 'n': options.shots = atoi(optarg); break;
+            case 'b': options.burst = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    ret = hw_get_module(CAMERA_HARDWARE_MODULE_ID, (const hw_module_t **) &module);
+    if ( 0 != ret ) {
+        printf("Couldn't load the camera HAL: %d\n", ret);
+        return 1;
+    }
+
+    if ( 0 > options.camera ) {
+        options.camera = module->get_number_of_cameras() - 1;
+    }
+
+    snprintf(id, sizeof(id), "%d", options.camera);
+    ret = module->common.methods->open(&module->common, id, &device);
+    if ( 0 != ret ) {
+        printf("Couldn't open camera %s: %d\n", id, ret);
+        return 1;
+    }
+
+    bench.device = reinterpret_cast<camera_device_t *>(device);
+    initWindow(&bench.window);
+    resetStats(&bench);
+
+    bench.device->ops->set_callbacks(bench.device, notifyCallback, dataCallback,
+                                     dataTimestampCallback, requestMemory, &bench);
+
+    printf("camera %d, preview %dx%d at %d fps, picture %dx%d\n", options.camera,
+           options.previewWidth, options.previewHeight, options.fps,
+           options.pictureWidth, options.pictureHeight);
+
+    const char * const *scenarios = kAllScenarios;
+    int scenarioCount = sizeof(kAllScenarios) / sizeof(kAllScenarios[0]);
+    if ( optind < argc ) {
+        scenarios = argv + optind;
+        scenarioCount = argc - optind;
+    }
+
+    for ( int i = 0; i < scenarioCount; i++ ) {
+        const char *scenario = scenarios[i];
+
+        if ( 0 == strcmp(scenario, "preview") ) {
+            ret = runStreaming(&bench, options, false);
+        } else if ( 0 == strcmp(scenario, "record") ) {
+            ret = runStreaming(&bench, options, true);
+        } else if ( 0 == strcmp(scenario, "capture") ) {
+            ret = runCapture(&bench, options, options.shots, 0);
+        } else if ( 0 == strcmp(scenario, "burst") ) {
+            ret = runCapture(&bench, options, options.shots, options.burst);
+        } else {
+            printf("Unknown scenario %s\n", scenario);
+            ret = -EINVAL;
+        }
+
+        if ( 0 != ret ) {
+            break;
+        }
+    }
+
+    bench.device->ops->release(bench.device);
+    device->close(device);
+
+    {
+        android::AutoMutex lock(bench.window.lock);
+        freeWindowBuffers(&bench.window);
+    }
+
+    return ( 0 == ret ) ? 0 : 1;
+}
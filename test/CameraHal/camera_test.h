@@ -152,6 +152,8 @@ typedef struct cmd_args {
     const char *output_path;
     int platform_id;
     int logging;
+    bool perf_mode;
+    const char *perf_thresholds;
 } cmd_args_t;
 
 namespace android {
@@ -267,6 +269,14 @@ char *load_script(const char *config);
 int start_logging(int flags, int &pid);
 int stop_logging(int flags, int &pid);
 int execute_error_script(char *script);
+int perf_init(const char *script, const char *thresholds);
+bool perf_enabled();
+void perf_step(const char *cmd);
+void perf_capture_start();
+void perf_preview_frame();
+void perf_shutter();
+bool perf_jpeg();
+int perf_report(const char *dir);
 int getParametersFromCapabilities();
 void  getSizeParametersFromCapabilities();
 int getDefaultParameter(const char* val, int numOptions, char **array);
@@ -858,8 +858,10 @@ void CameraHandler::notify(int32_t msgType, int32_t ext1, int32_t ext2) {
     if ( msgType & CAMERA_MSG_FOCUS )
         printf("AutoFocus %s in %llu us\n", (ext1) ? "OK" : "FAIL", timeval_delay(&autofocus_start));
 
-    if ( msgType & CAMERA_MSG_SHUTTER )
+    if ( msgType & CAMERA_MSG_SHUTTER ) {
         printf("Shutter done in %llu us\n", timeval_delay(&picture_start));
+        perf_shutter();
+    }
     if ( msgType  == 1) {
         printf("Camera Test CAMERA_MSG_ERROR.....\n");
         if (stressTest)
@@ -889,8 +891,10 @@ void CameraHandler::postData(int32_t msgType,
     int32_t msgMask;
     printf("Data cb: %d\n", msgType);
 
-    if ( msgType & CAMERA_MSG_PREVIEW_FRAME )
+    if ( msgType & CAMERA_MSG_PREVIEW_FRAME ) {
+        perf_preview_frame();
         my_preview_callback(dataPtr);
+    }
 
     msgMask = CAMERA_MSG_RAW_IMAGE;
 #ifdef OMAP_ENHANCEMENT_BURST_CAPTURE
@@ -907,6 +911,10 @@ void CameraHandler::postData(int32_t msgType,
 
     if (msgType & CAMERA_MSG_COMPRESSED_IMAGE ) {
         printf("JPEG done in %llu us\n", timeval_delay(&picture_start));
+        // a single preview callback marks the end of the shot
+        if (perf_jpeg() && (camera != NULL)) {
+            camera->setPreviewCallbackFlags(CAMERA_FRAME_CALLBACK_FLAG_ONE_SHOT_MASK);
+        }
         my_jpeg_callback(dataPtr);
     }
 
@@ -3804,6 +3812,13 @@ void print_usage() {
     printf(" -e [<script>] -> Error scenario tests. If no script file is provided\n");
     printf("                  the test is run in interactive mode.\n");
     printf(" -s <script> -c <sensorID>  -> Stress / regression tests.\n");
+    printf(" -m [<thresholds>] -> Performance mode for stress / regression tests, needs -s.\n");
+    printf("                  Preview fps, shot-to-shot time, shutter lag and JPEG latency\n");
+    printf("                  are checked per script step against the thresholds, by\n");
+    printf("                  default <script>.perf. Preview fps is read from the display\n");
+    printf("                  counters of 'dumpsys media.camera'. The report is saved as\n");
+    printf("                  perf_report.json in the output directory and missed\n");
+    printf("                  thresholds fail the test.\n");
     printf(" -l [<flags>]  -> Enable different kinds of logging capture. Multiple flags\n");
     printf("                  should be combined into a string. If flags are not provided\n");
     printf("                  no logs are captured.\n");
@@ -4082,6 +4097,13 @@ int parseCommandLine(int argc, char *argv[], cmd_args_t *cmd_args) {
                 cmd_args->test_type = TEST_TYPE_FUNCTIONAL;
                 break;
 
+            case 'm':
+                cmd_args->perf_mode = true;
+                if (a < argc - 1 && argv[a + 1][0] != '-') {
+                    cmd_args->perf_thresholds = argv[++a];
+                }
+                break;
+
             case 'a':
                 cmd_args->test_type = TEST_TYPE_API;
                 break;
@@ -4163,6 +4185,11 @@ int parseCommandLine(int argc, char *argv[], cmd_args_t *cmd_args) {
         }
     }
 
+    if (cmd_args->perf_mode && (cmd_args->test_type != TEST_TYPE_REGRESSION)) {
+        printf("Error: Performance mode needs a stress / regression script (-s).\n");
+        return -2;
+    }
+
     return 0;
 }
 
@@ -4261,6 +4288,11 @@ int runRegressionTest(cmd_args_t *cmd_args) {
 
     platformID = cmd_args->platform_id;
 
+    if (cmd_args->perf_mode &&
+        (perf_init(cmd_args->script_file_name, cmd_args->perf_thresholds) != 0)) {
+        return -2;
+    }
+
     res = startTest();
     if (res != 0) {
         return res;
@@ -4298,12 +4330,24 @@ int runRegressionTest(cmd_args_t *cmd_args) {
             if (res != 0) {
                 break;
             }
+
+            // steps are counted again from the start of the script
+            if (cmd_args->perf_mode &&
+                (perf_init(cmd_args->script_file_name, cmd_args->perf_thresholds) != 0)) {
+                res = -2;
+                break;
+            }
         }
 
         free(cmd);
         stop_logging(cmd_args->logging, pid);
     }
 
+    // a script which ran through fails on missed thresholds
+    if (res == 0) {
+        res = perf_report(output_dir_path);
+    }
+
     return res;
 }
 
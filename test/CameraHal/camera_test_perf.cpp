@@ -0,0 +1,522 @@
+/*
+ * Performance mode of the stress / regression scripts.
+ *
+ * While a script runs, every command is a step and these figures are
+ * collected per step:
+ *
+ *   preview_fps   - preview frames per second displayed during the step
+ *   shutter_lag   - ms from the picture request to the shutter callback
+ *   jpeg_latency  - ms from the picture request to each JPEG callback,
+ *                   the worst one of the step is kept
+ *   shot_to_shot  - ms from the picture request to the first preview frame
+ *                   after the last JPEG, i.e. until the next shot can be taken
+ *
+ * Preview fps is not counted on preview callbacks, copying every frame to the
+ * application would change the figure being measured. The HAL side count of
+ * frames displayed is read from "dumpsys media.camera" when each step starts
+ * and ends instead. A step during which the display adapter was recreated has
+ * no preview fps. Shot to shot only asks for a one shot preview callback once
+ * a JPEG arrived.
+ *
+ * Capture figures belong to the step which requested the picture ('p' or
+ * 'P'), even if the callbacks arrive while a later step runs.
+ *
+ * Thresholds are read from a file next to the script, "<script>.perf" with
+ * the ".txt" part of the script name dropped. One threshold per line:
+ *
+ *   # <step> <figure> <min|max> <value>
+ *   *   preview_fps   min 28
+ *   12  shutter_lag   max 150
+ *   12  shot_to_shot  max 900
+ *
+ * Steps are numbered from 1 in the order the commands are executed, cycles
+ * included. A "*" threshold applies to every step which has the figure and
+ * fails when no step has it; a threshold for a numbered step also fails when
+ * the figure wasn't measured.
+ * Preview fps needs at least PERF_MIN_FPS_FRAMES frames within the step.
+ *
+ * The report goes to perf_report.json in the output directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <camera/Camera.h>
+#include <camera/CameraParameters.h>
+#include <camera/ShotParameters.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include "camera_test.h"
+
+using namespace android;
+
+#define PERF_MIN_FPS_FRAMES 10
+#define PERF_COMMAND_LENGTH 32
+#define PERF_REPORT_FILE "perf_report.json"
+#define PERF_DUMP_COMMAND "dumpsys media.camera"
+#define PERF_DUMP_DISPLAY "ANativeWindowDisplayAdapter:"
+
+enum perf_figure_t {
+    PERF_PREVIEW_FPS = 0,
+    PERF_SHUTTER_LAG,
+    PERF_JPEG_LATENCY,
+    PERF_SHOT_TO_SHOT,
+    PERF_FIGURE_COUNT
+};
+
+static const char *perfFigureNames[PERF_FIGURE_COUNT] = {
+    "preview_fps",
+    "shutter_lag",
+    "jpeg_latency",
+    "shot_to_shot",
+};
+
+struct perf_step_t {
+    int index;
+    char command[PERF_COMMAND_LENGTH];
+
+    // display counter when the step started, -1 if it couldn't be read
+    int startFrames;
+    nsecs_t start;
+    // frames displayed within the step, -1 if not measured
+    int frames;
+    nsecs_t duration;
+
+    // capture figures in ns, valid when the bit of the figure is set
+    unsigned int measured;
+    nsecs_t value[PERF_FIGURE_COUNT];
+};
+
+struct perf_threshold_t {
+    int step;       // -1 for every step
+    int figure;
+    bool min;
+    double limit;
+};
+
+static Mutex perfLock;
+static bool perfEnabled = false;
+static char perfScript[256];
+static Vector<perf_step_t> perfSteps;
+static Vector<perf_threshold_t> perfThresholds;
+
+// step which requested the picture being taken, -1 if none
+static ssize_t perfCaptureStep = -1;
+static nsecs_t perfCaptureStart = 0;
+static bool perfShutterSeen = false;
+static bool perfWaitPreview = false;
+
+// frames displayed so far, -1 if the HAL didn't report them
+static int perf_display_frames() {
+    char line[256];
+    bool display = false;
+    int frames = -1;
+    FILE *dump;
+
+    dump = popen(PERF_DUMP_COMMAND, "r");
+    if (NULL == dump) {
+        return -1;
+    }
+
+    while (NULL != fgets(line, sizeof(line), dump)) {
+        const char *displayed;
+
+        if (NULL != strstr(line, PERF_DUMP_DISPLAY)) {
+            display = true;
+            continue;
+        }
+
+        displayed = strstr(line, "displayed ");
+        if (display && (NULL != displayed) && (1 == sscanf(displayed, "displayed %d", &frames))) {
+            display = false;
+        }
+    }
+
+    pclose(dump);
+
+    return frames;
+}
+
+static void perf_step_end(perf_step_t &step, nsecs_t now, int frames) {
+    // the counter restarts with the display
+    if ((0 > step.startFrames) || (step.startFrames > frames)) {
+        step.frames = -1;
+        return;
+    }
+
+    step.frames = frames - step.startFrames;
+    step.duration = now - step.start;
+}
+
+static int perf_figure(const char *name) {
+    for (int i = 0; i < PERF_FIGURE_COUNT; i++) {
+        if (strcmp(name, perfFigureNames[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int perf_load_thresholds(const char *path) {
+    FILE *file;
+    char line[256];
+    int lineNumber = 0;
+
+    file = fopen(path, "r");
+    if (NULL == file) {
+        printf("No performance thresholds at %s, figures are only reported\n", path);
+        return 0;
+    }
+
+    while (NULL != fgets(line, sizeof(line), file)) {
+        char step[16], figure[32], bound[8];
+        perf_threshold_t threshold;
+        char *p = line;
+
+        lineNumber++;
+
+        while (isspace(*p)) {
+            p++;
+        }
+        if (('#' == *p) || ('\0' == *p)) {
+            continue;
+        }
+
+        if (4 != sscanf(p, "%15s %31s %7s %lf", step, figure, bound, &threshold.limit)) {
+            printf("%s:%d: expected <step> <figure> <min|max> <value>\n", path, lineNumber);
+            fclose(file);
+            return -1;
+        }
+
+        threshold.step = (strcmp(step, "*") == 0) ? -1 : atoi(step);
+        threshold.figure = perf_figure(figure);
+        threshold.min = (strcmp(bound, "min") == 0);
+
+        if ((0 == threshold.step) || (0 > threshold.figure) ||
+            (!threshold.min && (strcmp(bound, "max") != 0))) {
+            printf("%s:%d: invalid threshold\n", path, lineNumber);
+            fclose(file);
+            return -1;
+        }
+
+        perfThresholds.add(threshold);
+    }
+
+    fclose(file);
+
+    printf("Loaded %d performance thresholds from %s\n", (int) perfThresholds.size(), path);
+
+    return 0;
+}
+
+int perf_init(const char *script, const char *thresholds) {
+    char path[256];
+
+    Mutex::Autolock lock(perfLock);
+
+    strncpy(perfScript, script, sizeof(perfScript) - 1);
+    perfScript[sizeof(perfScript) - 1] = '\0';
+    perfSteps.clear();
+    perfThresholds.clear();
+    perfCaptureStep = -1;
+    perfWaitPreview = false;
+
+    if (NULL == thresholds) {
+        // thresholds are kept next to the script
+        const char *ext = strrchr(script, '.');
+        const char *dir = strrchr(script, '/');
+        size_t length = strlen(script);
+
+        if ((NULL != ext) && ((NULL == dir) || (ext > dir))) {
+            length = ext - script;
+        }
+
+        if ((length + sizeof(".perf")) > sizeof(path)) {
+            printf("Script name %s is too long\n", script);
+            return -1;
+        }
+
+        memcpy(path, script, length);
+        strcpy(path + length, ".perf");
+        thresholds = path;
+    }
+
+    if (perf_load_thresholds(thresholds) < 0) {
+        return -1;
+    }
+
+    perfEnabled = true;
+
+    return 0;
+}
+
+bool perf_enabled() {
+    return perfEnabled;
+}
+
+void perf_step(const char *cmd) {
+    perf_step_t step;
+    nsecs_t now;
+    int frames;
+
+    if (!perfEnabled) {
+        return;
+    }
+
+    // the dump is read outside the lock, callbacks keep coming meanwhile
+    frames = perf_display_frames();
+    now = systemTime();
+
+    Mutex::Autolock lock(perfLock);
+
+    if (!perfSteps.isEmpty()) {
+        perf_step_end(perfSteps.editTop(), now, frames);
+    }
+
+    memset(&step, 0, sizeof(step));
+    step.index = perfSteps.size() + 1;
+    strncpy(step.command, cmd, sizeof(step.command) - 1);
+    step.startFrames = frames;
+    step.start = now;
+    step.frames = -1;
+
+    perfSteps.add(step);
+}
+
+void perf_capture_start() {
+    if (!perfEnabled) {
+        return;
+    }
+
+    Mutex::Autolock lock(perfLock);
+
+    if (perfSteps.isEmpty()) {
+        return;
+    }
+
+    perfCaptureStep = perfSteps.size() - 1;
+    perfCaptureStart = systemTime();
+    perfShutterSeen = false;
+    perfWaitPreview = false;
+}
+
+void perf_preview_frame() {
+    if (!perfEnabled) {
+        return;
+    }
+
+    Mutex::Autolock lock(perfLock);
+    nsecs_t now = systemTime();
+
+    if (perfWaitPreview && (0 <= perfCaptureStep)) {
+        perf_step_t &capture = perfSteps.editItemAt(perfCaptureStep);
+        capture.value[PERF_SHOT_TO_SHOT] = now - perfCaptureStart;
+        capture.measured |= 1 << PERF_SHOT_TO_SHOT;
+        perfWaitPreview = false;
+    }
+}
+
+void perf_shutter() {
+    if (!perfEnabled) {
+        return;
+    }
+
+    Mutex::Autolock lock(perfLock);
+
+    // bursts send a shutter per frame, the lag is the one of the first
+    if ((0 > perfCaptureStep) || perfShutterSeen) {
+        return;
+    }
+
+    perf_step_t &capture = perfSteps.editItemAt(perfCaptureStep);
+    capture.value[PERF_SHUTTER_LAG] = systemTime() - perfCaptureStart;
+    capture.measured |= 1 << PERF_SHUTTER_LAG;
+    perfShutterSeen = true;
+}
+
+bool perf_jpeg() {
+    if (!perfEnabled) {
+        return false;
+    }
+
+    Mutex::Autolock lock(perfLock);
+
+    if (0 > perfCaptureStep) {
+        return false;
+    }
+
+    perf_step_t &capture = perfSteps.editItemAt(perfCaptureStep);
+    nsecs_t latency = systemTime() - perfCaptureStart;
+
+    if (!(capture.measured & (1 << PERF_JPEG_LATENCY)) ||
+        (latency > capture.value[PERF_JPEG_LATENCY])) {
+        capture.value[PERF_JPEG_LATENCY] = latency;
+    }
+    capture.measured |= 1 << PERF_JPEG_LATENCY;
+
+    // every JPEG of a burst moves the end of the shot
+    perfWaitPreview = true;
+
+    return true;
+}
+
+static bool perf_get(const perf_step_t &step, int figure, double &value) {
+    if (PERF_PREVIEW_FPS == figure) {
+        if ((PERF_MIN_FPS_FRAMES > step.frames) || (0 >= step.duration)) {
+            return false;
+        }
+        value = step.frames * (double) s2ns(1) / step.duration;
+        return true;
+    }
+
+    if (!(step.measured & (1 << figure))) {
+        return false;
+    }
+
+    value = step.value[figure] / (double) ms2ns(1);
+    return true;
+}
+
+static void perf_write_string(FILE *file, const char *str) {
+    fputc('"', file);
+    for (; '\0' != *str; str++) {
+        if (('"' == *str) || ('\\' == *str)) {
+            fputc('\\', file);
+        }
+        if (isprint(*str)) {
+            fputc(*str, file);
+        }
+    }
+    fputc('"', file);
+}
+
+int perf_report(const char *dir) {
+    char path[384];
+    FILE *file;
+    int failures = 0;
+    bool unmeasured = false;
+    nsecs_t now;
+    int frames;
+
+    if (!perfEnabled) {
+        return 0;
+    }
+
+    frames = perf_display_frames();
+    now = systemTime();
+
+    Mutex::Autolock lock(perfLock);
+
+    if (!perfSteps.isEmpty()) {
+        perf_step_end(perfSteps.editTop(), now, frames);
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", dir, PERF_REPORT_FILE);
+    file = fopen(path, "w");
+    if (NULL == file) {
+        printf("Unable to create %s\n", path);
+        return -1;
+    }
+
+    fprintf(file, "{\n  \"script\": ");
+    perf_write_string(file, perfScript);
+    fprintf(file, ",\n  \"steps\": [");
+
+    for (size_t i = 0; i < perfSteps.size(); i++) {
+        const perf_step_t &step = perfSteps.itemAt(i);
+        bool first = true;
+        double value;
+
+        fprintf(file, "%s\n    { \"step\": %d, \"command\": ", (0 == i) ? "" : ",", step.index);
+        perf_write_string(file, step.command);
+
+        for (int figure = 0; figure < PERF_FIGURE_COUNT; figure++) {
+            if (perf_get(step, figure, value)) {
+                fprintf(file, ", \"%s\": %.2f", perfFigureNames[figure], value);
+            }
+        }
+
+        fprintf(file, ", \"failures\": [");
+
+        for (size_t t = 0; t < perfThresholds.size(); t++) {
+            const perf_threshold_t &threshold = perfThresholds.itemAt(t);
+            bool measured;
+
+            if ((-1 != threshold.step) && (threshold.step != step.index)) {
+                continue;
+            }
+
+            measured = perf_get(step, threshold.figure, value);
+            if (!measured && (-1 == threshold.step)) {
+                continue;
+            }
+
+            if (measured && (threshold.min ? (value >= threshold.limit) : (value <= threshold.limit))) {
+                continue;
+            }
+
+            fprintf(file, "%s{ \"figure\": \"%s\", \"%s\": %.2f",
+                    first ? "" : ", ",
+                    perfFigureNames[threshold.figure],
+                    threshold.min ? "min" : "max",
+                    threshold.limit);
+            if (measured) {
+                fprintf(file, ", \"value\": %.2f }", value);
+                printf("PERF FAIL: step %d (%s) %s %.2f, %s %.2f\n",
+                       step.index, step.command, perfFigureNames[threshold.figure], value,
+                       threshold.min ? "min" : "max", threshold.limit);
+            } else {
+                fprintf(file, ", \"value\": null }");
+                printf("PERF FAIL: step %d (%s) %s not measured\n",
+                       step.index, step.command, perfFigureNames[threshold.figure]);
+            }
+
+            first = false;
+            failures++;
+        }
+
+        fprintf(file, "] }");
+    }
+
+    fprintf(file, "\n  ],\n  \"unmeasured\": [");
+
+    // thresholds of steps the script never got to, or of figures no step had
+    for (size_t t = 0; t < perfThresholds.size(); t++) {
+        const perf_threshold_t &threshold = perfThresholds.itemAt(t);
+        bool measured = false;
+        double value;
+
+        if (threshold.step > (int) perfSteps.size()) {
+            printf("PERF FAIL: step %d was never executed\n", threshold.step);
+            failures++;
+        }
+
+        if (-1 != threshold.step) {
+            continue;
+        }
+
+        for (size_t i = 0; !measured && (i < perfSteps.size()); i++) {
+            measured = perf_get(perfSteps.itemAt(i), threshold.figure, value);
+        }
+
+        if (!measured) {
+            fprintf(file, "%s\"%s\"", unmeasured ? ", " : "", perfFigureNames[threshold.figure]);
+            printf("PERF FAIL: %s was not measured in any step\n", perfFigureNames[threshold.figure]);
+            unmeasured = true;
+            failures++;
+        }
+    }
+
+    fprintf(file, "],\n  \"failures\": %d,\n  \"result\": \"%s\"\n}\n",
+            failures, (0 == failures) ? "pass" : "fail");
+    fclose(file);
+
+    printf("\nPerformance report saved @ location: %s\n", path);
+    printf("Performance result: %s, %d thresholds missed\n\n", (0 == failures) ? "PASS" : "FAIL", failures);
+
+    return (0 == failures) ? 0 : 1;
+}
@@ -243,6 +243,8 @@ int execute_functional_script(char *script) {
         printf("Full Command: %s \n", cmd);
         printf("Command: %c \n", cmd[0]);
 
+        perf_step(cmd);
+
         switch (id) {
 
             // Case for Suspend-Resume Feature
@@ -1244,6 +1246,7 @@ int execute_functional_script(char *script) {
                     }
 
                     gettimeofday(&picture_start, 0);
+                    perf_capture_start();
                     ret = camera->setParameters(params.flatten());
                     if ( ret != NO_ERROR ) {
                         printf("Error returned while setting parameters");
@@ -1284,6 +1287,7 @@ int execute_functional_script(char *script) {
                 ShotParameters reprocParams;
 
                 gettimeofday(&picture_start, 0);
+                perf_capture_start();
 
                 createBufferInputSource();
 
@@ -0,0 +1,28 @@
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    FormatConverterTest.cpp \
+    ../../camera/FormatConverter.cpp
+
+LOCAL_SHARED_LIBRARIES:= \
+    libutils \
+    libcutils \
+    liblog \
+    libcamera_client
+
+LOCAL_C_INCLUDES += \
+    $(HARDWARE_TI_OMAP4_BASE)/camera/inc \
+    $(HARDWARE_TI_OMAP4_BASE)/libtiutils
+
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2 $(ANDROID_API_CFLAGS)
+
+ifdef ARCH_ARM_HAVE_NEON
+    LOCAL_CFLAGS += -DARCH_ARM_HAVE_NEON
+endif
+
+LOCAL_MODULE:= format_converter_test
+LOCAL_MODULE_TAGS:= tests
+
+include $(BUILD_EXECUTABLE)
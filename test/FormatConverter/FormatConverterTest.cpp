@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file FormatConverterTest.cpp
+*
+* Checks the packed 4:2:2 to NV12 conversions of Ti::Camera::FormatConverter.
+* The scalar kernels are checked against the byte layout of YUYV and UYVY,
+* every other kernel set available on the CPU against the scalar kernels.
+*
+* Usage: format_converter_test
+*
+* Prints one line per failing case and exits with 1 if there was any.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FormatConverter.h"
+
+using Ti::Camera::FormatConverter;
+
+// row widths around the 16 and 32 pixel steps of the SIMD kernels
+static const int gWidths[] = { 1, 2, 15, 16, 17, 31, 32, 33, 63, 64, 65, 640 };
+// frame sizes, the last one is above the two band threshold of NV12Converter
+static const struct { int width; int height; } gFrames[] = {
+    { 18, 6 }, { 176, 144 }, { 640, 480 }, { 1920, 1080 },
+};
+static const size_t DST_PADDING = 64;
+
+static int gFailures = 0;
+
+static void fill(uint8_t *buf, size_t size, unsigned int seed)
+{
+    for ( size_t i = 0; i < size; i++ ) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (uint8_t) ( seed >> 16 );
+    }
+}
+
+static void fail(const char *kernels, const char *what, FormatConverter::Format format,
+                 int width, int height)
+{
+    printf("FAIL %-8s %-12s %s %dx%d\n", kernels, what,
+           ( FormatConverter::FORMAT_UYVY == format ) ? "uyvy" : "yuyv", width, height);
+    gFailures++;
+}
+
+/**
+ * Scalar row kernels against the packed layout: YUYV is Y0 U Y1 V,
+ * UYVY is U Y0 V Y1, NV12 chroma keeps the U V order
+ */
+static void checkScalarRows(FormatConverter::Format format)
+{
+    const FormatConverter::Kernels *k = FormatConverter::kernels(FormatConverter::KERNELS_SCALAR);
+    const int lumaOffset = ( FormatConverter::FORMAT_UYVY == format ) ? 1 : 0;
+
+    for ( size_t w = 0; w < sizeof(gWidths) / sizeof(gWidths[0]); w++ ) {
+        const int width = gWidths[w];
+        uint8_t *src = new uint8_t[width * 2];
+        uint8_t *y = new uint8_t[width];
+        uint8_t *uv = new uint8_t[width];
+        bool ok = true;
+
+        fill(src, width * 2, width);
+        if ( FormatConverter::FORMAT_UYVY == format ) {
+            k->unpackUYVY(y, uv, src, width);
+        } else {
+            k->unpackYUYV(y, uv, src, width);
+        }
+
+        for ( int i = 0; i < width; i++ ) {
+            if ( ( y[i] != src[i * 2 + lumaOffset] ) || ( uv[i] != src[i * 2 + 1 - lumaOffset] ) ) {
+                ok = false;
+            }
+        }
+
+        if ( !ok ) {
+            fail(k->name, "row layout", format, width, 1);
+        }
+
+        delete [] src;
+        delete [] y;
+        delete [] uv;
+    }
+}
+
+/**
+ * Row kernels of one set against the scalar ones, with and without chroma
+ */
+static void checkRows(const FormatConverter::Kernels *k, FormatConverter::Format format)
+{
+    const FormatConverter::Kernels *ref = FormatConverter::kernels(FormatConverter::KERNELS_SCALAR);
+
+    for ( size_t w = 0; w < sizeof(gWidths) / sizeof(gWidths[0]); w++ ) {
+        const int width = gWidths[w];
+        uint8_t *src = new uint8_t[width * 2];
+        uint8_t *y = new uint8_t[width];
+        uint8_t *uv = new uint8_t[width];
+        uint8_t *refY = new uint8_t[width];
+        uint8_t *refUV = new uint8_t[width];
+
+        fill(src, width * 2, width + 1);
+        memset(y, 0, width);
+        memset(uv, 0, width);
+
+        if ( FormatConverter::FORMAT_UYVY == format ) {
+            ref->unpackUYVY(refY, refUV, src, width);
+            k->unpackUYVY(y, uv, src, width);
+        } else {
+            ref->unpackYUYV(refY, refUV, src, width);
+            k->unpackYUYV(y, uv, src, width);
+        }
+
+        if ( ( 0 != memcmp(y, refY, width) ) || ( 0 != memcmp(uv, refUV, width) ) ) {
+            fail(k->name, "row", format, width, 1);
+        }
+
+        memset(y, 0, width);
+        if ( FormatConverter::FORMAT_UYVY == format ) {
+            k->unpackUYVY(y, NULL, src, width);
+        } else {
+            k->unpackYUYV(y, NULL, src, width);
+        }
+
+        if ( 0 != memcmp(y, refY, width) ) {
+            fail(k->name, "luma row", format, width, 1);
+        }
+
+        delete [] src;
+        delete [] y;
+        delete [] uv;
+        delete [] refY;
+        delete [] refUV;
+    }
+}
+
+/**
+ * Whole frames into strided planes, the way preview buffers are filled.
+ * The padding of every row must be left alone
+ */
+static void checkFrames(const FormatConverter::Kernels *k, FormatConverter::Format format)
+{
+    const FormatConverter::Kernels *ref = FormatConverter::kernels(FormatConverter::KERNELS_SCALAR);
+
+    for ( size_t f = 0; f < sizeof(gFrames) / sizeof(gFrames[0]); f++ ) {
+        const int width = gFrames[f].width;
+        const int height = gFrames[f].height;
+        const size_t stride = width + DST_PADDING;
+        const size_t srcSize = width * height * 2;
+        const size_t dstSize = stride * height * 3 / 2;
+        uint8_t *src = new uint8_t[srcSize];
+        uint8_t *dst = new uint8_t[dstSize];
+        uint8_t *refDst = new uint8_t[dstSize];
+
+        fill(src, srcSize, width * height);
+        memset(dst, 0xa5, dstSize);
+        memset(refDst, 0xa5, dstSize);
+
+        FormatConverter::convertToNV12(format, refDst, refDst + stride * height, stride,
+                                       src, width * 2, width, height, *ref);
+        FormatConverter::convertToNV12(format, dst, dst + stride * height, stride,
+                                       src, width * 2, width, height, *k);
+
+        if ( 0 != memcmp(dst, refDst, dstSize) ) {
+            fail(k->name, "frame", format, width, height);
+        }
+
+        delete [] src;
+        delete [] dst;
+        delete [] refDst;
+    }
+}
+
+/**
+ * NV12Converter, which splits large frames in two bands, against a
+ * single scalar pass
+ */
+static void checkConverter(FormatConverter::Format format)
+{
+    const FormatConverter::Kernels *ref = FormatConverter::kernels(FormatConverter::KERNELS_SCALAR);
+    Ti::Camera::NV12Converter converter;
+
+    for ( size_t f = 0; f < sizeof(gFrames) / sizeof(gFrames[0]); f++ ) {
+        const int width = gFrames[f].width;
+        const int height = gFrames[f].height;
+        const size_t stride = width + DST_PADDING;
+        const size_t srcSize = width * height * 2;
+        const size_t dstSize = stride * height * 3 / 2;
+        uint8_t *src = new uint8_t[srcSize];
+        uint8_t *dst = new uint8_t[dstSize];
+        uint8_t *refDst = new uint8_t[dstSize];
+
+        fill(src, srcSize, width + height);
+        memset(dst, 0xa5, dstSize);
+        memset(refDst, 0xa5, dstSize);
+
+        FormatConverter::convertToNV12(format, refDst, refDst + stride * height, stride,
+                                       src, width * 2, width, height, *ref);
+        converter.convert(format, dst, dst + stride * height, stride, src, width, height);
+
+        if ( 0 != memcmp(dst, refDst, dstSize) ) {
+            fail("auto", "converter", format, width, height);
+        }
+
+        delete [] src;
+        delete [] dst;
+        delete [] refDst;
+    }
+}
+
+int main(int, char **)
+{
+    static const FormatConverter::KernelSet sets[] = {
+        FormatConverter::KERNELS_SCALAR,
+        FormatConverter::KERNELS_NEON,
+        FormatConverter::KERNELS_SSE2,
+    };
+    static const FormatConverter::Format formats[] = {
+        FormatConverter::FORMAT_YUYV,
+        FormatConverter::FORMAT_UYVY,
+    };
+
+    printf("Using %s kernels by default\n", FormatConverter::kernels().name);
+
+    for ( size_t j = 0; j < sizeof(formats) / sizeof(formats[0]); j++ ) {
+        checkScalarRows(formats[j]);
+
+        for ( size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); i++ ) {
+            const FormatConverter::Kernels *k = FormatConverter::kernels(sets[i]);
+            if ( NULL == k ) {
+                continue;
+            }
+            checkRows(k, formats[j]);
+            checkFrames(k, formats[j]);
+        }
+
+        checkConverter(formats[j]);
+    }
+
+    if ( gFailures ) {
+        printf("%d failures\n", gFailures);
+        return 1;
+    }
+
+    printf("All conversions match\n");
+    return 0;
+}
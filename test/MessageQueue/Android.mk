@@ -0,0 +1,22 @@
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    MessageQueueBenchmark.cpp
+
+LOCAL_SHARED_LIBRARIES:= \
+    libtiutils \
+    libutils \
+    libcutils \
+    liblog
+
+LOCAL_C_INCLUDES += \
+    $(HARDWARE_TI_OMAP4_BASE)/libtiutils
+
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2 $(ANDROID_API_CFLAGS)
+
+LOCAL_MODULE:= message_queue_benchmark
+LOCAL_MODULE_TAGS:= optional
+
+include $(BUILD_EXECUTABLE)
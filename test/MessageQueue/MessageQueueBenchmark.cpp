@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file MessageQueueBenchmark.cpp
+*
+* Compares Ti::Utils::MessageQueue against the pipe based queue it replaced.
+*
+* Usage: message_queue_benchmark [messages]
+*
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MessageQueue.h"
+
+using Ti::Utils::Message;
+using Ti::Utils::MessageQueue;
+
+#define DEFAULT_MESSAGES 1000000
+#define MAX_PRODUCERS 3
+
+/**
+ * The previous queue: every message is written to and read from a pipe
+ */
+class PipeQueue
+{
+public:
+    PipeQueue()
+    {
+        int fds[2];
+        if ( pipe(fds) < 0 ) {
+            printf("pipe() failed: %s\n", strerror(errno));
+            exit(1);
+        }
+        mRead = fds[0];
+        mWrite = fds[1];
+    }
+
+    ~PipeQueue()
+    {
+        close(mRead);
+        close(mWrite);
+    }
+
+    void put(Message *msg)
+    {
+        char *p = (char *) msg;
+        size_t bytes = 0;
+        while ( bytes < sizeof(*msg) ) {
+            int err = write(mWrite, p + bytes, sizeof(*msg) - bytes);
+            if ( err < 0 ) {
+                return;
+            }
+            bytes += err;
+        }
+    }
+
+    void get(Message *msg)
+    {
+        char *p = (char *) msg;
+        size_t bytes = 0;
+        while ( bytes < sizeof(*msg) ) {
+            int err = read(mRead, p + bytes, sizeof(*msg) - bytes);
+            if ( err < 0 ) {
+                return;
+            }
+            bytes += err;
+        }
+    }
+
+    static int waitForMsg(PipeQueue **queues, int n, int timeout)
+    {
+        struct pollfd pfd[MAX_PRODUCERS];
+        for ( int i = 0 ; i < n ; i++ ) {
+            pfd[i].fd = queues[i]->mRead;
+            pfd[i].events = POLLIN;
+            pfd[i].revents = 0;
+        }
+        return poll(pfd, n, timeout);
+    }
+
+    bool isEmpty()
+    {
+        struct pollfd pfd;
+        pfd.fd = mRead;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        poll(&pfd, 1, 0);
+        return !(pfd.revents & POLLIN);
+    }
+
+private:
+    int mRead;
+    int mWrite;
+};
+
+/**
+ * Thin adapters so the same scenarios run against both queues
+ */
+struct RingQueues
+{
+    MessageQueue *q[MAX_PRODUCERS];
+
+    RingQueues(int n, MessageQueue::Mode mode)
+    {
+        for ( int i = 0 ; i < MAX_PRODUCERS ; i++ ) {
+            q[i] = ( i < n ) ? new MessageQueue(MessageQueue::DEFAULT_CAPACITY, mode) : NULL;
+        }
+    }
+    ~RingQueues()
+    {
+        for ( int i = 0 ; i < MAX_PRODUCERS ; i++ ) {
+            delete q[i];
+        }
+    }
+    void put(int i, Message *msg) { q[i]->put(msg); }
+    void wait(int n)
+    {
+        MessageQueue::waitForMsg(q[0], ( n > 1 ) ? q[1] : NULL, ( n > 2 ) ? q[2] : NULL, -1);
+    }
+    bool tryGet(int i, Message *msg)
+    {
+        if ( q[i]->isEmpty() ) {
+            return false;
+        }
+        q[i]->get(msg);
+        return true;
+    }
+};
+
+struct PipeQueues
+{
+    PipeQueue *q[MAX_PRODUCERS];
+
+    PipeQueues(int n, MessageQueue::Mode)
+    {
+        for ( int i = 0 ; i < MAX_PRODUCERS ; i++ ) {
+            q[i] = ( i < n ) ? new PipeQueue() : NULL;
+        }
+    }
+    ~PipeQueues()
+    {
+        for ( int i = 0 ; i < MAX_PRODUCERS ; i++ ) {
+            delete q[i];
+        }
+    }
+    void put(int i, Message *msg) { q[i]->put(msg); }
+    void wait(int n) { PipeQueue::waitForMsg(q, n, -1); }
+    bool tryGet(int i, Message *msg)
+    {
+        if ( q[i]->isEmpty() ) {
+            return false;
+        }
+        q[i]->get(msg);
+        return true;
+    }
+};
+
+static double nowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+template <typename Queues>
+struct Producer
+{
+    Queues *queues;
+    int index;
+    int count;
+
+    static void *run(void *arg)
+    {
+        Producer *self = (Producer *) arg;
+        Message msg;
+        memset(&msg, 0, sizeof(msg));
+        for ( int i = 0 ; i < self->count ; i++ ) {
+            msg.command = i;
+            self->queues->put(self->index, &msg);
+        }
+        return NULL;
+    }
+};
+
+/**
+ * Throughput: 'producers' threads each feed their own queue while one
+ * consumer multiplexes all of them with waitForMsg, the way the
+ * notification and display threads do
+ */
+template <typename Queues>
+static double throughput(int producers, int messages, MessageQueue::Mode mode)
+{
+    Queues queues(producers, mode);
+    Producer<Queues> p[MAX_PRODUCERS];
+    pthread_t threads[MAX_PRODUCERS];
+    int perProducer = messages / producers;
+    int remaining = perProducer * producers;
+    Message msg;
+
+    double start = nowUs();
+
+    for ( int i = 0 ; i < producers ; i++ ) {
+        p[i].queues = &queues;
+        p[i].index = i;
+        p[i].count = perProducer;
+        pthread_create(&threads[i], NULL, Producer<Queues>::run, &p[i]);
+    }
+
+    while ( remaining > 0 ) {
+        queues.wait(producers);
+        for ( int i = 0 ; i < producers ; i++ ) {
+            while ( queues.tryGet(i, &msg) ) {
+                remaining--;
+            }
+        }
+    }
+
+    for ( int i = 0 ; i < producers ; i++ ) {
+        pthread_join(threads[i], NULL);
+    }
+
+    return ( nowUs() - start ) * 1000.0 / ( perProducer * producers );
+}
+
+template <typename Queues>
+struct Echo
+{
+    Queues *request;
+    Queues *reply;
+    int count;
+
+    static void *run(void *arg)
+    {
+        Echo *self = (Echo *) arg;
+        Message msg;
+        for ( int i = 0 ; i < self->count ; i++ ) {
+            while ( !self->request->tryGet(0, &msg) ) {
+                self->request->wait(1);
+            }
+            self->reply->put(0, &msg);
+        }
+        return NULL;
+    }
+};
+
+/**
+ * Latency: one message bounces between two threads, so every hop has
+ * a sleeping consumer to wake up. This is the command/acknowledge pattern
+ * of the adapter command thread
+ */
+template <typename Queues>
+static double pingPong(int messages, MessageQueue::Mode mode)
+{
+    Queues request(1, mode);
+    Queues reply(1, mode);
+    Echo<Queues> echo;
+    pthread_t thread;
+    Message msg;
+
+    memset(&msg, 0, sizeof(msg));
+    echo.request = &request;
+    echo.reply = &reply;
+    echo.count = messages;
+
+    double start = nowUs();
+
+    pthread_create(&thread, NULL, Echo<Queues>::run, &echo);
+
+    for ( int i = 0 ; i < messages ; i++ ) {
+        request.put(0, &msg);
+        while ( !reply.tryGet(0, &msg) ) {
+            reply.wait(1);
+        }
+    }
+
+    pthread_join(thread, NULL);
+
+    return ( nowUs() - start ) * 1000.0 / messages;
+}
+
+int main(int argc, char *argv[])
+{
+    int messages = DEFAULT_MESSAGES;
+
+    if ( argc > 1 ) {
+        messages = atoi(argv[1]);
+        if ( messages <= 0 ) {
+            printf("Usage: %s [messages]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%d messages of %u bytes, ns per message\n\n", messages, (unsigned int) sizeof(Message));
+    printf("%-28s %12s %12s %12s %12s\n", "scenario", "pipe", "ring mpmc", "ring mpsc", "ring spsc");
+
+    printf("%-28s %12.1f %12.1f %12.1f %12.1f\n", "1 producer throughput",
+           throughput<PipeQueues>(1, messages, MessageQueue::MULTI_PRODUCER),
+           throughput<RingQueues>(1, messages, MessageQueue::MULTI_PRODUCER),
+           throughput<RingQueues>(1, messages, MessageQueue::SINGLE_CONSUMER),
+           throughput<RingQueues>(1, messages, MessageQueue::SINGLE_PRODUCER));
+
+    printf("%-28s %12.1f %12.1f %12.1f %12.1f\n", "3 queues throughput",
+           throughput<PipeQueues>(MAX_PRODUCERS, messages, MessageQueue::MULTI_PRODUCER),
+           throughput<RingQueues>(MAX_PRODUCERS, messages, MessageQueue::MULTI_PRODUCER),
+           throughput<RingQueues>(MAX_PRODUCERS, messages, MessageQueue::SINGLE_CONSUMER),
+           throughput<RingQueues>(MAX_PRODUCERS, messages, MessageQueue::SINGLE_PRODUCER));
+
+    // round trips are much slower, don't make them take forever
+    int trips = messages / 10;
+    if ( trips == 0 ) {
+        trips = 1;
+    }
+
+    printf("%-28s %12.1f %12.1f %12.1f %12.1f\n", "ping-pong round trip",
+           pingPong<PipeQueues>(trips, MessageQueue::MULTI_PRODUCER),
+           pingPong<RingQueues>(trips, MessageQueue::MULTI_PRODUCER),
+           pingPong<RingQueues>(trips, MessageQueue::SINGLE_CONSUMER),
+           pingPong<RingQueues>(trips, MessageQueue::SINGLE_PRODUCER));
+
+    return 0;
+}